@@ -102,5 +102,29 @@ CREATE UNIQUE INDEX RPSENM_I001 ON RPSENM (PATH, PARAM, SEQ);
 CREATE UNIQUE INDEX RPSENM_I002 ON RPSENM (DOMAIN, SUBDMN, CONFIG, PARAM, SEQ);
 CREATE UNIQUE INDEX RPSENM_I003 ON RPSENM (DOMAIN, SUBDMN, CONFIG, PATH, PARAM, SEQ);
 
+--------------------------------------------------------------------------------------
+--  Configuration change notifications: processes cache configurations and
+--  listen on the cfsrepo channel; the payload is the path of the configuration
+--  that changed (an empty payload has all configurations reloaded).
+--------------------------------------------------------------------------------------
 
-
+CREATE FUNCTION RPSNTF() RETURNS TRIGGER AS $$
+BEGIN
+        IF TG_OP <> 'INSERT' THEN
+                PERFORM pg_notify('cfsrepo', OLD.PATH);
+        END IF;
+        IF TG_OP <> 'DELETE' THEN
+                PERFORM pg_notify('cfsrepo', NEW.PATH);
+        END IF;
+        RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE TRIGGER RPSCFM_NTF AFTER INSERT OR UPDATE OR DELETE ON RPSCFM
+        FOR EACH ROW EXECUTE FUNCTION RPSNTF();
+
+CREATE TRIGGER RPSCFP_NTF AFTER INSERT OR UPDATE OR DELETE ON RPSCFP
+        FOR EACH ROW EXECUTE FUNCTION RPSNTF();
+
+CREATE TRIGGER RPSENM_NTF AFTER INSERT OR UPDATE OR DELETE ON RPSENM
+        FOR EACH ROW EXECUTE FUNCTION RPSNTF();
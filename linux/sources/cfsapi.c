@@ -26,6 +26,8 @@
 
 =========================================================================== */
 
+#define _GNU_SOURCE
+
 #define MSGHDR_MSG_CONTROL
 
 #include <arpa/inet.h>
@@ -36,14 +38,26 @@
 #include <limits.h>
 #include <netdb.h>
 #include <openssl/bio.h>
+#include <openssl/core_names.h>
 #include <openssl/err.h>
+#include <openssl/evp.h>
 #include <openssl/rand.h>
 #include <openssl/ssl.h>
 #include <openssl/x509.h>
+#include <sched.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 #include <sys/poll.h>
+#include <sys/prctl.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
 #include <sys/un.h>
+#include <time.h>
 #include <unistd.h>
 #include <clarasoft/cslib.h>
 #include <clarasoft/cfsrepo.h>
@@ -90,7 +104,44 @@
 
 #define CFS_SR_OPTIONS_FMTV1          (0x00000000)
 
+// Event handler notifications and interest flags
+
+#define CFS_EVENT_NONE                (0x00000000)
+#define CFS_EVENT_OPEN                (0x00000001)
+#define CFS_EVENT_READABLE            (0x00000002)
+#define CFS_EVENT_WRITABLE            (0x00000004)
+#define CFS_EVENT_CLOSE               (0x00000008)
+
+#define CFS_MAX_DESCRIPTORS           (64)
+#define CFS_MAX_IOVEC                 (64)
+
+// maximum plaintext size of a TLS record
+#define CFS_TLS_RECORD_SIZE           (16384)
+
+#define CFS_SCOREBOARD_ENV            "CFS_SCOREBOARD"
+#define CFS_SCOREBOARD_MAGIC          "CFSSCBD"
+#define CFS_SCOREBOARD_VERSION        (1)
+
+#define CFS_SCB_STATE_FREE            (0)
+#define CFS_SCB_STATE_STARTING        (1)
+#define CFS_SCB_STATE_READY           (2)
+#define CFS_SCB_STATE_BUSY            (3)
+
+#define CFS_TLSSHARE_ENV              "CFS_TLS_SHARE"
+#define CFS_TLSSHARE_MAGIC            "CFSTLSS"
+#define CFS_TLSSHARE_VERSION          (1)
+
+// largest encoded session kept in the shared session cache
+#define CFS_TLS_SESSION_DER_MAX       (1920)
+
+// attempts at reading the ticket keys while clarad rotates them
+#define CFS_TLS_TICKET_KEY_RETRIES    (100)
+
+// outbound pool key: a configuration name or host:port
+#define CFS_POOL_KEY_MAX              (268)
+
 typedef struct tagCFS_SESSION CFS_SESSION;
+typedef struct tagCFS_POOL_KEY CFS_POOL_KEY;
 typedef struct tagCFS_SR_OPTIONS CFS_SR_OPTIONS;
 
 //////////////////////////////////////////////////////////////////////////////
@@ -127,6 +178,14 @@ typedef struct tagCFSVTBL {
        long*,
        long);
 
+  CSRESULT
+    (*CFS_SendV)
+      (CFS_SESSION*, 
+       struct iovec*,
+       int,
+       long*,
+       long);
+
 } CFSVTBL;
 
 typedef CFSVTBL* LPCFSVTBL;
@@ -142,6 +201,7 @@ typedef struct tagCFSERRINFOSTRUCT {
 typedef struct tagCFSENV {
 
   int secMode;
+  int ktls;
 
   SSL_CTX *ctx;
 
@@ -180,6 +240,34 @@ typedef struct tagCFS_SESSION {
   int readTimeout;
   int writeTimeout;
 
+  /////////////////////////////////////////////////////////////////////
+  // Readiness cache for non-secure reads: while set, we expect data
+  // to be waiting on the descriptor and read without polling first.
+  // It is cleared when a read comes short or would block.
+  /////////////////////////////////////////////////////////////////////
+
+  int readReady;
+
+  /////////////////////////////////////////////////////////////////////
+  // Set when the kernel encrypts the records we send (kTLS); writes
+  // then go through the non-secure functions.
+  /////////////////////////////////////////////////////////////////////
+
+  int ktls;
+
+  // functions called by the scoreboard vtable
+  LPCFSVTBL lpBaseVtbl;
+
+  /////////////////////////////////////////////////////////////////////
+  // Outbound pool: the key of a session acquired from a pool and,
+  // while the session is idle, the next idle session of that key.
+  /////////////////////////////////////////////////////////////////////
+
+  CFS_POOL_KEY* pPoolKey;
+  CFS_SESSION* pNextIdle;
+  time_t created;
+  time_t released;
+
   int32_t size;
 
   const SSL_METHOD *method;
@@ -190,6 +278,117 @@ typedef struct tagCFS_SESSION {
 
 } CFS_SESSION;
 
+typedef struct tagCFS_SCOREBOARD_SLOT {
+
+  int32_t pid;
+  int32_t state;
+  int32_t connections;
+  int32_t reserved;
+  int64_t lastActivity;
+  uint64_t requests;
+  uint64_t bytesIn;
+  uint64_t bytesOut;
+  unsigned char peer[16];
+
+} __attribute__((aligned(64))) CFS_SCOREBOARD_SLOT;
+
+typedef struct tagCFS_SCOREBOARD {
+
+  char magic[8];
+  int32_t version;
+  int32_t numSlots;
+  int32_t daemonPid;
+  int32_t reserved;
+  int64_t started;
+
+  CFS_SCOREBOARD_SLOT slots[];
+
+} __attribute__((aligned(64))) CFS_SCOREBOARD;
+
+//////////////////////////////////////////////////////////////////////////////
+// TLS state shared by the handlers of a daemon: session ticket keys
+// and a session cache. Both are updated under sequence locks (odd while
+// a slot is being written) since any process may die while holding one.
+//////////////////////////////////////////////////////////////////////////////
+
+typedef struct tagCFS_TLS_TICKET_KEY {
+
+  unsigned char name[16];
+  unsigned char hmac[32];
+  unsigned char aes[32];
+
+} CFS_TLS_TICKET_KEY;
+
+typedef struct tagCFS_TLS_CACHE_SLOT {
+
+  uint32_t seq;
+  uint32_t idLen;
+  uint32_t derLen;
+  uint32_t reserved;
+  int64_t expires;
+  unsigned char id[SSL_MAX_SSL_SESSION_ID_LENGTH];
+  unsigned char der[CFS_TLS_SESSION_DER_MAX];
+
+} __attribute__((aligned(64))) CFS_TLS_CACHE_SLOT;
+
+typedef struct tagCFS_TLSSHARE {
+
+  char magic[8];
+  int32_t version;
+  int32_t numSlots;
+  int32_t rotation;
+  int32_t timeout;
+  int64_t rotated;
+
+  uint32_t keySeq;
+  int32_t current;
+  int32_t tickets;
+  int32_t reserved;
+
+  CFS_TLS_TICKET_KEY keys[2];
+
+  CFS_TLS_CACHE_SLOT slots[];
+
+} __attribute__((aligned(64))) CFS_TLSSHARE;
+
+//////////////////////////////////////////////////////////////////////////////
+// Outbound session pool. Each key holds its idle sessions, the most
+// recently released first, the server its last connection was opened
+// to and the last TLS session we got from that server, which new 
+// connections of the key try to resume.
+//////////////////////////////////////////////////////////////////////////////
+
+typedef struct tagCFS_POOL CFS_POOL;
+
+typedef struct tagCFS_POOL_KEY {
+
+  CFS_POOL* pPool;
+
+  char szKey[CFS_POOL_KEY_MAX];
+  char szHost[256];
+  char szPort[11];
+
+  int numIdle;
+  CFS_SESSION* pIdle;
+
+  SSL_SESSION* pResume;
+
+  struct tagCFS_POOL_KEY* next;
+
+} CFS_POOL_KEY;
+
+typedef struct tagCFS_POOL {
+
+  CFSENV* pEnv;
+
+  int maxIdle;        // idle sessions kept per key
+  int idleTimeout;    // seconds; 0 means no limit
+  int maxLifetime;    // seconds; 0 means no limit
+
+  CFS_POOL_KEY* pKeys;
+
+} CFS_POOL;
+
 typedef struct tagCFS_SR_OPTIONS {
 
   long format;
@@ -217,6 +416,22 @@ typedef int
 
 static char g_CFS_TLS_UserData[256];
 
+//////////////////////////////////////////////////////////////////////////////
+// Handler scoreboard. The slot of this process is looked up by PID when
+// the first channel is opened (the slot is looked up again in a forked
+// process). g_CFS_ScoreboardState is 0 until we tried mapping the 
+// scoreboard, 1 if it is mapped, -1 if there is none.
+//////////////////////////////////////////////////////////////////////////////
+
+static CFS_SCOREBOARD* g_CFS_Scoreboard;
+static CFS_SCOREBOARD_SLOT* g_CFS_ScoreboardSlot;
+static pid_t g_CFS_ScoreboardPid;
+static int g_CFS_ScoreboardState;
+
+// TLS state shared with the other handlers, if the daemon created it
+
+static CFS_TLSSHARE* g_CFS_TlsShare;
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // CFS_PRV_SetBlocking
@@ -266,6 +481,7 @@ CSRESULT
    int rc;
    int readSize;
    int to;
+   int flags;
 
    struct pollfd fdset[1];
 
@@ -279,6 +495,17 @@ CSRESULT
    fdset[0].fd = This->connfd;
    fdset[0].events = POLLIN;
 
+   if (This->readReady) {
+
+     ////////////////////////////////////////////////////////////
+     // Data is likely waiting: try reading without blocking;
+     // we only poll if nothing can be read yet.
+     ////////////////////////////////////////////////////////////
+
+     flags = MSG_DONTWAIT;
+     goto CFS_WAIT_READ;
+   }
+
    ////////////////////////////////////////////////////////////
    // This branching label for restarting an interrupted
    // poll call. An interrupted system call may result from
@@ -347,6 +574,8 @@ CSRESULT
      }
    }
 
+   flags = 0;
+
    /////////////////////////////////////////////////////////
    // This branching label for restarting an interrupted
    // recv() call. An interrupted system call may result
@@ -358,7 +587,7 @@ CSRESULT
    //
    /////////////////////////////////////////////////////////
 
-   rc = recv(This->connfd, buffer, readSize, 0);
+   rc = recv(This->connfd, buffer, readSize, flags);
 
    if (rc < 0) {
 
@@ -373,6 +602,14 @@ CSRESULT
 
        goto CFS_WAIT_READ;
      }
+     else if (flags == MSG_DONTWAIT && 
+              (errno == EAGAIN || errno == EWOULDBLOCK)) {
+
+       // nothing to read yet; wait for the descriptor
+
+       This->readReady = 0;
+       goto CFS_WAIT_POLL;
+     }
      else {
 
        This->errInfo.csresult = 
@@ -402,6 +639,12 @@ CSRESULT
      }
    }
 
+   ////////////////////////////////////////////////////////////
+   // If we filled the buffer, more data is probably waiting.
+   ////////////////////////////////////////////////////////////
+
+   This->readReady = (rc == readSize);
+
    *maxSize = rc;
    return CS_SUCCESS;
 }
@@ -424,6 +667,7 @@ CSRESULT
    int rc;
    int readSize;
    int to;
+   int flags;
 
    struct pollfd fdset[1];
 
@@ -449,6 +693,17 @@ CSRESULT
 
    do {
 
+     if (This->readReady) {
+
+       //////////////////////////////////////////////////////////
+       // Data is likely waiting: try reading without blocking;
+       // we only poll if nothing can be read yet.
+       //////////////////////////////////////////////////////////
+
+       flags = MSG_DONTWAIT;
+       goto CFS_WAIT_READ;
+     }
+
      ////////////////////////////////////////////////////////////
      // This branching label for restarting an interrupted
      // poll call. An interrupted system call may result from
@@ -518,6 +773,8 @@ CSRESULT
        }
      }
 
+     flags = 0;
+
      /////////////////////////////////////////////////////////
      // This branching label for restarting an interrupted
      // recv() call. An interrupted system call may result
@@ -529,7 +786,7 @@ CSRESULT
      //
      /////////////////////////////////////////////////////////
 
-     rc = recv(This->connfd, buffer + offset, readSize, 0);
+     rc = recv(This->connfd, buffer + offset, readSize, flags);
 
      if (rc < 0) {
 
@@ -544,6 +801,14 @@ CSRESULT
 
          goto CFS_WAIT_READ;
        }
+       else if (flags == MSG_DONTWAIT && 
+                (errno == EAGAIN || errno == EWOULDBLOCK)) {
+
+         // nothing to read yet; wait for the descriptor
+
+         This->readReady = 0;
+         goto CFS_WAIT_POLL;
+       }
        else {
 
          This->errInfo.csresult = 
@@ -577,6 +842,13 @@ CSRESULT
          // as we don't block before receiving data.
          /////////////////////////////////////////////////////////////////
 
+         ///////////////////////////////////////////////////////////////
+         // A short read means the descriptor has been drained; 
+         // otherwise, the rest of the record is probably waiting.
+         ///////////////////////////////////////////////////////////////
+
+         This->readReady = (rc == readSize);
+
          offset += rc;
          *size += rc;
          leftToRead -= rc;
@@ -1610,6 +1882,11 @@ CSRESULT
 
          goto CFS_WAIT_WRITE;
       }
+      else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+
+         // the socket of a kTLS session is non-blocking
+         goto CFS_WAIT_POLL;
+      }
       else {
 
          return   CS_FAILURE
@@ -1764,6 +2041,11 @@ CSRESULT
 
             goto CFS_WAIT_SEND;
          }
+         else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+
+            // the socket of a kTLS session is non-blocking
+            goto CFS_WAIT_POLL;
+         }
          else {
 
            return   CS_FAILURE
@@ -1807,1471 +2089,4045 @@ CSRESULT
 
 //////////////////////////////////////////////////////////////////////////////
 //
-// Declare and initialize VTABLES
+// CFS_WriteV
 //
-// Assign function pointers to vTable members. Functions must already
-// be defined before assignment; this is why those global variables
-// are declared here.
+// This function writes a list of buffers to a non secure socket with as
+// few system calls as possible; every buffer is written entirely. On
+// return, size holds the number of bytes written.
 //
 //////////////////////////////////////////////////////////////////////////////
 
-CFSVTBL dftVtbl = {
-  CFS_Read,
-  CFS_ReadRecord,
-  CFS_Write,
-  CFS_WriteRecord,
-};
+CSRESULT
+  CFS_WriteV
+    (CFS_SESSION* This,
+     struct iovec* iov,
+     int iovcnt,
+     long* size,
+     long toSlices) {
 
-CFSVTBL secureVtbl = {
-  CFS_SecureRead,
-  CFS_SecureReadRecord,
-  CFS_SecureWrite,
-  CFS_SecureWriteRecord,
-};
+   int i;
+   int rc;
+   int to;
+   int first;
 
-//////////////////////////////////////////////////////////////////////////////
-//
-// CFS_Constructor
-//
-// This function creates a network session object
-//
-//////////////////////////////////////////////////////////////////////////////
+   struct pollfd fdset[1];
+   struct iovec vec[CFS_MAX_IOVEC];
 
-CFS_SESSION*
-  CFS_Constructor
-    (void) {
+   *size = 0;
 
-  CFS_SESSION* Instance;
+   if (iovcnt < 0 || iovcnt > CFS_MAX_IOVEC) {
+     return CS_FAILURE | CFS_OPER_WRITE | CFS_DIAG_INVALIDSIZE;
+   }
 
-  Instance = (CFS_SESSION*)malloc(sizeof(CFS_SESSION));
+   to = toSlices * This->readTimeout;
 
-  Instance->pEnv = 0;
+   // we work on a copy as the list is updated after partial writes
 
-  return Instance;
-}
+   memcpy(vec, iov, iovcnt * sizeof(struct iovec));
 
-//////////////////////////////////////////////////////////////////////////////
-//
-// CFS_Destructor
-//
-// This function releases the resources allocated by a network session object
-//
-//////////////////////////////////////////////////////////////////////////////
+   first = 0;
 
-CSRESULT
-  CFS_Destructor
-    (CFS_SESSION** This) {
+   while (first < iovcnt) {
 
-  if (This != NULL && *This != NULL) {
-    free(*This);
-    *This = NULL;
-    return CS_SUCCESS;
-  }
+      if (vec[first].iov_len == 0) {
+        first++;
+        continue;
+      }
 
-  return CS_FAILURE;
-}
+      ////////////////////////////////////////////////////////////
+      // This branching label for restarting an interrupted
+      // poll call. An interrupted system call may result from
+      // a caught signal and will have errno set to EINTR. We
+      // must call poll again.
 
-//////////////////////////////////////////////////////////////////////////////
-//
-// CFS_CloseChannel
-//
-// This function closes a server session.
-//
-//////////////////////////////////////////////////////////////////////////////
+      CFS_WAIT_POLL:
 
-CSRESULT
-  CFS_CloseChannel
-    (CFS_SESSION** This) {
+      //
+      ////////////////////////////////////////////////////////////
 
-   if (This != NULL && *This != NULL) {
+      fdset[0].fd = This->connfd;
+      fdset[0].events = POLLOUT;
 
-     if ((*This)->secMode == 1) {
+      rc = poll(fdset, 1, to >= 0 ? to * 1000: -1);
+ 
+      if (rc == 1) {
 
-       SSL_shutdown((*This)->ssl);
-       SSL_free((*This)->ssl);
-     }
+         /////////////////////////////////////////////////////////
+         // If we get anything other than POLLOUT
+         // this means we got an error.
+         /////////////////////////////////////////////////////////
 
-     close((*This)->connfd);
+         if (!(fdset[0].revents & POLLOUT)) {
 
-     CFS_Destructor(This);
-     return CS_SUCCESS;
-   }
+            return   CS_FAILURE
+                     | CFS_OPER_WAIT
+                     | CFS_DIAG_SYSTEM;
+         }
+      }
+      else {
 
-   return CS_FAILURE;
-}
+         if (rc == 0) {
 
-//////////////////////////////////////////////////////////////////////////////
-//
-// CFS_CloseChannelDescriptor
-//
-// This function closes a server session.
-//
-//////////////////////////////////////////////////////////////////////////////
+            return   CS_FAILURE
+                     | CFS_OPER_WAIT
+                     | CFS_DIAG_TIMEDOUT;
+         }
+         else {
 
-CSRESULT
-  CFS_CloseChannelDescriptor
-    (CFS_SESSION* This) {
+            if (errno == EINTR) {
 
-   if (This->secMode == 1) {
-     SSL_shutdown(This->ssl);
-     SSL_free(This->ssl);
-   }
+               ///////////////////////////////////////////////////
+               // poll() was interrupted by a signal
+               // or the kernel could not allocate an
+               // internal data structure. We will call
+               // poll() again.
+               ///////////////////////////////////////////////////
 
-   close(This->connfd);
+               goto CFS_WAIT_POLL;
+            }
+            else {
 
-   return CS_SUCCESS;
-}
+               return   CS_FAILURE
+                        | CFS_OPER_WAIT
+                        | CFS_DIAG_SYSTEM;
+            }
+         }
+      }
 
-//////////////////////////////////////////////////////////////////////////////
-//
-// CFS_CloseEnv
-//
-// This function releases a global environment
-//
-//////////////////////////////////////////////////////////////////////////////
+      /////////////////////////////////////////////////////////
+      // This branching label for restarting an interrupted
+      // writev() call. An interrupted system call may result
+      // from a signal and will have errno set to EINTR.
+      // We must call writev() again.
 
-CSRESULT
-  CFS_CloseEnv
-    (CFSENV** pEnv) {
+      CFS_WAIT_SEND:
+
+      //
+      /////////////////////////////////////////////////////////
+
+      rc = writev(This->connfd, vec + first, iovcnt - first);
+
+      if (rc < 0) {
+
+         if (errno == EINTR) {
+            goto CFS_WAIT_SEND;
+         }
+         else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+
+            // the socket of a kTLS session is non-blocking
+            goto CFS_WAIT_POLL;
+         }
+         else {
+
+           return   CS_FAILURE
+                  | CFS_OPER_WAIT
+                  | CFS_DIAG_SYSTEM;
+         }
+      }
+      else {
+
+         if (rc == 0) {
+
+            /////////////////////////////////////////////////////////////////
+            // This indicates a connection close; we are done.
+            /////////////////////////////////////////////////////////////////
+
+            return CS_FAILURE | CFS_OPER_WRITE | CFS_DIAG_CONNCLOSE;
+         }
+
+         *size += rc;
+
+         /////////////////////////////////////////////////////////////////
+         // Skip the buffers that were written; the first buffer not 
+         // entirely written is adjusted to its remaining part.
+         /////////////////////////////////////////////////////////////////
+
+         for (i = first; i < iovcnt && rc > 0; i++) {
+
+            if ((size_t)rc >= vec[i].iov_len) {
+              rc -= vec[i].iov_len;
+              vec[i].iov_len = 0;
+              first = i + 1;
+            }
+            else {
+              vec[i].iov_base = (char*)vec[i].iov_base + rc;
+              vec[i].iov_len -= rc;
+              rc = 0;
+            }
+         }
+      }
+   }
+
+   return CS_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_SecureWriteV
+//
+// This function writes a list of buffers on a secure socket. Small 
+// buffers are gathered so that they go out in as few TLS records as 
+// possible; buffers of at least one record are written directly. On 
+// return, size holds the number of bytes written.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  CFS_SecureWriteV
+    (CFS_SESSION* This,
+     struct iovec* iov,
+     int iovcnt,
+     long* size,
+     long toSlices) {
+
+  int i;
+
+  char record[CFS_TLS_RECORD_SIZE];
+
+  long count;
+  long length;
+  long offset;
+
+  size_t chunk;
+
+  CSRESULT hResult;
+
+  *size = 0;
+
+  if (iovcnt < 0 || iovcnt > CFS_MAX_IOVEC) {
+    return CS_FAILURE | CFS_OPER_WRITE | CFS_DIAG_INVALIDSIZE;
+  }
+
+  count = 0;
+
+  for (i = 0; i < iovcnt; i++) {
+
+    if (count == 0 && iov[i].iov_len >= CFS_TLS_RECORD_SIZE) {
+
+      length = (long)iov[i].iov_len;
+
+      hResult = CFS_SecureWriteRecord(This, iov[i].iov_base, &length, 
+                                      toSlices);
+      *size += length;
+
+      if (CS_FAIL(hResult)) {
+        return hResult;
+      }
+
+      continue;
+    }
+
+    offset = 0;
+
+    while (offset < (long)iov[i].iov_len) {
+
+      chunk = iov[i].iov_len - offset;
+
+      if (chunk > CFS_TLS_RECORD_SIZE - count) {
+        chunk = CFS_TLS_RECORD_SIZE - count;
+      }
+
+      memcpy(record + count, (char*)iov[i].iov_base + offset, chunk);
+
+      count += chunk;
+      offset += chunk;
+
+      if (count == CFS_TLS_RECORD_SIZE) {
+
+        length = count;
+        hResult = CFS_SecureWriteRecord(This, record, &length, toSlices);
+        *size += length;
+
+        if (CS_FAIL(hResult)) {
+          return hResult;
+        }
+
+        count = 0;
+      }
+    }
+  }
+
+  if (count > 0) {
+
+    length = count;
+    hResult = CFS_SecureWriteRecord(This, record, &length, toSlices);
+    *size += length;
+
+    if (CS_FAIL(hResult)) {
+      return hResult;
+    }
+  }
+
+  return CS_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Declare and initialize VTABLES
+//
+// Assign function pointers to vTable members. Functions must already
+// be defined before assignment; this is why those global variables
+// are declared here.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CFSVTBL dftVtbl = {
+  CFS_Read,
+  CFS_ReadRecord,
+  CFS_Write,
+  CFS_WriteRecord,
+  CFS_WriteV,
+};
+
+CFSVTBL secureVtbl = {
+  CFS_SecureRead,
+  CFS_SecureReadRecord,
+  CFS_SecureWrite,
+  CFS_SecureWriteRecord,
+  CFS_SecureWriteV,
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// Secure sessions whose records are encrypted by the kernel (kTLS) send
+// on the socket directly; received records may be TLS control messages
+// that only OpenSSL handles, so we still read through OpenSSL (which 
+// uses kernel decryption when it is available).
+//////////////////////////////////////////////////////////////////////////////
+
+CFSVTBL ktlsVtbl = {
+  CFS_SecureRead,
+  CFS_SecureReadRecord,
+  CFS_Write,
+  CFS_WriteRecord,
+  CFS_WriteV,
+};
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Scoreboard VTABLES
+//
+// Channels opened by a process that has a scoreboard slot use these 
+// functions; they call the functions of the session vtable they replace
+// and add the number of bytes transferred to the slot counters.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  CFS_PRV_ScbRead
+    (CFS_SESSION* This,
+     char* buffer,
+     long* maxSize,
+     long toSlices) {
+
+  CSRESULT hResult;
+
+  hResult = This->lpBaseVtbl->CFS_Receive(This, buffer, maxSize, toSlices);
+
+  if (g_CFS_ScoreboardSlot != NULL && *maxSize > 0) {
+    __atomic_add_fetch(&(g_CFS_ScoreboardSlot->bytesIn), 
+                       (uint64_t)*maxSize, __ATOMIC_RELAXED);
+  }
+
+  return hResult;
+}
+
+CSRESULT
+  CFS_PRV_ScbReadRecord
+    (CFS_SESSION* This,
+     char* buffer,
+     long* size,
+     long toSlices) {
+
+  CSRESULT hResult;
+
+  hResult = This->lpBaseVtbl->CFS_ReceiveRecord(This, buffer, size, 
+                                                toSlices);
+
+  if (g_CFS_ScoreboardSlot != NULL && *size > 0) {
+    __atomic_add_fetch(&(g_CFS_ScoreboardSlot->bytesIn), 
+                       (uint64_t)*size, __ATOMIC_RELAXED);
+  }
+
+  return hResult;
+}
+
+CSRESULT
+  CFS_PRV_ScbWrite
+    (CFS_SESSION* This,
+     char* buffer,
+     long* maxSize,
+     long toSlices) {
+
+  CSRESULT hResult;
+
+  hResult = This->lpBaseVtbl->CFS_Send(This, buffer, maxSize, toSlices);
+
+  if (g_CFS_ScoreboardSlot != NULL && *maxSize > 0) {
+    __atomic_add_fetch(&(g_CFS_ScoreboardSlot->bytesOut), 
+                       (uint64_t)*maxSize, __ATOMIC_RELAXED);
+  }
+
+  return hResult;
+}
+
+CSRESULT
+  CFS_PRV_ScbWriteRecord
+    (CFS_SESSION* This,
+     char* buffer,
+     long* size,
+     long toSlices) {
+
+  CSRESULT hResult;
+
+  hResult = This->lpBaseVtbl->CFS_SendRecord(This, buffer, size, 
+                                             toSlices);
+
+  if (g_CFS_ScoreboardSlot != NULL && *size > 0) {
+    __atomic_add_fetch(&(g_CFS_ScoreboardSlot->bytesOut), 
+                       (uint64_t)*size, __ATOMIC_RELAXED);
+  }
+
+  return hResult;
+}
+
+CSRESULT
+  CFS_PRV_ScbWriteV
+    (CFS_SESSION* This,
+     struct iovec* iov,
+     int iovcnt,
+     long* size,
+     long toSlices) {
+
+  CSRESULT hResult;
+
+  hResult = This->lpBaseVtbl->CFS_SendV(This, iov, iovcnt, size, 
+                                        toSlices);
+
+  if (g_CFS_ScoreboardSlot != NULL && *size > 0) {
+    __atomic_add_fetch(&(g_CFS_ScoreboardSlot->bytesOut), 
+                       (uint64_t)*size, __ATOMIC_RELAXED);
+  }
+
+  return hResult;
+}
+
+CFSVTBL scbVtbl = {
+  CFS_PRV_ScbRead,
+  CFS_PRV_ScbReadRecord,
+  CFS_PRV_ScbWrite,
+  CFS_PRV_ScbWriteRecord,
+  CFS_PRV_ScbWriteV,
+};
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_PRV_ScoreboardOpen
+//
+// Records a new channel in the scoreboard slot of this process, if any.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+void
+  CFS_PRV_ScoreboardOpen
+    (CFS_SESSION* This) {
+
+  int i;
+  int fd;
+
+  pid_t pid;
+
+  char* pszPath;
+
+  socklen_t len;
+
+  struct stat fileInfo;
+  struct sockaddr_storage peer;
+
+  CFS_SCOREBOARD_SLOT* pSlot;
+
+  pid = getpid();
+
+  if (pid != g_CFS_ScoreboardPid) {
+
+    // first channel in this process: find our slot
+
+    g_CFS_ScoreboardSlot = NULL;
+    g_CFS_ScoreboardPid = pid;
+
+    if (g_CFS_ScoreboardState == 0) {
+
+      g_CFS_ScoreboardState = -1;
+
+      if ((pszPath = getenv(CFS_SCOREBOARD_ENV)) != NULL &&
+          (fd = open(pszPath, O_RDWR | O_CLOEXEC)) >= 0) {
+
+        if (fstat(fd, &fileInfo) == 0 && 
+            fileInfo.st_size >= sizeof(CFS_SCOREBOARD)) {
+
+          g_CFS_Scoreboard = (CFS_SCOREBOARD*)
+                mmap(NULL, fileInfo.st_size, 
+                     PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+          if (g_CFS_Scoreboard != MAP_FAILED) {
+
+            if (fileInfo.st_size >= sizeof(CFS_SCOREBOARD) + 
+                  g_CFS_Scoreboard->numSlots * sizeof(CFS_SCOREBOARD_SLOT)) {
+              g_CFS_ScoreboardState = 1;
+            }
+            else {
+              munmap(g_CFS_Scoreboard, fileInfo.st_size);
+            }
+          }
+        }
+
+        close(fd);
+      }
+    }
+  }
+
+  if (g_CFS_ScoreboardState != 1) {
+    return;
+  }
+
+  if (g_CFS_ScoreboardSlot == NULL) {
+
+    //////////////////////////////////////////////////////////////////
+    // The daemon records our PID when we are spawned; if it is not
+    // there yet, we look again on the next channel.
+    //////////////////////////////////////////////////////////////////
+
+    for (i = 0; i < g_CFS_Scoreboard->numSlots; i++) {
+
+      if (__atomic_load_n(&(g_CFS_Scoreboard->slots[i].pid), 
+                          __ATOMIC_RELAXED) == pid) {
+        g_CFS_ScoreboardSlot = &(g_CFS_Scoreboard->slots[i]);
+        break;
+      }
+    }
+
+    if (g_CFS_ScoreboardSlot == NULL) {
+      return;
+    }
+  }
+
+  pSlot = g_CFS_ScoreboardSlot;
+
+  This->lpBaseVtbl = This->lpVtbl;
+  This->lpVtbl = &scbVtbl;
+
+  len = sizeof(peer);
+
+  if (getpeername(This->connfd, (struct sockaddr*)&peer, &len) == 0) {
+
+    if (peer.ss_family == AF_INET6) {
+      memcpy(pSlot->peer, 
+             &(((struct sockaddr_in6*)&peer)->sin6_addr), 16);
+    }
+    else {
+
+      if (peer.ss_family == AF_INET) {
+        memset(pSlot->peer, 0, 10);
+        pSlot->peer[10] = 0xFF;
+        pSlot->peer[11] = 0xFF;
+        memcpy(pSlot->peer + 12, 
+               &(((struct sockaddr_in*)&peer)->sin_addr), 4);
+      }
+    }
+  }
+
+  __atomic_add_fetch(&(pSlot->requests), 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&(pSlot->connections), 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&(pSlot->state), CFS_SCB_STATE_BUSY, __ATOMIC_RELAXED);
+  __atomic_store_n(&(pSlot->lastActivity), 
+                   (int64_t)time(NULL), __ATOMIC_RELAXED);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_PRV_ScoreboardClose
+//
+// Records the end of a channel opened with CFS_PRV_ScoreboardOpen.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+void
+  CFS_PRV_ScoreboardClose
+    (CFS_SESSION* This) {
+
+  CFS_SCOREBOARD_SLOT* pSlot;
+
+  if (This->lpVtbl != &scbVtbl) {
+    return;
+  }
+
+  This->lpVtbl = This->lpBaseVtbl;
+
+  if ((pSlot = g_CFS_ScoreboardSlot) == NULL) {
+    return;
+  }
+
+  if (__atomic_sub_fetch(&(pSlot->connections), 1, __ATOMIC_RELAXED) <= 0) {
+    __atomic_store_n(&(pSlot->state), CFS_SCB_STATE_READY, __ATOMIC_RELAXED);
+  }
+
+  __atomic_store_n(&(pSlot->lastActivity), 
+                   (int64_t)time(NULL), __ATOMIC_RELAXED);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_PRV_SecureOffload
+//
+// Called once the handshake of a secure session is complete: if the
+// environment enables kTLS (TLS_KTLS) and OpenSSL could hand the send 
+// keys to the kernel, writes use the non-secure functions.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+void
+  CFS_PRV_SecureOffload
+    (CFS_SESSION* This) {
+
+  if (This->pEnv == NULL || !This->pEnv->ktls) {
+    return;
+  }
+
+  if (BIO_get_ktls_send(SSL_get_wbio(This->ssl))) {
+    This->ktls = 1;
+    This->lpVtbl = &ktlsVtbl;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_Constructor
+//
+// This function creates a network session object
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CFS_SESSION*
+  CFS_Constructor
+    (void) {
+
+  CFS_SESSION* Instance;
+
+  Instance = (CFS_SESSION*)malloc(sizeof(CFS_SESSION));
+
+  if (Instance == NULL) {
+    return NULL;
+  }
+
+  Instance->pEnv = 0;
+  Instance->readReady = 0;
+  Instance->ktls = 0;
+  Instance->lpBaseVtbl = NULL;
+  Instance->pPoolKey = NULL;
+  Instance->pNextIdle = NULL;
+
+  return Instance;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_Destructor
+//
+// This function releases the resources allocated by a network session object
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  CFS_Destructor
+    (CFS_SESSION** This) {
+
+  if (This != NULL && *This != NULL) {
+    free(*This);
+    *This = NULL;
+    return CS_SUCCESS;
+  }
+
+  return CS_FAILURE;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_CloseChannel
+//
+// This function closes a server session.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  CFS_CloseChannel
+    (CFS_SESSION** This) {
+
+   if (This != NULL && *This != NULL) {
+
+     CFS_PRV_ScoreboardClose(*This);
+
+     if ((*This)->secMode == 1) {
+
+       SSL_shutdown((*This)->ssl);
+       SSL_free((*This)->ssl);
+     }
+
+     close((*This)->connfd);
+
+     CFS_Destructor(This);
+     return CS_SUCCESS;
+   }
+
+   return CS_FAILURE;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_CloseChannelDescriptor
+//
+// This function closes a server session.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  CFS_CloseChannelDescriptor
+    (CFS_SESSION* This) {
+
+   CFS_PRV_ScoreboardClose(This);
+
+   if (This->secMode == 1) {
+     SSL_shutdown(This->ssl);
+     SSL_free(This->ssl);
+   }
+
+   close(This->connfd);
+
+   return CS_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_CloseEnv
+//
+// This function releases a global environment
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  CFS_CloseEnv
+    (CFSENV** pEnv) {
 
   if (pEnv != NULL && *pEnv != NULL) {
 
-    if ((*pEnv)->secMode == 1) {
-      SSL_CTX_free((*pEnv)->ctx);
+    if ((*pEnv)->secMode == 1) {
+      SSL_CTX_free((*pEnv)->ctx);
+    }
+
+    free(*pEnv);
+    *pEnv = 0;
+    return CS_SUCCESS;
+  }
+
+  return CS_FAILURE;
+}
+
+int 
+  CFS_SSL_VerifyCallback
+    (int status, 
+     X509_STORE_CTX *store) {
+
+  char    szBuffer[256];
+  X509*   cert;
+  int     error; 
+  int     depth;
+
+  if (status == 0) {
+
+    cert = X509_STORE_CTX_get_current_cert(store);
+    depth = X509_STORE_CTX_get_error_depth(store);
+    error = X509_STORE_CTX_get_error(store);
+
+/*
+    printf("CFS - ERROR - TLS Certificate validation"
+           "" error: depth: %d error: %d - %s",
+          depth,
+          error,
+          X509_verify_cert_error_string(error));
+*/
+    X509_NAME_oneline(X509_get_issuer_name(cert), szBuffer, 255);
+/*    
+    printf("\n\tIssuer: %s",
+           szBuffer);
+*/           
+    X509_NAME_oneline(X509_get_subject_name(cert), szBuffer, 255);
+/*    
+    printf("\n\tSubject: %s",
+           szBuffer);
+*/           
+  }
+
+  return status;
+}
+
+CSRESULT
+  CFS_PRV_SecureLoadTrustStore
+    (CFSENV* pEnv) {
+
+  char szFile[129];
+  char szDir[129];
+
+  char* pszParam;
+
+  int useConf;
+
+  useConf = 0;
+  if ((pszParam = CFSCFG_LookupParam(pEnv->Config_Secure,
+                            "TLS_VALIDATE_PEER_DEPTH")) != NULL) {
+    useConf = 1;
+    SSL_CTX_set_verify_depth(pEnv->ctx, (int)strtol(pszParam, 0, 10));
+  }
+  
+  if ((pszParam = CFSCFG_LookupParam(pEnv->Config_Secure,
+                              "TLS_CERT_STORE_FILE")) != NULL) {
+    useConf = 1;
+    strcpy(szFile, pszParam); 
+  }
+  else {
+    szFile[0] = 0;
+  }
+
+  if ((pszParam = CFSCFG_LookupParam(pEnv->Config_Secure,
+                              "TLS_CERT_STORE_DIR")) != NULL) {
+    strcpy(szDir, pszParam); 
+  }
+  else {
+    szDir[0] = 0;
+  }
+
+  if (useConf) {
+    SSL_CTX_load_verify_locations(pEnv->ctx,
+                                  szFile[0] == 0 ? NULL: szFile,
+                                  szDir[0] == 0 ? NULL: szDir);
+  }
+  else {
+    SSL_CTX_set_default_verify_paths(pEnv->ctx);
+  }
+
+  return CS_SUCCESS;
+}
+
+static int
+  CFS_PRV_CALLBACK_Password
+    (char *buf,
+     int size,
+     int rwflag,
+     void *userdata) {
+
+  char *password;
+  int password_length;
+  
+  password = getenv("CFS_SSL_CERTKEYPWD");
+  password_length = strlen(password);
+
+  if ((password_length + 1) > size) {
+    // password too large
+    return 0;
+  }
+  
+  strcpy(buf,password);
+  return password_length;
+
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_CloseSession
+//
+// This function closes a client session.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  CFS_CloseSession
+    (CFS_SESSION** This) {
+
+  if (This != NULL && *This != NULL) {
+
+    if ((*This)->secMode == 1) {
+      SSL_shutdown((*This)->ssl);
+      SSL_free((*This)->ssl);
+    }
+
+    close((*This)->connfd);
+
+    CFS_Destructor(This);
+    return CS_SUCCESS;
+  }
+
+  return CS_FAILURE;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_PRV_TlsShareLock
+//
+// Takes the sequence lock of a shared TLS slot; fails if a writer 
+// already holds it (we never wait on another process).
+//
+//////////////////////////////////////////////////////////////////////////////
+
+int
+  CFS_PRV_TlsShareLock
+    (uint32_t* seq) {
+
+  uint32_t value;
+
+  value = __atomic_load_n(seq, __ATOMIC_RELAXED);
+
+  if (value & 1) {
+    return 0;
+  }
+
+  return __atomic_compare_exchange_n(seq, &value, value + 1, 0,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+void
+  CFS_PRV_TlsShareUnlock
+    (uint32_t* seq) {
+
+  __atomic_add_fetch(seq, 1, __ATOMIC_RELEASE);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_PRV_TicketKeyCallback
+//
+// Encrypts and decrypts session tickets with the keys shared by all the
+// handlers of a daemon. Tickets encrypted with the previous key are still
+// accepted but renewed. If the keys can't be read (clarad is rotating
+// them, or died while doing so), no ticket is issued or accepted and the
+// client does a full handshake.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+int
+  CFS_PRV_TicketKeyCallback
+    (SSL* ssl,
+     unsigned char keyName[16],
+     unsigned char iv[EVP_MAX_IV_LENGTH],
+     EVP_CIPHER_CTX* cctx,
+     EVP_MAC_CTX* hctx,
+     int enc) {
+
+  int i;
+  int current;
+  int attempt;
+
+  uint32_t seq;
+
+  CFS_TLS_TICKET_KEY key;
+
+  OSSL_PARAM params[2];
+
+  params[0] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, 
+                                               "SHA256", 0);
+  params[1] = OSSL_PARAM_construct_end();
+
+  // read a consistent copy of the keys; clarad may be rotating them
+
+  for (attempt = 0; ; attempt++) {
+
+    if (attempt == CFS_TLS_TICKET_KEY_RETRIES) {
+      return 0;
+    }
+
+    if (attempt > 0) {
+      sched_yield();
+    }
+
+    if ((seq = __atomic_load_n(&(g_CFS_TlsShare->keySeq), 
+                               __ATOMIC_ACQUIRE)) & 1) {
+      continue;
+    }
+
+    current = g_CFS_TlsShare->current;
+
+    if (enc) {
+      key = g_CFS_TlsShare->keys[current];
+      i = current;
+    }
+    else {
+      for (i = 0; i < 2; i++) {
+        if (!memcmp(keyName, g_CFS_TlsShare->keys[i].name, 16)) {
+          key = g_CFS_TlsShare->keys[i];
+          break;
+        }
+      }
+    }
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    if (__atomic_load_n(&(g_CFS_TlsShare->keySeq), 
+                        __ATOMIC_RELAXED) == seq) {
+      break;
+    }
+  }
+
+  if (enc) {
+
+    if (RAND_bytes(iv, 16) <= 0) {
+      return -1;
+    }
+
+    memcpy(keyName, key.name, 16);
+
+    if (!EVP_EncryptInit_ex(cctx, EVP_aes_256_cbc(), NULL, key.aes, iv) ||
+        !EVP_MAC_init(hctx, key.hmac, sizeof(key.hmac), params)) {
+      return -1;
+    }
+
+    return 1;
+  }
+
+  if (i == 2) {
+
+    // unknown key: the client will do a full handshake
+    return 0;
+  }
+
+  if (!EVP_DecryptInit_ex(cctx, EVP_aes_256_cbc(), NULL, key.aes, iv) ||
+      !EVP_MAC_init(hctx, key.hmac, sizeof(key.hmac), params)) {
+    return -1;
+  }
+
+  return i == current ? 1 : 2;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_PRV_TlsCacheSlot
+//
+// Returns the shared cache slot of a session ID.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CFS_TLS_CACHE_SLOT*
+  CFS_PRV_TlsCacheSlot
+    (const unsigned char* id,
+     unsigned int idLen) {
+
+  unsigned int i;
+  uint32_t hash;
+
+  // FNV-1a; session IDs are random
+
+  hash = 2166136261u;
+
+  for (i = 0; i < idLen; i++) {
+    hash = (hash ^ id[i]) * 16777619u;
+  }
+
+  return &(g_CFS_TlsShare->slots[hash % g_CFS_TlsShare->numSlots]);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_PRV_TlsCacheNew
+//
+// Stores a new server session in the shared cache. A session that is
+// too large, or whose slot is being written by another handler, is 
+// simply not cached.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+int
+  CFS_PRV_TlsCacheNew
+    (SSL* ssl,
+     SSL_SESSION* sess) {
+
+  int derLen;
+
+  unsigned int idLen;
+
+  const unsigned char* id;
+  unsigned char* p;
+
+  CFS_TLS_CACHE_SLOT* pSlot;
+
+  id = SSL_SESSION_get_id(sess, &idLen);
+
+  if (idLen == 0 || idLen > SSL_MAX_SSL_SESSION_ID_LENGTH) {
+    return 0;
+  }
+
+  derLen = i2d_SSL_SESSION(sess, NULL);
+
+  if (derLen <= 0 || derLen > CFS_TLS_SESSION_DER_MAX) {
+    return 0;
+  }
+
+  pSlot = CFS_PRV_TlsCacheSlot(id, idLen);
+
+  if (!CFS_PRV_TlsShareLock(&(pSlot->seq))) {
+    return 0;
+  }
+
+  p = pSlot->der;
+  pSlot->derLen = i2d_SSL_SESSION(sess, &p);
+  pSlot->idLen = idLen;
+  memcpy(pSlot->id, id, idLen);
+  pSlot->expires = (int64_t)SSL_SESSION_get_time(sess) + 
+                   SSL_SESSION_get_timeout(sess);
+
+  CFS_PRV_TlsShareUnlock(&(pSlot->seq));
+
+  // we did not keep a reference to the session
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_PRV_TlsCacheGet
+//
+// Looks up a session in the shared cache.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+SSL_SESSION*
+  CFS_PRV_TlsCacheGet
+    (SSL* ssl,
+     const unsigned char* id,
+     int idLen,
+     int* copy) {
+
+  uint32_t seq;
+  uint32_t derLen;
+
+  int64_t expires;
+
+  unsigned char der[CFS_TLS_SESSION_DER_MAX];
+
+  const unsigned char* p;
+
+  CFS_TLS_CACHE_SLOT* pSlot;
+
+  *copy = 0;
+
+  if (idLen <= 0 || idLen > SSL_MAX_SSL_SESSION_ID_LENGTH) {
+    return NULL;
+  }
+
+  pSlot = CFS_PRV_TlsCacheSlot(id, idLen);
+
+  seq = __atomic_load_n(&(pSlot->seq), __ATOMIC_ACQUIRE);
+
+  if ((seq & 1) || pSlot->idLen != idLen || memcmp(pSlot->id, id, idLen)) {
+    return NULL;
+  }
+
+  derLen = pSlot->derLen;
+  expires = pSlot->expires;
+
+  if (derLen > CFS_TLS_SESSION_DER_MAX || expires < (int64_t)time(NULL)) {
+    return NULL;
+  }
+
+  memcpy(der, pSlot->der, derLen);
+
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+  if (__atomic_load_n(&(pSlot->seq), __ATOMIC_RELAXED) != seq) {
+    return NULL;
+  }
+
+  p = der;
+
+  return d2i_SSL_SESSION(NULL, &p, derLen);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_PRV_TlsCacheRemove
+//
+// Removes a session from the shared cache.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+void
+  CFS_PRV_TlsCacheRemove
+    (SSL_CTX* ctx,
+     SSL_SESSION* sess) {
+
+  unsigned int idLen;
+
+  const unsigned char* id;
+
+  CFS_TLS_CACHE_SLOT* pSlot;
+
+  id = SSL_SESSION_get_id(sess, &idLen);
+
+  if (idLen == 0 || idLen > SSL_MAX_SSL_SESSION_ID_LENGTH) {
+    return;
+  }
+
+  pSlot = CFS_PRV_TlsCacheSlot(id, idLen);
+
+  if (!CFS_PRV_TlsShareLock(&(pSlot->seq))) {
+    return;
+  }
+
+  if (pSlot->idLen == idLen && !memcmp(pSlot->id, id, idLen)) {
+    pSlot->idLen = 0;
+  }
+
+  CFS_PRV_TlsShareUnlock(&(pSlot->seq));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_PRV_SecureShareSessions
+//
+// Makes a server context resume sessions across the handlers of a 
+// daemon, using the shared TLS state created by the daemon (see 
+// CFS_CreateTlsShare). Without it, each handler keeps its own cache and
+// ticket keys and resumption mostly fails.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+void
+  CFS_PRV_SecureShareSessions
+    (CFSENV* pEnv,
+     char* szConfig) {
+
+  int fd;
+
+  char* pszParam;
+
+  struct stat fileInfo;
+
+  CFS_TLSSHARE* pShare;
+
+  if (g_CFS_TlsShare == NULL) {
+
+    /////////////////////////////////////////////////////////////////
+    // The variable holds the descriptor of the shared state, which
+    // we inherit from the daemon; once mapped, the descriptor is 
+    // closed so that our own children don't inherit the keys.
+    /////////////////////////////////////////////////////////////////
+
+    if ((pszParam = getenv(CFS_TLSSHARE_ENV)) == NULL ||
+        (fd = atoi(pszParam)) <= 2) {
+      return;
+    }
+
+    if (fstat(fd, &fileInfo) < 0 || 
+        !S_ISREG(fileInfo.st_mode) ||
+        fileInfo.st_size < sizeof(CFS_TLSSHARE)) {
+      return;
+    }
+
+    pShare = (CFS_TLSSHARE*)mmap(NULL, fileInfo.st_size, 
+                                 PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (pShare == MAP_FAILED) {
+      return;
+    }
+
+    if (memcmp(pShare->magic, CFS_TLSSHARE_MAGIC, sizeof(pShare->magic)) ||
+        pShare->version != CFS_TLSSHARE_VERSION ||
+        fileInfo.st_size < sizeof(CFS_TLSSHARE) + 
+                           pShare->numSlots * sizeof(CFS_TLS_CACHE_SLOT)) {
+
+      munmap(pShare, fileInfo.st_size);
+      return;
+    }
+
+    close(fd);
+    g_CFS_TlsShare = pShare;
+  }
+
+  // sessions of one environment must not be resumed in another
+
+  SSL_CTX_set_session_id_context(pEnv->ctx, (unsigned char*)szConfig, 
+                                 strlen(szConfig) > SSL_MAX_SID_CTX_LENGTH ?
+                                   SSL_MAX_SID_CTX_LENGTH : strlen(szConfig));
+
+  SSL_CTX_set_timeout(pEnv->ctx, g_CFS_TlsShare->timeout);
+
+  if (g_CFS_TlsShare->tickets) {
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(pEnv->ctx, 
+                                         CFS_PRV_TicketKeyCallback);
+  }
+  else {
+
+    // resumption goes through the shared cache (TLS 1.3 stateful tickets)
+    SSL_CTX_set_options(pEnv->ctx, SSL_OP_NO_TICKET);
+  }
+
+  if (g_CFS_TlsShare->numSlots > 0) {
+
+    SSL_CTX_set_session_cache_mode(pEnv->ctx, 
+                                   SSL_SESS_CACHE_SERVER | 
+                                   SSL_SESS_CACHE_NO_INTERNAL);
+    SSL_CTX_sess_set_new_cb(pEnv->ctx, CFS_PRV_TlsCacheNew);
+    SSL_CTX_sess_set_get_cb(pEnv->ctx, CFS_PRV_TlsCacheGet);
+    SSL_CTX_sess_set_remove_cb(pEnv->ctx, CFS_PRV_TlsCacheRemove);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_OpenEnv
+//
+// This function creates a global environment
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CFSENV*
+  CFS_OpenEnv
+    (char* szConfig) {
+  
+  CFSENV* pEnv;
+  char* pszParam;
+
+  pEnv = (CFSENV*)malloc(sizeof(CFSENV));
+  
+  if (szConfig == 0) {
+
+    // fill environment with default values
+
+    pEnv->readTimeout    = 20;
+    pEnv->writeTimeout   = 20;
+    pEnv->connectTimeout = 20;
+    pEnv->secMode        = 0;
+    pEnv->ktls           = 0;
+    pEnv->Config_Session = 0;
+    pEnv->Config_Secure  = 0;
+
+    return pEnv;
+  }
+  else {
+
+    pEnv->pRepo = CFSRPS_Open(0);
+
+    if ((pEnv->Config_Session = 
+              CFSRPS_OpenConfig(pEnv->pRepo, szConfig)) == NULL) {
+      goto CFS_OPENENV_ERROR;
+    }  
+
+    if ((pszParam = 
+             CFSCFG_LookupParam(pEnv->Config_Session, "CONN_TO")) == NULL) {
+      pEnv->connectTimeout = 20;
+    }
+    else {
+      pEnv->connectTimeout = (int)strtol(pszParam, 0, 10);
+    }
+
+    if ((pszParam = 
+            CFSCFG_LookupParam(pEnv->Config_Session,"READ_TO")) == NULL) {
+      pEnv->readTimeout = 20;
+    }
+    else {
+      pEnv->readTimeout = (int)strtol(pszParam, 0, 10);
+    }
+
+    if ((pszParam = 
+            CFSCFG_LookupParam(pEnv->Config_Session, "WRITE_TO")) == NULL) {
+      pEnv->writeTimeout = 20;
+    }
+    else {
+      pEnv->writeTimeout = (int)strtol(pszParam, 0, 10);
+    }
+
+    if ((pszParam = 
+            CFSCFG_LookupParam(pEnv->Config_Session, 
+                                "SECURE_CONFIG")) != NULL) {
+
+      if ((pEnv->Config_Secure = 
+               CFSRPS_OpenConfig(pEnv->pRepo, pszParam)) == NULL) {
+        pEnv->Config_Secure = NULL;
+        goto CFS_OPENENV_ERROR;
+      }  
+
+      // Seed random number generator
+      //RAND_load_file("/dev/random", 256);
+
+      // Load secure configuration
+      SSL_library_init();
+      OpenSSL_add_all_algorithms();
+      SSL_load_error_strings();
+    
+      if ((pszParam = 
+             CFSCFG_LookupParam(pEnv->Config_Secure, 
+                                 "TLS_SESSION_TYPE")) == NULL) {
+        goto CFS_OPENENV_ERROR;
+      }
+    
+      if (!strcmp("*CLIENT", pszParam)) {
+
+        pEnv->ctx = SSL_CTX_new(TLS_client_method());
+
+        // By default, we make a client validate peer certificates; OpenSSL
+        // does not validate certificatesd by default. Unfortunately, we 
+        // must duplicate certificate validation code if the configuration
+        // verify key value is missing for client sessions.
+
+        if ((pszParam = 
+                CFSCFG_LookupParam(pEnv->Config_Secure, 
+                                       "TLS_VALIDATE_PEER")) == NULL) {
+
+          SSL_CTX_set_verify(pEnv->ctx, 
+                             SSL_VERIFY_PEER, CFS_SSL_VerifyCallback);
+          CFS_PRV_SecureLoadTrustStore(pEnv);
+        }
+        else {
+          if (!strcmp(pszParam, "*YES")) {
+
+            SSL_CTX_set_verify(pEnv->ctx, 
+                               SSL_VERIFY_PEER, CFS_SSL_VerifyCallback);
+            CFS_PRV_SecureLoadTrustStore(pEnv);
+          }
+          else {
+            SSL_CTX_set_verify(pEnv->ctx, 
+                               SSL_VERIFY_NONE, CFS_SSL_VerifyCallback);
+          }
+        }
+      }
+      else {
+
+        pEnv->ctx = SSL_CTX_new(TLS_server_method());
+
+        // Server certificate
+        if ((pszParam = 
+                CFSCFG_LookupParam(pEnv->Config_Secure, 
+                                   "TLS_CERT_FILE")) != NULL) {
+
+          if (SSL_CTX_use_certificate_file(pEnv->ctx, 
+                                pszParam, SSL_FILETYPE_PEM) <= 0) {
+            goto CFS_OPENENV_ERROR;
+          }
+
+          if ((pszParam = 
+                   CFSCFG_LookupParam(pEnv->Config_Secure, 
+                                      "TLS_CERT_KEY_FILE")) != NULL) {
+
+            if (SSL_CTX_use_PrivateKey_file(pEnv->ctx, 
+                                  pszParam, SSL_FILETYPE_PEM) <= 0 ) {
+              goto CFS_OPENENV_ERROR;
+            }
+          }
+          else {
+            goto CFS_OPENENV_ERROR;
+          }
+        }
+        else {
+          goto CFS_OPENENV_ERROR;
+        }
+
+        // For server sessions, we do not validate client certificates 
+        // by default, unless the configuration states otherwise.
+
+        if ((pszParam = 
+                CFSCFG_LookupParam(pEnv->Config_Secure, 
+                                   "TLS_VALIDATE_PEER")) != NULL) {
+
+          if (!strcmp(pszParam, "*YES")) {
+
+            STACK_OF(X509_NAME) *certs;
+  
+            if ((pszParam = 
+                    CFSCFG_LookupParam(pEnv->Config_Secure, 
+                                       "TLS_CA_LIST_FILE")) != NULL) {
+
+              certs = SSL_load_client_CA_file(pszParam);
+
+              if (certs != NULL) {
+
+                // Note that the following function will have 
+                // the context take ownership
+                // of the stack and free it when the context is freed.
+                SSL_CTX_set_client_CA_list(pEnv->ctx, certs);
+
+                if ((pszParam = 
+                        CFSCFG_LookupParam(pEnv->Config_Secure, 
+                                           "TLS_CA_LIST_DIR")) != NULL) { 
+                  SSL_add_dir_cert_subjects_to_stack(certs, pszParam);
+                }  
+              }
+            }
+          }
+        }
+
+        if ((pszParam = 
+                CFSCFG_LookupParam(pEnv->Config_Secure, 
+                                   "TLS_PWD_CALLBACK_USERDATA")) != NULL) {
+          
+          strcpy(g_CFS_TLS_UserData, pszParam);
+          SSL_CTX_set_default_passwd_cb_userdata(pEnv->ctx, 
+                                          (void*)g_CFS_TLS_UserData);
+        }
+        else {
+
+        }
+          
+        if ((pszParam = 
+                 CFSCFG_LookupParam(pEnv->Config_Secure, 
+                                    "TLS_PWD_CALLBACK_INPROCSERVER")) != NULL) {
+
+          char szLib[256];
+
+          strcpy(szLib, pszParam);
+
+          if ((pszParam = 
+                  CFSCFG_LookupParam(pEnv->Config_Secure, 
+                                     "TLS_PWD_CALLBACK_EXPORT")) != NULL) {
+
+            // the password callback function is exported from a shared library
+ 
+            PASSWORD_CALLBACK_Export pwdCb;
+            void* inprocServer = dlopen(szLib, RTLD_NOW);
+
+            pwdCb = dlsym(inprocServer, pszParam);
+
+            SSL_CTX_set_default_passwd_cb(pEnv->ctx, pwdCb);
+          }
+          else {
+            goto CFS_OPENENV_ERROR;
+          }  
+        }
+        else {
+          // default password callback if not provided from so export
+          SSL_CTX_set_default_passwd_cb(pEnv->ctx, CFS_PRV_CALLBACK_Password);
+        }
+
+        CFS_PRV_SecureShareSessions(pEnv, szConfig);
+      }
+
+      // Kernel TLS: OpenSSL hands the record keys to the kernel after the
+      // handshake when both support the negotiated cipher.
+
+      pEnv->ktls = 0;
+
+      if ((pszParam = 
+              CFSCFG_LookupParam(pEnv->Config_Secure, "TLS_KTLS")) != NULL) {
+
+        if (!strcmp(pszParam, "*YES")) {
+          SSL_CTX_set_options(pEnv->ctx, SSL_OP_ENABLE_KTLS);
+          pEnv->ktls = 1;
+        }
+      }
+
+      pEnv->secMode = 1;
+    }
+    else {
+     pEnv->Config_Secure = NULL;
+     pEnv->secMode = 0;
+     pEnv->ktls = 0;
+    }
+
+    CFSRPS_CloseConfig(pEnv->pRepo, &(pEnv->Config_Session));
+    CFSRPS_CloseConfig(pEnv->pRepo, &(pEnv->Config_Secure));
+    CFSRPS_Close(&(pEnv->pRepo));
+
+    return pEnv;
+  }
+
+  ///////////////////////////////////////////////////////////////
+  //
+  CFS_OPENENV_ERROR:
+  //
+  CFSRPS_CloseConfig(pEnv->pRepo, &(pEnv->Config_Session));
+  CFSRPS_CloseConfig(pEnv->pRepo, &(pEnv->Config_Secure));
+  CFSRPS_Close(&(pEnv->pRepo));
+  free(pEnv);
+
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_PRV_ChannelConstructor
+//
+// Creates a server session on a client connection with the timeouts
+// and security mode of the environment.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CFS_SESSION*
+  CFS_PRV_ChannelConstructor
+    (CFSENV* pEnv,
+     int connfd) {
+
+  CFS_SESSION* Session;
+
+  if ((Session = CFS_Constructor()) == NULL) {
+    return 0;
+  }
+
+  Session->connfd         = connfd;
+
+  if (pEnv != NULL) {
+    Session->connectTimeout = pEnv->connectTimeout;
+    Session->readTimeout    = pEnv->readTimeout;
+    Session->writeTimeout   = pEnv->writeTimeout;
+    Session->secMode        = pEnv->secMode;
+    Session->pEnv           = pEnv;
+  }
+  else {
+    Session->connectTimeout = 20;
+    Session->readTimeout    = 20;
+    Session->writeTimeout   = 20;
+    Session->secMode        = 0;
+    Session->pEnv           = pEnv;
+  }
+
+  return Session;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_OpenChannel
+//
+// This function initializes a server session.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CFS_SESSION*
+  CFS_OpenChannel
+    (CFSENV* pEnv,
+     int connfd) {
+
+  int rc;
+
+  CFS_SESSION* Session;
+
+  struct pollfd fdset[1];
+
+  if ((Session = CFS_PRV_ChannelConstructor(pEnv, connfd)) == NULL) {
+    close(connfd);
+    return 0;
+  }
+
+  if (Session->secMode == 1) {
+
+    // use TLS functions
+    Session->lpVtbl = &secureVtbl;
+
+    // perform handshake
+
+    Session->ssl = SSL_new(Session->pEnv->ctx);
+    
+    // Set socket to NON-blocking mode
+    CFS_PRV_SetBlocking(Session->connfd, 0);
+
+    SSL_set_fd(Session->ssl, Session->connfd);
+
+    while (1) 
+    {
+      rc = SSL_accept(Session->ssl); 
+
+      switch (SSL_get_error(Session->ssl, rc))
+      {
+        case SSL_ERROR_NONE:
+
+          CFS_PRV_SecureOffload(Session);
+          CFS_PRV_ScoreboardOpen(Session);
+          return Session;
+
+        case SSL_ERROR_ZERO_RETURN:
+
+          goto CFS_OPENCHANNEL_CLOSE_SSL;
+
+        case SSL_ERROR_WANT_READ:
+
+          fdset[0].fd = Session->connfd;
+          fdset[0].events = POLLIN;
+
+          CFS_OPENCHANNEL_POLL_READ:
+
+          rc = poll(fdset, 1,
+                    Session->connectTimeout >= 0 ? 
+                    Session->connectTimeout * 1000: -1);
+
+          if (rc == 1) {
+
+            /////////////////////////////////////////////////////////
+            // If we get anything other than POLLIN
+            // this means we got an error.
+            /////////////////////////////////////////////////////////
+
+            if (!(fdset[0].revents & POLLIN)) {
+              goto CFS_OPENCHANNEL_CLOSE_SSL;
+            }
+          }
+          else {
+
+            if (rc == 0) { // timed out
+              goto CFS_OPENCHANNEL_CLOSE_SSL;
+            }
+            else {
+
+              if (errno == EINTR) { // poll() interrupted
+                goto CFS_OPENCHANNEL_POLL_READ;
+              }
+              else { // system error
+                goto CFS_OPENCHANNEL_CLOSE_SSL;
+              }
+            }
+          }
+
+          break;
+
+        case SSL_ERROR_WANT_WRITE:
+
+          fdset[0].fd = Session->connfd;
+          fdset[0].events = POLLOUT;
+
+          CFS_OPENCHANNEL_POLL_WRITE:
+
+          rc = poll(fdset, 1,
+                    Session->connectTimeout >= 0 ? 
+                    Session->connectTimeout * 1000: -1);
+
+          if (rc == 1) {
+
+            /////////////////////////////////////////////////////////
+            // If we get anything other than POLLOUT
+            // this means we got an error.
+            /////////////////////////////////////////////////////////
+
+            if (!(fdset[0].revents & POLLOUT)) {
+              goto CFS_OPENCHANNEL_CLOSE_SSL;
+            }
+          }
+          else {
+
+            if (rc == 0) { // timed out
+              goto CFS_OPENCHANNEL_CLOSE_SSL;
+            }
+            else {
+
+              if (errno == EINTR) { // poll() interrupted
+                goto CFS_OPENCHANNEL_POLL_WRITE;
+              }
+              else { // system error
+                goto CFS_OPENCHANNEL_CLOSE_SSL;
+              }
+            }
+          }
+
+          break;
+
+        default:
+
+          goto CFS_OPENCHANNEL_CLOSE_SSL;
+      }
+    }
+
+    CFS_OPENCHANNEL_CLOSE_SSL:
+
+    SSL_shutdown(Session->ssl);
+    SSL_free(Session->ssl);
+    close(Session->connfd);
+    Session->connfd = -1;
+  }
+  else {
+
+    // User non-TLS functions
+    Session->lpVtbl = &dftVtbl;
+
+    // Set socket to blocking mode
+    CFS_PRV_SetBlocking(Session->connfd, 1);
+
+    // the client request has usually arrived by the time we get here
+    Session->readReady = 1;
+
+    CFS_PRV_ScoreboardOpen(Session);
+    return Session;
+  }
+
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_OpenChannelAsync
+//
+// This function initializes a server session without performing the
+// TLS handshake; the caller drives the handshake with 
+// CFS_AcceptHandshake when the descriptor is ready. The descriptor is
+// closed if the session can't be initialized.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CFS_SESSION*
+  CFS_OpenChannelAsync
+    (CFSENV* pEnv,
+     int connfd) {
+
+  CFS_SESSION* Session;
+
+  if ((Session = CFS_PRV_ChannelConstructor(pEnv, connfd)) == NULL) {
+    close(connfd);
+    return 0;
+  }
+
+  if (Session->secMode == 1) {
+
+    // use TLS functions
+    Session->lpVtbl = &secureVtbl;
+
+    if ((Session->ssl = SSL_new(Session->pEnv->ctx)) == NULL) {
+      close(connfd);
+      CFS_Destructor(&Session);
+      return 0;
+    }
+
+    // Set socket to NON-blocking mode
+    CFS_PRV_SetBlocking(Session->connfd, 0);
+
+    SSL_set_fd(Session->ssl, Session->connfd);
+
+    // the handshake must complete within the connect timeout
+    Session->created = time(NULL);
+  }
+  else {
+
+    // User non-TLS functions
+    Session->lpVtbl = &dftVtbl;
+
+    // Set socket to blocking mode
+    CFS_PRV_SetBlocking(Session->connfd, 1);
+
+    // the client request has usually arrived by the time we get here
+    Session->readReady = 1;
+
+    CFS_PRV_ScoreboardOpen(Session);
+  }
+
+  return Session;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_AcceptHandshake
+//
+// Advances the TLS handshake of a session opened with 
+// CFS_OpenChannelAsync; this function does not block. Returns 
+// CFS_EVENT_OPEN once the handshake is complete (at once for a 
+// non-secure session), CFS_EVENT_READABLE or CFS_EVENT_WRITABLE when it
+// must be called again once the descriptor is ready, or CFS_EVENT_CLOSE
+// if the handshake failed or did not complete within the connect 
+// timeout; the session must then be closed with CFS_CloseChannel.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+int
+  CFS_AcceptHandshake
+    (CFS_SESSION* This) {
+
+  int rc;
+  int sslError;
+
+  if (This->secMode != 1 || SSL_is_init_finished(This->ssl)) {
+    return CFS_EVENT_OPEN;
+  }
+
+  rc = SSL_accept(This->ssl);
+  sslError = SSL_get_error(This->ssl, rc);
+
+  switch (sslError)
+  {
+    case SSL_ERROR_NONE:
+
+      CFS_PRV_SecureOffload(This);
+      CFS_PRV_ScoreboardOpen(This);
+      return CFS_EVENT_OPEN;
+
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+
+      if (This->connectTimeout >= 0 &&
+          time(NULL) - This->created > This->connectTimeout) {
+        return CFS_EVENT_CLOSE;
+      }
+
+      return sslError == SSL_ERROR_WANT_READ ?
+               CFS_EVENT_READABLE : CFS_EVENT_WRITABLE;
+  }
+
+  return CFS_EVENT_CLOSE;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_PRV_SessionConfig
+//
+// Sets the connection parameters of a client session, either from
+// the named configuration or from the given host and port.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  CFS_PRV_SessionConfig
+    (CFS_SESSION* Session,
+     CFSENV* pEnv,
+     char* szConfig,
+     char* szHost,
+     char* szPort) {
+
+  char* pszHost;
+  char* pszPort;
+  char* pszParam;
+
+  CFSRPS pRepo;
+  CFSCFG pConfig;
+
+  if (pEnv == NULL) {
+
+    Session->secMode        = 0;
+    Session->connectTimeout = 20;
+    Session->readTimeout    = 20;
+    Session->writeTimeout   = 20;
+  }
+  else {
+
+    Session->secMode        = pEnv->secMode;
+    Session->connectTimeout = pEnv->connectTimeout;
+    Session->readTimeout    = pEnv->readTimeout;
+    Session->writeTimeout   = pEnv->writeTimeout;
+  }
+
+  if (szConfig) {
+
+    pRepo = CFSRPS_Open(0);
+
+    if ((pConfig = CFSRPS_OpenConfig(pRepo, szConfig)) == NULL) {
+      CFSRPS_Close(&pRepo);
+      return CS_FAILURE;
+    }  
+
+    if ((pszHost = CFSCFG_LookupParam(pConfig, "HOST")) == NULL) {
+      CFSRPS_CloseConfig(pRepo, &pConfig);
+      CFSRPS_Close(&pRepo);
+      return CS_FAILURE;
+    }
+
+    strncpy(Session->szHostName, pszHost, 256);
+    Session->szHostName[255] = 0;
+
+    if ((pszPort = CFSCFG_LookupParam(pConfig, "PORT")) == NULL) {
+      CFSRPS_CloseConfig(pRepo, &pConfig);
+      CFSRPS_Close(&pRepo);
+      return CS_FAILURE;
+    }
+
+    strncpy(Session->szPort, pszPort, 11);
+    Session->szPort[10] = 0;
+
+    // Configuration overrides on the environment
+
+    if ((pszParam = CFSCFG_LookupParam(pConfig, "CONN_TO")) != NULL) {
+      Session->connectTimeout = (int)strtol(pszParam, 0, 10);
+    }
+
+    if ((pszParam = CFSCFG_LookupParam(pConfig, "READ_TO")) != NULL) {
+      Session->readTimeout = (int)strtol(pszParam, 0, 10);
+    }
+
+    if ((pszParam = CFSCFG_LookupParam(pConfig, "WRITE_TO")) != NULL) {
+      Session->writeTimeout = (int)strtol(pszParam, 0, 10);    
+    }
+
+    CFSRPS_CloseConfig(pRepo, &pConfig);
+    CFSRPS_Close(&pRepo);
+  } 
+  else {
+
+    if (szHost == NULL) {
+      return CS_FAILURE;
+    }
+    else {
+      strncpy(Session->szHostName, szHost, 256);
+      Session->szHostName[255] = 0;
+    }
+
+    if (szPort == NULL) {
+      return CS_FAILURE;
+    }
+    else {
+      strncpy(Session->szPort, szPort, 11);
+      Session->szPort[10] = 0;
+    }
+  }
+
+  Session->info.szHost = Session->szHostName;
+  Session->info.szPort = Session->szPort;
+  Session->info.szLocalPort = 0;
+  Session->info.szRemotePort = 0;
+  
+  Session->pEnv = pEnv;
+
+  return CS_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_PRV_SessionConnect
+//
+// Connects a client session and, in secure mode, performs the TLS
+// handshake. pResume is a TLS session to resume, or NULL.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  CFS_PRV_SessionConnect
+    (CFS_SESSION* Session,
+     SSL_SESSION* pResume) {
+
+  int rc;
+
+  CSRESULT hResult;
+
+  struct addrinfo* addrInfo;
+  struct addrinfo* addrInfo_first;
+  struct addrinfo  hints;
+
+  struct pollfd fdset[1];
+
+  hResult = CS_FAILURE;
+
+  memset(&hints, 0, sizeof(struct addrinfo));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  if (getaddrinfo(Session->szHostName,
+                  Session->szPort,
+                  &hints,
+                  &addrInfo) == 0) {
+
+    addrInfo_first = addrInfo;
+
+    while (addrInfo != 0)
+    {
+      Session->connfd = socket(addrInfo->ai_family,
+                               addrInfo->ai_socktype,
+                               addrInfo->ai_protocol);
+
+      if (Session->connfd >= 0) {
+
+        // Set socket to non-blocking
+        CFS_PRV_SetBlocking(Session->connfd, 0);
+
+        rc = connect(Session->connfd,
+                     addrInfo->ai_addr,
+                     addrInfo->ai_addrlen);
+
+        if (rc < 0) {
+
+          if (errno != EINPROGRESS) {
+            
+            Session->errInfo.csresult = 
+                          CS_FAILURE | CFS_OPER_READ | CFS_DIAG_CONNCLOSE;
+            Session->errInfo.m_errno = errno;
+            Session->errInfo.secrc = 0;
+
+            close(Session->connfd);
+          }
+          else {
+
+            ////////////////////////////////////////////////////////
+            // The connection is in progress, so we must wait
+            // for the TCP handshgake to complete
+            ////////////////////////////////////////////////////////
+
+            fdset[0].fd = Session->connfd;
+            fdset[0].events = POLLOUT;
+
+            CFS_OPENSESSION_CONNECT_POLL_READ:
+
+            rc = poll(fdset, 1,
+                      Session->connectTimeout >= 0 ? 
+                      Session->connectTimeout * 1000: -1);
+
+            if (rc == 1) {
+
+              /////////////////////////////////////////////////////////
+              // If we get anything other than POLLOUT
+              // this means we got an error.
+              /////////////////////////////////////////////////////////
+ 
+              if (fdset[0].revents & POLLOUT) {
+                // TCP handshake has completed so we are connected
+                hResult = CS_SUCCESS;
+                break;  // leave the connection loop
+              } 
+              else {
+
+                Session->errInfo.csresult = 
+                           CS_FAILURE | CFS_OPER_READ | CFS_DIAG_CONNCLOSE;
+                Session->errInfo.m_errno = errno;
+                Session->errInfo.secrc = 0;
+
+                close(Session->connfd);
+              }
+            }
+            else {
+
+              if (rc == 0) {
+
+                Session->errInfo.csresult = 
+                           CS_FAILURE | CFS_OPER_READ | CFS_DIAG_CONNCLOSE;
+                Session->errInfo.m_errno = errno;
+                Session->errInfo.secrc = 0;
+
+                close(Session->connfd);
+              }
+              else {
+
+                if (errno == EINTR) {
+                  goto CFS_OPENSESSION_CONNECT_POLL_READ;
+                }
+                else {
+
+                  Session->errInfo.csresult = 
+                           CS_FAILURE | CFS_OPER_READ | CFS_DIAG_CONNCLOSE;
+                  Session->errInfo.m_errno = errno;
+                  Session->errInfo.secrc = 0;
+
+                  close(Session->connfd);
+                }
+              }
+            }
+          }
+        }
+        else {
+          hResult = CS_SUCCESS;
+          break;
+        }
+      }
+
+      addrInfo = addrInfo->ai_next;
+    }
+
+    freeaddrinfo(addrInfo_first);
+  }
+  else {
+    hResult = CS_FAILURE;
+  }
+
+  if (CS_SUCCEED(hResult)) {
+
+    if (Session->secMode == 1) {
+
+      // Use TLS functions
+      Session->lpVtbl = &secureVtbl;
+
+      Session->ssl = SSL_new(Session->pEnv->ctx);
+
+      SSL_set_tlsext_host_name(Session->ssl, Session->szHostName);
+
+      if (pResume != NULL) {
+        SSL_set_session(Session->ssl, pResume);
+      }
+
+      SSL_set_fd(Session->ssl, Session->connfd);
+
+      while (1) 
+      {
+        rc = SSL_connect(Session->ssl);
+
+        switch (SSL_get_error(Session->ssl, rc))
+        {
+          case SSL_ERROR_NONE:
+
+            // SSL handshake succeeded, we return the session handle
+
+            /* ---------------------------------------------------------------
+              The following shows how to retrieve information from the 
+              peer certificate
+
+              X509 *cert;
+              char *line;
+              cert = SSL_get_peer_certificate(This->ssl); 
+              if ( cert != NULL )
+              {
+                printf("Server certificates:\n");
+                line = X509_NAME_oneline(X509_get_subject_name(cert), 0, 0);
+                printf("Subject: %s\n", line);
+                free(line);       // free the malloc'ed string
+                line = X509_NAME_oneline(X509_get_issuer_name(cert), 0, 0);
+                printf("Issuer: %s\n", line);
+                free(line);       // free the malloc'ed string 
+                X509_free(cert);     // free the malloc'ed certificate copy 
+              }
+              else
+                printf("Info: No client certificates configured.\n");
+              }
+            --------------------------------------------------------------- */
+
+            CFS_PRV_SecureOffload(Session);
+            return CS_SUCCESS;
+
+          case SSL_ERROR_ZERO_RETURN:
+
+            goto CFS_OPENSESSION_CLOSE_SSL;
+
+          case SSL_ERROR_WANT_READ:
+
+            fdset[0].fd = Session->connfd;
+            fdset[0].events = POLLIN;
+
+            CFS_OPENSESSION_POLL_READ:
+
+            rc = poll(fdset, 1,
+                      Session->connectTimeout >= 0 ? 
+                      Session->connectTimeout * 1000: -1);
+
+            if (rc == 1) {
+
+              /////////////////////////////////////////////////////////
+              // If we get anything other than POLLIN
+              // this means we got an error.
+              /////////////////////////////////////////////////////////
+ 
+              if (!(fdset[0].revents & POLLIN)) {
+
+                Session->errInfo.csresult = 
+                          CS_FAILURE | CFS_OPER_READ | CFS_DIAG_CONNCLOSE;
+                Session->errInfo.m_errno = errno;
+                Session->errInfo.secrc = 0;
+
+                goto CFS_OPENSESSION_CLOSE_SSL;
+              }
+            }
+            else {
+
+              if (rc == 0) { // timed out
+
+                Session->errInfo.csresult = 
+                          CS_FAILURE | CFS_OPER_READ | CFS_DIAG_CONNCLOSE;
+                Session->errInfo.m_errno = errno;
+                Session->errInfo.secrc = 0;
+
+                goto CFS_OPENSESSION_CLOSE_SSL;
+              }
+              else {
+
+                if (errno == EINTR) { // poll() interrupted
+                  goto CFS_OPENSESSION_POLL_READ;
+                }
+                else { // system error
+
+                  Session->errInfo.csresult = 
+                            CS_FAILURE | CFS_OPER_READ | CFS_DIAG_CONNCLOSE;
+                  Session->errInfo.m_errno = errno;
+                  Session->errInfo.secrc = 0;
+
+                  goto CFS_OPENSESSION_CLOSE_SSL;
+                }
+              }
+            }
+
+            break;
+
+          case SSL_ERROR_WANT_WRITE:
+
+            fdset[0].fd = Session->connfd;
+            fdset[0].events = POLLOUT;
+
+            CFS_OPENSESSION_POLL_WRITE:
+
+            rc = poll(fdset, 1,
+                      Session->connectTimeout >= 0 ? 
+                      Session->connectTimeout * 1000: -1);
+
+            if (rc == 1) {
+
+              /////////////////////////////////////////////////////////
+              // If we get anything other than POLLOUT
+              // this means we got an error.
+              /////////////////////////////////////////////////////////
+ 
+              if (!(fdset[0].revents & POLLOUT)) {
+
+                Session->errInfo.csresult = 
+                          CS_FAILURE | CFS_OPER_READ | CFS_DIAG_CONNCLOSE;
+                Session->errInfo.m_errno = errno;
+                Session->errInfo.secrc = 0;
+
+                goto CFS_OPENSESSION_CLOSE_SSL;
+              }
+            }
+            else {
+
+              if (rc == 0) { // timed out
+
+                Session->errInfo.csresult = 
+                          CS_FAILURE | CFS_OPER_READ | CFS_DIAG_CONNCLOSE;
+                Session->errInfo.m_errno = errno;
+                Session->errInfo.secrc = 0;
+
+                goto CFS_OPENSESSION_CLOSE_SSL;
+              }
+              else {
+
+                if (errno == EINTR) { // poll() interrupted
+                  goto CFS_OPENSESSION_POLL_WRITE;
+                }
+                else { // system error
+
+                  Session->errInfo.csresult = 
+                            CS_FAILURE | CFS_OPER_READ | CFS_DIAG_CONNCLOSE;
+                  Session->errInfo.m_errno = errno;
+                  Session->errInfo.secrc = 0;
+
+                  goto CFS_OPENSESSION_CLOSE_SSL;
+                }
+              }
+            }
+
+            break;
+
+          default:
+
+            goto CFS_OPENSESSION_CLOSE_SSL;
+        }
+      }
+
+      CFS_OPENSESSION_CLOSE_SSL:
+
+      SSL_shutdown(Session->ssl);
+      SSL_free(Session->ssl);
+      close(Session->connfd);
+      Session->connfd = -1;
+    }
+    else {
+
+      // Use non-TLS functions
+      Session->lpVtbl = &dftVtbl;
+
+      // Set socket back to blocking
+      CFS_PRV_SetBlocking(Session->connfd, 1);
+      return CS_SUCCESS;
+    }
+  }
+  else {
+    close(Session->connfd);
+    Session->connfd = -1;
+  }
+
+  return CS_FAILURE;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_OpenSession
+//
+// This function initialises a connection to a server.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CFS_SESSION*
+  CFS_OpenSession
+    (CFSENV* pEnv,
+     char* szConfig,
+     char* szHost,
+     char* szPort) {
+
+  CFS_SESSION* Session;
+
+  Session = CFS_Constructor();
+
+  if (CS_FAIL(CFS_PRV_SessionConfig(Session, pEnv, 
+                                    szConfig, szHost, szPort)) ||
+      CS_FAIL(CFS_PRV_SessionConnect(Session, NULL))) {
+
+    CFS_Destructor(&Session);
+    return NULL;
+  }
+
+  return Session;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_PRV_PoolCheck
+//
+// Checks that an idle session can still be used: the peer must not
+// have closed the connection nor sent anything we did not ask for.
+// In secure mode, this also processes the post-handshake messages
+// (such as TLS 1.3 session tickets) waiting on the connection.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  CFS_PRV_PoolCheck
+    (CFS_SESSION* This) {
+
+  int rc;
+  char c;
+
+  if (This->secMode == 1) {
+
+    if (SSL_pending(This->ssl) > 0) {
+      return CS_FAILURE;
+    }
+
+    ERR_clear_error();
+    rc = SSL_peek(This->ssl, &c, 1);
+
+    if (rc <= 0 && SSL_get_error(This->ssl, rc) == SSL_ERROR_WANT_READ) {
+      return CS_SUCCESS;
+    }
+
+    return CS_FAILURE;
+  }
+
+  CFS_POOLCHECK_PEEK:
+
+  rc = recv(This->connfd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+
+  if (rc < 0) {
+
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return CS_SUCCESS;
+    }
+
+    if (errno == EINTR) {
+      goto CFS_POOLCHECK_PEEK;
+    }
+  }
+
+  // closed by the peer, unexpected data or error
+
+  return CS_FAILURE;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_PRV_PoolExpired
+//
+// Tells if a session has reached its maximum lifetime or, when idle,
+// has been idle for too long.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+int
+  CFS_PRV_PoolExpired
+    (CFS_POOL* pPool,
+     CFS_SESSION* This,
+     time_t now,
+     int idle) {
+
+  if (pPool->maxLifetime > 0 && now - This->created >= pPool->maxLifetime) {
+    return 1;
+  }
+
+  if (idle && pPool->idleTimeout > 0 && 
+      now - This->released >= pPool->idleTimeout) {
+    return 1;
+  }
+
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_PRV_PoolKey
+//
+// Returns the pool key for a configuration name or, without one, for
+// a host and port. The key is created if it does not exist.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CFS_POOL_KEY*
+  CFS_PRV_PoolKey
+    (CFS_POOL* pPool,
+     char* szConfig,
+     char* szHost,
+     char* szPort) {
+
+  char szKey[CFS_POOL_KEY_MAX];
+
+  CFS_POOL_KEY* pKey;
+
+  if (szConfig != NULL) {
+    snprintf(szKey, CFS_POOL_KEY_MAX, "%s", szConfig);
+  }
+  else {
+
+    if (szHost == NULL || szPort == NULL) {
+      return NULL;
+    }
+
+    snprintf(szKey, CFS_POOL_KEY_MAX, "%s:%s", szHost, szPort);
+  }
+
+  for (pKey = pPool->pKeys; pKey != NULL; pKey = pKey->next) {
+    if (!strcmp(pKey->szKey, szKey)) {
+      return pKey;
+    }
+  }
+
+  if ((pKey = (CFS_POOL_KEY*)malloc(sizeof(CFS_POOL_KEY))) == NULL) {
+    return NULL;
+  }
+
+  pKey->pPool = pPool;
+  strcpy(pKey->szKey, szKey);
+  pKey->szHost[0] = 0;
+  pKey->szPort[0] = 0;
+  pKey->numIdle = 0;
+  pKey->pIdle = NULL;
+  pKey->pResume = NULL;
+
+  pKey->next = pPool->pKeys;
+  pPool->pKeys = pKey;
+
+  return pKey;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_PRV_PoolResume
+//
+// Keeps the TLS session of a connection so that the next connection
+// to the same key can resume it instead of doing a full handshake.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+void
+  CFS_PRV_PoolResume
+    (CFS_POOL_KEY* pKey,
+     CFS_SESSION* This) {
+
+  SSL_SESSION* pResume;
+
+  if ((pResume = SSL_get1_session(This->ssl)) == NULL) {
+    return;
+  }
+
+  if (!SSL_SESSION_is_resumable(pResume)) {
+    SSL_SESSION_free(pResume);
+    return;
+  }
+
+  if (pKey->pResume != NULL) {
+    SSL_SESSION_free(pKey->pResume);
+  }
+
+  pKey->pResume = pResume;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_CreatePool
+//
+// Creates a pool of outbound sessions opened from the given
+// environment. A pool belongs to the process (and thread) that 
+// created it.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CFS_POOL*
+  CFS_CreatePool
+    (CFSENV* pEnv,
+     int maxIdle,
+     int idleTimeout,
+     int maxLifetime) {
+
+  CFS_POOL* pPool;
+
+  if ((pPool = (CFS_POOL*)malloc(sizeof(CFS_POOL))) == NULL) {
+    return NULL;
+  }
+
+  pPool->pEnv = pEnv;
+  pPool->maxIdle = maxIdle > 0 ? maxIdle : 0;
+  pPool->idleTimeout = idleTimeout > 0 ? idleTimeout : 0;
+  pPool->maxLifetime = maxLifetime > 0 ? maxLifetime : 0;
+  pPool->pKeys = NULL;
+
+  return pPool;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_AcquireSession
+//
+// Returns a connected session for a configuration name or, without
+// one, for a host and port (same as CFS_OpenSession). An idle session
+// of the pool is returned if one is still usable; otherwise, a new
+// session is opened. The session must be given back with
+// CFS_ReleaseSession.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CFS_SESSION*
+  CFS_AcquireSession
+    (CFS_POOL* pPool,
+     char* szConfig,
+     char* szHost,
+     char* szPort) {
+
+  time_t now;
+
+  CFS_POOL_KEY* pKey;
+  CFS_SESSION* Session;
+
+  if (pPool == NULL ||
+      (pKey = CFS_PRV_PoolKey(pPool, szConfig, szHost, szPort)) == NULL) {
+    return NULL;
+  }
+
+  time(&now);
+
+  while ((Session = pKey->pIdle) != NULL) {
+
+    pKey->pIdle = Session->pNextIdle;
+    pKey->numIdle--;
+    Session->pNextIdle = NULL;
+
+    if (!CFS_PRV_PoolExpired(pPool, Session, now, 1) &&
+        CS_SUCCEED(CFS_PRV_PoolCheck(Session))) {
+      return Session;
     }
 
-    free(*pEnv);
-    *pEnv = 0;
-    return CS_SUCCESS;
+    CFS_CloseSession(&Session);
   }
 
-  return CS_FAILURE;
-}
+  if ((Session = CFS_Constructor()) == NULL) {
+    return NULL;
+  }
 
-int 
-  CFS_SSL_VerifyCallback
-    (int status, 
-     X509_STORE_CTX *store) {
+  ////////////////////////////////////////////////////////////////////
+  // The parameters are resolved for each new connection (the 
+  // repository caches the configuration) so that a reloaded 
+  // configuration applies to the next one. A TLS session kept for 
+  // another server can't be resumed.
+  ////////////////////////////////////////////////////////////////////
+
+  if (CS_FAIL(CFS_PRV_SessionConfig(Session, pPool->pEnv,
+                                    szConfig, szHost, szPort))) {
+    CFS_Destructor(&Session);
+    return NULL;
+  }
 
-  char    szBuffer[256];
-  X509*   cert;
-  int     error; 
-  int     depth;
+  if (strcmp(pKey->szHost, Session->szHostName) ||
+      strcmp(pKey->szPort, Session->szPort)) {
 
-  if (status == 0) {
+    if (pKey->pResume != NULL) {
+      SSL_SESSION_free(pKey->pResume);
+      pKey->pResume = NULL;
+    }
 
-    cert = X509_STORE_CTX_get_current_cert(store);
-    depth = X509_STORE_CTX_get_error_depth(store);
-    error = X509_STORE_CTX_get_error(store);
+    strcpy(pKey->szHost, Session->szHostName);
+    strcpy(pKey->szPort, Session->szPort);
+  }
 
-/*
-    printf("CFS - ERROR - TLS Certificate validation"
-           "" error: depth: %d error: %d - %s",
-          depth,
-          error,
-          X509_verify_cert_error_string(error));
-*/
-    X509_NAME_oneline(X509_get_issuer_name(cert), szBuffer, 255);
-/*    
-    printf("\n\tIssuer: %s",
-           szBuffer);
-*/           
-    X509_NAME_oneline(X509_get_subject_name(cert), szBuffer, 255);
-/*    
-    printf("\n\tSubject: %s",
-           szBuffer);
-*/           
+  if (CS_FAIL(CFS_PRV_SessionConnect(Session, 
+                 Session->secMode == 1 ? pKey->pResume : NULL))) {
+    CFS_Destructor(&Session);
+    return NULL;
   }
 
-  return status;
+  Session->pPoolKey = pKey;
+  Session->created = now;
+
+  return Session;
 }
 
-CSRESULT
-  CFS_PRV_SecureLoadTrustStore
-    (CFSENV* pEnv) {
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_ReleaseSession
+//
+// Gives back a session obtained from CFS_AcquireSession. The session
+// is kept for reuse if reuse is set (the caller must have read all
+// the data it expects from the peer), the pool is not full for that
+// key and the session is still usable; otherwise, it is closed.
+//
+//////////////////////////////////////////////////////////////////////////////
 
-  char szFile[129];
-  char szDir[129];
+CSRESULT
+  CFS_ReleaseSession
+    (CFS_POOL* pPool,
+     CFS_SESSION** This,
+     int reuse) {
 
-  char* pszParam;
+  time_t now;
 
-  int useConf;
+  CFS_POOL_KEY* pKey;
+  CFS_SESSION* Session;
+  CFS_SESSION* pExpired;
+  CFS_SESSION** ppNext;
 
-  useConf = 0;
-  if ((pszParam = CFSCFG_LookupParam(pEnv->Config_Secure,
-                            "TLS_VALIDATE_PEER_DEPTH")) != NULL) {
-    useConf = 1;
-    SSL_CTX_set_verify_depth(pEnv->ctx, (int)strtol(pszParam, 0, 10));
+  if (This == NULL || *This == NULL) {
+    return CS_FAILURE;
   }
-  
-  if ((pszParam = CFSCFG_LookupParam(pEnv->Config_Secure,
-                              "TLS_CERT_STORE_FILE")) != NULL) {
-    useConf = 1;
-    strcpy(szFile, pszParam); 
+
+  Session = *This;
+  *This = NULL;
+
+  pKey = Session->pPoolKey;
+
+  // A session opened before the key moved to another server is not kept
+
+  if (pKey == NULL || pKey->pPool != pPool ||
+      strcmp(pKey->szHost, Session->szHostName) ||
+      strcmp(pKey->szPort, Session->szPort)) {
+    CFS_CloseSession(&Session);
+    return CS_SUCCESS;
   }
-  else {
-    szFile[0] = 0;
+
+  time(&now);
+
+  if (Session->secMode == 1) {
+    CFS_PRV_PoolResume(pKey, Session);
   }
 
-  if ((pszParam = CFSCFG_LookupParam(pEnv->Config_Secure,
-                              "TLS_CERT_STORE_DIR")) != NULL) {
-    strcpy(szDir, pszParam); 
+  // Close the sessions that have been idle for too long
+
+  ppNext = &(pKey->pIdle);
+
+  while (*ppNext != NULL) {
+
+    if (CFS_PRV_PoolExpired(pPool, *ppNext, now, 1)) {
+
+      pExpired = *ppNext;
+      *ppNext = pExpired->pNextIdle;
+      pKey->numIdle--;
+
+      CFS_CloseSession(&pExpired);
+    }
+    else {
+      ppNext = &((*ppNext)->pNextIdle);
+    }
   }
-  else {
-    szDir[0] = 0;
+
+  if (!reuse || 
+      pKey->numIdle >= pPool->maxIdle ||
+      CFS_PRV_PoolExpired(pPool, Session, now, 0) ||
+      CS_FAIL(CFS_PRV_PoolCheck(Session))) {
+
+    CFS_CloseSession(&Session);
+    return CS_SUCCESS;
   }
 
-  if (useConf) {
-    SSL_CTX_load_verify_locations(pEnv->ctx,
-                                  szFile[0] == 0 ? NULL: szFile,
-                                  szDir[0] == 0 ? NULL: szDir);
+  Session->readReady = 0;
+  Session->released = now;
+  Session->pNextIdle = pKey->pIdle;
+
+  pKey->pIdle = Session;
+  pKey->numIdle++;
+
+  return CS_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_ClosePool
+//
+// Closes the idle sessions of a pool and releases it. All sessions 
+// acquired from the pool must have been released.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  CFS_ClosePool
+    (CFS_POOL** pPool) {
+
+  CFS_POOL_KEY* pKey;
+  CFS_SESSION* Session;
+
+  if (pPool == NULL || *pPool == NULL) {
+    return CS_FAILURE;
   }
-  else {
-    SSL_CTX_set_default_verify_paths(pEnv->ctx);
+
+  while ((pKey = (*pPool)->pKeys) != NULL) {
+
+    while ((Session = pKey->pIdle) != NULL) {
+      pKey->pIdle = Session->pNextIdle;
+      CFS_CloseSession(&Session);
+    }
+
+    if (pKey->pResume != NULL) {
+      SSL_SESSION_free(pKey->pResume);
+    }
+
+    (*pPool)->pKeys = pKey->next;
+    free(pKey);
   }
 
+  free(*pPool);
+  *pPool = NULL;
+
   return CS_SUCCESS;
 }
 
-static int
-  CFS_PRV_CALLBACK_Password
-    (char *buf,
-     int size,
-     int rwflag,
-     void *userdata) {
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_QueryPendingSize
+//
+// This function returns the number of bytes already received and
+// buffered by the session that can be read without waiting on the
+// socket descriptor. Only secure sessions buffer data; an event driven
+// caller must drain this data before waiting for the descriptor to
+// become readable again.
+//
+//////////////////////////////////////////////////////////////////////////////
 
-  char *password;
-  int password_length;
-  
-  password = getenv("CFS_SSL_CERTKEYPWD");
-  password_length = strlen(password);
+long
+  CFS_QueryPendingSize
+    (CFS_SESSION* This) {
 
-  if ((password_length + 1) > size) {
-    // password too large
-    return 0;
+  if (This->secMode == 1) {
+    return (long)SSL_pending(This->ssl);
   }
-  
-  strcpy(buf,password);
-  return password_length;
 
+  return 0;
 }
 
 //////////////////////////////////////////////////////////////////////////////
 //
-// CFS_CloseSession
+// CFS_QuerySessionInfo
 //
-// This function closes a client session.
+// This function retrieves session information.
 //
 //////////////////////////////////////////////////////////////////////////////
 
-CSRESULT
-  CFS_CloseSession
-    (CFS_SESSION** This) {
-
-  if (This != NULL && *This != NULL) {
+SESSIONINFO*
+  CFS_QuerySessionInfo
+    (CFS_SESSION* This) {
 
-    if ((*This)->secMode == 1) {
-      SSL_shutdown((*This)->ssl);
-      SSL_free((*This)->ssl);
-    }
+  return &(This->info);
+}
 
-    close((*This)->connfd);
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_SetReadReady
+//
+// This function tells the session that its descriptor was reported 
+// readable, typically by the epoll instance of an event driven caller;
+// the next read will not poll the descriptor before receiving. Secure
+// sessions always try reading first and ignore this notification.
+//
+//////////////////////////////////////////////////////////////////////////////
 
-    CFS_Destructor(This);
-    return CS_SUCCESS;
-  }
+void
+  CFS_SetReadReady
+    (CFS_SESSION* This) {
 
-  return CS_FAILURE;
+  This->readReady = 1;
 }
 
 //////////////////////////////////////////////////////////////////////////////
 //
-// CFS_OpenEnv
+// CFS_ReceiveDescriptor
 //
-// This function creates a global environment
+// This function receives a file (socket) descriptor from another process.
+// It is assumed that the caller has already established a connection to
+// the other process via a local domain (UNIX) socket.
 //
 //////////////////////////////////////////////////////////////////////////////
 
-CFSENV*
-  CFS_OpenEnv
-    (char* szConfig) {
-  
-  CFSENV* pEnv;
-  char* pszParam;
+CSRESULT
+  CFS_ReceiveDescriptor
+    (int fd,
+     int* descriptor,
+     int timeout) {
 
-  pEnv = (CFSENV*)malloc(sizeof(CFSENV));
-  
-  if (szConfig == 0) {
+  // The peer needs to send some data
+  // even though we will ignore it; this is required
+  // by the sendmsg function.
 
-    // fill environment with default values
+  char dummyByte = 0;
 
-    pEnv->readTimeout    = 20;
-    pEnv->writeTimeout   = 20;
-    pEnv->connectTimeout = 20;
-    pEnv->secMode        = 0;
-    pEnv->Config_Session = 0;
-    pEnv->Config_Secure  = 0;
+  struct iovec iov[1];
 
-    return pEnv;
-  }
-  else {
+  struct pollfd fdset[1];
 
-    pEnv->pRepo = CFSRPS_Open(0);
+  struct msghdr msgInstance;
 
-    if ((pEnv->Config_Session = 
-              CFSRPS_OpenConfig(pEnv->pRepo, szConfig)) == NULL) {
-      goto CFS_OPENENV_ERROR;
-    }  
+  int rc;
 
-    if ((pszParam = 
-             CFSCFG_LookupParam(pEnv->Config_Session, "CONN_TO")) == NULL) {
-      pEnv->connectTimeout = 20;
-    }
-    else {
-      pEnv->connectTimeout = (int)strtol(pszParam, 0, 10);
-    }
+  //////////////////////////////////////////////////////////////////////////
+  // ancillary (control) data.
+  // This is where the descriptor will be held.
+  //////////////////////////////////////////////////////////////////////////
 
-    if ((pszParam = 
-            CFSCFG_LookupParam(pEnv->Config_Session,"READ_TO")) == NULL) {
-      pEnv->readTimeout = 20;
-    }
-    else {
-      pEnv->readTimeout = (int)strtol(pszParam, 0, 10);
-    }
+#ifdef MSGHDR_MSG_CONTROL
+
+  union {
+    struct cmsghdr cm;
+    char control[CMSG_SPACE(sizeof(int))];
+  } control_un;
+
+  struct cmsghdr* cmptr;
+
+  msgInstance.msg_control = control_un.control;
+  msgInstance.msg_controllen = sizeof(control_un.control);
+
+#else
+
+  int receivedFD;
+  msgInstance.msg_accrights = (caddr_t)&receivedFD;
+  msgInstance.msg_accrightslen = sizeof(int);
+
+#endif
+
+  msgInstance.msg_name = NULL;
+  msgInstance.msg_namelen = 0;
 
-    if ((pszParam = 
-            CFSCFG_LookupParam(pEnv->Config_Session, "WRITE_TO")) == NULL) {
-      pEnv->writeTimeout = 20;
-    }
-    else {
-      pEnv->writeTimeout = (int)strtol(pszParam, 0, 10);
-    }
+  iov[0].iov_base = &dummyByte;
+  iov[0].iov_len = 1;
 
-    if ((pszParam = 
-            CFSCFG_LookupParam(pEnv->Config_Session, 
-                                "SECURE_CONFIG")) != NULL) {
+  msgInstance.msg_iov = iov;
+  msgInstance.msg_iovlen = 1;
 
-      if ((pEnv->Config_Secure = 
-               CFSRPS_OpenConfig(pEnv->pRepo, pszParam)) == NULL) {
-        pEnv->Config_Secure = NULL;
-        goto CFS_OPENENV_ERROR;
-      }  
+  //////////////////////////////////////////////////////////////////////////
+  // This branching label for restarting an interrupted poll call.
+  // An interrupted system call may results from a caught signal
+  // and will have errno set to EINTR. We must call poll again.
 
-      // Seed random number generator
-      //RAND_load_file("/dev/random", 256);
+  CFS_WAIT_DESCRIPTOR:
 
-      // Load secure configuration
-      SSL_library_init();
-      OpenSSL_add_all_algorithms();
-      SSL_load_error_strings();
-    
-      if ((pszParam = 
-             CFSCFG_LookupParam(pEnv->Config_Secure, 
-                                 "TLS_SESSION_TYPE")) == NULL) {
-        goto CFS_OPENENV_ERROR;
-      }
-    
-      if (!strcmp("*CLIENT", pszParam)) {
+  //
+  //////////////////////////////////////////////////////////////////////////
 
-        pEnv->ctx = SSL_CTX_new(TLS_client_method());
+  *descriptor = -1;
 
-        // By default, we make a client validate peer certificates; OpenSSL
-        // does not validate certificatesd by default. Unfortunately, we 
-        // must duplicate certificate validation code if the configuration
-        // verify key value is missing for client sessions.
+  fdset[0].fd = fd;
+  fdset[0].events = POLLIN;
 
-        if ((pszParam = 
-                CFSCFG_LookupParam(pEnv->Config_Secure, 
-                                       "TLS_VALIDATE_PEER")) == NULL) {
+  rc = poll(fdset, 1, timeout >= 0 ? timeout * 1000: -1);
 
-          SSL_CTX_set_verify(pEnv->ctx, 
-                             SSL_VERIFY_PEER, CFS_SSL_VerifyCallback);
-          CFS_PRV_SecureLoadTrustStore(pEnv);
-        }
-        else {
-          if (!strcmp(pszParam, "*YES")) {
+  switch(rc) {
 
-            SSL_CTX_set_verify(pEnv->ctx, 
-                               SSL_VERIFY_PEER, CFS_SSL_VerifyCallback);
-            CFS_PRV_SecureLoadTrustStore(pEnv);
-          }
-          else {
-            SSL_CTX_set_verify(pEnv->ctx, 
-                               SSL_VERIFY_NONE, CFS_SSL_VerifyCallback);
-          }
-        }
-      }
-      else {
+    case 0:  // timed-out
 
-        pEnv->ctx = SSL_CTX_new(TLS_server_method());
+      rc = CS_FAILURE | CFS_OPER_WAIT | CFS_DIAG_TIMEDOUT;
+      break;
 
-        // Server certificate
-        if ((pszParam = 
-                CFSCFG_LookupParam(pEnv->Config_Secure, 
-                                   "TLS_CERT_FILE")) != NULL) {
+    case 1:  // descriptor is ready
 
-          if (SSL_CTX_use_certificate_file(pEnv->ctx, 
-                                pszParam, SSL_FILETYPE_PEM) <= 0) {
-            goto CFS_OPENENV_ERROR;
-          }
+      if (fdset[0].revents & POLLIN) {
 
-          if ((pszParam = 
-                   CFSCFG_LookupParam(pEnv->Config_Secure, 
-                                      "TLS_CERT_KEY_FILE")) != NULL) {
+        // get the descriptor
 
-            if (SSL_CTX_use_PrivateKey_file(pEnv->ctx, 
-                                  pszParam, SSL_FILETYPE_PEM) <= 0 ) {
-              goto CFS_OPENENV_ERROR;
-            }
-          }
-          else {
-            goto CFS_OPENENV_ERROR;
-          }
-        }
-        else {
-          goto CFS_OPENENV_ERROR;
-        }
+        rc = recvmsg(fd, &msgInstance, 0);
 
-        // For server sessions, we do not validate client certificates 
-        // by default, unless the configuration states otherwise.
+        if (rc > 0) {
 
-        if ((pszParam = 
-                CFSCFG_LookupParam(pEnv->Config_Secure, 
-                                   "TLS_VALIDATE_PEER")) != NULL) {
+          // Assume the rest will fail
+          rc = CS_FAILURE | CFS_OPER_READ | CFS_DIAG_SYSTEM;
 
-          if (!strcmp(pszParam, "*YES")) {
+#ifdef MSGHDR_MSG_CONTROL
 
-            STACK_OF(X509_NAME) *certs;
-  
-            if ((pszParam = 
-                    CFSCFG_LookupParam(pEnv->Config_Secure, 
-                                       "TLS_CA_LIST_FILE")) != NULL) {
+          if ( (cmptr = CMSG_FIRSTHDR(&msgInstance)) != NULL) {
 
-              certs = SSL_load_client_CA_file(pszParam);
+            if (cmptr->cmsg_len == CMSG_LEN(sizeof(int))) {
 
-              if (certs != NULL) {
+              if (cmptr->cmsg_level == SOL_SOCKET &&
+                  cmptr->cmsg_type  == SCM_RIGHTS) {
 
-                // Note that the following function will have 
-                // the context take ownership
-                // of the stack and free it when the context is freed.
-                SSL_CTX_set_client_CA_list(pEnv->ctx, certs);
+                *descriptor = *((int*)CMSG_DATA(cmptr));
+                rc = CS_SUCCESS;
 
-                if ((pszParam = 
-                        CFSCFG_LookupParam(pEnv->Config_Secure, 
-                                           "TLS_CA_LIST_DIR")) != NULL) { 
-                  SSL_add_dir_cert_subjects_to_stack(certs, pszParam);
-                }  
               }
             }
           }
-        }
-
-        if ((pszParam = 
-                CFSCFG_LookupParam(pEnv->Config_Secure, 
-                                   "TLS_PWD_CALLBACK_USERDATA")) != NULL) {
-          
-          strcpy(g_CFS_TLS_UserData, pszParam);
-          SSL_CTX_set_default_passwd_cb_userdata(pEnv->ctx, 
-                                          (void*)g_CFS_TLS_UserData);
-        }
-        else {
-
-        }
-          
-        if ((pszParam = 
-                 CFSCFG_LookupParam(pEnv->Config_Secure, 
-                                    "TLS_PWD_CALLBACK_INPROCSERVER")) != NULL) {
-
-          char szLib[256];
 
-          strcpy(szLib, pszParam);
+#else
 
-          if ((pszParam = 
-                  CFSCFG_LookupParam(pEnv->Config_Secure, 
-                                     "TLS_PWD_CALLBACK_EXPORT")) != NULL) {
+          if (msgInstance.msg_accrightslen == sizeof(receivedFD)) {
 
-            // the password callback function is exported from a shared library
- 
-            PASSWORD_CALLBACK_Export pwdCb;
-            void* inprocServer = dlopen(szLib, RTLD_NOW);
+            *descriptor = receivedFD;
+            rc = CS_SUCCESS;
+          }
 
-            pwdCb = dlsym(inprocServer, pszParam);
+#endif
 
-            SSL_CTX_set_default_passwd_cb(pEnv->ctx, pwdCb);
-          }
-          else {
-            goto CFS_OPENENV_ERROR;
-          }  
         }
         else {
-          // default password callback if not provided from so export
-          SSL_CTX_set_default_passwd_cb(pEnv->ctx, CFS_PRV_CALLBACK_Password);
+          rc = rc == 0 ? CS_FAILURE | CFS_OPER_READ | CFS_DIAG_CONNCLOSE :
+                         CS_FAILURE | CFS_OPER_READ | CFS_DIAG_SYSTEM;
         }
       }
+      else {
+        rc = CS_FAILURE | CFS_OPER_WAIT | CFS_DIAG_SYSTEM;
+      }
 
-      pEnv->secMode = 1;
-    }
-    else {
-     pEnv->Config_Secure = NULL;
-     pEnv->secMode = 0;
-    }
+      break;
 
-    CFSRPS_CloseConfig(pEnv->pRepo, &(pEnv->Config_Session));
-    CFSRPS_CloseConfig(pEnv->pRepo, &(pEnv->Config_Secure));
-    CFSRPS_Close(&(pEnv->pRepo));
+    default:
 
-    return pEnv;
-  }
+      if (errno == EINTR) {
 
-  ///////////////////////////////////////////////////////////////
-  //
-  CFS_OPENENV_ERROR:
-  //
-  CFSRPS_CloseConfig(pEnv->pRepo, &(pEnv->Config_Session));
-  CFSRPS_CloseConfig(pEnv->pRepo, &(pEnv->Config_Secure));
-  CFSRPS_Close(&(pEnv->pRepo));
-  free(pEnv);
+        goto CFS_WAIT_DESCRIPTOR;
+      }
+      else {
+        rc = CS_FAILURE | CFS_OPER_WAIT | CFS_DIAG_SYSTEM;
+      }
 
-  return 0;
+      break;
+   }
+
+   return rc;
 }
 
 //////////////////////////////////////////////////////////////////////////////
 //
-// CFS_OpenChannel
+// CFS_SendDescriptor
 //
-// This function initializes a server session.
+// This function sends a file (socket) descriptor to another process.
+// The caller has already established a connection to the other process
+// via a local domain (UNIX) socket.
 //
 //////////////////////////////////////////////////////////////////////////////
 
-CFS_SESSION*
-  CFS_OpenChannel
-    (CFSENV* pEnv,
-     int connfd) {
+CSRESULT
+  CFS_SendDescriptor
+    (int fd,
+     int descriptor,
+     int timeout) {
 
-  int rc;
+   struct iovec iov[1];
 
-  CFS_SESSION* Session;
+   struct pollfd fdset[1];
 
-  struct pollfd fdset[1];
+   struct msghdr msgInstance;
 
-  Session = CFS_Constructor();
+   int rc;
 
-  Session->connfd         = connfd;
+   // We need to send some data, even though it will be ignored
+   // by the peer
 
-  if (pEnv != NULL) {
-    Session->connectTimeout = pEnv->connectTimeout;
-    Session->readTimeout    = pEnv->readTimeout;
-    Session->writeTimeout   = pEnv->writeTimeout;
-    Session->secMode        = pEnv->secMode;
-    Session->pEnv           = pEnv;
-  }
-  else {
-    Session->connectTimeout = 20;
-    Session->readTimeout    = 20;
-    Session->writeTimeout   = 20;
-    Session->secMode        = 0;
-    Session->pEnv           = pEnv;
-  }
+   char dummyByte = 0;
+
+   //////////////////////////////////////////////////////////////////////////
+   // ancillary (control) data.
+   // This is where the descriptor will be held.
+   //////////////////////////////////////////////////////////////////////////
+
+#ifdef MSGHDR_MSG_CONTROL
 
-  if (Session->secMode == 1) {
+   //////////////////////////////////////////////////////////////////////////
+   // We are using a cmsghdr to pass along the ancillary data ...
+   // This union is to properly align the cmsghdr structure with the data
+   // buffer that will hold the descriptor.
+   //////////////////////////////////////////////////////////////////////////
 
-    // use TLS functions
-    Session->lpVtbl = &secureVtbl;
+   union {
+      struct cmsghdr cm;
+      char control[CMSG_SPACE(sizeof(int))];
+   } control_un;
 
-    // perform handshake
+   struct cmsghdr* cmptr;
 
-    Session->ssl = SSL_new(Session->pEnv->ctx);
-    
-    // Set socket to NON-blocking mode
-    CFS_PRV_SetBlocking(Session->connfd, 0);
+   //////////////////////////////////////////////////////////////////////////
+   //  Initialise the msghdr with the ancillary data and
+   //  ancillary data length.
+   //////////////////////////////////////////////////////////////////////////
 
-    SSL_set_fd(Session->ssl, Session->connfd);
+   msgInstance.msg_control    = control_un.control;
+   msgInstance.msg_controllen = sizeof(control_un.control);
 
-    while (1) 
-    {
-      rc = SSL_accept(Session->ssl); 
+   //////////////////////////////////////////////////////////////////////////
+   //  Initialise the ancillary data itself with the
+   //  descriptor to pass along sendmsg().
+   //////////////////////////////////////////////////////////////////////////
 
-      switch (SSL_get_error(Session->ssl, rc))
-      {
-        case SSL_ERROR_NONE:
+   // point to first (and only) ancillary data entry.
+   cmptr = CMSG_FIRSTHDR(&msgInstance);
 
-          return Session;
+   // initialise ancillary data header.
+   cmptr->cmsg_len   = CMSG_LEN(sizeof(int));  // size of descriptor
+   cmptr->cmsg_level = SOL_SOCKET;
+   cmptr->cmsg_type  = SCM_RIGHTS;
 
-        case SSL_ERROR_ZERO_RETURN:
+   //////////////////////////////////////////////////////////////////////////
+   // Assign the descriptor to ancillary data
+   //
+   // CMSG_DATA will return the address of the first data byte,
+   // which is located somewhere in the control_un.control array.
+   // To assign the descriptor, which is an integer, we must cast
+   // this address to int* and dereference the address to set
+   // it to the descriptor value.
+   //////////////////////////////////////////////////////////////////////////
 
-          goto CFS_OPENCHANNEL_CLOSE_SSL;
+   *((int*)CMSG_DATA(cmptr)) = descriptor;
 
-        case SSL_ERROR_WANT_READ:
+#else
 
-          fdset[0].fd = Session->connfd;
-          fdset[0].events = POLLIN;
+   msgInstance.msg_accrights = (caddr_t)&descriptor;
+   msgInstance.msg_accrightslen = sizeof(descriptor);
 
-          CFS_OPENCHANNEL_POLL_READ:
+#endif
 
-          rc = poll(fdset, 1,
-                    Session->connectTimeout >= 0 ? 
-                    Session->connectTimeout * 1000: -1);
+   msgInstance.msg_name    = NULL;
+   msgInstance.msg_namelen = 0;
 
-          if (rc == 1) {
+   iov[0].iov_base = &dummyByte;
+   iov[0].iov_len = 1;
 
-            /////////////////////////////////////////////////////////
-            // If we get anything other than POLLIN
-            // this means we got an error.
-            /////////////////////////////////////////////////////////
+   msgInstance.msg_iov = iov;
+   msgInstance.msg_iovlen = 1;
 
-            if (!(fdset[0].revents & POLLIN)) {
-              goto CFS_OPENCHANNEL_CLOSE_SSL;
-            }
-          }
-          else {
+   //////////////////////////////////////////////////////////////////////////
+   // Send the descriptor via the stream pipe descriptor.
+   //////////////////////////////////////////////////////////////////////////
 
-            if (rc == 0) { // timed out
-              goto CFS_OPENCHANNEL_CLOSE_SSL;
-            }
-            else {
+   //////////////////////////////////////////////////////////////////////////
+   // This branching label for restarting an interrupted poll call.
+   // An interrupted system call may results from a caught signal
+   // and will have errno set to EINTR. We must call poll again.
 
-              if (errno == EINTR) { // poll() interrupted
-                goto CFS_OPENCHANNEL_POLL_READ;
-              }
-              else { // system error
-                goto CFS_OPENCHANNEL_CLOSE_SSL;
-              }
-            }
-          }
+   CFS_WAIT_DESCRIPTOR:
 
-          break;
+   //
+   //////////////////////////////////////////////////////////////////////////
 
-        case SSL_ERROR_WANT_WRITE:
+   fdset[0].fd = fd;
+   fdset[0].events = POLLOUT;
 
-          fdset[0].fd = Session->connfd;
-          fdset[0].events = POLLOUT;
+   rc = poll(fdset, 1, timeout >= 0 ? timeout * 1000: -1);
 
-          CFS_OPENCHANNEL_POLL_WRITE:
+   switch(rc) {
 
-          rc = poll(fdset, 1,
-                    Session->connectTimeout >= 0 ? 
-                    Session->connectTimeout * 1000: -1);
+      case 0:  // timed-out
 
-          if (rc == 1) {
+         rc = CS_FAILURE | CFS_OPER_WAIT | CFS_DIAG_TIMEDOUT;
+         break;
 
-            /////////////////////////////////////////////////////////
-            // If we get anything other than POLLOUT
-            // this means we got an error.
-            /////////////////////////////////////////////////////////
+      case 1:  // descriptor is ready
 
-            if (!(fdset[0].revents & POLLOUT)) {
-              goto CFS_OPENCHANNEL_CLOSE_SSL;
-            }
-          }
-          else {
+         if(fdset[0].revents == POLLOUT) {
 
-            if (rc == 0) { // timed out
-              goto CFS_OPENCHANNEL_CLOSE_SSL;
+            rc = sendmsg(fd, &msgInstance, 0);
+
+            if (rc < 0) {
+               rc = CS_FAILURE | CFS_OPER_WRITE  | CFS_DIAG_SYSTEM;
             }
             else {
-
-              if (errno == EINTR) { // poll() interrupted
-                goto CFS_OPENCHANNEL_POLL_WRITE;
-              }
-              else { // system error
-                goto CFS_OPENCHANNEL_CLOSE_SSL;
-              }
+               rc = CS_SUCCESS;
             }
-          }
-
-          break;
+         }
+         else {
 
-        default:
+            rc = CS_FAILURE | CFS_OPER_WAIT | CFS_DIAG_SYSTEM;
+         }
 
-          goto CFS_OPENCHANNEL_CLOSE_SSL;
-      }
-    }
+         break;
 
-    CFS_OPENCHANNEL_CLOSE_SSL:
+      default:
 
-    SSL_shutdown(Session->ssl);
-    SSL_free(Session->ssl);
-    close(Session->connfd);
-    Session->connfd = -1;
-  }
-  else {
+         if (errno == EINTR) {
 
-    // User non-TLS functions
-    Session->lpVtbl = &dftVtbl;
+            goto CFS_WAIT_DESCRIPTOR;
+         }
+         else {
+            rc = CS_FAILURE | CFS_OPER_WAIT | CFS_DIAG_SYSTEM;
+         }
 
-    // Set socket to blocking mode
-    CFS_PRV_SetBlocking(Session->connfd, 1);
-    return Session;
-  }
+         break;
+   }
 
-  return 0;
+   return rc;
 }
 
 //////////////////////////////////////////////////////////////////////////////
 //
-// CFS_OpenSession
+// CFS_ReceiveDescriptors
 //
-// This function initialises a connection to a server.
+// This function receives up to CFS_MAX_DESCRIPTORS file (socket)
+// descriptors sent by another process in a single message. On input,
+// count holds the capacity of the descriptors array; on output, it
+// holds the number of descriptors received.
 //
 //////////////////////////////////////////////////////////////////////////////
 
-CFS_SESSION*
-  CFS_OpenSession
-    (CFSENV* pEnv,
-     char* szConfig,
-     char* szHost,
-     char* szPort) {
+CSRESULT
+  CFS_ReceiveDescriptors
+    (int fd,
+     int* descriptors,
+     int* count,
+     int timeout) {
 
-  int rc;
-  
-  char* pszHost;
-  char* pszPort;
-  char* pszParam;
-  
-  CSRESULT hResult;
+  // The peer sends the number of descriptors as data
 
-  CFSRPS pRepo;
-  CFSCFG pConfig;
+  unsigned char numDescriptors = 0;
 
-  struct addrinfo* addrInfo;
-  struct addrinfo* addrInfo_first;
-  struct addrinfo  hints;
+  int i;
+  int rc;
+  int maxCount;
+
+  struct iovec iov[1];
 
   struct pollfd fdset[1];
 
-  CFS_SESSION* Session;
+  struct msghdr msgInstance;
 
-  Session = CFS_Constructor();
+  union {
+    struct cmsghdr cm;
+    char control[CMSG_SPACE(sizeof(int) * CFS_MAX_DESCRIPTORS)];
+  } control_un;
 
-  if (pEnv == NULL) {
+  struct cmsghdr* cmptr;
 
-    Session->secMode        = 0;
-    Session->connectTimeout = 20;
-    Session->readTimeout    = 20;
-    Session->writeTimeout   = 20;
-  }
-  else {
+  maxCount = *count > CFS_MAX_DESCRIPTORS ? CFS_MAX_DESCRIPTORS : *count;
+  *count = 0;
+
+  msgInstance.msg_control = control_un.control;
+  msgInstance.msg_controllen = CMSG_SPACE(sizeof(int) * maxCount);
+  msgInstance.msg_name = NULL;
+  msgInstance.msg_namelen = 0;
+  msgInstance.msg_flags = 0;
+
+  iov[0].iov_base = &numDescriptors;
+  iov[0].iov_len = 1;
+
+  msgInstance.msg_iov = iov;
+  msgInstance.msg_iovlen = 1;
+
+  //////////////////////////////////////////////////////////////////////////
+  // This branching label for restarting an interrupted poll call.
+  // An interrupted system call may results from a caught signal
+  // and will have errno set to EINTR. We must call poll again.
+
+  CFS_WAIT_DESCRIPTORS:
+
+  //
+  //////////////////////////////////////////////////////////////////////////
+
+  fdset[0].fd = fd;
+  fdset[0].events = POLLIN;
+
+  rc = poll(fdset, 1, timeout >= 0 ? timeout * 1000: -1);
+
+  switch(rc) {
+
+    case 0:  // timed-out
+
+      rc = CS_FAILURE | CFS_OPER_WAIT | CFS_DIAG_TIMEDOUT;
+      break;
+
+    case 1:  // descriptor is ready
+
+      if (fdset[0].revents & POLLIN) {
+
+        rc = recvmsg(fd, &msgInstance, MSG_CMSG_CLOEXEC);
+
+        if (rc > 0) {
+
+          // Assume the rest will fail
+          rc = CS_FAILURE | CFS_OPER_READ | CFS_DIAG_SYSTEM;
 
-    Session->secMode        = pEnv->secMode;
-    Session->connectTimeout = pEnv->connectTimeout;
-    Session->readTimeout    = pEnv->readTimeout;
-    Session->writeTimeout   = pEnv->writeTimeout;
-  }
+          if ( (cmptr = CMSG_FIRSTHDR(&msgInstance)) != NULL) {
 
-  if (szConfig) {
+            if (cmptr->cmsg_level == SOL_SOCKET &&
+                cmptr->cmsg_type  == SCM_RIGHTS) {
 
-    pRepo = CFSRPS_Open(0);
+              *count = (cmptr->cmsg_len - CMSG_LEN(0)) / sizeof(int);
 
-    if ((pConfig = CFSRPS_OpenConfig(pRepo, szConfig)) == NULL) {
-      CFSRPS_Close(&pRepo);
-      return NULL;
-    }  
+              for (i=0; i<*count; i++) {
+                descriptors[i] = ((int*)CMSG_DATA(cmptr))[i];
+              }
 
-    if ((pszHost = CFSCFG_LookupParam(pConfig, "HOST")) == NULL) {
-      CFSRPS_CloseConfig(pRepo, &pConfig);
-      CFSRPS_Close(&pRepo);
-      return NULL;
-    }
+              rc = (msgInstance.msg_flags & MSG_CTRUNC) ?
+                       CS_SUCCESS | CFS_DIAG_PARTIALDATA :
+                       CS_SUCCESS;
+            }
+          }
+        }
+        else {
+          rc = rc == 0 ? CS_FAILURE | CFS_OPER_READ | CFS_DIAG_CONNCLOSE :
+                         CS_FAILURE | CFS_OPER_READ | CFS_DIAG_SYSTEM;
+        }
+      }
+      else {
+        rc = CS_FAILURE | CFS_OPER_WAIT | CFS_DIAG_SYSTEM;
+      }
 
-    strncpy(Session->szHostName, pszHost, 256);
-    Session->szHostName[255] = 0;
+      break;
 
-    if ((pszPort = CFSCFG_LookupParam(pConfig, "PORT")) == NULL) {
-      CFSRPS_CloseConfig(pRepo, &pConfig);
-      CFSRPS_Close(&pConfig);
-      return NULL;
-    }
+    default:
 
-    strncpy(Session->szPort, pszPort, 11);
-    Session->szPort[10] = 0;
+      if (errno == EINTR) {
 
-    // Configuration overrides on the environment
+        goto CFS_WAIT_DESCRIPTORS;
+      }
+      else {
+        rc = CS_FAILURE | CFS_OPER_WAIT | CFS_DIAG_SYSTEM;
+      }
 
-    if ((pszParam = CFSCFG_LookupParam(pConfig, "CONN_TO")) != NULL) {
-      Session->connectTimeout = (int)strtol(pszParam, 0, 10);
-    }
+      break;
+   }
 
-    if ((pszParam = CFSCFG_LookupParam(pConfig, "READ_TO")) != NULL) {
-      Session->readTimeout = (int)strtol(pszParam, 0, 10);
-    }
+   return rc;
+}
 
-    if ((pszParam = CFSCFG_LookupParam(pConfig, "WRITE_TO")) != NULL) {
-      Session->writeTimeout = (int)strtol(pszParam, 0, 10);    
-    }
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_RunZygote
+//
+// Turns an initialized handler into a zygote: a template from which
+// the main daemon obtains new handlers. The daemon requests a handler 
+// by sending the handler half of a new stream pipe on the zygote 
+// stream; the handler is cloned from this process with the daemon as
+// its parent (the daemon reaps it as any other handler) and inherits
+// the initialized state. The PID of the new handler (or -1) is sent
+// back to the daemon; our own PID is sent first, to tell the daemon 
+// that we are initialized.
+//
+// In a new handler, this function returns the handler's stream pipe.
+// In the zygote, it returns -1 once the daemon has closed the zygote 
+// stream; the caller then releases its state and exits. The zygote
+// stream is closed in both cases.
+//
+//////////////////////////////////////////////////////////////////////////////
 
-    CFSRPS_CloseConfig(pRepo, &pConfig);
-    CFSRPS_Close(&pRepo);
-  } 
-  else {
+int
+  CFS_RunZygote
+    (int stream) {
 
-    if (szHost == NULL) {
-      return NULL;
-    }
-    else {
-      strncpy(Session->szHostName, szHost, 256);
-      Session->szHostName[255] = 0;
-    }
+  int count;
+  int handlerfd;
 
-    if (szPort == NULL) {
-      return NULL;
-    }
-    else {
-      strncpy(Session->szPort, szPort, 11);
-      Session->szPort[10] = 0;
-    }
-  }
+  pid_t child;
 
-  Session->info.szHost = Session->szHostName;
-  Session->info.szPort = Session->szPort;
-  Session->info.szLocalPort = 0;
-  Session->info.szRemotePort = 0;
-  
-  Session->pEnv = pEnv;
+  CSRESULT hResult;
 
-  memset(&hints, 0, sizeof(struct addrinfo));
-  hints.ai_family = AF_UNSPEC;
-  hints.ai_socktype = SOCK_STREAM;
+  child = getpid();
 
-  if (getaddrinfo(Session->szHostName,
-                  Session->szPort,
-                  &hints,
-                  &addrInfo) == 0) {
+  send(stream, &child, sizeof(child), MSG_NOSIGNAL);
 
-    addrInfo_first = addrInfo;
+  for (;;) {
 
-    while (addrInfo != 0)
-    {
-      Session->connfd = socket(addrInfo->ai_family,
-                               addrInfo->ai_socktype,
-                               addrInfo->ai_protocol);
+    count = 1;
 
-      if (Session->connfd >= 0) {
+    hResult = CFS_ReceiveDescriptors(stream, &handlerfd, &count, -1);
 
-        // Set socket to non-blocking
-        CFS_PRV_SetBlocking(Session->connfd, 0);
+    if (CS_FAIL(hResult)) {
 
-        rc = connect(Session->connfd,
-                     addrInfo->ai_addr,
-                     addrInfo->ai_addrlen);
+      if (CS_DIAG(hResult) == CFS_DIAG_CONNCLOSE) {
+        break; // daemon has terminated
+      }
 
-        if (rc < 0) {
+      continue;
+    }
 
-          if (errno != EINPROGRESS) {
-            
-            Session->errInfo.csresult = 
-                          CS_FAILURE | CFS_OPER_READ | CFS_DIAG_CONNCLOSE;
-            Session->errInfo.m_errno = errno;
-            Session->errInfo.secrc = 0;
+    if (count != 1) {
+      continue;
+    }
 
-            close(Session->connfd);
-          }
-          else {
+    child = (pid_t)syscall(SYS_clone, CLONE_PARENT | SIGCHLD, 0, 0, 0, 0);
 
-            ////////////////////////////////////////////////////////
-            // The connection is in progress, so we must wait
-            // for the TCP handshgake to complete
-            ////////////////////////////////////////////////////////
+    if (child == 0) {
 
-            fdset[0].fd = Session->connfd;
-            fdset[0].events = POLLOUT;
+      // we are the new handler; we do not outlive the daemon
 
-            CFS_OPENSESSION_CONNECT_POLL_READ:
+      close(stream);
+      prctl(PR_SET_PDEATHSIG, SIGKILL);
 
-            rc = poll(fdset, 1,
-                      Session->connectTimeout >= 0 ? 
-                      Session->connectTimeout * 1000: -1);
+      return handlerfd;
+    }
 
-            if (rc == 1) {
+    close(handlerfd);
 
-              /////////////////////////////////////////////////////////
-              // If we get anything other than POLLOUT
-              // this means we got an error.
-              /////////////////////////////////////////////////////////
- 
-              if (fdset[0].revents & POLLOUT) {
-                // TCP handshake has completed so we are connected
-                hResult = CS_SUCCESS;
-                break;  // leave the connection loop
-              } 
-              else {
+    send(stream, &child, sizeof(child), MSG_NOSIGNAL);
+  }
 
-                Session->errInfo.csresult = 
-                           CS_FAILURE | CFS_OPER_READ | CFS_DIAG_CONNCLOSE;
-                Session->errInfo.m_errno = errno;
-                Session->errInfo.secrc = 0;
+  close(stream);
 
-                close(Session->connfd);
-              }
-            }
-            else {
+  return -1;
+}
 
-              if (rc == 0) {
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_SendDescriptors
+//
+// This function sends up to CFS_MAX_DESCRIPTORS file (socket) descriptors
+// to another process in a single message. The caller has already 
+// established a connection to the other process via a local domain
+// (UNIX) socket.
+//
+//////////////////////////////////////////////////////////////////////////////
 
-                Session->errInfo.csresult = 
-                           CS_FAILURE | CFS_OPER_READ | CFS_DIAG_CONNCLOSE;
-                Session->errInfo.m_errno = errno;
-                Session->errInfo.secrc = 0;
+CSRESULT
+  CFS_SendDescriptors
+    (int fd,
+     int* descriptors,
+     int count,
+     int timeout) {
 
-                close(Session->connfd);
-              }
-              else {
+   int i;
+   int rc;
 
-                if (errno == EINTR) {
-                  goto CFS_OPENSESSION_CONNECT_POLL_READ;
-                }
-                else {
+   unsigned char numDescriptors;
 
-                  Session->errInfo.csresult = 
-                           CS_FAILURE | CFS_OPER_READ | CFS_DIAG_CONNCLOSE;
-                  Session->errInfo.m_errno = errno;
-                  Session->errInfo.secrc = 0;
+   struct iovec iov[1];
 
-                  close(Session->connfd);
-                }
-              }
-            }
-          }
-        }
-        else {
-          hResult = CS_SUCCESS;
-          break;
-        }
-      }
+   struct pollfd fdset[1];
 
-      addrInfo = addrInfo->ai_next;
-    }
+   struct msghdr msgInstance;
 
-    freeaddrinfo(addrInfo_first);
-  }
-  else {
-    hResult = CS_FAILURE;
-  }
+   union {
+      struct cmsghdr cm;
+      char control[CMSG_SPACE(sizeof(int) * CFS_MAX_DESCRIPTORS)];
+   } control_un;
 
-  if (CS_SUCCEED(hResult)) {
+   struct cmsghdr* cmptr;
 
-    if (Session->secMode == 1) {
+   if (count < 1 || count > CFS_MAX_DESCRIPTORS) {
+     return CS_FAILURE | CFS_OPER_WRITE | CFS_DIAG_INVALIDSIZE;
+   }
 
-      // Use TLS functions
-      Session->lpVtbl = &secureVtbl;
+   //////////////////////////////////////////////////////////////////////////
+   // All descriptors are held in a single ancillary data entry;
+   // the data byte tells the peer how many there are.
+   //////////////////////////////////////////////////////////////////////////
 
-      Session->ssl = SSL_new(Session->pEnv->ctx);
+   memset(&control_un, 0, sizeof(control_un));
 
-      SSL_set_tlsext_host_name(Session->ssl, pszHost);
+   msgInstance.msg_control    = control_un.control;
+   msgInstance.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+   msgInstance.msg_flags      = 0;
 
-      SSL_set_fd(Session->ssl, Session->connfd);
+   cmptr = CMSG_FIRSTHDR(&msgInstance);
 
-      while (1) 
-      {
-        rc = SSL_connect(Session->ssl);
+   cmptr->cmsg_len   = CMSG_LEN(sizeof(int) * count);
+   cmptr->cmsg_level = SOL_SOCKET;
+   cmptr->cmsg_type  = SCM_RIGHTS;
 
-        switch (SSL_get_error(Session->ssl, rc))
-        {
-          case SSL_ERROR_NONE:
+   for (i=0; i<count; i++) {
+     ((int*)CMSG_DATA(cmptr))[i] = descriptors[i];
+   }
 
-            // SSL handshake succeeded, we return the session handle
+   numDescriptors = (unsigned char)count;
 
-            /* ---------------------------------------------------------------
-              The following shows how to retrieve information from the 
-              peer certificate
+   msgInstance.msg_name    = NULL;
+   msgInstance.msg_namelen = 0;
 
-              X509 *cert;
-              char *line;
-              cert = SSL_get_peer_certificate(This->ssl); 
-              if ( cert != NULL )
-              {
-                printf("Server certificates:\n");
-                line = X509_NAME_oneline(X509_get_subject_name(cert), 0, 0);
-                printf("Subject: %s\n", line);
-                free(line);       // free the malloc'ed string
-                line = X509_NAME_oneline(X509_get_issuer_name(cert), 0, 0);
-                printf("Issuer: %s\n", line);
-                free(line);       // free the malloc'ed string 
-                X509_free(cert);     // free the malloc'ed certificate copy 
-              }
-              else
-                printf("Info: No client certificates configured.\n");
-              }
-            --------------------------------------------------------------- */
+   iov[0].iov_base = &numDescriptors;
+   iov[0].iov_len = 1;
+
+   msgInstance.msg_iov = iov;
+   msgInstance.msg_iovlen = 1;
+
+   //////////////////////////////////////////////////////////////////////////
+   // This branching label for restarting an interrupted poll call.
+   // An interrupted system call may results from a caught signal
+   // and will have errno set to EINTR. We must call poll again.
 
-            return Session;
+   CFS_WAIT_DESCRIPTORS:
 
-          case SSL_ERROR_ZERO_RETURN:
+   //
+   //////////////////////////////////////////////////////////////////////////
 
-            goto CFS_OPENSESSION_CLOSE_SSL;
+   fdset[0].fd = fd;
+   fdset[0].events = POLLOUT;
 
-          case SSL_ERROR_WANT_READ:
+   rc = poll(fdset, 1, timeout >= 0 ? timeout * 1000: -1);
 
-            fdset[0].fd = Session->connfd;
-            fdset[0].events = POLLIN;
+   switch(rc) {
 
-            CFS_OPENSESSION_POLL_READ:
+      case 0:  // timed-out
 
-            rc = poll(fdset, 1,
-                      Session->connectTimeout >= 0 ? 
-                      Session->connectTimeout * 1000: -1);
+         rc = CS_FAILURE | CFS_OPER_WAIT | CFS_DIAG_TIMEDOUT;
+         break;
 
-            if (rc == 1) {
+      case 1:  // descriptor is ready
 
-              /////////////////////////////////////////////////////////
-              // If we get anything other than POLLIN
-              // this means we got an error.
-              /////////////////////////////////////////////////////////
- 
-              if (!(fdset[0].revents & POLLIN)) {
+         if(fdset[0].revents == POLLOUT) {
 
-                Session->errInfo.csresult = 
-                          CS_FAILURE | CFS_OPER_READ | CFS_DIAG_CONNCLOSE;
-                Session->errInfo.m_errno = errno;
-                Session->errInfo.secrc = 0;
+            rc = sendmsg(fd, &msgInstance, MSG_NOSIGNAL);
 
-                goto CFS_OPENSESSION_CLOSE_SSL;
-              }
+            if (rc < 0) {
+               rc = CS_FAILURE | CFS_OPER_WRITE  | CFS_DIAG_SYSTEM;
             }
             else {
+               rc = CS_SUCCESS;
+            }
+         }
+         else {
 
-              if (rc == 0) { // timed out
+            rc = CS_FAILURE | CFS_OPER_WAIT | CFS_DIAG_SYSTEM;
+         }
 
-                Session->errInfo.csresult = 
-                          CS_FAILURE | CFS_OPER_READ | CFS_DIAG_CONNCLOSE;
-                Session->errInfo.m_errno = errno;
-                Session->errInfo.secrc = 0;
+         break;
 
-                goto CFS_OPENSESSION_CLOSE_SSL;
-              }
-              else {
+      default:
 
-                if (errno == EINTR) { // poll() interrupted
-                  goto CFS_OPENSESSION_POLL_READ;
-                }
-                else { // system error
+         if (errno == EINTR) {
 
-                  Session->errInfo.csresult = 
-                            CS_FAILURE | CFS_OPER_READ | CFS_DIAG_CONNCLOSE;
-                  Session->errInfo.m_errno = errno;
-                  Session->errInfo.secrc = 0;
+            goto CFS_WAIT_DESCRIPTORS;
+         }
+         else {
+            rc = CS_FAILURE | CFS_OPER_WAIT | CFS_DIAG_SYSTEM;
+         }
 
-                  goto CFS_OPENSESSION_CLOSE_SSL;
-                }
-              }
-            }
+         break;
+   }
 
-            break;
+   return rc;
+}
 
-          case SSL_ERROR_WANT_WRITE:
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_SendFile
+//
+// This function sends size bytes of a file, starting at offset. The 
+// kernel copies the file directly to the socket on non-secure sessions
+// and on secure sessions that use kTLS; other secure sessions read and
+// encrypt it one TLS record at a time. On return, size holds the number
+// of bytes sent.
+//
+//////////////////////////////////////////////////////////////////////////////
 
-            fdset[0].fd = Session->connfd;
-            fdset[0].events = POLLOUT;
+CSRESULT
+  CFS_SendFile
+    (CFS_SESSION* This,
+     int fd,
+     off_t offset,
+     long* size,
+     long toSlices) {
 
-            CFS_OPENSESSION_POLL_WRITE:
+  int rc;
+  int to;
 
-            rc = poll(fdset, 1,
-                      Session->connectTimeout >= 0 ? 
-                      Session->connectTimeout * 1000: -1);
+  char record[CFS_TLS_RECORD_SIZE];
 
-            if (rc == 1) {
+  long leftToSend;
+  long length;
 
-              /////////////////////////////////////////////////////////
-              // If we get anything other than POLLOUT
-              // this means we got an error.
-              /////////////////////////////////////////////////////////
- 
-              if (!(fdset[0].revents & POLLOUT)) {
+  ssize_t bytes;
 
-                Session->errInfo.csresult = 
-                          CS_FAILURE | CFS_OPER_READ | CFS_DIAG_CONNCLOSE;
-                Session->errInfo.m_errno = errno;
-                Session->errInfo.secrc = 0;
+  struct pollfd fdset[1];
 
-                goto CFS_OPENSESSION_CLOSE_SSL;
-              }
-            }
-            else {
+  CSRESULT hResult;
 
-              if (rc == 0) { // timed out
+  leftToSend = *size;
+  *size = 0;
 
-                Session->errInfo.csresult = 
-                          CS_FAILURE | CFS_OPER_READ | CFS_DIAG_CONNCLOSE;
-                Session->errInfo.m_errno = errno;
-                Session->errInfo.secrc = 0;
+  if (This->secMode == 1 && !This->ktls) {
 
-                goto CFS_OPENSESSION_CLOSE_SSL;
-              }
-              else {
+    while (leftToSend > 0) {
 
-                if (errno == EINTR) { // poll() interrupted
-                  goto CFS_OPENSESSION_POLL_WRITE;
-                }
-                else { // system error
+      bytes = pread(fd, record, leftToSend > CFS_TLS_RECORD_SIZE ? 
+                                  CFS_TLS_RECORD_SIZE : leftToSend, offset);
 
-                  Session->errInfo.csresult = 
-                            CS_FAILURE | CFS_OPER_READ | CFS_DIAG_CONNCLOSE;
-                  Session->errInfo.m_errno = errno;
-                  Session->errInfo.secrc = 0;
+      if (bytes < 0 && errno == EINTR) {
+        continue;
+      }
 
-                  goto CFS_OPENSESSION_CLOSE_SSL;
-                }
-              }
-            }
+      if (bytes <= 0) {
+        return CS_FAILURE | CFS_OPER_READ | 
+               (bytes == 0 ? CFS_DIAG_PARTIALDATA : CFS_DIAG_SYSTEM);
+      }
 
-            break;
+      length = (long)bytes;
+      hResult = This->lpVtbl->CFS_SendRecord(This, record, &length, toSlices);
 
-          default:
+      *size += length;
 
-            goto CFS_OPENSESSION_CLOSE_SSL;
-        }
+      if (CS_FAIL(hResult)) {
+        return hResult;
       }
 
-      CFS_OPENSESSION_CLOSE_SSL:
-
-      SSL_shutdown(Session->ssl);
-      SSL_free(Session->ssl);
-      close(Session->connfd);
-      Session->connfd = -1;
+      offset += bytes;
+      leftToSend -= bytes;
     }
-    else {
 
-      // Use non-TLS functions
-      Session->lpVtbl = &dftVtbl;
-
-      // Set socket back to blocking
-      CFS_PRV_SetBlocking(Session->connfd, 1);
-      return Session;
-    }
-  }
-  else {
-    close(Session->connfd);
-    Session->connfd = -1;
+    return CS_SUCCESS;
   }
 
-  CFS_Destructor(&Session);
+  to = toSlices * This->writeTimeout;
 
-  return 0;
-}
+  while (leftToSend > 0) {
 
-//////////////////////////////////////////////////////////////////////////////
-//
-// CFS_QuerySessionInfo
-//
-// This function retrieves session information.
-//
-//////////////////////////////////////////////////////////////////////////////
+    ////////////////////////////////////////////////////////////
+    // This branching label for restarting an interrupted
+    // poll call. An interrupted system call may result from
+    // a caught signal and will have errno set to EINTR. We
+    // must call poll again.
 
-SESSIONINFO*
-  CFS_QuerySessionInfo
-    (CFS_SESSION* This) {
+    CFS_WAIT_POLL:
 
-  return &(This->info);
-}
+    //
+    ////////////////////////////////////////////////////////////
 
-//////////////////////////////////////////////////////////////////////////////
-//
-// CFS_ReceiveDescriptor
-//
-// This function receives a file (socket) descriptor from another process.
-// It is assumed that the caller has already established a connection to
-// the other process via a local domain (UNIX) socket.
-//
-//////////////////////////////////////////////////////////////////////////////
+    fdset[0].fd = This->connfd;
+    fdset[0].events = POLLOUT;
 
-CSRESULT
-  CFS_ReceiveDescriptor
-    (int fd,
-     int* descriptor,
-     int timeout) {
+    rc = poll(fdset, 1, to >= 0 ? to * 1000: -1);
 
-  // The peer needs to send some data
-  // even though we will ignore it; this is required
-  // by the sendmsg function.
+    if (rc == 1) {
 
-  char dummyByte = 0;
+      if (!(fdset[0].revents & POLLOUT)) {
+        return CS_FAILURE | CFS_OPER_WAIT | CFS_DIAG_SYSTEM;
+      }
+    }
+    else {
 
-  struct iovec iov[1];
+      if (rc == 0) {
+        return CS_FAILURE | CFS_OPER_WAIT | CFS_DIAG_TIMEDOUT;
+      }
 
-  struct pollfd fdset[1];
+      if (errno == EINTR) {
+        goto CFS_WAIT_POLL;
+      }
 
-  struct msghdr msgInstance;
+      return CS_FAILURE | CFS_OPER_WAIT | CFS_DIAG_SYSTEM;
+    }
 
-  int rc;
+    CFS_WAIT_SEND:
 
-  //////////////////////////////////////////////////////////////////////////
-  // ancillary (control) data.
-  // This is where the descriptor will be held.
-  //////////////////////////////////////////////////////////////////////////
+    bytes = sendfile(This->connfd, fd, &offset, leftToSend);
 
-#ifdef MSGHDR_MSG_CONTROL
+    if (bytes < 0) {
 
-  union {
-    struct cmsghdr cm;
-    char control[CMSG_SPACE(sizeof(int))];
-  } control_un;
+      if (errno == EINTR) {
+        goto CFS_WAIT_SEND;
+      }
 
-  struct cmsghdr* cmptr;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        goto CFS_WAIT_POLL;
+      }
 
-  msgInstance.msg_control = control_un.control;
-  msgInstance.msg_controllen = sizeof(control_un.control);
+      return CS_FAILURE | CFS_OPER_WRITE | CFS_DIAG_SYSTEM;
+    }
 
-#else
+    if (bytes == 0) {
 
-  int receivedFD;
-  msgInstance.msg_accrights = (caddr_t)&receivedFD;
-  msgInstance.msg_accrightslen = sizeof(int);
+      // the file is shorter than expected
 
-#endif
+      return CS_FAILURE | CFS_OPER_WRITE | CFS_DIAG_PARTIALDATA;
+    }
 
-  msgInstance.msg_name = NULL;
-  msgInstance.msg_namelen = 0;
+    if (This->lpVtbl == &scbVtbl && g_CFS_ScoreboardSlot != NULL) {
+      __atomic_add_fetch(&(g_CFS_ScoreboardSlot->bytesOut), 
+                         (uint64_t)bytes, __ATOMIC_RELAXED);
+    }
 
-  iov[0].iov_base = &dummyByte;
-  iov[0].iov_len = 1;
+    *size += bytes;
+    leftToSend -= bytes;
+  }
 
-  msgInstance.msg_iov = iov;
-  msgInstance.msg_iovlen = 1;
+  return CS_SUCCESS;
+}
 
-  //////////////////////////////////////////////////////////////////////////
-  // This branching label for restarting an interrupted poll call.
-  // An interrupted system call may results from a caught signal
-  // and will have errno set to EINTR. We must call poll again.
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_CreateScoreboard
+//
+// This function creates (or truncates) a scoreboard file with the given
+// number of slots and maps it in memory. Used by the main daemon, which 
+// passes the file path to its handlers in the CFS_SCOREBOARD environment
+// variable.
+//
+//////////////////////////////////////////////////////////////////////////////
 
-  CFS_WAIT_DESCRIPTOR:
+CFS_SCOREBOARD*
+  CFS_CreateScoreboard
+    (char* szPath,
+     int numSlots) {
 
-  //
-  //////////////////////////////////////////////////////////////////////////
+  int fd;
+
+  size_t size;
+
+  CFS_SCOREBOARD* This;
+
+  size = sizeof(CFS_SCOREBOARD) + numSlots * sizeof(CFS_SCOREBOARD_SLOT);
+
+  if ((fd = open(szPath, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0) {
+    return NULL;
+  }
+
+  if (ftruncate(fd, size) < 0) {
+    close(fd);
+    return NULL;
+  }
+
+  This = (CFS_SCOREBOARD*)mmap(NULL, size, 
+                               PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (This == MAP_FAILED) {
+    return NULL;
+  }
 
-  *descriptor = -1;
+  // the file was truncated: every slot is zeroed (CFS_SCB_STATE_FREE)
 
-  fdset[0].fd = fd;
-  fdset[0].events = POLLIN;
+  memcpy(This->magic, CFS_SCOREBOARD_MAGIC, sizeof(This->magic));
+  This->version = CFS_SCOREBOARD_VERSION;
+  This->numSlots = numSlots;
+  This->daemonPid = getpid();
+  This->started = (int64_t)time(NULL);
 
-  rc = poll(fdset, 1, timeout >= 0 ? timeout * 1000: -1);
+  return This;
+}
 
-  switch(rc) {
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_OpenScoreboard
+//
+// This function maps an existing scoreboard file for reading.
+//
+//////////////////////////////////////////////////////////////////////////////
 
-    case 0:  // timed-out
+CFS_SCOREBOARD*
+  CFS_OpenScoreboard
+    (char* szPath) {
 
-      rc = CS_FAILURE | CFS_OPER_WAIT | CFS_DIAG_TIMEDOUT;
-      break;
+  int fd;
 
-    case 1:  // descriptor is ready
+  struct stat fileInfo;
 
-      if (fdset[0].revents == POLLIN) {
+  CFS_SCOREBOARD* This;
 
-        // get the descriptor
+  if ((fd = open(szPath, O_RDONLY | O_CLOEXEC)) < 0) {
+    return NULL;
+  }
 
-        rc = recvmsg(fd, &msgInstance, 0);
+  if (fstat(fd, &fileInfo) < 0 || 
+      fileInfo.st_size < sizeof(CFS_SCOREBOARD)) {
+    close(fd);
+    return NULL;
+  }
 
-        if (rc >= 0) {
+  This = (CFS_SCOREBOARD*)mmap(NULL, fileInfo.st_size, 
+                               PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
 
-          // Assume the rest will fail
-          rc = CS_FAILURE | CFS_OPER_READ | CFS_DIAG_SYSTEM;
+  if (This == MAP_FAILED) {
+    return NULL;
+  }
 
-#ifdef MSGHDR_MSG_CONTROL
+  if (memcmp(This->magic, CFS_SCOREBOARD_MAGIC, sizeof(This->magic)) ||
+      This->version != CFS_SCOREBOARD_VERSION ||
+      fileInfo.st_size < sizeof(CFS_SCOREBOARD) + 
+                         This->numSlots * sizeof(CFS_SCOREBOARD_SLOT)) {
 
-          if ( (cmptr = CMSG_FIRSTHDR(&msgInstance)) != NULL) {
+    munmap(This, fileInfo.st_size);
+    return NULL;
+  }
 
-            if (cmptr->cmsg_len == CMSG_LEN(sizeof(int))) {
+  return This;
+}
 
-              if (cmptr->cmsg_level == SOL_SOCKET &&
-                  cmptr->cmsg_type  == SCM_RIGHTS) {
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_CloseScoreboard
+//
+// This function unmaps a scoreboard.
+//
+//////////////////////////////////////////////////////////////////////////////
 
-                *descriptor = *((int*)CMSG_DATA(cmptr));
-                rc = CS_SUCCESS;
+CSRESULT
+  CFS_CloseScoreboard
+    (CFS_SCOREBOARD** This) {
 
-              }
-            }
-          }
+  if (This != NULL && *This != NULL) {
 
-#else
+    munmap(*This, sizeof(CFS_SCOREBOARD) + 
+                  (*This)->numSlots * sizeof(CFS_SCOREBOARD_SLOT));
+    *This = NULL;
 
-          if (msgInstance.msg_accrightslen == sizeof(receivedFD)) {
+    return CS_SUCCESS;
+  }
 
-            *descriptor = receivedFD;
-            rc = CS_SUCCESS;
-          }
+  return CS_FAILURE;
+}
 
-#endif
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_SetScoreboardSlot
+//
+// This function sets the PID and state of a scoreboard slot. Used by the
+// main daemon; the slot counters are reset when a handler is starting or
+// when the slot is released (CFS_SCB_STATE_FREE).
+//
+//////////////////////////////////////////////////////////////////////////////
 
-        }
-        else {
-          rc = CS_FAILURE | CFS_OPER_READ | CFS_DIAG_SYSTEM;
-        }
-      }
+CSRESULT
+  CFS_SetScoreboardSlot
+    (CFS_SCOREBOARD* This,
+     int slot,
+     int pid,
+     int state) {
 
-      break;
+  CFS_SCOREBOARD_SLOT* pSlot;
 
-    default:
+  if (This == NULL || slot < 0 || slot >= This->numSlots) {
+    return CS_FAILURE | CFS_DIAG_INVALIDSIZE;
+  }
 
-      if (errno == EINTR) {
+  pSlot = &(This->slots[slot]);
 
-        goto CFS_WAIT_DESCRIPTOR;
-      }
-      else {
-        rc = CS_FAILURE | CFS_OPER_WAIT | CFS_DIAG_SYSTEM;
-      }
+  if (state == CFS_SCB_STATE_STARTING || state == CFS_SCB_STATE_FREE) {
 
-      break;
-   }
+    __atomic_store_n(&(pSlot->connections), 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&(pSlot->requests), 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&(pSlot->bytesIn), 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&(pSlot->bytesOut), 0, __ATOMIC_RELAXED);
+    memset(pSlot->peer, 0, sizeof(pSlot->peer));
+  }
 
-   return rc;
+  __atomic_store_n(&(pSlot->state), state, __ATOMIC_RELAXED);
+  __atomic_store_n(&(pSlot->pid), pid, __ATOMIC_RELAXED);
+  __atomic_store_n(&(pSlot->lastActivity), 
+                   (int64_t)time(NULL), __ATOMIC_RELAXED);
+
+  return CS_SUCCESS;
 }
 
 //////////////////////////////////////////////////////////////////////////////
 //
-// CFS_SendDescriptor
+// CFS_CreateTlsShare
 //
-// This function sends a file (socket) descriptor to another process.
-// The caller has already established a connection to the other process
-// via a local domain (UNIX) socket.
+// This function creates the TLS state shared by the handlers of a daemon
+// for the secure configuration of the given environment. The state is
+// held in an anonymous memory file that is never linked in the file 
+// system; its descriptor, returned in fd, is inherited by the handlers
+// and the daemon passes its number to them in the CFS_TLS_SHARE 
+// environment variable. The secure configuration parameters are:
+//
+//   TLS_TICKET_KEY_ROTATION  seconds between ticket key rotations; 
+//                            tickets are not shared if missing or 0
+//   TLS_TICKET_KEY_FILE      file holding a fixed 80 bytes ticket key
+//                            (name, HMAC and AES keys) shared with other
+//                            hosts; the key is then never rotated
+//   TLS_SESSION_CACHE_SIZE   number of sessions in the shared cache;
+//                            no cache if missing or 0
+//   TLS_SESSION_TIMEOUT      session lifetime in seconds (default 300)
+//
+// Returns NULL if the environment is not secure or shares nothing.
 //
 //////////////////////////////////////////////////////////////////////////////
 
-CSRESULT
-  CFS_SendDescriptor
-    (int fd,
-     int descriptor,
-     int timeout) {
+CFS_TLSSHARE*
+  CFS_CreateTlsShare
+    (char* szConfig,
+     int* fd) {
 
-   struct iovec iov[1];
+  int keyfd;
+  int tickets;
+  int numSlots;
+  int rotation;
+  int timeout;
 
-   struct pollfd fdset[1];
+  char* pszParam;
 
-   struct msghdr msgInstance;
+  size_t size;
 
-   int rc;
+  CFSRPS pRepo;
+  CFSCFG pConfig;
+  CFSCFG pSecure;
 
-   // We need to send some data, even though it will be ignored
-   // by the peer
+  CFS_TLS_TICKET_KEY fixedKey;
 
-   char dummyByte = 0;
+  CFS_TLSSHARE* This;
 
-   //////////////////////////////////////////////////////////////////////////
-   // ancillary (control) data.
-   // This is where the descriptor will be held.
-   //////////////////////////////////////////////////////////////////////////
+  *fd = -1;
 
-#ifdef MSGHDR_MSG_CONTROL
+  if (szConfig == NULL) {
+    return NULL;
+  }
 
-   //////////////////////////////////////////////////////////////////////////
-   // We are using a cmsghdr to pass along the ancillary data ...
-   // This union is to properly align the cmsghdr structure with the data
-   // buffer that will hold the descriptor.
-   //////////////////////////////////////////////////////////////////////////
+  pRepo = CFSRPS_Open(0);
+  pSecure = NULL;
 
-   union {
-      struct cmsghdr cm;
-      char control[CMSG_SPACE(sizeof(int))];
-   } control_un;
+  if ((pConfig = CFSRPS_OpenConfig(pRepo, szConfig)) != NULL) {
 
-   struct cmsghdr* cmptr;
+    if ((pszParam = 
+             CFSCFG_LookupParam(pConfig, "SECURE_CONFIG")) != NULL) {
+      pSecure = CFSRPS_OpenConfig(pRepo, pszParam);
+    }
 
-   //////////////////////////////////////////////////////////////////////////
-   //  Initialise the msghdr with the ancillary data and
-   //  ancillary data length.
-   //////////////////////////////////////////////////////////////////////////
+    CFSRPS_CloseConfig(pRepo, &pConfig);
+  }
 
-   msgInstance.msg_control    = control_un.control;
-   msgInstance.msg_controllen = sizeof(control_un.control);
+  if (pSecure == NULL) {
+    CFSRPS_Close(&pRepo);
+    return NULL;
+  }
 
-   //////////////////////////////////////////////////////////////////////////
-   //  Initialise the ancillary data itself with the
-   //  descriptor to pass along sendmsg().
-   //////////////////////////////////////////////////////////////////////////
+  tickets = 0;
+  rotation = 0;
 
-   // point to first (and only) ancillary data entry.
-   cmptr = CMSG_FIRSTHDR(&msgInstance);
+  if ((pszParam = 
+          CFSCFG_LookupParam(pSecure, "TLS_TICKET_KEY_FILE")) != NULL) {
 
-   // initialise ancillary data header.
-   cmptr->cmsg_len   = CMSG_LEN(sizeof(int));  // size of descriptor
-   cmptr->cmsg_level = SOL_SOCKET;
-   cmptr->cmsg_type  = SCM_RIGHTS;
+    if ((keyfd = open(pszParam, O_RDONLY | O_CLOEXEC)) >= 0) {
 
-   //////////////////////////////////////////////////////////////////////////
-   // Assign the descriptor to ancillary data
-   //
-   // CMSG_DATA will return the address of the first data byte,
-   // which is located somewhere in the control_un.control array.
-   // To assign the descriptor, which is an integer, we must cast
-   // this address to int* and dereference the address to set
-   // it to the descriptor value.
-   //////////////////////////////////////////////////////////////////////////
+      tickets = read(keyfd, &fixedKey, sizeof(fixedKey)) == sizeof(fixedKey);
+      close(keyfd);
+    }
+  }
+  else {
 
-   *((int*)CMSG_DATA(cmptr)) = descriptor;
+    if ((pszParam = 
+            CFSCFG_LookupParam(pSecure, "TLS_TICKET_KEY_ROTATION")) != NULL) {
+      rotation = atoi(pszParam);
+      tickets = rotation > 0;
+    }
+  }
 
-#else
+  numSlots = (pszParam = 
+                 CFSCFG_LookupParam(pSecure, "TLS_SESSION_CACHE_SIZE")) ?
+                   atoi(pszParam) : 0;
 
-   msgInstance.msg_accrights = (caddr_t)&descriptor;
-   msgInstance.msg_accrightslen = sizeof(descriptor);
+  timeout = (pszParam = 
+                CFSCFG_LookupParam(pSecure, "TLS_SESSION_TIMEOUT")) ?
+                  atoi(pszParam) : 300;
 
-#endif
+  CFSRPS_CloseConfig(pRepo, &pSecure);
+  CFSRPS_Close(&pRepo);
 
-   msgInstance.msg_name    = NULL;
-   msgInstance.msg_namelen = 0;
+  if (numSlots < 0) {
+    numSlots = 0;
+  }
 
-   iov[0].iov_base = &dummyByte;
-   iov[0].iov_len = 1;
+  if (!tickets && numSlots == 0) {
+    return NULL;
+  }
 
-   msgInstance.msg_iov = iov;
-   msgInstance.msg_iovlen = 1;
+  size = sizeof(CFS_TLSSHARE) + numSlots * sizeof(CFS_TLS_CACHE_SLOT);
 
-   //////////////////////////////////////////////////////////////////////////
-   // Send the descriptor via the stream pipe descriptor.
-   //////////////////////////////////////////////////////////////////////////
+  /////////////////////////////////////////////////////////////////////
+  // The memory file holds secret keys: it can only be reached through
+  // the descriptor, which the handlers inherit (no close-on-exec). 
+  // Its size is sealed so that a handler can't truncate it under the
+  // others.
+  /////////////////////////////////////////////////////////////////////
 
-   //////////////////////////////////////////////////////////////////////////
-   // This branching label for restarting an interrupted poll call.
-   // An interrupted system call may results from a caught signal
-   // and will have errno set to EINTR. We must call poll again.
+  if ((keyfd = memfd_create("cfs-tlsshare", MFD_ALLOW_SEALING)) < 0) {
+    return NULL;
+  }
 
-   CFS_WAIT_DESCRIPTOR:
+  if (ftruncate(keyfd, size) < 0 ||
+      fcntl(keyfd, F_ADD_SEALS, 
+            F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+    close(keyfd);
+    return NULL;
+  }
 
-   //
-   //////////////////////////////////////////////////////////////////////////
+  This = (CFS_TLSSHARE*)mmap(NULL, size, 
+                             PROT_READ | PROT_WRITE, MAP_SHARED, keyfd, 0);
 
-   fdset[0].fd = fd;
-   fdset[0].events = POLLOUT;
+  if (This == MAP_FAILED) {
+    close(keyfd);
+    return NULL;
+  }
 
-   rc = poll(fdset, 1, timeout >= 0 ? timeout * 1000: -1);
+  memcpy(This->magic, CFS_TLSSHARE_MAGIC, sizeof(This->magic));
+  This->version = CFS_TLSSHARE_VERSION;
+  This->numSlots = numSlots;
+  This->rotation = rotation;
+  This->timeout = timeout > 0 ? timeout : 300;
+  This->tickets = tickets;
 
-   switch(rc) {
+  if (tickets) {
 
-      case 0:  // timed-out
+    if (rotation > 0) {
 
-         rc = CS_FAILURE | CFS_OPER_WAIT | CFS_DIAG_TIMEDOUT;
-         break;
+      // both keys are valid until the first rotation
 
-      case 1:  // descriptor is ready
+      if (RAND_bytes((unsigned char*)This->keys, sizeof(This->keys)) <= 0) {
+        munmap(This, size);
+        close(keyfd);
+        return NULL;
+      }
+    }
+    else {
+      This->keys[0] = fixedKey;
+      This->keys[1] = fixedKey;
+    }
+  }
 
-         if(fdset[0].revents == POLLOUT) {
+  This->rotated = (int64_t)time(NULL);
 
-            rc = sendmsg(fd, &msgInstance, 0);
+  *fd = keyfd;
 
-            if (rc < 0) {
-               rc = CS_FAILURE | CFS_OPER_WRITE  | CFS_DIAG_SYSTEM;
-            }
-            else {
-               rc = CS_SUCCESS;
-            }
-         }
-         else {
+  return This;
+}
 
-            rc = CS_FAILURE | CFS_OPER_WAIT | CFS_DIAG_SYSTEM;
-         }
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_RotateTicketKeys
+//
+// This function replaces the older of the two ticket keys when the 
+// rotation interval has elapsed; the daemon calls it periodically.
+//
+//////////////////////////////////////////////////////////////////////////////
 
-         break;
+CSRESULT
+  CFS_RotateTicketKeys
+    (CFS_TLSSHARE* This) {
 
-      default:
+  int next;
 
-         if (errno == EINTR) {
+  time_t now;
 
-            goto CFS_WAIT_DESCRIPTOR;
-         }
-         else {
-            rc = CS_FAILURE | CFS_OPER_WAIT | CFS_DIAG_SYSTEM;
-         }
+  CFS_TLS_TICKET_KEY key;
 
-         break;
-   }
+  if (This == NULL || This->rotation <= 0) {
+    return CS_SUCCESS;
+  }
 
-   return rc;
+  time(&now);
+
+  if (now - This->rotated < This->rotation) {
+    return CS_SUCCESS;
+  }
+
+  if (RAND_bytes((unsigned char*)&key, sizeof(key)) <= 0) {
+    return CS_FAILURE;
+  }
+
+  next = 1 - This->current;
+
+  // only the daemon writes the keys
+
+  __atomic_add_fetch(&(This->keySeq), 1, __ATOMIC_RELEASE);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  This->keys[next] = key;
+  This->current = next;
+
+  __atomic_add_fetch(&(This->keySeq), 1, __ATOMIC_RELEASE);
+
+  This->rotated = (int64_t)now;
+
+  return CS_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFS_CloseTlsShare
+//
+// This function unmaps the shared TLS state.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  CFS_CloseTlsShare
+    (CFS_TLSSHARE** This) {
+
+  if (This != NULL && *This != NULL) {
+
+    OPENSSL_cleanse((*This)->keys, sizeof((*This)->keys));
+
+    munmap(*This, sizeof(CFS_TLSSHARE) + 
+                  (*This)->numSlots * sizeof(CFS_TLS_CACHE_SLOT));
+    *This = NULL;
+
+    return CS_SUCCESS;
+  }
+
+  return CS_FAILURE;
 }
 
 CSRESULT
@@ -3288,6 +6144,8 @@ CSRESULT
   // Set socket to blocking mode
   CFS_PRV_SetBlocking(This->connfd, 1);
 
+  This->readReady = 1;
+
   return CS_SUCCESS;
 }
 
@@ -30,6 +30,8 @@
 #define __CLARASOFT_CFS_CFSAPI_H__
 
 #include <inttypes.h>
+#include <sys/types.h>
+#include <sys/uio.h>
 #include <clarasoft/cslib.h>
 
 //////////////////////////////////////////////////////////////////////////////
@@ -76,6 +78,42 @@
 
 #define CFS_SR_OPTIONS_FMTV1          (0x00000000)
 
+// Event handler notifications and interest flags
+
+#define CFS_EVENT_NONE                (0x00000000)
+#define CFS_EVENT_OPEN                (0x00000001)
+#define CFS_EVENT_READABLE            (0x00000002)
+#define CFS_EVENT_WRITABLE            (0x00000004)
+#define CFS_EVENT_CLOSE               (0x00000008)
+
+// Handler status bytes sent to the main daemon on the stream pipe
+
+#define CFS_HANDLER_READY             (0x00)
+#define CFS_HANDLER_BUSY              (0x01)
+
+// Maximum number of descriptors passed in a single message; a handler
+// advertises capacity for k more connections by sending a byte of 
+// value k (1 to 255) on the stream pipe; a byte of value 0 stands for
+// a single connection.
+
+#define CFS_MAX_DESCRIPTORS           (64)
+#define CFS_MAX_IOVEC                 (64)
+
+// Handler scoreboard: the main daemon creates the scoreboard file and 
+// passes its path to the handlers in the CFS_SCOREBOARD environment 
+// variable; each handler updates the slot holding its PID.
+
+#define CFS_SCOREBOARD_ENV            "CFS_SCOREBOARD"
+#define CFS_SCOREBOARD_MAGIC          "CFSSCBD"
+#define CFS_SCOREBOARD_VERSION        (1)
+
+#define CFS_SCB_STATE_FREE            (0)
+#define CFS_SCB_STATE_STARTING        (1)
+#define CFS_SCB_STATE_READY           (2)
+#define CFS_SCB_STATE_BUSY            (3)
+
+#define CFS_TLSSHARE_ENV              "CFS_TLS_SHARE"
+
 typedef void* CFSENV;
 typedef void* CFSRPS;
 
@@ -108,6 +146,9 @@ typedef struct tagCFSVTBL {
   CSRESULT 
     (*CFS_SendRecord)  
       (CFS_SESSION*, char*, long*, long);
+  CSRESULT 
+    (*CFS_SendV)  
+      (CFS_SESSION*, struct iovec*, int, long*, long);
 
 } CFSVTBL;
 
@@ -128,10 +169,82 @@ typedef struct tagSESSIONINFO {
 
 } SESSIONINFO;
 
+//////////////////////////////////////////////////////////////////////////////
+// Scoreboard layout (shared memory). Each slot fills a cache line so that
+// handlers updating their own slot do not contend with each other. Fields
+// are updated with relaxed atomic operations; readers get a consistent
+// value for each field but not for the slot as a whole.
+//////////////////////////////////////////////////////////////////////////////
+
+typedef struct tagCFS_TLSSHARE CFS_TLSSHARE;
+
+// Outbound session pool (see CFS_AcquireSession)
+
+typedef struct tagCFS_POOL CFS_POOL;
+
+typedef struct tagCFS_SCOREBOARD_SLOT {
+
+  int32_t pid;
+  int32_t state;          // CFS_SCB_STATE_xxx
+  int32_t connections;    // active connections
+  int32_t reserved;
+  int64_t lastActivity;   // time of the last connection open/close
+  uint64_t requests;      // connections served
+  uint64_t bytesIn;
+  uint64_t bytesOut;
+  unsigned char peer[16]; // last peer address (IPv4 addresses are mapped)
+
+} __attribute__((aligned(64))) CFS_SCOREBOARD_SLOT;
+
+typedef struct tagCFS_SCOREBOARD {
+
+  char magic[8];
+  int32_t version;
+  int32_t numSlots;
+  int32_t daemonPid;
+  int32_t reserved;
+  int64_t started;
+
+  CFS_SCOREBOARD_SLOT slots[];
+
+} __attribute__((aligned(64))) CFS_SCOREBOARD;
+
+//////////////////////////////////////////////////////////////////////////////
+// Event handler entry point
+//
+// An in-process server may export this function instead of (or alongside)
+// a blocking handler. The handler process calls it with one of the
+// CFS_EVENT_OPEN, CFS_EVENT_READABLE, CFS_EVENT_WRITABLE or CFS_EVENT_CLOSE
+// notifications; ppUserData points to a per-session slot initialised to
+// NULL that the module may use to hold its own state. The function must
+// not block: it returns the events it wants to be notified of next
+// (CFS_EVENT_READABLE and/or CFS_EVENT_WRITABLE) or CFS_EVENT_CLOSE to
+// have the session closed. The return value is ignored on CFS_EVENT_CLOSE.
+// On a secure session, CFS_EVENT_OPEN is sent once the TLS handshake,
+// itself driven by the event loop, is complete.
+//////////////////////////////////////////////////////////////////////////////
+
+typedef int 
+  (*INPROCEVENTHANDLER)
+    (CFS_SESSION* pSession,
+     int event,
+     void** ppUserData);
+
 // ---------------------------------------------------------------------------
 // Prototypes
 // ---------------------------------------------------------------------------
 
+int
+  CFS_AcceptHandshake
+    (CFS_SESSION* This);
+
+CFS_SESSION*
+  CFS_AcquireSession
+    (CFS_POOL* pPool,
+     char* szConfig,
+     char* szHost,
+     char* szPort);
+
 CSRESULT
   CFS_CloseChannel
     (CFS_SESSION** Session);
@@ -144,10 +257,39 @@ CSRESULT
   CFS_CloseEnv
     (CFSENV* pEnv);
 
+CSRESULT
+  CFS_ClosePool
+    (CFS_POOL** pPool);
+
+CSRESULT
+  CFS_CloseScoreboard
+    (CFS_SCOREBOARD** This);
+
 CSRESULT
   CFS_CloseSession
     (CFS_SESSION** Session);
 
+CSRESULT
+  CFS_CloseTlsShare
+    (CFS_TLSSHARE** This);
+
+CFS_POOL*
+  CFS_CreatePool
+    (CFSENV pEnv,
+     int maxIdle,
+     int idleTimeout,
+     int maxLifetime);
+
+CFS_SCOREBOARD*
+  CFS_CreateScoreboard
+    (char* szPath,
+     int numSlots);
+
+CFS_TLSSHARE*
+  CFS_CreateTlsShare
+    (char* szConfig,
+     int* fd);
+
 CSRESULT
   CFS_GetLastError
     (CFSENV pEnv,
@@ -158,10 +300,19 @@ CFS_SESSION*
     (CFSENV pEnv,
      int connfd);
 
+CFS_SESSION*
+  CFS_OpenChannelAsync
+    (CFSENV pEnv,
+     int connfd);
+
 CFSENV
   CFS_OpenEnv
     (char* szConfig);
 
+CFS_SCOREBOARD*
+  CFS_OpenScoreboard
+    (char* szPath);
+
 CFS_SESSION*
   CFS_OpenSession
     (CFSENV pEnv,
@@ -169,6 +320,10 @@ CFS_SESSION*
      char* szHost,
      char* szPort);
 
+long
+  CFS_QueryPendingSize
+    (CFS_SESSION* This);
+
 SESSIONINFO*
   CFS_QuerySessionInfo
     (CFS_SESSION* This);
@@ -179,18 +334,65 @@ CSRESULT
      int* descriptor,
      int timeout);
 
+CSRESULT
+  CFS_ReceiveDescriptors
+    (int fd,
+     int* descriptors,
+     int* count,
+     int timeout);
+
+CSRESULT
+  CFS_ReleaseSession
+    (CFS_POOL* pPool,
+     CFS_SESSION** Session,
+     int reuse);
+
+CSRESULT
+  CFS_RotateTicketKeys
+    (CFS_TLSSHARE* This);
+
+int
+  CFS_RunZygote
+    (int stream);
+
 CSRESULT
   CFS_SendDescriptor
     (int fd,
      int descriptor,
      int timeout);
 
+CSRESULT
+  CFS_SendDescriptors
+    (int fd,
+     int* descriptors,
+     int count,
+     int timeout);
+
+CSRESULT
+  CFS_SendFile
+    (CFS_SESSION* This,
+     int fd,
+     off_t offset,
+     long* size,
+     long toSlices);
+
 CSRESULT
   CFS_SetChannelDescriptor
     (CFS_SESSION* This,
      int connfd,
      int* iSSLResult);
 
+void
+  CFS_SetReadReady
+    (CFS_SESSION* This);
+
+CSRESULT
+  CFS_SetScoreboardSlot
+    (CFS_SCOREBOARD* This,
+     int slot,
+     int pid,
+     int state);
+
 CFSRPS
   CFSRPS_Open
     (char* fileName);
@@ -103,15 +103,49 @@
   any other CFSRPS methods; if you pass a NULL handle, the functions
   will crash.
 
+  Configurations are cached by each process: a configuration is loaded
+  and indexed the first time it is opened and later opens share that
+  copy until it changes. When the CFS_CONFIG_IMAGES environment 
+  variable names a directory, configurations are first looked up 
+  there as compiled images (see CFSRPS_CompileConfig) that are mapped
+  and shared by all the processes that open them. Configuration files (*FILE storage) are 
+  watched with inotify; changes in the database are notified on the
+  cfsrepo channel by the triggers of the repository tables (see
+  cfsrepo-ddl.sql). A process that needs to load configurations from
+  the database keeps one connection to listen on that channel.
+  CFSRPS_Reload discards everything that was cached (clarad calls it,
+  and has its handlers call it, on SIGHUP). CFSRPS_Changed tells if a
+  configuration loaded from the repository changed since it was 
+  cached; clarad uses it to compile the images again.
+
 --------------------------------------------------------------------------- */
 
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 #include <clarasoft/cslib.h>
 #include <clarasoft/csjson.h>
 
+// PostgreSQL channel on which configuration changes are notified
+#define CFSRPS_NOTIFY_CHANNEL         "cfsrepo"
+
+#define CFSRPS_WATCH_EVENTS           (IN_CLOSE_WRITE | IN_MOVED_TO | \
+                                       IN_MOVED_FROM | IN_DELETE)
+
+#define CFSRPS_IMAGES_ENV             "CFS_CONFIG_IMAGES"
+
+#define CFSCFG_IMAGE_MAGIC            "CFSCFGI"
+#define CFSCFG_IMAGE_VERSION          (1)
+
 #ifdef __CLARASOFT_CFS_POSTGRESQL_SUPPORT
 
 #include <postgresql/libpq-fe.h>
@@ -135,16 +169,149 @@ typedef struct tagCFSRPS {
 
 #endif
 
+//////////////////////////////////////////////////////////////////////////////
+// Configuration images. An image holds the parameters and enumerations
+// of a configuration in a single block without pointers, so that it
+// can be written to a file and mapped read-only by other processes
+// (see CFSRPS_CompileConfig). Offsets are from the start of the image,
+// except string offsets which are from the start of the string pool,
+// where each distinct string is stored once. Parameters and
+// enumerations are sorted by name; parameters are also indexed by an
+// open addressing hash table (its size is a power of two, at least
+// twice the number of parameters) holding parameter index + 1.
+//////////////////////////////////////////////////////////////////////////////
+
+typedef struct tagCFSCFG_IMAGE {
+
+  char magic[8];
+  uint32_t version;
+  uint32_t size;
+  uint32_t name;          // configuration name (string)
+
+  uint32_t numParams;
+  uint32_t params;        // CFSCFG_IMAGE_PARAM[numParams]
+  uint32_t tableSize;
+  uint32_t table;         // uint32_t[tableSize], 0 for an empty slot
+
+  uint32_t numEnums;
+  uint32_t enums;         // CFSCFG_IMAGE_ENUM[numEnums]
+  uint32_t numValues;
+  uint32_t values;        // uint32_t[numValues]: enumeration values
+
+  uint32_t strings;
+  uint32_t stringsSize;
+
+} CFSCFG_IMAGE;
+
+typedef struct tagCFSCFG_IMAGE_PARAM {
+
+  uint32_t hash;
+  uint32_t name;
+  uint32_t value;
+
+} CFSCFG_IMAGE_PARAM;
+
+typedef struct tagCFSCFG_IMAGE_ENUM {
+
+  uint32_t name;
+  uint32_t first;         // index of the first value in the values array
+  uint32_t count;
+
+} CFSCFG_IMAGE_ENUM;
+
+#define CFSCFG_IMAGE_STRING(pImage, offset) \
+          ((char*)(pImage) + (pImage)->strings + (offset))
+
+//////////////////////////////////////////////////////////////////////////////
+// Configuration snapshots. A snapshot holds the image of a configuration
+// as it was when it was loaded (or compiled); it is never modified 
+// afterwards and is shared by all the CFSCFG handles opened on that
+// configuration in this process.
+//////////////////////////////////////////////////////////////////////////////
+
+typedef struct tagCFSCFG_SNAPSHOT {
+
+  CFSCFG_IMAGE* pImage;
+  int mapped;         // pImage maps an image file
+
+  char* szName;       // in the image
+  char* szFile;       // backing file (*FILE storage or image) or NULL
+  int wd;             // inotify watch on the directory of szFile
+
+  int stale;          // not (or no longer) cached: freed when unused
+  long refCount;
+
+  struct tagCFSCFG_SNAPSHOT* next;
+
+} CFSCFG_SNAPSHOT;
+
 typedef struct tagCFSCFG {
 
-  char szPath[256];
-  CSJSON pJson;
-  CSJSON_DIRENTRY dire;
+  CFSCFG_SNAPSHOT* pSnapshot;
+  CFSCFG_IMAGE_ENUM* pEnum;
   long enumIndex;
-  CSJSON_LSENTRY lse;
 
 } CFSCFG;
 
+//////////////////////////////////////////////////////////////////////////////
+// Temporary entries and string pool used to build an image
+//////////////////////////////////////////////////////////////////////////////
+
+typedef struct tagCFSRPS_PRV_ENTRY {
+
+  char* szName;
+  char* szValue;          // parameters
+  long first;             // enumerations
+  long count;
+
+} CFSRPS_PRV_ENTRY;
+
+typedef struct tagCFSRPS_PRV_POOL {
+
+  char* pStrings;
+  uint32_t size;
+  uint32_t capacity;
+
+  uint32_t* slots;        // offset + 1 of the interned strings
+  uint32_t numSlots;
+
+} CFSRPS_PRV_POOL;
+
+//////////////////////////////////////////////////////////////////////////////
+// Configuration cache of this process. The inotify descriptor and the
+// database connection are not shared with child processes: after a
+// fork, the child drops the cache and sets up its own.
+//////////////////////////////////////////////////////////////////////////////
+
+static CFSCFG_SNAPSHOT* g_CFSRPS_Cache;
+static pid_t g_CFSRPS_CachePid;
+static int g_CFSRPS_Inotify = -1;
+static volatile sig_atomic_t g_CFSRPS_Reload;
+
+// Repository configurations (not images) that changed since the last
+// call to CFSRPS_Changed
+static unsigned long g_CFSRPS_Changes;
+
+#ifdef __CLARASOFT_CFS_POSTGRESQL_SUPPORT
+
+// Repository connection, also listening for configuration changes
+static PGconn* g_CFSRPS_Conn;
+
+#endif
+
+CFSCFG_SNAPSHOT*
+  CFSRPS_PRV_Snapshot
+    (CSJSON pJson,
+     char* szConfig);
+
+void
+  CFSRPS_PRV_FreeSnapshot
+    (CFSCFG_SNAPSHOT* pSnapshot);
+
+int
+  CFSRPS_PRV_Watch
+    (char* szFile);
+
 #ifdef __CLARASOFT_CFS_POSTGRESQL_SUPPORT
 
 CFSRPS*
@@ -165,35 +332,81 @@ CFSRPS*
       free(pRepo);
       return NULL;
     }
-
-    pRepo->conn = NULL;
   }
   else {
 
+    // The database connection is opened when a configuration
+    // must be loaded (see CFSRPS_PRV_Connect)
+
+    pRepo->pFileRepo = NULL;
+  }
+
+  pRepo->conn = NULL;
+
+  return pRepo;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFSRPS_PRV_Connect
+//
+// Returns the repository connection of this process, opening it if
+// needed. The connection listens on the cfsrepo channel, on which the
+// repository triggers notify the path of changed configurations.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+PGconn*
+  CFSRPS_PRV_Connect
+    (void) {
+
+  PGresult* result;
+
+  if (g_CFSRPS_Conn == NULL) {
+
     // At present, only the cfsrepo database name is supported
-    pRepo->conn = PQconnectdb("dbname=cfsrepo");
+    g_CFSRPS_Conn = PQconnectdb("dbname=cfsrepo");
 
-    if (PQstatus(pRepo->conn) == CONNECTION_BAD) {
-    
-      PQfinish(pRepo->conn);
-      free(pRepo);
+    if (PQstatus(g_CFSRPS_Conn) == CONNECTION_BAD) {
+      PQfinish(g_CFSRPS_Conn);
+      g_CFSRPS_Conn = NULL;
       return NULL;
     }
 
-    pRepo->pFileRepo = NULL;
+    result = PQexec(g_CFSRPS_Conn, "LISTEN " CFSRPS_NOTIFY_CHANNEL);
+
+    if (PQresultStatus(result) != PGRES_COMMAND_OK) {
+      PQclear(result);
+      PQfinish(g_CFSRPS_Conn);
+      g_CFSRPS_Conn = NULL;
+      return NULL;
+    }
+
+    PQclear(result);
   }
 
-  return pRepo;
+  return g_CFSRPS_Conn;
 }
 
-CFSCFG*
-  CFSRPS_OpenConfig
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFSRPS_PRV_Load
+//
+// Reads a configuration from the repository and returns its snapshot.
+// The snapshot is marked stale (it will not be cached) if we could
+// not set up what tells us when it changes.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CFSCFG_SNAPSHOT*
+  CFSRPS_PRV_Load
     (CFSRPS* pRepo,
      char* szConfig) {
 
   int numRows;
   int numRows2;
   int i, j;
+  int wd;
 
   long size;
 
@@ -201,6 +414,8 @@ CFSCFG*
   char* szConfigFile;
   char* szFileBuffer;
 
+  char szPath[256];
+
   struct stat fileInfo;
 
   FILE* stream;
@@ -208,165 +423,172 @@ CFSCFG*
   PGresult *result;
   PGresult *result2;
 
-  CFSCFG* pConfig;
+  CSJSON pJson;
 
-  if (szConfig != NULL) {
+  CFSCFG_SNAPSHOT* pSnapshot;
 
-    if (pRepo->conn != NULL) {
+  if (pRepo == NULL || pRepo->pFileRepo != NULL) {
 
-      pConfig = (CFSCFG*)malloc(sizeof(CFSCFG));
+    // The repository is file based
 
-      pConfig->pJson = CSJSON_Constructor();
-      pConfig->enumIndex = 0;
+    return NULL;
+  }
 
-      sprintf(pRepo->szStatement,
-            "SELECT STORAGE, FORMAT, ATTR FROM RPSCFM WHERE PATH = '%s'", 
-            szConfig);
+  if ((pRepo->conn = CFSRPS_PRV_Connect()) == NULL) {
+    return NULL;
+  }
 
-      result = PQexec(pRepo->conn, pRepo->szStatement);    
-    
-      if (PQresultStatus(result) != PGRES_TUPLES_OK) {
-        CSJSON_Destructor(&(pConfig->pJson));
-        free(pConfig);
-        PQclear(result);
-        return NULL;
-      }
+  sprintf(pRepo->szStatement,
+        "SELECT STORAGE, FORMAT, ATTR FROM RPSCFM WHERE PATH = '%s'", 
+        szConfig);
 
-      if (PQntuples(result) < 1) {
-        CSJSON_Destructor(&(pConfig->pJson));
-        free(pConfig);
-        PQclear(result);
-        return NULL;
-      } 
-
-      if (!strcmp("*DATABASE", PQgetvalue(result, 0, 0))) {
-
-        sprintf(pRepo->szStatement,
-              "SELECT PARAM, VALUE FROM RPSCFP WHERE PATH = '%s'", 
-              szConfig);
-
-        result = PQexec(pRepo->conn, pRepo->szStatement);    
-        
-        if (PQresultStatus(result) != PGRES_TUPLES_OK) {
-          CSJSON_Destructor(&(pConfig->pJson));
-          free(pConfig);
-          PQclear(result);
-          return NULL;
-        }
+  result = PQexec(pRepo->conn, pRepo->szStatement);    
+
+  if (PQresultStatus(result) != PGRES_TUPLES_OK) {
+    PQclear(result);
+    return NULL;
+  }
+
+  if (PQntuples(result) < 1) {
+    PQclear(result);
+    return NULL;
+  } 
+
+  if (!strcmp("*DATABASE", PQgetvalue(result, 0, 0))) {
+
+    PQclear(result);
+
+    pJson = CSJSON_Constructor();
+
+    sprintf(pRepo->szStatement,
+          "SELECT PARAM, VALUE FROM RPSCFP WHERE PATH = '%s'", 
+          szConfig);
+
+    result = PQexec(pRepo->conn, pRepo->szStatement);    
     
-        numRows = PQntuples(result);
+    if (PQresultStatus(result) != PGRES_TUPLES_OK) {
+      CSJSON_Destructor(&pJson);
+      PQclear(result);
+      return NULL;
+    }
 
-        CSJSON_Init(pConfig->pJson, JSON_TYPE_OBJECT);
-        CSJSON_MkDir(pConfig->pJson, "/", "param", JSON_TYPE_OBJECT);
-        CSJSON_MkDir(pConfig->pJson, "/", "enum", JSON_TYPE_OBJECT);
+    numRows = PQntuples(result);
 
-        for(i=0; i<numRows; i++) {
+    CSJSON_Init(pJson, JSON_TYPE_OBJECT);
+    CSJSON_MkDir(pJson, "/", "param", JSON_TYPE_OBJECT);
+    CSJSON_MkDir(pJson, "/", "enum", JSON_TYPE_OBJECT);
 
-          CSJSON_InsertString(pConfig->pJson, 
-                              "/param", 
-                              PQgetvalue(result, i, 0), 
-                              PQgetvalue(result, i, 1));
-        }      
+    for(i=0; i<numRows; i++) {
 
-        PQclear(result);
+      CSJSON_InsertString(pJson, 
+                          "/param", 
+                          PQgetvalue(result, i, 0), 
+                          PQgetvalue(result, i, 1));
+    }      
 
-        sprintf(pRepo->szStatement,
-              "Select Distinct param From rpsenm Where path = '%s'", 
-              szConfig);
-  
-        result = PQexec(pRepo->conn, pRepo->szStatement);    
+    PQclear(result);
 
-        numRows = PQntuples(result);
+    sprintf(pRepo->szStatement,
+          "Select Distinct param From rpsenm Where path = '%s'", 
+          szConfig);
 
-        for(i=0; i<numRows; i++) {
+    result = PQexec(pRepo->conn, pRepo->szStatement);    
 
-          szParam = PQgetvalue(result, i, 0);
- 
-          CSJSON_MkDir(pConfig->pJson, "/enum", szParam, JSON_TYPE_ARRAY);
+    numRows = PQntuples(result);
 
-          sprintf(pRepo->szStatement,
-                 "Select value From rpsenm Where path = '%s' And param = '%s' order by seq", 
-                 szConfig, szParam);
+    for(i=0; i<numRows; i++) {
 
-          result2 = PQexec(pRepo->conn, pRepo->szStatement);    
+      szParam = PQgetvalue(result, i, 0);
 
-          numRows2 = PQntuples(result2);
+      CSJSON_MkDir(pJson, "/enum", szParam, JSON_TYPE_ARRAY);
 
-          sprintf(pConfig->szPath, "/enum/%s", szParam);
+      sprintf(pRepo->szStatement,
+             "Select value From rpsenm Where path = '%s' And param = '%s' order by seq", 
+             szConfig, szParam);
 
-          for (j=0; j<numRows2; j++) {
+      result2 = PQexec(pRepo->conn, pRepo->szStatement);    
 
-            CSJSON_InsertString(pConfig->pJson, 
-                                pConfig->szPath, 
-                                0, 
-                                PQgetvalue(result2, j, 0));
-          }
+      numRows2 = PQntuples(result2);
 
-          PQclear(result2);
-        }
+      sprintf(szPath, "/enum/%s", szParam);
 
-        PQclear(result);
+      for (j=0; j<numRows2; j++) {
 
-        return pConfig;
+        CSJSON_InsertString(pJson, 
+                            szPath, 
+                            0, 
+                            PQgetvalue(result2, j, 0));
       }
-      else {
 
-        if (!strcmp("*FILE", PQgetvalue(result, 0, 0))) {
+      PQclear(result2);
+    }
+
+    PQclear(result);
 
-          szConfigFile = PQgetvalue(result, 0, 2);
+    pSnapshot = CFSRPS_PRV_Snapshot(pJson, szConfig);
+    CSJSON_Destructor(&pJson);
 
-          if (stat(szConfigFile, &fileInfo) == -1) {
-            CSJSON_Destructor(&(pConfig->pJson));
-            free(pConfig);
-            return NULL;
-          }
+    return pSnapshot;
+  }
 
-          szFileBuffer = (char*)malloc( (fileInfo.st_size + 1) * sizeof(char));
+  if (strcmp("*FILE", PQgetvalue(result, 0, 0))) {
+    PQclear(result);
+    return NULL;
+  }
 
-          stream = fopen(szConfigFile, "rb");
+  szConfigFile = PQgetvalue(result, 0, 2);
 
-          if (!stream) {
-            free(szFileBuffer);
-            CSJSON_Destructor(&(pConfig->pJson));
-            free(pConfig);
-            return NULL;
-          }
+  ///////////////////////////////////////////////////////////////////
+  // Watch the file before reading it so that we do not miss
+  // a change made while we read.
+  ///////////////////////////////////////////////////////////////////
 
-          size = fread(szFileBuffer, sizeof(char), fileInfo.st_size, stream);
-          szFileBuffer[size] = 0;
-          fclose(stream);
+  wd = CFSRPS_PRV_Watch(szConfigFile);
 
-          if (CS_FAIL(CSJSON_Parse(pConfig->pJson, szFileBuffer, 0))) {
-            free(szFileBuffer);
-            CSJSON_Destructor(&(pConfig->pJson));
-            free(pConfig);
-            return NULL;
-          }
+  if (stat(szConfigFile, &fileInfo) == -1) {
+    PQclear(result);
+    return NULL;
+  }
 
-          free(szFileBuffer);
-          PQclear(result);
-          return pConfig;
-        }
-        else {
-          PQclear(result);
-          CSJSON_Destructor(&(pConfig->pJson));
-          free(pConfig);
-          return NULL;
-        }
-      }
-    }
-    else {
-       
-      // The repository is file based
+  szFileBuffer = (char*)malloc( (fileInfo.st_size + 1) * sizeof(char));
 
-    }
+  stream = fopen(szConfigFile, "rb");
+
+  if (!stream) {
+    free(szFileBuffer);
+    PQclear(result);
+    return NULL;
   }
-  else {
 
+  size = fread(szFileBuffer, sizeof(char), fileInfo.st_size, stream);
+  szFileBuffer[size] = 0;
+  fclose(stream);
 
-  } 
+  pJson = CSJSON_Constructor();
 
-  return NULL;
+  if (CS_FAIL(CSJSON_Parse(pJson, szFileBuffer, 0))) {
+    free(szFileBuffer);
+    CSJSON_Destructor(&pJson);
+    PQclear(result);
+    return NULL;
+  }
+
+  free(szFileBuffer);
+
+  pSnapshot = CFSRPS_PRV_Snapshot(pJson, szConfig);
+  CSJSON_Destructor(&pJson);
+
+  pSnapshot->szFile = (char*)malloc(strlen(szConfigFile) + 1);
+  strcpy(pSnapshot->szFile, szConfigFile);
+  pSnapshot->wd = wd;
+
+  if (wd < 0) {
+    pSnapshot->stale = 1;
+  }
+
+  PQclear(result);
+
+  return pSnapshot;
 }
 
 CSRESULT
@@ -374,8 +596,13 @@ CSRESULT
     (CFSRPS** This) {
 
   if ((This != NULL) && (*This != NULL)) {
-    
-    PQfinish((*This)->conn);
+
+    // The database connection is kept by the configuration cache
+
+    if ((*This)->pFileRepo != NULL) {
+      fclose((*This)->pFileRepo);
+    }
+
     free(*This);
     *This= NULL;
   }
@@ -411,28 +638,33 @@ CFSRPS*
   return NULL;
 }
 
-CFSCFG*
-  CFSRPS_OpenConfig
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFSRPS_PRV_Load
+//
+// Without a database, configurations are empty.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CFSCFG_SNAPSHOT*
+  CFSRPS_PRV_Load
     (CFSRPS* pRepo,
      char* szConfig) {
 
-  CFSCFG* pConfig;
-
-  if (szConfig != NULL) {
+  CSJSON pJson;
 
-    pConfig = (CFSCFG*)malloc(sizeof(CFSCFG));
+  CFSCFG_SNAPSHOT* pSnapshot;
 
-    pConfig->pJson = CSJSON_Constructor();
-    pConfig->enumIndex = 0;
+  pJson = CSJSON_Constructor();
 
-    CSJSON_Init(pConfig->pJson, JSON_TYPE_OBJECT);
-    CSJSON_MkDir(pConfig->pJson, "/", "param", JSON_TYPE_OBJECT);
-    CSJSON_MkDir(pConfig->pJson, "/", "enum", JSON_TYPE_OBJECT);
+  CSJSON_Init(pJson, JSON_TYPE_OBJECT);
+  CSJSON_MkDir(pJson, "/", "param", JSON_TYPE_OBJECT);
+  CSJSON_MkDir(pJson, "/", "enum", JSON_TYPE_OBJECT);
 
-    return pConfig;
-  }
+  pSnapshot = CFSRPS_PRV_Snapshot(pJson, szConfig);
+  CSJSON_Destructor(&pJson);
 
-  return NULL;
+  return pSnapshot;
 }
 
 CSRESULT
@@ -451,55 +683,1175 @@ CSRESULT
 
 #endif
 
-char* 
-  CFSCFG_LookupParam
-    (CFSCFG* This,
-     char* szParam) {
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFSRPS_PRV_Hash
+//
+// FNV-1a hash of a string.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+uint32_t
+  CFSRPS_PRV_Hash
+    (char* szName) {
 
-  if (CS_SUCCEED(CSJSON_LookupKey(This->pJson, "/param", szParam, &(This->lse)))) {
+  uint32_t hash;
 
-    return This->lse.szValue;
+  hash = 2166136261U;
+
+  while (*szName != 0) {
+    hash ^= (unsigned char)(*szName);
+    hash *= 16777619U;
+    szName++;
   }
 
-  return NULL;
+  return hash;
 }
 
-CSRESULT
-  CFSCFG_IterStart
-    (CFSCFG* This, 
-     char* szEnum) {
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFSRPS_PRV_CopyString
+//
+//////////////////////////////////////////////////////////////////////////////
 
-  This->enumIndex = 0;
-  sprintf(This->szPath, "/enum/%s", szEnum);
+char*
+  CFSRPS_PRV_CopyString
+    (char* szString) {
 
-  if (CS_SUCCEED(CSJSON_LookupDir(This->pJson, This->szPath, &(This->dire)))) {
-    return CS_SUCCESS;
-  }
+  char* szCopy;
 
-  return CS_FAILURE;
+  szCopy = (char*)malloc(strlen(szString) + 1);
+  strcpy(szCopy, szString);
+
+  return szCopy;
 }
 
-char*
-  CFSCFG_IterNext
-    (CFSCFG* This) {
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFSRPS_PRV_Intern
+//
+// Adds a string to the pool of an image being built, unless it is
+// already there; returns its offset in the pool.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+uint32_t
+  CFSRPS_PRV_Intern
+    (CFSRPS_PRV_POOL* pPool,
+     char* szString) {
+
+  uint32_t i;
+  uint32_t len;
+  uint32_t offset;
+
+  i = CFSRPS_PRV_Hash(szString) & (pPool->numSlots - 1);
+
+  while (pPool->slots[i] != 0) {
+
+    if (!strcmp(pPool->pStrings + pPool->slots[i] - 1, szString)) {
+      return pPool->slots[i] - 1;
+    }
 
-  if (This->enumIndex < This->dire.numItems) {
-    CSJSON_LookupIndex(This->pJson, This->szPath, This->enumIndex, &(This->lse));
-    (This->enumIndex)++;
-    return This->lse.szValue;
+    i = (i + 1) & (pPool->numSlots - 1);
   }
 
-  return NULL;
+  len = strlen(szString) + 1;
+
+  if (pPool->size + len > pPool->capacity) {
+
+    while (pPool->size + len > pPool->capacity) {
+      pPool->capacity *= 2;
+    }
+
+    pPool->pStrings = (char*)realloc(pPool->pStrings, pPool->capacity);
+  }
+
+  offset = pPool->size;
+  memcpy(pPool->pStrings + offset, szString, len);
+  pPool->size += len;
+
+  pPool->slots[i] = offset + 1;
+
+  return offset;
 }
 
-CSRESULT
-  CFSRPS_CloseConfig
-    (CFSRPS* pRepo,
-     CFSCFG** pConfig) {
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFSRPS_PRV_CompareEntries
+//
+//////////////////////////////////////////////////////////////////////////////
 
-  if ((pConfig != NULL) && (*pConfig != NULL)) {
+int
+  CFSRPS_PRV_CompareEntries
+    (const void* pEntry1,
+     const void* pEntry2) {
+
+  return strcmp(((CFSRPS_PRV_ENTRY*)pEntry1)->szName,
+                ((CFSRPS_PRV_ENTRY*)pEntry2)->szName);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFSRPS_PRV_NewSnapshot
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CFSCFG_SNAPSHOT*
+  CFSRPS_PRV_NewSnapshot
+    (CFSCFG_IMAGE* pImage,
+     int mapped) {
+
+  CFSCFG_SNAPSHOT* pSnapshot;
+
+  pSnapshot = (CFSCFG_SNAPSHOT*)malloc(sizeof(CFSCFG_SNAPSHOT));
+
+  pSnapshot->pImage = pImage;
+  pSnapshot->mapped = mapped;
+  pSnapshot->szName = CFSCFG_IMAGE_STRING(pImage, pImage->name);
+  pSnapshot->szFile = NULL;
+  pSnapshot->wd = -1;
+  pSnapshot->stale = 0;
+  pSnapshot->refCount = 0;
+  pSnapshot->next = NULL;
+
+  return pSnapshot;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFSRPS_PRV_Snapshot
+//
+// Builds the snapshot of a configuration from its JSON representation
+// (string and numeric values of the /param object and of the arrays
+// of the /enum object).
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CFSCFG_SNAPSHOT*
+  CFSRPS_PRV_Snapshot
+    (CSJSON pJson,
+     char* szConfig) {
+
+  long i;
+  long j;
+  long count;
+  long numParams;
+  long numEnums;
+  long numValues;
+
+  uint32_t size;
+  uint32_t mask;
+  uint32_t tableSize;
+
+  char szPath[256];
+
+  char** pValues;
+
+  CSLIST listing;
+  CSLIST values;
+
+  CSJSON_LSENTRY* plse;
+
+  CFSRPS_PRV_ENTRY* pParams;
+  CFSRPS_PRV_ENTRY* pEnums;
+  CFSRPS_PRV_POOL pool;
+
+  CFSCFG_IMAGE* pImage;
+  CFSCFG_IMAGE_PARAM* pImageParam;
+  CFSCFG_IMAGE_ENUM* pImageEnum;
+
+  uint32_t* pTable;
+  uint32_t* pImageValues;
+
+  listing = CSLIST_Constructor();
+  values = CSLIST_Constructor();
+
+  // CSJSON_Ls returns the type of the listed value
+
+  numParams = 0;
+  pParams = NULL;
+
+  if (CSJSON_Ls(pJson, "/param", listing) == JSON_TYPE_OBJECT &&
+      (count = CSLIST_Count(listing)) > 0) {
+
+    pParams = (CFSRPS_PRV_ENTRY*)malloc(count * sizeof(CFSRPS_PRV_ENTRY));
+
+    for (i=0; i<count; i++) {
+
+      CSLIST_Get(listing, (void*)(&plse), i);
+
+      if (plse->szValue != NULL) {
+        pParams[numParams].szName = plse->szKey;
+        pParams[numParams].szValue = plse->szValue;
+        numParams++;
+      }
+    }
+  }
+
+  // The values of all enumerations are kept in a single list
+
+  numEnums = 0;
+  numValues = 0;
+  pEnums = NULL;
+  pValues = NULL;
+
+  if (CSJSON_Ls(pJson, "/enum", listing) == JSON_TYPE_OBJECT &&
+      (count = CSLIST_Count(listing)) > 0) {
+
+    pEnums = (CFSRPS_PRV_ENTRY*)malloc(count * sizeof(CFSRPS_PRV_ENTRY));
+
+    for (i=0; i<count; i++) {
+
+      CSLIST_Get(listing, (void*)(&plse), i);
+
+      snprintf(szPath, sizeof(szPath), "/enum/%s", plse->szKey);
+
+      if (CSJSON_Ls(pJson, szPath, values) != JSON_TYPE_ARRAY) {
+        continue;
+      }
+
+      pEnums[numEnums].szName = plse->szKey;
+      pEnums[numEnums].szValue = NULL;
+      pEnums[numEnums].first = numValues;
+      pEnums[numEnums].count = 0;
+
+      if (CSLIST_Count(values) > 0) {
+        pValues = (char**)realloc(pValues, 
+                     (numValues + CSLIST_Count(values)) * sizeof(char*));
+      }
+
+      for (j=0; j<CSLIST_Count(values); j++) {
+
+        CSLIST_Get(values, (void*)(&plse), j);
+
+        if (plse->szValue != NULL) {
+          pValues[numValues++] = plse->szValue;
+          (pEnums[numEnums].count)++;
+        }
+      }
+
+      numEnums++;
+    }
+  }
+
+  if (numParams > 1) {
+    qsort(pParams, numParams, sizeof(CFSRPS_PRV_ENTRY), 
+          CFSRPS_PRV_CompareEntries);
+  }
+
+  if (numEnums > 1) {
+    qsort(pEnums, numEnums, sizeof(CFSRPS_PRV_ENTRY), 
+          CFSRPS_PRV_CompareEntries);
+  }
+
+  tableSize = 8;
+  while (tableSize < numParams * 2) {
+    tableSize *= 2;
+  }
+
+  mask = tableSize - 1;
+
+  ///////////////////////////////////////////////////////////////////
+  // Lay out everything but the string pool, which is appended 
+  // once all strings are interned.
+  ///////////////////////////////////////////////////////////////////
+
+  size = sizeof(CFSCFG_IMAGE);
+
+  pImage = (CFSCFG_IMAGE*)calloc(1, size + 
+                                 numParams * sizeof(CFSCFG_IMAGE_PARAM) +
+                                 tableSize * sizeof(uint32_t) +
+                                 numEnums * sizeof(CFSCFG_IMAGE_ENUM) +
+                                 numValues * sizeof(uint32_t));
+
+  pImage->numParams = numParams;
+  pImage->params = size;
+  size += numParams * sizeof(CFSCFG_IMAGE_PARAM);
+
+  pImage->tableSize = tableSize;
+  pImage->table = size;
+  size += tableSize * sizeof(uint32_t);
+
+  pImage->numEnums = numEnums;
+  pImage->enums = size;
+  size += numEnums * sizeof(CFSCFG_IMAGE_ENUM);
+
+  pImage->numValues = numValues;
+  pImage->values = size;
+  size += numValues * sizeof(uint32_t);
+
+  pImage->strings = size;
+
+  pool.size = 0;
+  pool.capacity = 1024;
+  pool.pStrings = (char*)malloc(pool.capacity);
+
+  pool.numSlots = 16;
+  while (pool.numSlots < (1 + numParams * 2 + numEnums + numValues) * 2) {
+    pool.numSlots *= 2;
+  }
+
+  pool.slots = (uint32_t*)calloc(pool.numSlots, sizeof(uint32_t));
+
+  pImage->name = CFSRPS_PRV_Intern(&pool, szConfig);
+
+  pTable = (uint32_t*)((char*)pImage + pImage->table);
+
+  for (i=0; i<numParams; i++) {
+
+    pImageParam = 
+      (CFSCFG_IMAGE_PARAM*)((char*)pImage + pImage->params) + i;
+
+    pImageParam->hash = CFSRPS_PRV_Hash(pParams[i].szName);
+    pImageParam->name = CFSRPS_PRV_Intern(&pool, pParams[i].szName);
+    pImageParam->value = CFSRPS_PRV_Intern(&pool, pParams[i].szValue);
+
+    j = pImageParam->hash & mask;
+
+    while (pTable[j] != 0) {
+      j = (j + 1) & mask;
+    }
+
+    pTable[j] = i + 1;
+  }
+
+  pImageValues = (uint32_t*)((char*)pImage + pImage->values);
+
+  for (i=0; i<numValues; i++) {
+    pImageValues[i] = CFSRPS_PRV_Intern(&pool, pValues[i]);
+  }
+
+  for (i=0; i<numEnums; i++) {
+
+    pImageEnum = (CFSCFG_IMAGE_ENUM*)((char*)pImage + pImage->enums) + i;
+
+    pImageEnum->name = CFSRPS_PRV_Intern(&pool, pEnums[i].szName);
+    pImageEnum->first = pEnums[i].first;
+    pImageEnum->count = pEnums[i].count;
+  }
+
+  pImage = (CFSCFG_IMAGE*)realloc(pImage, size + pool.size);
+
+  memcpy((char*)pImage + size, pool.pStrings, pool.size);
+
+  memcpy(pImage->magic, CFSCFG_IMAGE_MAGIC, sizeof(pImage->magic));
+  pImage->version = CFSCFG_IMAGE_VERSION;
+  pImage->size = size + pool.size;
+  pImage->stringsSize = pool.size;
+
+  free(pool.pStrings);
+  free(pool.slots);
+  free(pParams);
+  free(pEnums);
+  free(pValues);
+
+  CSLIST_Destructor(&listing);
+  CSLIST_Destructor(&values);
+
+  return CFSRPS_PRV_NewSnapshot(pImage, 0);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFSRPS_PRV_CheckImage
+//
+// Validates an image read from a file: everything it refers to must
+// lie within the image.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  CFSRPS_PRV_CheckImage
+    (CFSCFG_IMAGE* pImage,
+     size_t size) {
+
+  uint32_t i;
+
+  uint32_t* pTable;
+  uint32_t* pValues;
+
+  CFSCFG_IMAGE_PARAM* pParams;
+  CFSCFG_IMAGE_ENUM* pEnums;
+
+  if (size < sizeof(CFSCFG_IMAGE) ||
+      memcmp(pImage->magic, CFSCFG_IMAGE_MAGIC, sizeof(pImage->magic)) ||
+      pImage->version != CFSCFG_IMAGE_VERSION ||
+      pImage->size != size) {
+    return CS_FAILURE;
+  }
+
+  // The string pool comes last and ends with a null character
+
+  if (((pImage->params | pImage->table | 
+        pImage->enums | pImage->values) & 3) != 0 ||
+      pImage->params > size ||
+      pImage->numParams > 
+           (size - pImage->params) / sizeof(CFSCFG_IMAGE_PARAM) ||
+      pImage->table > size ||
+      pImage->tableSize > (size - pImage->table) / sizeof(uint32_t) ||
+      pImage->tableSize <= pImage->numParams ||
+      (pImage->tableSize & (pImage->tableSize - 1)) != 0 ||
+      pImage->enums > size ||
+      pImage->numEnums > 
+           (size - pImage->enums) / sizeof(CFSCFG_IMAGE_ENUM) ||
+      pImage->values > size ||
+      pImage->numValues > (size - pImage->values) / sizeof(uint32_t) ||
+      pImage->strings > size ||
+      pImage->stringsSize != size - pImage->strings ||
+      pImage->stringsSize == 0 ||
+      ((char*)pImage)[size - 1] != 0 ||
+      pImage->name >= pImage->stringsSize) {
+    return CS_FAILURE;
+  }
+
+  pParams = (CFSCFG_IMAGE_PARAM*)((char*)pImage + pImage->params);
+
+  for (i=0; i<pImage->numParams; i++) {
+    if (pParams[i].name >= pImage->stringsSize ||
+        pParams[i].value >= pImage->stringsSize) {
+      return CS_FAILURE;
+    }
+  }
+
+  pTable = (uint32_t*)((char*)pImage + pImage->table);
+
+  for (i=0; i<pImage->tableSize; i++) {
+    if (pTable[i] > pImage->numParams) {
+      return CS_FAILURE;
+    }
+  }
+
+  pEnums = (CFSCFG_IMAGE_ENUM*)((char*)pImage + pImage->enums);
+
+  for (i=0; i<pImage->numEnums; i++) {
+    if (pEnums[i].name >= pImage->stringsSize ||
+        pEnums[i].first > pImage->numValues ||
+        pEnums[i].count > pImage->numValues - pEnums[i].first) {
+      return CS_FAILURE;
+    }
+  }
+
+  pValues = (uint32_t*)((char*)pImage + pImage->values);
+
+  for (i=0; i<pImage->numValues; i++) {
+    if (pValues[i] >= pImage->stringsSize) {
+      return CS_FAILURE;
+    }
+  }
+
+  return CS_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFSRPS_PRV_FreeSnapshot
+//
+//////////////////////////////////////////////////////////////////////////////
+
+void
+  CFSRPS_PRV_FreeSnapshot
+    (CFSCFG_SNAPSHOT* pSnapshot) {
+
+  if (pSnapshot->mapped) {
+    munmap(pSnapshot->pImage, pSnapshot->pImage->size);
+  }
+  else {
+    free(pSnapshot->pImage);
+  }
+
+  free(pSnapshot->szFile);
+  free(pSnapshot);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFSRPS_PRV_Watch
+//
+// Watches the directory of a configuration file (editors usually
+// replace the file rather than write it in place). Returns the watch
+// descriptor, or -1 if the file cannot be watched.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+int
+  CFSRPS_PRV_Watch
+    (char* szFile) {
+
+  char* pSep;
+
+  char szDir[256];
+
+  if (g_CFSRPS_Inotify < 0) {
+    if ((g_CFSRPS_Inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+      return -1;
+    }
+  }
+
+  if ((pSep = strrchr(szFile, '/')) == NULL) {
+    strcpy(szDir, ".");
+  }
+  else {
+
+    if (pSep - szFile >= sizeof(szDir)) {
+      return -1;
+    }
+
+    if (pSep == szFile) {
+      strcpy(szDir, "/");
+    }
+    else {
+      memcpy(szDir, szFile, pSep - szFile);
+      szDir[pSep - szFile] = 0;
+    }
+  }
+
+  return inotify_add_watch(g_CFSRPS_Inotify, szDir, CFSRPS_WATCH_EVENTS);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFSRPS_PRV_Invalidate
+//
+// Removes a snapshot from the cache; it is freed once the handles 
+// opened on it are closed.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+void
+  CFSRPS_PRV_Invalidate
+    (CFSCFG_SNAPSHOT* pSnapshot) {
+
+  CFSCFG_SNAPSHOT** ppNext;
+
+  for (ppNext = &g_CFSRPS_Cache; *ppNext != NULL; 
+       ppNext = &((*ppNext)->next)) {
+
+    if (*ppNext == pSnapshot) {
+      *ppNext = pSnapshot->next;
+      break;
+    }
+  }
+
+  pSnapshot->next = NULL;
+  pSnapshot->stale = 1;
+
+  if (pSnapshot->refCount == 0) {
+    CFSRPS_PRV_FreeSnapshot(pSnapshot);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFSRPS_PRV_CacheFlush
+//
+//////////////////////////////////////////////////////////////////////////////
+
+void
+  CFSRPS_PRV_CacheFlush
+    (void) {
+
+  while (g_CFSRPS_Cache != NULL) {
+    CFSRPS_PRV_Invalidate(g_CFSRPS_Cache);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFSRPS_PRV_CacheRefresh
+//
+// Removes the configurations that changed since they were cached.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+void
+  CFSRPS_PRV_CacheRefresh
+    (void) {
+
+  int rc;
+
+  char* pName;
+
+  char buffer[4096] 
+    __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+  struct inotify_event* pEvent;
+
+  CFSCFG_SNAPSHOT* pSnapshot;
+  CFSCFG_SNAPSHOT* pNext;
+
+#ifdef __CLARASOFT_CFS_POSTGRESQL_SUPPORT
+
+  PGnotify* pNotify;
+
+#endif
+
+  if (g_CFSRPS_CachePid != getpid()) {
+
+    ///////////////////////////////////////////////////////////////////
+    // We were forked: what we inherited is shared with the parent.
+    // We drop our copies of its descriptors; the parent's database
+    // connection is not terminated (nor freed) since the parent 
+    // still uses it.
+    ///////////////////////////////////////////////////////////////////
+
+    if (g_CFSRPS_CachePid != 0) {
+
+      if (g_CFSRPS_Inotify >= 0) {
+        close(g_CFSRPS_Inotify);
+        g_CFSRPS_Inotify = -1;
+      }
+
+#ifdef __CLARASOFT_CFS_POSTGRESQL_SUPPORT
+
+      if (g_CFSRPS_Conn != NULL) {
+        close(PQsocket(g_CFSRPS_Conn));
+        g_CFSRPS_Conn = NULL;
+      }
+
+#endif
+
+      CFSRPS_PRV_CacheFlush();
+    }
+
+    g_CFSRPS_CachePid = getpid();
+  }
+
+  if (g_CFSRPS_Reload) {
+    g_CFSRPS_Reload = 0;
+    CFSRPS_PRV_CacheFlush();
+  }
+
+  // Configuration files that changed
+
+  if (g_CFSRPS_Inotify >= 0) {
+
+    CFSRPS_CACHEREFRESH_READ:
+
+    while ((rc = read(g_CFSRPS_Inotify, buffer, sizeof(buffer))) > 0) {
+
+      for (pName = buffer; pName < buffer + rc; 
+           pName += sizeof(struct inotify_event) + pEvent->len) {
+
+        pEvent = (struct inotify_event*)pName;
+
+        if (pEvent->mask & IN_Q_OVERFLOW) {
+          g_CFSRPS_Changes++;
+          CFSRPS_PRV_CacheFlush();
+          continue;
+        }
+
+        for (pSnapshot = g_CFSRPS_Cache; pSnapshot != NULL; 
+             pSnapshot = pNext) {
+
+          pNext = pSnapshot->next;
+
+          if (pSnapshot->szFile == NULL || pSnapshot->wd != pEvent->wd) {
+            continue;
+          }
+
+          // IN_IGNORED: the directory is no longer watched
+
+          if ((pEvent->mask & IN_IGNORED) ||
+              (pEvent->len > 0 && 
+               !strcmp(pEvent->name, 
+                       strrchr(pSnapshot->szFile, '/') == NULL ? 
+                       pSnapshot->szFile :
+                       strrchr(pSnapshot->szFile, '/') + 1))) {
+
+            if (!pSnapshot->mapped) {
+              g_CFSRPS_Changes++;
+            }
+
+            CFSRPS_PRV_Invalidate(pSnapshot);
+          }
+        }
+      }
+    }
+
+    if (rc < 0 && errno == EINTR) {
+      goto CFSRPS_CACHEREFRESH_READ;
+    }
+  }
+
+#ifdef __CLARASOFT_CFS_POSTGRESQL_SUPPORT
+
+  ///////////////////////////////////////////////////////////////////
+  // Configurations changed in the database; an empty payload means
+  // that all configurations must be reloaded. If we lost the 
+  // connection, we may have missed notifications.
+  ///////////////////////////////////////////////////////////////////
+
+  if (g_CFSRPS_Conn != NULL) {
+
+    if (!PQconsumeInput(g_CFSRPS_Conn) || 
+        PQstatus(g_CFSRPS_Conn) == CONNECTION_BAD) {
+
+      PQfinish(g_CFSRPS_Conn);
+      g_CFSRPS_Conn = NULL;
+      g_CFSRPS_Changes++;
+      CFSRPS_PRV_CacheFlush();
+    }
+    else {
+
+      while ((pNotify = PQnotifies(g_CFSRPS_Conn)) != NULL) {
+
+        if (pNotify->extra == NULL || pNotify->extra[0] == 0) {
+          g_CFSRPS_Changes++;
+          CFSRPS_PRV_CacheFlush();
+        }
+        else {
+
+          for (pSnapshot = g_CFSRPS_Cache; pSnapshot != NULL; 
+               pSnapshot = pSnapshot->next) {
+
+            if (!strcmp(pSnapshot->szName, pNotify->extra)) {
+
+              if (!pSnapshot->mapped) {
+                g_CFSRPS_Changes++;
+              }
+
+              CFSRPS_PRV_Invalidate(pSnapshot);
+              break;
+            }
+          }
+        }
+
+        PQfreemem(pNotify);
+      }
+    }
+  }
+
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFSRPS_PRV_ImagePath
+//
+// Builds the path of the image of a configuration in a directory.
+// Characters of the configuration name other than letters, digits,
+// '-' and '_' are escaped (%XX) in the file name.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  CFSRPS_PRV_ImagePath
+    (char* szDir,
+     char* szConfig,
+     char* szPath,
+     long size) {
+
+  long len;
+
+  if (szDir == NULL || szDir[0] == 0) {
+    return CS_FAILURE;
+  }
+
+  len = snprintf(szPath, size, "%s/", szDir);
+
+  for (; *szConfig != 0 && len + 3 < size; szConfig++) {
+
+    if (isalnum((unsigned char)(*szConfig)) || 
+        *szConfig == '-' || *szConfig == '_') {
+      szPath[len++] = *szConfig;
+    }
+    else {
+      len += sprintf(szPath + len, "%%%02X", (unsigned char)(*szConfig));
+    }
+  }
+
+  if (*szConfig != 0 || len + sizeof(".cfgi") > size) {
+    return CS_FAILURE;
+  }
+
+  strcpy(szPath + len, ".cfgi");
+
+  return CS_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFSRPS_PRV_MapImage
+//
+// Maps the compiled image of a configuration, if there is one in the
+// directory named by the CFS_CONFIG_IMAGES environment variable. The
+// image file is watched like a configuration file: it is replaced (not
+// modified) when the configuration is compiled again.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CFSCFG_SNAPSHOT*
+  CFSRPS_PRV_MapImage
+    (char* szConfig) {
+
+  int fd;
+  int wd;
+
+  char szPath[1024];
+
+  struct stat fileInfo;
+
+  CFSCFG_IMAGE* pImage;
+  CFSCFG_SNAPSHOT* pSnapshot;
+
+  if (CS_FAIL(CFSRPS_PRV_ImagePath(getenv(CFSRPS_IMAGES_ENV), szConfig,
+                                   szPath, sizeof(szPath)))) {
+    return NULL;
+  }
+
+  // Watch before reading so that we do not miss a change
+
+  wd = CFSRPS_PRV_Watch(szPath);
+
+  if ((fd = open(szPath, O_RDONLY | O_CLOEXEC)) < 0) {
+    return NULL;
+  }
+
+  if (fstat(fd, &fileInfo) < 0 || 
+      fileInfo.st_size < sizeof(CFSCFG_IMAGE) ||
+      fileInfo.st_size > UINT32_MAX) {
+    close(fd);
+    return NULL;
+  }
+
+  pImage = (CFSCFG_IMAGE*)mmap(NULL, fileInfo.st_size, PROT_READ, 
+                               MAP_SHARED, fd, 0);
+
+  close(fd);
+
+  if (pImage == MAP_FAILED) {
+    return NULL;
+  }
+
+  if (CS_FAIL(CFSRPS_PRV_CheckImage(pImage, fileInfo.st_size)) ||
+      strcmp(CFSCFG_IMAGE_STRING(pImage, pImage->name), szConfig)) {
+    munmap(pImage, fileInfo.st_size);
+    return NULL;
+  }
+
+  pSnapshot = CFSRPS_PRV_NewSnapshot(pImage, 1);
+
+  pSnapshot->szFile = CFSRPS_PRV_CopyString(szPath);
+  pSnapshot->wd = wd;
+  pSnapshot->stale = (wd < 0);
+
+  return pSnapshot;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFSRPS_CompileConfig
+//
+// Loads a configuration from the repository and writes its image in
+// a directory; processes started with CFS_CONFIG_IMAGES set to that
+// directory then map the image instead of loading the configuration.
+// The image file is replaced atomically: processes that mapped the
+// previous image keep it until they see that the file changed. The 
+// image is only readable by our user (it may hold secrets). The 
+// configuration we loaded is cached, so that CFSRPS_Changed tells
+// when it must be compiled again.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  CFSRPS_CompileConfig
+    (CFSRPS* pRepo,
+     char* szConfig,
+     char* szDir) {
+
+  int fd;
+
+  long rc;
+
+  uint32_t written;
+
+  char szPath[1024];
+  char szTempPath[1040];
+
+  CFSCFG_SNAPSHOT* pSnapshot;
+  CFSCFG_SNAPSHOT* pCached;
+
+  if (szConfig == NULL ||
+      CS_FAIL(CFSRPS_PRV_ImagePath(szDir, szConfig, 
+                                   szPath, sizeof(szPath)))) {
+    return CS_FAILURE;
+  }
+
+  if ((pSnapshot = CFSRPS_PRV_Load(pRepo, szConfig)) == NULL) {
+    return CS_FAILURE;
+  }
+
+  snprintf(szTempPath, sizeof(szTempPath), "%s.%d", szPath, (int)getpid());
+
+  if ((fd = open(szTempPath, 
+                 O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)) < 0) {
+    CFSRPS_PRV_FreeSnapshot(pSnapshot);
+    return CS_FAILURE;
+  }
+
+  written = 0;
+
+  while (written < pSnapshot->pImage->size) {
+
+    rc = write(fd, (char*)(pSnapshot->pImage) + written, 
+               pSnapshot->pImage->size - written);
+
+    if (rc < 0) {
+
+      if (errno == EINTR) {
+        continue;
+      }
+
+      close(fd);
+      unlink(szTempPath);
+      CFSRPS_PRV_FreeSnapshot(pSnapshot);
+      return CS_FAILURE;
+    }
+
+    written += rc;
+  }
+
+  if (close(fd) < 0 || rename(szTempPath, szPath) < 0) {
+    unlink(szTempPath);
+    CFSRPS_PRV_FreeSnapshot(pSnapshot);
+    return CS_FAILURE;
+  }
+
+  // Our own copy of the configuration is replaced by the one we loaded
+
+  CFSRPS_PRV_CacheRefresh();
+
+  for (pCached = g_CFSRPS_Cache; pCached != NULL; 
+       pCached = pCached->next) {
+
+    if (!strcmp(pCached->szName, szConfig)) {
+      CFSRPS_PRV_Invalidate(pCached);
+      break;
+    }
+  }
+
+  if (pSnapshot->stale) {
+    CFSRPS_PRV_FreeSnapshot(pSnapshot);
+  }
+  else {
+    pSnapshot->next = g_CFSRPS_Cache;
+    g_CFSRPS_Cache = pSnapshot;
+  }
+
+  return CS_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFSRPS_OpenConfig
+//
+// Opens a configuration. Configurations are cached: the configuration
+// is mapped from its image or loaded from the repository only the 
+// first time it is opened in this process or if it changed since.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CFSCFG*
+  CFSRPS_OpenConfig
+    (CFSRPS* pRepo,
+     char* szConfig) {
+
+  CFSCFG* pConfig;
+  CFSCFG_SNAPSHOT* pSnapshot;
+
+  if (szConfig == NULL) {
+    return NULL;
+  }
+
+  CFSRPS_PRV_CacheRefresh();
+
+  for (pSnapshot = g_CFSRPS_Cache; pSnapshot != NULL; 
+       pSnapshot = pSnapshot->next) {
+
+    if (!strcmp(pSnapshot->szName, szConfig)) {
+      break;
+    }
+  }
+
+  if (pSnapshot == NULL) {
+
+    if ((pSnapshot = CFSRPS_PRV_MapImage(szConfig)) == NULL &&
+        (pSnapshot = CFSRPS_PRV_Load(pRepo, szConfig)) == NULL) {
+      return NULL;
+    }
+
+    if (!pSnapshot->stale) {
+      pSnapshot->next = g_CFSRPS_Cache;
+      g_CFSRPS_Cache = pSnapshot;
+    }
+  }
+
+  (pSnapshot->refCount)++;
+
+  pConfig = (CFSCFG*)malloc(sizeof(CFSCFG));
+
+  pConfig->pSnapshot = pSnapshot;
+  pConfig->pEnum = NULL;
+  pConfig->enumIndex = 0;
+
+  return pConfig;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFSRPS_Reload
+//
+// Discards the cached configurations; they will be loaded again when
+// next opened. This only sets a flag and may be called from a signal
+// handler.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+void
+  CFSRPS_Reload
+    (void) {
+
+  g_CFSRPS_Reload = 1;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CFSRPS_Changed
+//
+// Tells if a configuration loaded from the repository (not mapped 
+// from an image) changed since it was cached or since the previous
+// call. Changes of configurations that were not cached are not seen.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+int
+  CFSRPS_Changed
+    (void) {
+
+  int changed;
+
+  CFSRPS_PRV_CacheRefresh();
+
+  changed = (g_CFSRPS_Changes != 0);
+  g_CFSRPS_Changes = 0;
+
+  return changed;
+}
+
+char* 
+  CFSCFG_LookupParam
+    (CFSCFG* This,
+     char* szParam) {
+
+  uint32_t i;
+  uint32_t mask;
+  uint32_t hash;
+
+  uint32_t* pTable;
+
+  CFSCFG_IMAGE* pImage;
+  CFSCFG_IMAGE_PARAM* pParam;
+
+  pImage = This->pSnapshot->pImage;
+  pTable = (uint32_t*)((char*)pImage + pImage->table);
+
+  hash = CFSRPS_PRV_Hash(szParam);
+  mask = pImage->tableSize - 1;
+
+  for (i = hash & mask; pTable[i] != 0; i = (i + 1) & mask) {
+
+    pParam = (CFSCFG_IMAGE_PARAM*)((char*)pImage + pImage->params) + 
+             (pTable[i] - 1);
+
+    if (pParam->hash == hash && 
+        !strcmp(CFSCFG_IMAGE_STRING(pImage, pParam->name), szParam)) {
+      return CFSCFG_IMAGE_STRING(pImage, pParam->value);
+    }
+  }
+
+  return NULL;
+}
+
+CSRESULT
+  CFSCFG_IterStart
+    (CFSCFG* This, 
+     char* szEnum) {
+
+  int rc;
+
+  uint32_t low;
+  uint32_t high;
+  uint32_t middle;
+
+  CFSCFG_IMAGE* pImage;
+  CFSCFG_IMAGE_ENUM* pEnums;
+
+  This->enumIndex = 0;
+  This->pEnum = NULL;
+
+  pImage = This->pSnapshot->pImage;
+  pEnums = (CFSCFG_IMAGE_ENUM*)((char*)pImage + pImage->enums);
+
+  // Enumerations are sorted by name
+
+  low = 0;
+  high = pImage->numEnums;
+
+  while (low < high) {
+
+    middle = low + (high - low) / 2;
+
+    rc = strcmp(CFSCFG_IMAGE_STRING(pImage, pEnums[middle].name), szEnum);
+
+    if (rc == 0) {
+      This->pEnum = &(pEnums[middle]);
+      return CS_SUCCESS;
+    }
+
+    if (rc < 0) {
+      low = middle + 1;
+    }
+    else {
+      high = middle;
+    }
+  }
+
+  return CS_FAILURE;
+}
+
+char*
+  CFSCFG_IterNext
+    (CFSCFG* This) {
+
+  CFSCFG_IMAGE* pImage;
+
+  if (This->pEnum != NULL && This->enumIndex < This->pEnum->count) {
+
+    pImage = This->pSnapshot->pImage;
+
+    return CFSCFG_IMAGE_STRING(pImage, 
+             ((uint32_t*)((char*)pImage + pImage->values))
+                [This->pEnum->first + (This->enumIndex)++]);
+  }
+
+  return NULL;
+}
+
+CSRESULT
+  CFSRPS_CloseConfig
+    (CFSRPS* pRepo,
+     CFSCFG** pConfig) {
+
+  CFSCFG_SNAPSHOT* pSnapshot;
+
+  if ((pConfig != NULL) && (*pConfig != NULL)) {
+
+    pSnapshot = (*pConfig)->pSnapshot;
+
+    if (--(pSnapshot->refCount) == 0 && pSnapshot->stale) {
+      CFSRPS_PRV_FreeSnapshot(pSnapshot);
+    }
 
-    CSJSON_Destructor(&((*pConfig)->pJson));
     free(*pConfig);
     *pConfig = NULL;
     return CS_SUCCESS;
@@ -35,6 +35,9 @@
 
 #include <clarasoft/cslib.h>
 
+// Directory of compiled configuration images (see CFSRPS_CompileConfig)
+#define CFSRPS_IMAGES_ENV             "CFS_CONFIG_IMAGES"
+
 typedef void* CFSRPS;
 typedef void* CFSCFG;
 
@@ -70,6 +73,20 @@ CSRESULT
   CFSRPS_Close
     (CFSRPS* This);
 
+CSRESULT
+  CFSRPS_CompileConfig
+    (CFSRPS This,
+     char* szConfig,
+     char* szDir);
+
+void
+  CFSRPS_Reload
+    (void);
+
+int
+  CFSRPS_Changed
+    (void);
+
 #endif
 
 
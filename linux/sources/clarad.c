@@ -33,16 +33,20 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <netinet/in.h>
+#include <pthread.h>
 #include <signal.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/poll.h>
 #include <sys/prctl.h>
 #include <sys/signal.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 #include <syslog.h>
 #include <time.h>
@@ -74,15 +78,143 @@ int
   RunAsDaemon
     (int argc, char **argv);
 
+void
+  SuperviseAcceptors
+    (char* szHandlerConfig);
+
+void
+  CompileConfigs
+    (void);
+
+void
+  ReloadConfigs
+    (void);
+
+void
+  CheckConfigs
+    (void);
+
+CSRESULT
+  OpenRuntimeDir
+    (char* szBaseDir);
+
+CSRESULT
+  RuntimePath
+    (char* szPath,
+     int size,
+     char* szName);
+
+void
+  ReapHandlers
+    (void);
+
+void
+  StopDaemon
+    (void);
+
+void
+  AcceptConnections
+    (void);
+
+void
+  ReceiveCredits
+    (int slot);
+
+void
+  DispatchConnections
+    (void);
+
+void
+  ScaleHandlers
+    (char* szHandlerConfig);
+
+pid_t
+  StartZygote
+    (char *szHandler,
+     char *szConfig);
+
+pid_t
+  CloneFromZygote
+    (int handler_fd);
+
+void
+  ReadLateClones
+    (void);
+
+void
+  FormatPeerName
+    (struct sockaddr_in6* client,
+     char* szPeerName);
+
+CSRESULT
+  OpenDaemonLog
+    (void);
+
+void
+  CloseDaemonLog
+    (void);
+
+void
+  DaemonLog
+    (char* szFormat, ...);
+
+void
+  LogConnection
+    (pid_t pid,
+     struct sockaddr_in6* client);
+
+void*
+  DaemonLogWriter
+    (void* arg);
+
+#define CLARAD_DFT_IDLE_TIMEOUT    (60)
+#define CLARAD_DFT_MIN_SPARE       (1)
+#define CLARAD_DFT_MAX_SPARE       (4)
+#define CLARAD_DFT_STARTUP_TIME    (100)  // milliseconds
+#define CLARAD_DFT_RUNTIME_DIR     "/run/clarad"
+#define CLARAD_MAX_SPAWN_RATE      (32)   // handlers started per second
+#define CLARAD_MAX_SPAWN_BATCH     (2)    // handlers started per pass
+#define CLARAD_ZYGOTE_WAIT         (5)    // milliseconds
+#define CLARAD_ZYGOTE_MAX_LATE     (4)
+#define CLARAD_SCALE_INTERVAL      (1000) // milliseconds
+#define CLARAD_MAX_EVENTS          (256)
+#define CLARAD_MAX_PENDING         (1024)
+#define CLARAD_LISTENER_ID         (0xFFFFFFFF)
+
+#define CLARAD_LOG_RECORDS         (4096) // must be a power of 2
+#define CLARAD_LOG_TEXT_SIZE       (256)
+#define CLARAD_LOG_LINE_SIZE       (512)
+#define CLARAD_LOG_BATCH           (64)
+#define CLARAD_LOG_FLUSH_INTERVAL  (10)   // milliseconds
+
+#define CLARAD_LOG_TEXT            (0)
+#define CLARAD_LOG_CONN            (1)
+
 typedef struct tagHANDLERINFO
 {
 
   pid_t pid;  // the handler's PID
   int stream; // stream pipe
-  int state;  // child state (1 == executing, 0 == waiting, -1 terminated)
+  int state;  // child state (2 == starting, 1 == executing, 0 == waiting)
+
+  time_t lastActivity; // last state change reported by the handler
+
+  struct timespec started; // when the handler was spawned
+
+  int credits;  // number of connections the handler can still take
+  int capacity; // highest number of credits seen (handler is idle)
+  int ready;   // 1 if the handler slot is in the ready ring
 
 } HANDLERINFO;
 
+typedef struct tagCONFIGIMAGE
+{
+
+  ino_t ino;           // the image file before compiling
+  char szPath[1024];
+
+} CONFIGIMAGE;
+
 typedef struct tagDAEMON {
 
   int initialNumHandlers;
@@ -93,36 +225,206 @@ typedef struct tagDAEMON {
   int iDaemonNameLength;
   int iPeerNameSize;
 
+  /////////////////////////////////////////////////////////////////////
+  // When reusePort is set, each handler binds its own listening
+  // socket on the daemon port and accepts connections directly;
+  // the daemon only supervises the handlers.
+  /////////////////////////////////////////////////////////////////////
+
+  int reusePort;
+  int cpuAffinity;
+  int numCpus;
+  int backlog;
+  int idleTimeout;
+  int minSpare;
+  int maxSpare;
+
+  char szPort[11];
+
   char* szDaemonName;
   char* szProtocolHandler;
 
-  char szPeerName[256];
   char szLogDir[1024];
   char szLogName[256];
+  char* pszLogPattern;
   char szLogFile[2049];
 
-  struct pollfd listenerFdSet[1];
   struct pollfd *handlerFdSet;
 
-  CSLIST handlers;
+  HANDLERINFO* handlers;
+
+  /////////////////////////////////////////////////////////////////////
+  // The dispatcher waits on the listening socket and the handler
+  // stream pipes with epoll. Handlers that can take connections are
+  // kept in a ring of slot indexes so that an available handler is
+  // found in constant time. Accepted connections that no handler can
+  // take yet wait in the pending ring; when it is full, we stop
+  // accepting and leave connections in the listen backlog.
+  /////////////////////////////////////////////////////////////////////
+
+  int epoll_fd;
+  int numStarting;
+  int listenerPaused;
+
+  int* readyRing;
+  int readyHead;
+  int readyCount;
+
+  int pendingFds[CLARAD_MAX_PENDING];
+  struct sockaddr_in6 pendingPeers[CLARAD_MAX_PENDING];
+  int pendingHead;
+  int pendingCount;
+
+  /////////////////////////////////////////////////////////////////////
+  // Scaling controller: keeps enough spare handlers to absorb the 
+  // connections that arrive while an additional handler starts. The
+  // arrival rate (connections per second) and the handler start-up 
+  // time (milliseconds) are smoothed over the scaling intervals.
+  /////////////////////////////////////////////////////////////////////
+
+  time_t lastScale;
+  long arrivals;
+  double arrivalRate;
+  double startupTime;
+  int maxReached;
+
+  /////////////////////////////////////////////////////////////////////
+  // Starting a handler blocks the dispatcher (fork and exec), so only
+  // a few are started per pass of the main loop; while spawnPending 
+  // is set, the controller runs again on the next pass, which does not
+  // wait for events. spawned counts the handlers started during the 
+  // current second.
+  /////////////////////////////////////////////////////////////////////
+
+  int spawned;
+  int spawnPending;
+
+  /////////////////////////////////////////////////////////////////////
+  // Zygote mode: handlers are cloned from an initialized template 
+  // process instead of being executed; we fall back to executing the
+  // handler until the zygote reports it is ready (zygoteReady is -1
+  // while a zygote that failed is terminating). zygoteLate counts the
+  // clone requests we stopped waiting for; their replies come first.
+  /////////////////////////////////////////////////////////////////////
+
+  int zygote;
+  int zygoteReady;
+  int zygoteStream;
+  int zygoteLate;
+  pid_t zygotePid;
+
+  /////////////////////////////////////////////////////////////////////
+  // Private directory (RUNTIME_DIR/<configuration>, mode 0700) holding
+  // the files shared with the handlers; unlike the log directory, no
+  // file in it is removed by CleanupLogs.
+  /////////////////////////////////////////////////////////////////////
+
+  char szRunDir[1024];
+
+  /////////////////////////////////////////////////////////////////////
+  // Shared-memory scoreboard, one slot per handler slot; handlers
+  // update their own slot counters (see CFS_SCOREBOARD in cfsapi.h).
+  /////////////////////////////////////////////////////////////////////
+
+  CFS_SCOREBOARD* scoreboard;
+  char szScoreboard[1024];
+
+  /////////////////////////////////////////////////////////////////////
+  // TLS session ticket keys and session cache shared by handlers; we
+  // rotate the ticket keys.
+  /////////////////////////////////////////////////////////////////////
+
+  CFS_TLSSHARE* tlsShare;
+  int tlsShareFd;
+  char szTlsShare[16];
+
+  /////////////////////////////////////////////////////////////////////
+  // Compiled images of the configurations used by the handlers (see
+  // CFSRPS_CompileConfig), kept in the runtime directory; they are 
+  // compiled again on SIGHUP, which only sets the reload flag, and
+  // when the repository reports that a configuration changed (checked
+  // at most once per second).
+  /////////////////////////////////////////////////////////////////////
+
+  char szConfig[99];
+  char szHandlerConfig[99];
+  char szConfigImages[1024];
+  volatile sig_atomic_t reload;
+  time_t lastConfigCheck;
+
+  /////////////////////////////////////////////////////////////////////
+  // Set by SIGCHLD; terminated handlers are released by the main loop
+  // (see ReapHandlers) once the events of the current pass are 
+  // processed, so that a slot is never reused while events for its
+  // previous handler are pending.
+  /////////////////////////////////////////////////////////////////////
+
+  volatile sig_atomic_t childExited;
+
+  /////////////////////////////////////////////////////////////////////
+  // Set by SIGTERM; the main loop stops the daemon (see StopDaemon).
+  // Nothing else is done in the signal handler: it could interrupt
+  // the main loop while it holds a log record or the handler table.
+  /////////////////////////////////////////////////////////////////////
+
+  volatile sig_atomic_t terminate;
 
 } DAEMON;
 
+typedef struct tagLOGRECORD
+{
+  unsigned long sequence; // ring position + 1 when the record is readable
+
+  int type;   // CLARAD_LOG_TEXT or CLARAD_LOG_CONN
+  pid_t pid;  // handler receiving the connection (CLARAD_LOG_CONN)
+  time_t when;
+
+  struct sockaddr_in6 peer;
+
+  char szText[CLARAD_LOG_TEXT_SIZE];
+
+} LOGRECORD;
+
+/////////////////////////////////////////////////////////////////////////////
+// The daemon log is written by a background thread. The dispatcher 
+// (and the signal handlers) only reserve a record in a lock-free ring
+// and fill it; the writer thread formats the records and writes them
+// in batches. Records are stamped with a clock that the writer updates;
+// its value changes once per second. If the ring is full, records are
+// discarded and the number of discarded records is logged.
+/////////////////////////////////////////////////////////////////////////////
+
+typedef struct tagDAEMONLOG
+{
+  int fd;
+  int day;  // day of the year of the current log file
+  int stop;
+
+  time_t clock;
+
+  unsigned long head;    // next record to write (writer thread only)
+  unsigned long tail;    // next record to reserve
+  unsigned long dropped;
+
+  pthread_t writer;
+  pthread_mutex_t clockLock;
+
+  LOGRECORD records[CLARAD_LOG_RECORDS];
+
+} DAEMONLOG;
+
 /* --------------------------------------------------------------------------
   Globals
 -------------------------------------------------------------------------- */
 
-FILE* daemonlog;
+DAEMONLOG lg;
 
 time_t now;
-struct tm ts;
 
 int days;
 
 DAEMON d;
 
-char timestamp[80];
-
 /////////////////////////////////////////////////////////////////////////////
 // A descriptor set for the listener (a single instance) and
 // a descriptor set for the handler stream pipes. The number of
@@ -133,46 +435,31 @@ int main(int argc, char **argv)
 {
 
   int i;
-  int numDescriptors;
+  int numEvents;
   int on;
-  int rc;
   int backlog;
-  int handlerTimeout;
   int pid;
   int size;
 
-  //////////////////////////////////////////////////////////////
-  // The following is the client connection socket; when a new
-  // handler is spawned, this descriptor must be closed
-  // by both the parent and the child; the parent closes it
-  // after sending it to the child; the child has to close
-  // it before calling the exec function.
-  //////////////////////////////////////////////////////////////
-
-  int conn_fd;
-
-  char dummyData;
-
   char* pszParam;
 
   char szPort[11];
   char szConfig[99];
   char szHandlerConfig[99];
-
-  socklen_t socklen;
+  char szEnvConfig[99];
 
   struct sigaction sa;
 
-  struct sockaddr_in6 client;
   struct sockaddr_in6 server;
 
-  CSRESULT hResult;
+  struct epoll_event ev;
+  struct epoll_event events[CLARAD_MAX_EVENTS];
 
   CFSRPS pRepo;
+  CFSCFG pHandlerConfig;
   CFSCFG pConfig;
 
   HANDLERINFO hi;
-  HANDLERINFO* phi;
  
   openlog(basename(argv[0]), LOG_PID, LOG_LOCAL3);
 
@@ -235,14 +522,12 @@ int main(int argc, char **argv)
 
   ////////////////////////////////////////////////////////////////////////////
   // Set signal handlers.
-  // We will monitor for SIGCHLD and SIGTERM.
+  // We will monitor for SIGCHLD, SIGTERM and SIGHUP (configuration reload).
   ////////////////////////////////////////////////////////////////////////////
 
-  // ignore SIGHUP
-  sa.sa_handler = SIG_IGN;
+  sa.sa_handler = signalCatcher;
   sa.sa_flags = 0; // or SA_RESTART
   sigemptyset(&sa.sa_mask);
-  sa.sa_sigaction = (void *)signalCatcher;
 
   sigaction(SIGHUP, &sa, NULL);
 
@@ -293,19 +578,25 @@ int main(int argc, char **argv)
      days = atoi(pszParam);
   }
 
-  CleanupLogs(d.szLogDir, d.szLogName, days);
+  // Old log files are removed from the directory part of LOGFILE
 
-  time(&now);
-  ts = *localtime(&now);
-  strftime(timestamp, sizeof(timestamp), "%Y-%m-%d-%H-%M-%S", &ts);
-
-  sprintf(d.szLogFile, 
-          "%s-%s-log.txt",
-          d.szLogName, timestamp);    
+  if ((pszParam = strrchr(d.szLogName, '/')) == NULL) {
+    strcpy(d.szLogDir, ".");
+    d.pszLogPattern = d.szLogName;
+  }
+  else {
+    size = pszParam - d.szLogName;
+    memcpy(d.szLogDir, d.szLogName, size);
+    d.szLogDir[size] = 0;
+    if (size == 0) {
+      strcpy(d.szLogDir, "/");
+    }
+    d.pszLogPattern = pszParam + 1;
+  }
 
-  daemonlog = fopen(d.szLogFile, "w+");
+  CleanupLogs(d.szLogDir, d.pszLogPattern, days);
 
-  if (!daemonlog) {
+  if (CS_FAIL(OpenDaemonLog())) {
     syslog(LOG_ERR, "can't open log file : %s", d.szLogFile);
     closelog();
     CFSRPS_CloseConfig(pRepo, &pConfig);
@@ -319,13 +610,8 @@ int main(int argc, char **argv)
 
   if ((pszParam = CFSCFG_LookupParam(pConfig, "HANDLER")) == NULL)
   {
-    time(&now);
-    ts = *localtime(&now);
-    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &ts);
-
-    fprintf(daemonlog, "%s - CONF-ERR   HANDLER parameter not found\n",
-            timestamp);
-    fflush(daemonlog);
+    DaemonLog("CONF-ERR   HANDLER parameter not found");
+    CloseDaemonLog();
 
     CFSRPS_CloseConfig(pRepo, &pConfig);
     CFSRPS_Close(&pRepo);
@@ -337,21 +623,12 @@ int main(int argc, char **argv)
 
   strcpy(d.szProtocolHandler, pszParam);
 
-  time(&now);
-  ts = *localtime(&now);
-  strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &ts);
-
   pid = getpid();
 
   if ((pszParam = CFSCFG_LookupParam(pConfig, "PORT")) == NULL)
   {
-    time(&now);
-    ts = *localtime(&now);
-    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &ts);
-
-    fprintf(daemonlog, "%s - CONF-ERR   PORT parameter not found()\n",
-            timestamp);
-    fflush(daemonlog);
+    DaemonLog("CONF-ERR   PORT parameter not found()");
+    CloseDaemonLog();
 
     CFSRPS_CloseConfig(pRepo, &pConfig);
     CFSRPS_Close(&pRepo);
@@ -360,40 +637,46 @@ int main(int argc, char **argv)
 
   strcpy(szPort, pszParam);
 
-  fprintf(daemonlog, "%s - DAEMON-STR NAME: %s PID: %d CONFIG: %s "
-                     "port: %s "
-                     "handler: %s\n", 
-                     timestamp, d.szDaemonName, pid, 
-                     szConfig, szPort, d.szProtocolHandler);
-  fflush(daemonlog);
+  DaemonLog("DAEMON-STR NAME: %s PID: %d CONFIG: %s "
+            "port: %s "
+            "handler: %s", d.szDaemonName, pid,
+            szConfig, szPort, d.szProtocolHandler);
 
   if ((pszParam = CFSCFG_LookupParam(pConfig, "HANDLER_CONFIG"))== NULL)
   {
     strncpy(szHandlerConfig, argv[1], 99);
 
-    time(&now);
-    ts = *localtime(&now);
-    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &ts);
-
-    fprintf(daemonlog, "%s - CONF-WARN  HANDLER_CONFIG parameter not found"
-                       " - using daemon configuration\n",
-            timestamp);
-    fflush(daemonlog);
+    DaemonLog("CONF-WARN  HANDLER_CONFIG parameter not found"
+              " - using daemon configuration");
   }
   else {
     strncpy(szHandlerConfig, pszParam, 99);
   }
 
-  if ((pszParam = CFSCFG_LookupParam(pConfig, "LISTEN_BACKLOG")) == NULL)
+  strcpy(d.szConfig, szConfig);
+  memcpy(d.szHandlerConfig, szHandlerConfig, 98);
+  d.szHandlerConfig[98] = 0;
+
+  ////////////////////////////////////////////////////////////////////////////
+  // The handler environment tells whether handlers share TLS sessions
+  ////////////////////////////////////////////////////////////////////////////
+
+  szEnvConfig[0] = 0;
+
+  if ((pHandlerConfig = CFSRPS_OpenConfig(pRepo, szHandlerConfig)) != NULL)
   {
-    time(&now);
-    ts = *localtime(&now);
-    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &ts);
+    if ((pszParam = CFSCFG_LookupParam(pHandlerConfig, "ENV")) != NULL) {
+      strncpy(szEnvConfig, pszParam, 98);
+      szEnvConfig[98] = 0;
+    }
 
-    fprintf(daemonlog, "%s - CONF-WARN  LISTEN_BACKLOG parameter not found "
-                       "- using default value of 1024\n",
-            timestamp);
-    fflush(daemonlog);
+    CFSRPS_CloseConfig(pRepo, &pHandlerConfig);
+  }
+
+  if ((pszParam = CFSCFG_LookupParam(pConfig, "LISTEN_BACKLOG")) == NULL)
+  {
+    DaemonLog("CONF-WARN  LISTEN_BACKLOG parameter not found "
+              "- using default value of 1024");
 
     backlog = 1024;
   }
@@ -404,14 +687,8 @@ int main(int argc, char **argv)
 
   if ((pszParam = CFSCFG_LookupParam(pConfig, "RES_NUM_HANDLERS")) == NULL)
   {
-    time(&now);
-    ts = *localtime(&now);
-    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &ts);
-
-    fprintf(daemonlog, "%s - CONF-WARN  RES_NUM_HANDLERS parameter not found "
-                       "- using default value of 0\n",
-            timestamp);
-    fflush(daemonlog);
+    DaemonLog("CONF-WARN  RES_NUM_HANDLERS parameter not found "
+              "- using default value of 0");
 
     d.initialNumHandlers = 1; // this means all handlers will be transcient
   }
@@ -426,14 +703,8 @@ int main(int argc, char **argv)
 
   if ((pszParam = CFSCFG_LookupParam(pConfig, "MAX_NUM_HANDLERS")) == NULL)
   {
-    time(&now);
-    ts = *localtime(&now);
-    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &ts);
-
-    fprintf(daemonlog, "%s - CONF-WARN  MAX_NUM_HANDLERS parameter not found "
-                       "- using default value\n",
-            timestamp);
-    fflush(daemonlog);
+    DaemonLog("CONF-WARN  MAX_NUM_HANDLERS parameter not found "
+              "- using default value");
 
     d.maxNumHandlers = d.initialNumHandlers;
   }
@@ -445,13 +716,123 @@ int main(int argc, char **argv)
     }
   }
 
+  d.reusePort = 0;
+  d.cpuAffinity = 0;
+  d.backlog = backlog;
+  d.numCpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  strcpy(d.szPort, szPort);
+
+  if ((pszParam = CFSCFG_LookupParam(pConfig, "LISTEN_MODE")) != NULL)
+  {
+    if (!strcmp(pszParam, "*REUSEPORT")) {
+
+      ////////////////////////////////////////////////////////////////
+      // Only clarah accepts connections on its own listening socket
+      // (acceptor mode); other handlers would never see a connection.
+      ////////////////////////////////////////////////////////////////
+
+      if (strcmp(basename(d.szProtocolHandler), "clarah")) {
+
+        DaemonLog("CONF-ERR   LISTEN_MODE *REUSEPORT not supported "
+                  "by handler %s", d.szProtocolHandler);
+        CloseDaemonLog();
+
+        CFSRPS_CloseConfig(pRepo, &pConfig);
+        CFSRPS_Close(&pRepo);
+        exit(6);
+      }
+
+      d.reusePort = 1;
+
+      if ((pszParam = 
+              CFSCFG_LookupParam(pConfig, "ACCEPT_CPU_AFFINITY")) != NULL) {
+        if (!strcmp(pszParam, "*YES")) {
+          d.cpuAffinity = 1;
+        }
+      }
+    }
+  }
+
+  if ((pszParam = CFSCFG_LookupParam(pConfig, "HANDLER_IDLE_TIMEOUT")) == NULL)
+  {
+    d.idleTimeout = CLARAD_DFT_IDLE_TIMEOUT;
+  }
+  else
+  {
+    d.idleTimeout = atoi(pszParam);
+  }
+
+  if ((pszParam = CFSCFG_LookupParam(pConfig, "MIN_SPARE_HANDLERS")) == NULL)
+  {
+    d.minSpare = CLARAD_DFT_MIN_SPARE;
+  }
+  else
+  {
+    d.minSpare = atoi(pszParam);
+  }
+
+  if ((pszParam = CFSCFG_LookupParam(pConfig, "MAX_SPARE_HANDLERS")) == NULL)
+  {
+    d.maxSpare = CLARAD_DFT_MAX_SPARE;
+  }
+  else
+  {
+    d.maxSpare = atoi(pszParam);
+  }
+
+  if (d.maxSpare < d.minSpare) {
+    d.maxSpare = d.minSpare;
+  }
+
+  if ((pszParam = CFSCFG_LookupParam(pConfig, "RUNTIME_DIR")) == NULL)
+  {
+    pszParam = CLARAD_DFT_RUNTIME_DIR;
+  }
+
+  if (CS_FAIL(OpenRuntimeDir(pszParam))) {
+
+    DaemonLog("CONF-WARN  errno: %10d         "
+              "Failed creating runtime directory in %s", errno, pszParam);
+
+    d.szRunDir[0] = 0;
+  }
+
+  d.zygote = 0;
+  d.zygotePid = -1;
+  d.zygoteStream = -1;
+  d.zygoteLate = 0;
+
+  if ((pszParam = CFSCFG_LookupParam(pConfig, "ZYGOTE")) != NULL)
+  {
+    if (!strcmp(pszParam, "*YES")) {
+
+      if (d.reusePort) {
+        DaemonLog("CONF-WARN  ZYGOTE not supported in REUSEPORT "
+                  "listen mode - parameter ignored");
+      }
+      else {
+        d.zygote = 1;
+      }
+    }
+  }
+
   CFSRPS_CloseConfig(pRepo, &pConfig);
   CFSRPS_Close(&pRepo);
 
   ////////////////////////////////////////////////////////////////////////////
-  // Get listening socket
+  // Get listening socket; in REUSEPORT mode, handlers bind their own.
   ////////////////////////////////////////////////////////////////////////////
 
+  if (d.reusePort) {
+
+    d.listen_fd = -1;
+
+    DaemonLog("DAEMON-STR REUSEPORT listen mode: "
+              "handlers accept connections");
+
+    goto START_HANDLERS;
+  }
+
   server.sin6_family = AF_INET6;
   server.sin6_addr = in6addr_any;
   server.sin6_port = htons(atoi(szPort));
@@ -459,72 +840,158 @@ int main(int argc, char **argv)
   d.listen_fd = socket(AF_INET6, SOCK_STREAM, 0);
 
   on = 1;
-  hResult = setsockopt(d.listen_fd,
-                       SOL_SOCKET,
-                       SO_REUSEADDR,
-                       (void *)&on,
-                       sizeof(int));
+  setsockopt(d.listen_fd,
+             SOL_SOCKET,
+             SO_REUSEADDR,
+             (void *)&on,
+             sizeof(int));
 
   bind(d.listen_fd, (struct sockaddr *)&server, sizeof(server));
 
   listen(d.listen_fd, backlog);
 
-  // Assign listening socket to first wait container slot
+  // The listening socket is non-blocking so that pending 
+  // connections can be drained after a single wake-up
 
-  d.listenerFdSet[0].fd = d.listen_fd;
-  d.listenerFdSet[0].events = POLLIN;
+  fcntl(d.listen_fd, F_SETFL, fcntl(d.listen_fd, F_GETFL, 0) | O_NONBLOCK);
 
   ////////////////////////////////////////////////////////////////////////////
   // pre-fork connection handlers.
   ////////////////////////////////////////////////////////////////////////////
 
+  d.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+  ev.events = EPOLLIN;
+  ev.data.u32 = CLARAD_LISTENER_ID;
+
+  epoll_ctl(d.epoll_fd, EPOLL_CTL_ADD, d.listen_fd, &ev);
+
+  ////////////////////////////////////////////////////////////////////////////
+  // branching label
+  START_HANDLERS:
+
+  ////////////////////////////////////////////////////////////////////////////
+  // Create the scoreboard in the runtime directory; handlers find it 
+  // through the environment. The daemon runs without it if it can't be
+  // created.
+  ////////////////////////////////////////////////////////////////////////////
+
+  d.scoreboard = NULL;
+
+  if (CS_SUCCEED(RuntimePath(d.szScoreboard, 
+                             sizeof(d.szScoreboard), "scoreboard")) &&
+      (d.scoreboard = CFS_CreateScoreboard(d.szScoreboard, 
+                                           d.maxNumHandlers)) != NULL) {
+    setenv(CFS_SCOREBOARD_ENV, d.szScoreboard, 1);
+  }
+  else {
+    unsetenv(CFS_SCOREBOARD_ENV);
+    DaemonLog("SCBD-WARN  errno: %10d         "
+              "Failed creating scoreboard %s", errno, d.szScoreboard);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////
+  // The TLS share lives in an anonymous memory file; handlers inherit
+  // its descriptor and find its number in the environment.
+  ////////////////////////////////////////////////////////////////////////////
+
+  if ((d.tlsShare = CFS_CreateTlsShare(szEnvConfig[0] ? 
+                                         szEnvConfig : NULL,
+                                       &(d.tlsShareFd))) != NULL) {
+    snprintf(d.szTlsShare, sizeof(d.szTlsShare), "%d", d.tlsShareFd);
+    setenv(CFS_TLSSHARE_ENV, d.szTlsShare, 1);
+    DaemonLog("DAEMON-STR Handlers share TLS sessions");
+  }
+  else {
+    unsetenv(CFS_TLSSHARE_ENV);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////
+  // Compile the configurations used by the handlers; handlers map the
+  // images instead of each loading the configurations.
+  ////////////////////////////////////////////////////////////////////////////
+
+  d.reload = 0;
+  d.lastConfigCheck = 0;
+  d.childExited = 0;
+
+  if (CS_SUCCEED(RuntimePath(d.szConfigImages, 
+                             sizeof(d.szConfigImages), "configs")) &&
+      (mkdir(d.szConfigImages, 0700) == 0 || errno == EEXIST)) {
+    CompileConfigs();
+    setenv(CFSRPS_IMAGES_ENV, d.szConfigImages, 1);
+  }
+  else {
+    DaemonLog("CONF-WARN  errno: %10d         "
+              "Failed creating directory %s", errno, d.szConfigImages);
+    d.szConfigImages[0] = 0;
+    unsetenv(CFSRPS_IMAGES_ENV);
+  }
+
   d.handlerFdSet = (struct pollfd *)
       malloc((d.maxNumHandlers) * sizeof(struct pollfd));
 
-  for (i=0; i<d.maxNumHandlers; i++) {
-    d.handlerFdSet[i].fd = -1;
-    d.handlerFdSet[i].events = 0;
-  }
+  d.handlers = (HANDLERINFO *)
+      malloc((d.maxNumHandlers) * sizeof(HANDLERINFO));
+
+  d.readyRing = (int *)malloc((d.maxNumHandlers) * sizeof(int));
+  d.readyHead = 0;
+  d.readyCount = 0;
+  d.pendingHead = 0;
+  d.pendingCount = 0;
+  d.numStarting = 0;
+  d.listenerPaused = 0;
+
+  d.lastScale = 0;
+  d.arrivals = 0;
+  d.arrivalRate = 0;
+  d.startupTime = CLARAD_DFT_STARTUP_TIME;
+  d.maxReached = 0;
+  d.spawned = 0;
+  d.spawnPending = 0;
 
   hi.pid = -1;
   hi.state = 0;
   hi.stream = -1;
+  hi.lastActivity = 0;
+  hi.credits = 0;
+  hi.capacity = 0;
+  hi.ready = 0;
   d.numHandlers = 0;
 
-  d.handlers = CSLIST_Constructor();
+  for (i=0; i<d.maxNumHandlers; i++) {
+    d.handlerFdSet[i].fd = -1;
+    d.handlerFdSet[i].events = 0;
+    d.handlers[i] = hi;
+  }
+
+  if (d.zygote) {
+
+    if ((pid = StartZygote(d.szProtocolHandler, szHandlerConfig)) > 0) {
+      DaemonLog("ZYGT-STR   PID: %10d         Starting zygote", pid);
+    }
+    else {
+      DaemonLog("ZYGT-ERROR Failed starting zygote");
+    }
+  }
 
   for (i=0; i<d.initialNumHandlers; i++)
   {
-    CSLIST_Insert(d.handlers, &hi, sizeof(HANDLERINFO), CSLIST_BOTTOM);
     if ((pid = spawnHandler(d.szProtocolHandler, 
                             szHandlerConfig, -1)) > 0) {
 
-      fprintf(daemonlog, 
-           "%s - HNDL-STR   PID: %10d         Starting resident handler\n", 
-              timestamp, pid);
+      DaemonLog("HNDL-STR   PID: %10d         Starting resident handler", pid);
     }
     else {
 
-      fprintf(daemonlog, 
-              "%s - HNDL-ERROR Failed starting resident handler\n",
-              timestamp);
+      DaemonLog("HNDL-ERROR Failed starting resident handler");
     }
   }
 
-  fflush(daemonlog);
-
-  // add additional process structures 
-  // for additional handlers up to the maximum
-  
-  memset(&hi, 0, sizeof(HANDLERINFO));
-
-  for (; i < d.maxNumHandlers; i++)
-  {
-    CSLIST_Insert(d.handlers, &hi, sizeof(HANDLERINFO), CSLIST_BOTTOM);
+  if (d.reusePort) {
+    SuperviseAcceptors(szHandlerConfig); // does not return
   }
 
-  socklen = sizeof(struct sockaddr_in6);
-
   ///////////////////////////////////////////////////////////////////////////
   // This is the main listening loop...
   // wait for client connections and dispatch to child handler
@@ -532,408 +999,173 @@ int main(int argc, char **argv)
 
   for (;;)
   {
-    numDescriptors = poll(d.listenerFdSet, 1, -1);
-
-    time(&now);
-    ts = *localtime(&now);
-    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &ts);
+    numEvents = epoll_wait(d.epoll_fd, events, CLARAD_MAX_EVENTS, 
+                           d.spawnPending ? 0 : CLARAD_SCALE_INTERVAL);
 
-    if (numDescriptors > 0) {
-
-      //////////////////////////////////////////////////////////////////
-      // A connection request has come in; we want to
-      // get an available handler. For this, we specify
-      // a zero timeout to immediately get the descriptors
-      // that are ready.
-      //////////////////////////////////////////////////////////////////
+    if (d.terminate) {
+      StopDaemon();
+    }
 
-      //////////////////////////////////////////////////////////////////
-      // BRANCHING LABEL
-      RESTART_ACCEPT:
-      //////////////////////////////////////////////////////////////////
+    now = __atomic_load_n(&(lg.clock), __ATOMIC_RELAXED);
 
-      memset(&client, 0, sizeof(struct sockaddr_in6));
+    if (d.reload) {
+      ReloadConfigs();
+    }
+    else {
+      CheckConfigs();
+    }
 
-      conn_fd = accept(d.listen_fd, (struct sockaddr *)&client, &socklen);
+    if (numEvents < 0) {
 
-      if (conn_fd < 0)
+      if (errno != EINTR)
       {
-        if (errno == EINTR)
-        {
-          // At this point, we know there is a connection pending
-          // so we must restart accept() again
+        //////////////////////////////////////////////////////////////////
+        // Some error occurred.
+        //////////////////////////////////////////////////////////////////
 
-          fprintf(daemonlog, "%s - ACCP-INT   interrupted on accept()\n",
-                  timestamp);
-          fflush(daemonlog);
+        DaemonLog("SYS-ERROR  errno: %10d         "
+                  "epoll_wait returned error", errno);
+      }
 
-          goto RESTART_ACCEPT; // accept was interrupted by a signal
-        }
-        else {
+      continue;
+    }
 
-          fprintf(daemonlog, "%s - ACCP-ERR   errno: "
-                             "%10d accept() returned an error\n",
-                  timestamp, errno);
-          fflush(daemonlog);
-        }
+    for (i = 0; i < numEvents; i++)
+    {
+      if (events[i].data.u32 == CLARAD_LISTENER_ID) {
+        AcceptConnections();
       }
       else {
+        ReceiveCredits((int)events[i].data.u32);
+      }
+    }
 
-        handlerTimeout = 0; // return immediately for available handler
+    DispatchConnections();
 
-        //////////////////////////////////////////////////////////////////
-        // Find an available handler; we first wait on handler descriptors
-        // assuming they have all been used at least once.
-        //////////////////////////////////////////////////////////////////
+    if (d.childExited) {
+      ReapHandlers();
+    }
 
-        //////////////////////////////////////////////////////////////////
-        // BRANCHING LABEL
-        RESTART_WAIT:
-        //////////////////////////////////////////////////////////////////
+    ///////////////////////////////////////////////////////////////////
+    // Handlers are started by the scaling controller once per 
+    // interval; it runs sooner if connections are waiting with no 
+    // handler available or starting, or if it has more handlers to
+    // start.
+    ///////////////////////////////////////////////////////////////////
 
-        numDescriptors = poll(d.handlerFdSet, d.numHandlers, handlerTimeout);
+    if (now != d.lastScale || d.spawnPending ||
+        (d.pendingCount > 0 && d.readyCount == 0 && d.numStarting == 0)) {
+      ScaleHandlers(szHandlerConfig);
+    }
+  }
 
-        if (numDescriptors > 0)
-        {
-          ///////////////////////////////////////////////////////////////
-          // A handler is available; let's pass it the client
-          // socket descriptor.
-          ///////////////////////////////////////////////////////////////
-
-          for (i = 0; i < d.maxNumHandlers; i++)
-          {
-            if (d.handlerFdSet[i].revents == POLLIN)
-            {
-              /////////////////////////////////////////////////////////
-              // Receive dummy byte so to free up blocking handler
-              /////////////////////////////////////////////////////////
-
-              /////////////////////////////////////////////////////////
-              // BRANCHING LABEL
-              RESTART_RECV:
-              /////////////////////////////////////////////////////////
-
-              rc = recv(d.handlerFdSet[i].fd, &dummyData, 1, 0);
-
-              if (rc > 0)
-              {
-                ///////////////////////////////////////////////////
-                // This handler is ready
-                // send the connection socket to the
-                // handler and close the descriptor
-                //////////////////////////////////////////////////
-
-                hResult = CFS_SendDescriptor(d.handlerFdSet[i].fd,
-                                             conn_fd,
-                                             10);
-
-                if (CS_SUCCEED(hResult))
-                {
-
-                  CSLIST_GetDataRef(d.handlers, (void**)&phi, i);
-
-                  ////////////////////////////////////////////////////////////
-                  // Log information on the peer
-                  ////////////////////////////////////////////////////////////
-
-                  sprintf(d.szPeerName,
-                          "IPV6 %02x%02x:%02x%02x:%02x%02x:%02x%02x:"
-                          "%02x%02x:%02x%02x:%02x%02x:%02x%02x - " 
-                          "IPV4 %03d:%03d:%03d:%03d",
-                          (int)client.sin6_addr.s6_addr[0],  
-                          (int)client.sin6_addr.s6_addr[1],
-                          (int)client.sin6_addr.s6_addr[2],  
-                          (int)client.sin6_addr.s6_addr[3],
-                          (int)client.sin6_addr.s6_addr[4],  
-                          (int)client.sin6_addr.s6_addr[5],
-                          (int)client.sin6_addr.s6_addr[6],  
-                          (int)client.sin6_addr.s6_addr[7],
-                          (int)client.sin6_addr.s6_addr[8],  
-                          (int)client.sin6_addr.s6_addr[9],
-                          (int)client.sin6_addr.s6_addr[10], 
-                          (int)client.sin6_addr.s6_addr[11],
-                          (int)client.sin6_addr.s6_addr[12], 
-                          (int)client.sin6_addr.s6_addr[13],
-                          (int)client.sin6_addr.s6_addr[14], 
-                          (int)client.sin6_addr.s6_addr[15],
-                          (int)client.sin6_addr.s6_addr[12], 
-                          (int)client.sin6_addr.s6_addr[13],
-                          (int)client.sin6_addr.s6_addr[14], 
-                          (int)client.sin6_addr.s6_addr[15]); 
-
-                  fprintf(daemonlog, 
-                      "%s - CONN       HOST: %s PID:  "
-                      "%10d Connection received\n", 
-                  timestamp, d.szPeerName, phi->pid);
-
-                  fflush(daemonlog);
-
-                  ////////////////////////////////////////////////
-                  // IMPORTANT... we must break out of the loop
-                  // because another handler may be sending its
-                  // dummy byte and we would wind up sending
-                  // it the client socket but we have already
-                  // done so; there would be more than one
-                  // handler for a single client!
-                  ////////////////////////////////////////////////
-                  break;
-                }
-                else {
+  free(d.handlers);
+  free(d.readyRing);
+  free(d.handlerFdSet);
+  free(d.szDaemonName);
 
-                  CSLIST_GetDataRef(d.handlers, (void**)&phi, i);
+  return 0;
+}
 
-                  fprintf(daemonlog, "%s - CONN-ERR   errno: %10d       "
-                          "Failed to send socket descriptor to handler\n", 
-                          timestamp, errno);
+//////////////////////////////////////////////////////////////////////////////
+//
+//////////////////////////////////////////////////////////////////////////////
 
-                  fflush(daemonlog);
-                  break;
-                }
-              }
-              else
-              {
-                if (rc < 0) {
-                  if (errno == EINTR)
-                  {
-                    fprintf(daemonlog, "%s - HND-RECV-H recv() "
-                          "interrupted while reading handler stream pipe\n",
-                          timestamp);
-                    fflush(daemonlog);
-
-                    goto RESTART_RECV; // call recv() again
-                  }
-                  else {
-                    fprintf(daemonlog, 
-                        "%s - HND-RECV-H errno: %d recv() error\n",
-                            timestamp, errno);
-                    fflush(daemonlog);
-                    break;
-                  }
-                }
-                else {
-                  
-                  ///////////////////////////////////////////////////
-                  // handler closed connection
-                  ///////////////////////////////////////////////////
-
-                  fprintf(daemonlog, 
-                       "%s - HND-DISC-H handler closed "
-                       "connection on stream pipe\n",
-                          timestamp);
-                  fflush(daemonlog);
-                  break;
-                }
-              }
-            }
-          } // for
-        }
-        else {
+pid_t spawnHandler
+  (char *szHandler,
+   char *szConfig,
+   int conn_fd) {
 
-          if (numDescriptors == 0) {
+  char *szArgs[8];
+  char szDescriptor[8];
+  char szBacklog[11];
+  char szCpu[12];
 
-            ///////////////////////////////////////////////////////////////
-            // No handler is available... if we have not yet reached 
-            // max handlers, spawn a new one and retry the poll call.
-            ///////////////////////////////////////////////////////////////
+  char szRunMode[2];
 
-            if (d.numHandlers < d.maxNumHandlers)
-            {
-              if ((pid = spawnHandler(d.szProtocolHandler, 
-                                      szHandlerConfig, conn_fd)) > 0) {
+  pid_t pid;
 
-                fprintf(daemonlog, "%s - HNDL-STR   PID: %10d         "
-                                   "Starting resident handler\n", 
-                        timestamp, pid);
-                fflush(daemonlog);
+  HANDLERINFO hi;
 
-                // allow extra handler time to start
-                handlerTimeout = 20000;
-                // return back to poll on handler descriptors
-                goto RESTART_WAIT;
-              }
-              else {
-
-                sprintf(d.szPeerName,
-                        "IPV6 %02x%02x:%02x%02x:%02x%02x:%02x%02x:"
-                        "%02x%02x:%02x%02x:%02x%02x:%02x%02x - " 
-                        "IPV4 %03d:%03d:%03d:%03d",
-                        (int)client.sin6_addr.s6_addr[0],  
-                        (int)client.sin6_addr.s6_addr[1],
-                        (int)client.sin6_addr.s6_addr[2],  
-                        (int)client.sin6_addr.s6_addr[3],
-                        (int)client.sin6_addr.s6_addr[4],  
-                        (int)client.sin6_addr.s6_addr[5],
-                        (int)client.sin6_addr.s6_addr[6],  
-                        (int)client.sin6_addr.s6_addr[7],
-                        (int)client.sin6_addr.s6_addr[8],  
-                        (int)client.sin6_addr.s6_addr[9],
-                        (int)client.sin6_addr.s6_addr[10], 
-                        (int)client.sin6_addr.s6_addr[11],
-                        (int)client.sin6_addr.s6_addr[12], 
-                        (int)client.sin6_addr.s6_addr[13],
-                        (int)client.sin6_addr.s6_addr[14], 
-                        (int)client.sin6_addr.s6_addr[15],
-                        (int)client.sin6_addr.s6_addr[12], 
-                        (int)client.sin6_addr.s6_addr[13],
-                        (int)client.sin6_addr.s6_addr[14], 
-                        (int)client.sin6_addr.s6_addr[15]); 
-
-                fprintf(daemonlog, 
-                      "%s - CONN-FAIL  HOST: %s Could not spawn "
-                      "extra handler: spawn function returned invalid PID\n",
-                      timestamp, d.szPeerName);
-                fflush(daemonlog);
-              }
-            }
-            else {
-
-              sprintf(d.szPeerName,
-                      "IPV6 %02x%02x:%02x%02x:%02x%02x:%02x%02x:"
-                      "%02x%02x:%02x%02x:%02x%02x:%02x%02x - " 
-                      "IPV4 %03d:%03d:%03d:%03d",
-                      (int)client.sin6_addr.s6_addr[0],  
-                      (int)client.sin6_addr.s6_addr[1],
-                      (int)client.sin6_addr.s6_addr[2],  
-                      (int)client.sin6_addr.s6_addr[3],
-                      (int)client.sin6_addr.s6_addr[4],  
-                      (int)client.sin6_addr.s6_addr[5],
-                      (int)client.sin6_addr.s6_addr[6],  
-                      (int)client.sin6_addr.s6_addr[7],
-                      (int)client.sin6_addr.s6_addr[8],  
-                      (int)client.sin6_addr.s6_addr[9],
-                      (int)client.sin6_addr.s6_addr[10], 
-                      (int)client.sin6_addr.s6_addr[11],
-                      (int)client.sin6_addr.s6_addr[12], 
-                      (int)client.sin6_addr.s6_addr[13],
-                      (int)client.sin6_addr.s6_addr[14], 
-                      (int)client.sin6_addr.s6_addr[15],
-                      (int)client.sin6_addr.s6_addr[12], 
-                      (int)client.sin6_addr.s6_addr[13],
-                      (int)client.sin6_addr.s6_addr[14], 
-                      (int)client.sin6_addr.s6_addr[15]); 
-
-              fprintf(daemonlog, "%s - CONN-FAIL  HOST: %s Could "
-                         "not spawn extra handler: maximum limit reached\n",
-                      timestamp, d.szPeerName);
-              fflush(daemonlog);
-            }
-          }
-          else {
-        
-            if (errno == EINTR)
-            {
-              fprintf(daemonlog, "%s - WAIT-INT-H poll() "
-                                 "interrupted on handler wait\n",
-                          timestamp);
-              fflush(daemonlog);
-              goto RESTART_WAIT; // call poll() again
-            }
-            else
-            {
-              ////////////////////////////////////////////////////////////
-              // Some error occurred.
-              ////////////////////////////////////////////////////////////
-              fprintf(daemonlog, "%s - WAIT-ERR-H errno: %10d        "
-                      "poll() returned an error waiting "
-                      "on available handler - \n",
-                       timestamp, errno);
-              fflush(daemonlog);
-            }
-          } 
-        }
-
-        close(conn_fd);
-
-      }
-    }
-    else {
+  int i;
+  int streamfd[2];
 
-      if (numDescriptors < 0)
-      {
-        if (errno != EINTR)
-        {
-          //////////////////////////////////////////////////////////////////
-          // Some error occurred.
-          //////////////////////////////////////////////////////////////////
-
-          fprintf(daemonlog, "%s - SYS-ERROR  errno: %10d         "
-                  "poll returned error\n",
-                     timestamp, errno);
-          fflush(daemonlog);
-        }
-        else {
+  struct epoll_event ev;
 
-          fprintf(daemonlog, "%s - WAIT-INT-P poll() interrupted\n",
-                          timestamp);
-          fflush(daemonlog);
-        }
-      }
-      else {
+  // find next available handler slot
 
-        fprintf(daemonlog, "%s - POLL-WAIT  poll() timed-out\n",
-                   timestamp);
-        fflush(daemonlog);
-      }
+  d.nextHandlerSlot = -1;
+  for (i=0; i<d.maxNumHandlers; i++) {
+    if (d.handlerFdSet[i].fd == -1) {
+      d.nextHandlerSlot = i;
+      break;
     }
   }
 
-  CSLIST_Destructor(&(d.handlers));
-  free(d.szDaemonName);
-
-  return 0;
-}
+  if (d.nextHandlerSlot == -1) {
+    return -1;
+  }
 
-//////////////////////////////////////////////////////////////////////////////
-//
-//////////////////////////////////////////////////////////////////////////////
+  // other handlers must not inherit this stream pipe
 
-pid_t spawnHandler
-  (char *szHandler,
-   char *szConfig,
-   int conn_fd) {
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, streamfd) < 0)
+  {
+    return -1;
+  }
 
-  char *szArgs[5];
-  char szDescriptor[8];
+  if ((pid = CloneFromZygote(streamfd[1])) < 0) {
 
-  char szRunMode[2];
+    if (pid == -2) {
 
-  pid_t pid;
+      /////////////////////////////////////////////////////////////////
+      // The zygote may still clone a handler on this stream pipe; once
+      // we close our end, that handler exits on its own.
+      /////////////////////////////////////////////////////////////////
 
-  HANDLERINFO hi;
+      close(streamfd[0]);
+      close(streamfd[1]);
 
-  int i;
-  int streamfd[2];
+      if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, streamfd) < 0)
+      {
+        return -1;
+      }
+    }
 
-  if (socketpair(AF_UNIX, SOCK_STREAM, 0, streamfd) < 0)
-  {
-    return -1;
+    pid = fork();
   }
 
-  pid = fork();
-
   if (pid > 0)
   {
     hi.pid = pid;
-    hi.state = 0;
+    hi.state = 2; // until the handler advertises its capacity
     hi.stream = streamfd[0];
+    hi.credits = 0;
+    hi.capacity = 0;
+    time(&(hi.lastActivity));
+    clock_gettime(CLOCK_MONOTONIC, &(hi.started));
 
-    // find next available handler slot
-
-    d.nextHandlerSlot = -1;
-    for (i=0; i<d.maxNumHandlers; i++) {
-      if (d.handlerFdSet[i].fd == -1) {
-        d.nextHandlerSlot = i;
-        break;
-      }
-    }
+    // a stale entry for this slot may still be in the ready ring
+    hi.ready = d.handlers[d.nextHandlerSlot].ready;
 
     d.handlerFdSet[d.nextHandlerSlot].fd = hi.stream;
     d.handlerFdSet[d.nextHandlerSlot].events = POLLIN;
-    CSLIST_Set(d.handlers, &hi, sizeof(HANDLERINFO), (long)d.nextHandlerSlot);
+    d.handlers[d.nextHandlerSlot] = hi;
+
+    if (!d.reusePort) {
+
+      ev.events = EPOLLIN;
+      ev.data.u32 = (uint32_t)d.nextHandlerSlot;
+
+      epoll_ctl(d.epoll_fd, EPOLL_CTL_ADD, hi.stream, &ev);
+      (d.numStarting)++;
+    }
 
     (d.numHandlers)++;
     close(streamfd[1]); // close child half of stream pipe.
 
+    CFS_SetScoreboardSlot(d.scoreboard, d.nextHandlerSlot, 
+                          pid, CFS_SCB_STATE_STARTING);
+
     return pid;
   }
   else
@@ -942,7 +1174,7 @@ pid_t spawnHandler
     {
       // we are the child
       
-      fclose(daemonlog); // no need for dameon log file
+      close(lg.fd); // no need for dameon log file
 
       close(d.listen_fd);   // handler will not listen for connections
 
@@ -958,6 +1190,22 @@ pid_t spawnHandler
 
       close(streamfd[0]); // close parent half of stream pipe.
 
+      // nor does it need the stream pipes of the other handlers
+
+      for (i=0; i<d.maxNumHandlers; i++) {
+        if (d.handlers[i].stream > -1) {
+          close(d.handlers[i].stream);
+        }
+      }
+
+      if (d.zygoteStream > -1) {
+        close(d.zygoteStream);
+      }
+
+      // our half of the stream pipe is kept across execv()
+
+      fcntl(streamfd[1], F_SETFD, 0);
+
       // Execute handler; stream pipe descriptor is handed over in argv[1]
 
       szArgs[0] = szHandler;
@@ -971,6 +1219,26 @@ pid_t spawnHandler
       szArgs[3] = szConfig;
       szArgs[4] = 0;
 
+      if (d.reusePort) {
+
+        /////////////////////////////////////////////////////////////////
+        // The handler accepts connections on its own listening socket;
+        // with CPU affinity, each handler is bound to a processor
+        // and only accepts connections received on that processor.
+        /////////////////////////////////////////////////////////////////
+
+        szRunMode[0] = 'A';
+
+        sprintf(szBacklog, "%d", d.backlog);
+        sprintf(szCpu, "%d", d.cpuAffinity && d.numCpus > 0 ? 
+                             d.nextHandlerSlot % d.numCpus : -1);
+
+        szArgs[4] = d.szPort;
+        szArgs[5] = szBacklog;
+        szArgs[6] = szCpu;
+        szArgs[7] = 0;
+      }
+
       syslog(LOG_INFO, "Spawning handler %s config: %s",szArgs[0], szArgs[3]);
 
       // When parent exists, send SIGKILL to all children
@@ -1001,120 +1269,203 @@ void
   signalCatcher
     (int signal) {
 
-  pid_t pid;
-
-  int stat;
-  long i;
-  long count;
-
-  HANDLERINFO *phi;
-
   switch (signal)
   {
     case SIGCHLD:
 
+      // the main loop reaps the terminated children (see ReapHandlers)
+
+      d.childExited = 1;
+      break;
+
+    case SIGHUP:
+
       ///////////////////////////////////////////////////////////////////
-      // wait for the available child ...
-      // this is to avoid accumulation of zombies
+      // Reload the configurations: the images are compiled again by 
+      // the main loop (see ReloadConfigs).
       ///////////////////////////////////////////////////////////////////
 
-      while ((pid = waitpid(-1, &stat, WNOHANG)) > 0)
-      {
-        count = CSLIST_Count(d.handlers);
+      CFSRPS_Reload();
+      d.reload = 1;
 
-        for (i = 0; i < count; i++)
-        {
-          CSLIST_GetDataRef(d.handlers, (void **)(&phi), i);
+      break;
 
-          if (phi->pid == pid)
-          {
+    case SIGTERM:
 
-            if (phi->stream > -1)
-            {
-              close(phi->stream);
-            }
+      // the main loop stops the daemon (see StopDaemon)
 
-            ////////////////////////////////////////////////////////////
-            // The handler list is aligned to the stream pipe array;
-            // We must set this handler as non-executing rather than
-            // remove it from the list because the addition of handlers
-            // later on would mis-align the handler pid with its stream
-            // pipe. It could also overwrite a valid stream pipe
-            // and would render its existing associated handler useless.
-            ////////////////////////////////////////////////////////////
+      d.terminate = 1;
+      break;
+  }
 
-            phi->pid = -1;
-            phi->state = 0;
-            phi->stream = -1;
+  return;
+}
 
-            d.nextHandlerSlot = i;
+//////////////////////////////////////////////////////////////////////////////
+//
+// StopDaemon
+//
+// Terminates the handlers and the zygote, waits for them, releases the
+// shared state and exits; called from the main loop once SIGTERM is 
+// received.
+//
+//////////////////////////////////////////////////////////////////////////////
 
-            // mark this stream pipe as invalid
-            d.handlerFdSet[i].fd = -1;
-            d.handlerFdSet[i].events = 0;
+void
+  StopDaemon
+    (void) {
 
-            // Decrement number of executing handlers
-            (d.numHandlers)--;
+  long i;
 
-            time(&now);
-            ts = *localtime(&now);
-            strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &ts);
+  HANDLERINFO *phi;
 
-            fprintf(daemonlog, "%s - HND-KILL   PID: %d         "
-                               "Handler terminated\n", 
-                                 timestamp, pid);
-            fflush(daemonlog);
+  DaemonLog("DAEMON-END Daemon "
+            "terminated by SIGTERM signal");
 
-            break;
-          }
-        }
+  // terminate every child handler
+
+  close(d.listen_fd);
+
+  if (d.zygotePid > 0) {
+    kill(d.zygotePid, SIGTERM);
+  }
+
+  for (i = 0; i < d.maxNumHandlers; i++)
+  {
+    phi = &(d.handlers[i]);
+
+    if (phi->pid > 0)
+    {
+      kill(phi->pid, SIGTERM);
+
+      if (phi->stream > -1)
+      {
+        close(phi->stream);
       }
+    }
+  }
 
-      break;
+  // wait for all children
 
-    case SIGTERM:
+  while (wait(NULL) > 0)
+            ;
+
+  if (d.scoreboard != NULL) {
+    CFS_CloseScoreboard(&(d.scoreboard));
+    unlink(d.szScoreboard);
+  }
+
+  if (d.tlsShare != NULL) {
+    CFS_CloseTlsShare(&(d.tlsShare));
+    close(d.tlsShareFd);
+  }
+
+  CloseDaemonLog();
+
+  exit(0);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// ReapHandlers
+//
+// Waits for the children that have terminated and releases the slots of
+// terminated handlers; called from the main loop when SIGCHLD is 
+// received.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+void
+  ReapHandlers
+    (void) {
+
+  pid_t pid;
+
+  int stat;
+  long i;
 
+  HANDLERINFO *phi;
+
+  d.childExited = 0;
 
-      time(&now);
-      ts = *localtime(&now);
-      strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &ts);
+  ///////////////////////////////////////////////////////////////////
+  // wait for the available child ...
+  // this is to avoid accumulation of zombies
+  ///////////////////////////////////////////////////////////////////
+
+  while ((pid = waitpid(-1, &stat, WNOHANG)) > 0)
+  {
+    if (pid == d.zygotePid) {
 
-      fprintf(daemonlog, "%s - DAEMON-END Daemon "
-                         "terminated by SIGTERM signal\n", 
-                          timestamp);
-      fflush(daemonlog);
+      // handlers are executed until the zygote is restarted
 
-      // terminate every child handler
+      close(d.zygoteStream);
+      d.zygoteStream = -1;
+      d.zygotePid = -1;
+      d.zygoteReady = 0;
+      d.zygoteLate = 0;
 
-      close(d.listen_fd);
+      DaemonLog("ZYGT-KILL  PID: %d         "
+                "Zygote terminated", pid);
+      continue;
+    }
 
-      count = CSLIST_Count(d.handlers);
+    for (i = 0; i < d.maxNumHandlers; i++)
+    {
+      phi = &(d.handlers[i]);
 
-      for (i = 0; i < count; i++)
+      if (phi->pid == pid)
       {
-        CSLIST_GetDataRef(d.handlers, (void **)(&phi), i);
+        if (phi->state == 2 && !d.reusePort) {
+          (d.numStarting)--;
+        }
 
-        if (phi->pid != -1)
+        if (phi->stream > -1)
         {
-          kill(phi->pid, SIGTERM);
+          // a closed descriptor would still be reported by epoll
 
-          if (phi->stream > -1)
-          {
-            close(phi->stream);
+          if (!d.reusePort) {
+            epoll_ctl(d.epoll_fd, EPOLL_CTL_DEL, phi->stream, NULL);
           }
+
+          close(phi->stream);
         }
-      }
 
-      // wait for all children
+        ////////////////////////////////////////////////////////////
+        // The handler array is aligned to the stream pipe array;
+        // We must set this handler as non-executing rather than
+        // remove it from the array because the addition of handlers
+        // later on would mis-align the handler pid with its stream
+        // pipe. It could also overwrite a valid stream pipe
+        // and would render its existing associated handler useless.
+        // The stream pipe is removed from the epoll set before it is
+        // closed; if the slot is in the ready ring, it will be discarded
+        // when it reaches the head of the ring.
+        ////////////////////////////////////////////////////////////
+
+        phi->pid = -1;
+        phi->state = 0;
+        phi->stream = -1;
+        phi->credits = 0;
+
+        CFS_SetScoreboardSlot(d.scoreboard, i, 0, CFS_SCB_STATE_FREE);
 
-      while (wait(NULL) > 0)
-                ;
+        d.nextHandlerSlot = i;
 
-      exit(0);
-      break;
-  }
+        // mark this stream pipe as invalid
+        d.handlerFdSet[i].fd = -1;
+        d.handlerFdSet[i].events = 0;
 
-  return;
+        // Decrement number of executing handlers
+        (d.numHandlers)--;
+
+        DaemonLog("HND-KILL   PID: %d         "
+                  "Handler terminated", pid);
+
+        break;
+      }
+    }
+  }
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -1286,5 +1637,1579 @@ int
   return 0;
 }
 
+//////////////////////////////////////////////////////////////////////////////
+//
+// SuperviseAcceptors
+//
+// Supervision loop used in REUSEPORT listen mode. Handlers accept their
+// own connections and report CFS_HANDLER_BUSY / CFS_HANDLER_READY on
+// their stream pipe. We respawn resident handlers that terminate, start
+// an additional handler when fewer than MIN_SPARE_HANDLERS are idle and
+// terminate extra handlers that have been idle for longer than 
+// HANDLER_IDLE_TIMEOUT when more than MAX_SPARE_HANDLERS are idle.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+void
+  SuperviseAcceptors
+    (char* szHandlerConfig) {
+
+  int i;
+  int rc;
+  int numDescriptors;
+  int numBusy;
+  int numIdle;
+
+  char status[64];
+
+  pid_t pid;
+
+  HANDLERINFO* phi;
+
+  for (;;)
+  {
+
+    //////////////////////////////////////////////////////////////////
+    // Replace resident handlers that have terminated
+    //////////////////////////////////////////////////////////////////
+
+    while (d.numHandlers < d.initialNumHandlers) {
+
+      if ((pid = spawnHandler(d.szProtocolHandler, 
+                              szHandlerConfig, -1)) > 0) {
+
+        DaemonLog("HNDL-STR   PID: %10d         Starting resident handler", pid);
+      }
+      else {
+
+        DaemonLog("HNDL-ERROR Failed starting resident handler");
+        break;
+      }
+    }
+
+    CFS_RotateTicketKeys(d.tlsShare);
+
+    numDescriptors = poll(d.handlerFdSet, d.maxNumHandlers, 1000);
+
+    if (d.terminate) {
+      StopDaemon();
+    }
+
+    if (d.reload) {
+      ReloadConfigs();
+    }
+    else {
+      CheckConfigs();
+    }
+
+    if (numDescriptors < 0) {
+
+      if (errno != EINTR) {
+
+        DaemonLog("SYS-ERROR  errno: %10d         "
+                  "poll returned error", errno);
+      }
+
+      continue;
+    }
+
+    time(&now);
+
+    for (i = 0; i < d.maxNumHandlers && numDescriptors > 0; i++)
+    {
+      if (d.handlerFdSet[i].fd < 0 || d.handlerFdSet[i].revents == 0) {
+        continue;
+      }
+
+      numDescriptors--;
+
+      phi = &(d.handlers[i]);
+
+      rc = recv(d.handlerFdSet[i].fd, status, sizeof(status), 0);
+
+      if (rc > 0) {
+
+        if (phi->state == 2) {
+          CFS_SetScoreboardSlot(d.scoreboard, i, 
+                                phi->pid, CFS_SCB_STATE_READY);
+        }
+
+        // Only the latest status reported by the handler matters
+
+        phi->state = status[rc-1] == CFS_HANDLER_BUSY ? 1 : 0;
+        phi->lastActivity = now;
+      }
+      else {
+
+        if (rc == 0 || errno != EINTR) {
+
+          ///////////////////////////////////////////////////////////
+          // The handler is terminating; stop polling its stream
+          // pipe until SIGCHLD releases the slot. A negative 
+          // descriptor other than -1 is ignored by poll() but keeps
+          // the slot from being reused.
+          ///////////////////////////////////////////////////////////
+
+          d.handlerFdSet[i].fd = -2;
+          d.handlerFdSet[i].events = 0;
+        }
+      }
+    }
+
+    if (d.childExited) {
+      ReapHandlers();
+    }
+
+    //////////////////////////////////////////////////////////////////
+    // Scale the number of handlers
+    //////////////////////////////////////////////////////////////////
+
+    numBusy = 0;
+    numIdle = 0;
+
+    for (i = 0; i < d.maxNumHandlers; i++)
+    {
+      phi = &(d.handlers[i]);
+
+      if (phi->pid > 0) {
+        if (phi->state == 1) {
+          numBusy++;
+        }
+        else {
+          numIdle++;
+        }
+      }
+    }
+
+    if (numIdle < d.minSpare && d.numHandlers < d.maxNumHandlers) {
 
+      if ((pid = spawnHandler(d.szProtocolHandler, 
+                              szHandlerConfig, -1)) > 0) {
 
+        DaemonLog("HNDL-STR   PID: %10d         "
+                  "Starting additional handler - busy: %d", pid, numBusy);
+      }
+    }
+    else {
+
+      if (numIdle > d.maxSpare && d.numHandlers > d.initialNumHandlers) {
+
+        for (i = d.maxNumHandlers - 1; i >= 0; i--)
+        {
+          phi = &(d.handlers[i]);
+
+          if (phi->pid > 0 && phi->state == 0 &&
+              now - phi->lastActivity > d.idleTimeout) {
+
+            DaemonLog("HNDL-END   PID: %10d         "
+                      "Stopping idle handler", phi->pid);
+
+            // prevent selecting this handler again until SIGCHLD
+            phi->state = 1;
+            kill(phi->pid, SIGTERM);
+            break;
+          }
+        }
+      }
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CompileConfigs
+//
+// Compiles the daemon configuration, the configurations listed in its
+// COMPILE enumeration, the handler configuration, its environment 
+// (ENV) and the TLS configuration of that environment (SECURE_CONFIG)
+// into the configuration images directory. Each image is replaced in
+// place; the images that were not replaced (configurations we no longer
+// compile, or that failed to compile) are then removed so that handlers
+// never map them. An image always exists while it is being compiled.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+void
+  CompileConfigs
+    (void) {
+
+  int i;
+  int rc;
+  int numConfigs;
+  int numImages;
+  int maxImages;
+
+  char* pszParam;
+
+  char szConfigs[4][99];
+
+  struct dirent* dir;
+  struct stat fileInfo;
+  DIR* directory;
+
+  CONFIGIMAGE* pImages;
+  CONFIGIMAGE* pMore;
+
+  CFSRPS pRepo;
+  CFSCFG pConfig;
+
+  /////////////////////////////////////////////////////////////////////
+  // Note the images we have now; an image that is compiled again is
+  // a new file (see CFSRPS_CompileConfig).
+  /////////////////////////////////////////////////////////////////////
+
+  numImages = 0;
+  maxImages = 0;
+  pImages = NULL;
+
+  if ((directory = opendir(d.szConfigImages)) != NULL) {
+
+    while ((dir = readdir(directory)) != NULL) {
+
+      if (strstr(dir->d_name, ".cfgi") == NULL) {
+        continue;
+      }
+
+      if (numImages == maxImages) {
+
+        if ((pMore = (CONFIGIMAGE*)realloc(pImages, 
+                        (maxImages + 16) * sizeof(CONFIGIMAGE))) == NULL) {
+          break;
+        }
+
+        pImages = pMore;
+        maxImages += 16;
+      }
+
+      rc = snprintf(pImages[numImages].szPath, 
+                    sizeof(pImages[numImages].szPath), "%s/%s", 
+                    d.szConfigImages, dir->d_name);
+
+      if (rc > 0 && rc < sizeof(pImages[numImages].szPath) &&
+          lstat(pImages[numImages].szPath, &fileInfo) == 0) {
+        pImages[numImages++].ino = fileInfo.st_ino;
+      }
+    }
+
+    closedir(directory);
+  }
+
+  pRepo = CFSRPS_Open(NULL);
+
+  numConfigs = 0;
+  strcpy(szConfigs[numConfigs++], d.szConfig);
+
+  if (strcmp(d.szHandlerConfig, d.szConfig)) {
+    strcpy(szConfigs[numConfigs++], d.szHandlerConfig);
+  }
+
+  if ((pConfig = CFSRPS_OpenConfig(pRepo, d.szHandlerConfig)) != NULL) {
+
+    if ((pszParam = CFSCFG_LookupParam(pConfig, "ENV")) != NULL) {
+      strncpy(szConfigs[numConfigs], pszParam, 98);
+      szConfigs[numConfigs++][98] = 0;
+    }
+
+    CFSRPS_CloseConfig(pRepo, &pConfig);
+  }
+
+  if (numConfigs > 1 && 
+      (pConfig = CFSRPS_OpenConfig(pRepo, 
+                                   szConfigs[numConfigs - 1])) != NULL) {
+
+    if ((pszParam = CFSCFG_LookupParam(pConfig, "SECURE_CONFIG")) != NULL) {
+      strncpy(szConfigs[numConfigs], pszParam, 98);
+      szConfigs[numConfigs++][98] = 0;
+    }
+
+    CFSRPS_CloseConfig(pRepo, &pConfig);
+  }
+
+  for (i = 0; i < numConfigs; i++) {
+
+    if (CS_FAIL(CFSRPS_CompileConfig(pRepo, szConfigs[i], 
+                                     d.szConfigImages))) {
+      DaemonLog("CONF-WARN  Failed compiling configuration %s", 
+                szConfigs[i]);
+    }
+  }
+
+  if ((pConfig = CFSRPS_OpenConfig(pRepo, d.szConfig)) != NULL) {
+
+    if (CS_SUCCEED(CFSCFG_IterStart(pConfig, "COMPILE"))) {
+
+      while ((pszParam = CFSCFG_IterNext(pConfig)) != NULL) {
+
+        if (CS_FAIL(CFSRPS_CompileConfig(pRepo, pszParam, 
+                                         d.szConfigImages))) {
+          DaemonLog("CONF-WARN  Failed compiling configuration %s", 
+                    pszParam);
+        }
+      }
+    }
+
+    CFSRPS_CloseConfig(pRepo, &pConfig);
+  }
+
+  CFSRPS_Close(&pRepo);
+
+  // Remove the images that were not compiled again
+
+  for (i = 0; i < numImages; i++) {
+
+    if (lstat(pImages[i].szPath, &fileInfo) == 0 &&
+        fileInfo.st_ino == pImages[i].ino) {
+      unlink(pImages[i].szPath);
+    }
+  }
+
+  free(pImages);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// OpenRuntimeDir
+//
+// Creates the runtime directory of this daemon under the given base
+// directory, which may be shared by several daemons. The directory is
+// named after the daemon configuration; an existing directory must be
+// owned by us and is made private.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  OpenRuntimeDir
+    (char* szBaseDir) {
+
+  int rc;
+
+  struct stat dirInfo;
+
+  rc = snprintf(d.szRunDir, sizeof(d.szRunDir), "%s/%s", 
+                szBaseDir, d.szConfig);
+
+  if (rc < 0 || rc >= sizeof(d.szRunDir)) {
+    errno = ENAMETOOLONG;
+    return CS_FAILURE;
+  }
+
+  if (mkdir(szBaseDir, 0755) < 0 && errno != EEXIST) {
+    return CS_FAILURE;
+  }
+
+  if (mkdir(d.szRunDir, 0700) < 0 && errno != EEXIST) {
+    return CS_FAILURE;
+  }
+
+  if (lstat(d.szRunDir, &dirInfo) < 0) {
+    return CS_FAILURE;
+  }
+
+  if (!S_ISDIR(dirInfo.st_mode) || dirInfo.st_uid != geteuid()) {
+    errno = EPERM;
+    return CS_FAILURE;
+  }
+
+  if ((dirInfo.st_mode & 0077) != 0 && chmod(d.szRunDir, 0700) < 0) {
+    return CS_FAILURE;
+  }
+
+  return CS_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// RuntimePath
+//
+// Formats the path of a file in the runtime directory; fails if there
+// is no runtime directory or if the path does not fit.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  RuntimePath
+    (char* szPath,
+     int size,
+     char* szName) {
+
+  int rc;
+
+  szPath[0] = 0;
+
+  if (d.szRunDir[0] == 0) {
+    errno = ENOENT;
+    return CS_FAILURE;
+  }
+
+  rc = snprintf(szPath, size, "%s/%s", d.szRunDir, szName);
+
+  if (rc < 0 || rc >= size) {
+    szPath[0] = 0;
+    errno = ENAMETOOLONG;
+    return CS_FAILURE;
+  }
+
+  return CS_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// ReloadConfigs
+//
+// Compiles the configuration images again and has the handlers (and
+// the zygote) drop the configurations they cached; handlers are not
+// restarted.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+void
+  ReloadConfigs
+    (void) {
+
+  int i;
+
+  d.reload = 0;
+
+  DaemonLog("DAEMON-HUP Reloading configurations");
+
+  if (d.szConfigImages[0] != 0) {
+    CompileConfigs();
+  }
+
+  if (d.zygotePid > 0) {
+    kill(d.zygotePid, SIGHUP);
+  }
+
+  for (i = 0; i < d.maxNumHandlers; i++)
+  {
+    if (d.handlers[i].pid > 0)
+    {
+      kill(d.handlers[i].pid, SIGHUP);
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CheckConfigs
+//
+// Compiles the configuration images again if the repository reports
+// that one of the configurations we compiled changed (the file was
+// modified or the database notified a change). Handlers see that the
+// images were replaced; they are not signalled.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+void
+  CheckConfigs
+    (void) {
+
+  time_t checkTime;
+
+  if (d.szConfigImages[0] == 0) {
+    return;
+  }
+
+  time(&checkTime);
+
+  if (checkTime == d.lastConfigCheck) {
+    return;
+  }
+
+  d.lastConfigCheck = checkTime;
+
+  if (CFSRPS_Changed()) {
+    DaemonLog("CONF-INFO  Configurations changed, compiling images");
+    CompileConfigs();
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// AcceptConnections
+//
+// Accepts every pending connection on the (non-blocking) listening
+// socket into the pending ring. If the ring is full, we stop waiting on
+// the listening socket; connections then remain in the listen backlog
+// until handlers take the pending connections.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+void
+  AcceptConnections
+    (void) {
+
+  int conn_fd;
+  int index;
+
+  socklen_t socklen;
+
+  struct sockaddr_in6 client;
+
+  struct epoll_event ev;
+
+  while (d.pendingCount < CLARAD_MAX_PENDING) {
+
+    socklen = sizeof(struct sockaddr_in6);
+    memset(&client, 0, sizeof(struct sockaddr_in6));
+
+    conn_fd = accept4(d.listen_fd, 
+                      (struct sockaddr *)&client, 
+                      &socklen, 
+                      SOCK_CLOEXEC | SOCK_NONBLOCK);
+
+    if (conn_fd < 0)
+    {
+      if (errno == EINTR)
+      {
+        DaemonLog("ACCP-INT   interrupted on accept()");
+
+        continue; // accept was interrupted by a signal
+      }
+
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+
+        DaemonLog("ACCP-ERR   errno: "
+                  "%10d accept() returned an error", errno);
+      }
+
+      return; // no more pending connections
+    }
+
+    index = (d.pendingHead + d.pendingCount) % CLARAD_MAX_PENDING;
+
+    d.pendingFds[index] = conn_fd;
+    d.pendingPeers[index] = client;
+    (d.pendingCount)++;
+    (d.arrivals)++;
+  }
+
+  ev.events = 0;
+  ev.data.u32 = CLARAD_LISTENER_ID;
+
+  epoll_ctl(d.epoll_fd, EPOLL_CTL_MOD, d.listen_fd, &ev);
+  d.listenerPaused = 1;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// ReceiveCredits
+//
+// Reads the capacity advertised by a handler on its stream pipe (a byte
+// of value k for k connections, 0 for one connection) and puts the
+// handler in the ready ring if it was not already there.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+void
+  ReceiveCredits
+    (int slot) {
+
+  int j;
+  int rc;
+
+  double elapsed;
+
+  unsigned char credits[256];
+
+  struct timespec ready;
+
+  HANDLERINFO* phi;
+
+  phi = &(d.handlers[slot]);
+
+  if (phi->stream < 0) {
+    return;
+  }
+
+  ///////////////////////////////////////////////////////////////////
+  // BRANCHING LABEL
+  RESTART_RECV:
+  ///////////////////////////////////////////////////////////////////
+
+  rc = recv(phi->stream, credits, sizeof(credits), 0);
+
+  if (rc > 0) {
+
+    for (j = 0; j < rc; j++) {
+      phi->credits += credits[j] == 0 ? 1 : credits[j];
+    }
+
+    if (phi->capacity < phi->credits) {
+      phi->capacity = phi->credits;
+    }
+
+    if (phi->state == 2) {
+
+      // smooth the time it takes for a handler to become available
+
+      clock_gettime(CLOCK_MONOTONIC, &ready);
+
+      elapsed = (ready.tv_sec - phi->started.tv_sec) * 1000.0 +
+                (ready.tv_nsec - phi->started.tv_nsec) / 1000000.0;
+
+      d.startupTime = (d.startupTime + elapsed) / 2;
+
+      (d.numStarting)--;
+
+      CFS_SetScoreboardSlot(d.scoreboard, slot, 
+                            phi->pid, CFS_SCB_STATE_READY);
+    }
+
+    phi->state = 0;
+    phi->lastActivity = now;
+
+    if (!phi->ready) {
+      d.readyRing[(d.readyHead + d.readyCount) % d.maxNumHandlers] = slot;
+      (d.readyCount)++;
+      phi->ready = 1;
+    }
+  }
+  else {
+
+    if (rc < 0) {
+
+      if (errno == EINTR)
+      {
+        goto RESTART_RECV; // call recv() again
+      }
+
+      if (errno != EAGAIN) {
+
+        ///////////////////////////////////////////////////
+        // the stream pipe is unusable; stop waiting on it
+        // (it would be reported again at once) until 
+        // SIGCHLD releases the slot.
+        ///////////////////////////////////////////////////
+
+        DaemonLog("HND-RECV-H errno: %d recv() error", errno);
+
+        epoll_ctl(d.epoll_fd, EPOLL_CTL_DEL, phi->stream, NULL);
+        phi->credits = 0;
+      }
+    }
+    else {
+
+      ///////////////////////////////////////////////////
+      // handler closed connection; stop waiting on
+      // its stream pipe until SIGCHLD releases the slot.
+      ///////////////////////////////////////////////////
+
+      DaemonLog("HND-DISC-H handler closed "
+                "connection on stream pipe");
+
+      epoll_ctl(d.epoll_fd, EPOLL_CTL_DEL, phi->stream, NULL);
+      phi->credits = 0;
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// DispatchConnections
+//
+// Hands over pending connections to the handlers at the head of the 
+// ready ring; the connections given to a handler are passed in a single
+// message. If no handler is available, the connections wait in the 
+// pending ring until the scaling controller starts one.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+void
+  DispatchConnections
+    (void) {
+
+  int j;
+  int k;
+  int slot;
+  int index;
+
+  int connections[CFS_MAX_DESCRIPTORS];
+
+  CSRESULT hResult;
+
+  HANDLERINFO* phi;
+
+  struct epoll_event ev;
+
+  while (d.pendingCount > 0 && d.readyCount > 0) {
+
+    slot = d.readyRing[d.readyHead];
+    phi = &(d.handlers[slot]);
+
+    if (phi->pid <= 0 || phi->credits <= 0) {
+
+      // terminated handler or no capacity left: drop from ring
+
+      d.readyHead = (d.readyHead + 1) % d.maxNumHandlers;
+      (d.readyCount)--;
+      phi->ready = 0;
+      continue;
+    }
+
+    k = d.pendingCount;
+
+    if (k > phi->credits) {
+      k = phi->credits;
+    }
+
+    if (k > CFS_MAX_DESCRIPTORS) {
+      k = CFS_MAX_DESCRIPTORS;
+    }
+
+    ////////////////////////////////////////////////////////////////////
+    // Handlers expect blocking connections; O_NONBLOCK (set by accept4)
+    // is the only status flag a connection has, and the handler shares
+    // it with us.
+    ////////////////////////////////////////////////////////////////////
+
+    for (j = 0; j < k; j++) {
+      connections[j] = 
+          d.pendingFds[(d.pendingHead + j) % CLARAD_MAX_PENDING];
+      fcntl(connections[j], F_SETFL, 0);
+    }
+
+    hResult = CFS_SendDescriptors(phi->stream, connections, k, 10);
+
+    if (CS_SUCCEED(hResult)) {
+
+      for (j = 0; j < k; j++) {
+
+        index = (d.pendingHead + j) % CLARAD_MAX_PENDING;
+
+        LogConnection(phi->pid, &(d.pendingPeers[index]));
+
+        close(connections[j]);
+      }
+
+      d.pendingHead = (d.pendingHead + k) % CLARAD_MAX_PENDING;
+      d.pendingCount -= k;
+      phi->credits -= k;
+      phi->state = 1;
+      phi->lastActivity = now;
+    }
+    else {
+
+      DaemonLog("CONN-ERR   errno: %10d       "
+                "Failed to send socket descriptor to handler", errno);
+
+      phi->credits = 0;
+    }
+  }
+
+  // Resume accepting connections once there is room in the pending ring
+
+  if (d.listenerPaused && d.pendingCount < CLARAD_MAX_PENDING) {
+
+    ev.events = EPOLLIN;
+    ev.data.u32 = CLARAD_LISTENER_ID;
+
+    epoll_ctl(d.epoll_fd, EPOLL_CTL_MOD, d.listen_fd, &ev);
+    d.listenerPaused = 0;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// ScaleHandlers
+//
+// Scaling controller for the dispatcher mode. A spare handler is one 
+// that is starting or can take connections. The number of spare 
+// handlers is kept between MIN_SPARE_HANDLERS and MAX_SPARE_HANDLERS:
+// within these limits, we keep as many spare handlers as connections 
+// are expected to arrive during the start-up of a handler, so that 
+// additional handlers are started ahead of demand. Spare handlers that
+// have been idle for longer than HANDLER_IDLE_TIMEOUT are terminated 
+// (one per interval) when there are more than MAX_SPARE_HANDLERS.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+void
+  ScaleHandlers
+    (char* szHandlerConfig) {
+
+  int i;
+  int numSpare;
+  int target;
+  int victim;
+
+  pid_t pid;
+
+  HANDLERINFO* phi;
+
+  if (d.zygote && d.zygotePid < 0) {
+
+    if ((pid = StartZygote(d.szProtocolHandler, szHandlerConfig)) > 0) {
+      DaemonLog("ZYGT-STR   PID: %10d         Restarting zygote", pid);
+    }
+  }
+
+  ReadLateClones();
+
+  if (now != d.lastScale) {
+
+    CFS_RotateTicketKeys(d.tlsShare);
+
+    if (d.lastScale > 0) {
+      d.arrivalRate = (d.arrivalRate + 
+                       (double)d.arrivals / (now - d.lastScale)) / 2;
+    }
+
+    d.arrivals = 0;
+    d.spawned = 0;
+    d.lastScale = now;
+  }
+
+  numSpare = 0;
+  victim = -1;
+
+  for (i = 0; i < d.maxNumHandlers; i++)
+  {
+    phi = &(d.handlers[i]);
+
+    if (phi->pid > 0) {
+
+      if (phi->state == 2 || phi->credits > 0) {
+        numSpare++;
+      }
+
+      // a handler is idle when all its connections have ended
+
+      if (phi->state != 2 && phi->credits > 0 && 
+          phi->credits == phi->capacity) {
+
+        if (victim < 0 || 
+            phi->lastActivity < d.handlers[victim].lastActivity) {
+          victim = i;
+        }
+      }
+    }
+  }
+
+  target = (int)(d.arrivalRate * d.startupTime / 1000.0 + 0.999);
+
+  if (target < d.minSpare) {
+    target = d.minSpare;
+  }
+
+  if (target > d.maxSpare) {
+    target = d.maxSpare;
+  }
+
+  if (target == 0 && d.pendingCount > 0) {
+    target = 1; // connections are waiting
+  }
+
+  //////////////////////////////////////////////////////////////////
+  // Resident handlers that have terminated are replaced, then 
+  // spare handlers are started up to the target; at most 
+  // CLARAD_MAX_SPAWN_BATCH per pass and CLARAD_MAX_SPAWN_RATE per
+  // second.
+  //////////////////////////////////////////////////////////////////
+
+  d.spawnPending = 0;
+
+  for (i = 0; 
+       d.numHandlers < d.maxNumHandlers &&
+       (d.numHandlers < d.initialNumHandlers || numSpare < target); 
+       i++) {
+
+    if (i == CLARAD_MAX_SPAWN_BATCH || d.spawned == CLARAD_MAX_SPAWN_RATE) {
+      d.spawnPending = d.spawned < CLARAD_MAX_SPAWN_RATE;
+      break;
+    }
+
+    if ((pid = spawnHandler(d.szProtocolHandler, 
+                            szHandlerConfig, -1)) > 0) {
+
+      DaemonLog("HNDL-STR   PID: %10d         "
+                "Starting spare handler - rate: %.1f", 
+                pid, d.arrivalRate);
+
+      numSpare++;
+      (d.spawned)++;
+    }
+    else {
+
+      DaemonLog("HNDL-ERROR Failed starting spare handler");
+      break;
+    }
+  }
+
+  if (numSpare < target && d.numHandlers >= d.maxNumHandlers) {
+
+    if (!d.maxReached) {
+      DaemonLog("CONN-WAIT  Maximum number of handlers reached");
+      d.maxReached = 1;
+    }
+  }
+  else {
+    d.maxReached = 0;
+  }
+
+  if (numSpare > d.maxSpare && victim >= 0 && 
+      d.numHandlers > d.initialNumHandlers &&
+      now - d.handlers[victim].lastActivity > d.idleTimeout) {
+
+    phi = &(d.handlers[victim]);
+
+    DaemonLog("HNDL-END   PID: %10d         "
+              "Stopping idle handler", phi->pid);
+
+    // prevent dispatching to this handler again until SIGCHLD
+
+    phi->state = 1;
+    phi->credits = 0;
+    kill(phi->pid, SIGTERM);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// StartZygote
+//
+// Executes the handler in zygote run mode ('Z'): the zygote initializes
+// itself as a handler would, then clones new handlers on request (see
+// CloneFromZygote).
+//
+//////////////////////////////////////////////////////////////////////////////
+
+pid_t
+  StartZygote
+    (char *szHandler,
+     char *szConfig) {
+
+  char *szArgs[5];
+  char szDescriptor[8];
+
+  pid_t pid;
+
+  int streamfd[2];
+
+  // handlers executed later must not inherit the zygote stream pipe
+
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, streamfd) < 0)
+  {
+    return -1;
+  }
+
+  pid = fork();
+
+  if (pid > 0)
+  {
+    close(streamfd[1]);
+
+    d.zygoteStream = streamfd[0];
+    d.zygoteReady = 0;
+    d.zygoteLate = 0;
+    d.zygotePid = pid;
+
+    return pid;
+  }
+
+  if (pid < 0)
+  {
+    close(streamfd[0]);
+    close(streamfd[1]);
+    return -1;
+  }
+
+  // we are the child
+
+  close(lg.fd);
+  close(d.listen_fd);
+  close(streamfd[0]);
+
+  fcntl(streamfd[1], F_SETFD, 0);
+
+  szArgs[0] = szHandler;
+  sprintf(szDescriptor, "%d", streamfd[1]);
+  szArgs[1] = szDescriptor;
+  szArgs[2] = "Z";
+  szArgs[3] = szConfig;
+  szArgs[4] = 0;
+
+  syslog(LOG_INFO, "Spawning zygote %s config: %s",szArgs[0], szArgs[3]);
+
+  // When parent exists, send SIGKILL to all children
+  prctl(PR_SET_PDEATHSIG, SIGKILL);
+
+  if (execv((const char *)szHandler, szArgs) < 0) {
+    syslog(LOG_ERR, "Failed to exec %s: errno: %d",szArgs[0], errno);
+    exit(5);
+  }
+
+  return -1;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CloneFromZygote
+//
+// Asks the zygote for a new handler that will use the given stream pipe.
+// The handler is cloned with this process as its parent. Returns the PID
+// of the new handler, -1 if the zygote is not available, or -2 if it 
+// did not reply within CLARAD_ZYGOTE_WAIT milliseconds; the caller then
+// executes the handler, with a new stream pipe in the latter case since
+// the zygote may still clone a handler on this one.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+pid_t
+  CloneFromZygote
+    (int handler_fd) {
+
+  int rc;
+
+  pid_t pid;
+
+  struct pollfd fdset[1];
+
+  if (d.zygotePid <= 0 || d.zygoteReady < 0) {
+    return -1;
+  }
+
+  if (!d.zygoteReady) {
+
+    // the zygote sends its PID once initialized
+
+    rc = recv(d.zygoteStream, &pid, sizeof(pid), MSG_DONTWAIT);
+
+    if (rc != sizeof(pid)) {
+      return -1;
+    }
+
+    d.zygoteReady = 1;
+  }
+
+  if (CS_FAIL(CFS_SendDescriptors(d.zygoteStream, &handler_fd, 1, 1))) {
+    return -1;
+  }
+
+  fdset[0].fd = d.zygoteStream;
+  fdset[0].events = POLLIN;
+
+  for (;;)
+  {
+    rc = poll(fdset, 1, CLARAD_ZYGOTE_WAIT);
+
+    if (rc < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (rc != 1 || 
+        recv(d.zygoteStream, &pid, sizeof(pid), 0) != sizeof(pid)) {
+      break;
+    }
+
+    if (d.zygoteLate > 0) {
+
+      // reply to a request we stopped waiting for (see ReadLateClones)
+
+      (d.zygoteLate)--;
+      continue;
+    }
+
+    // the zygote closes the handler end of the stream pipe on failure
+
+    return pid > 0 ? pid : -1;
+  }
+
+  ///////////////////////////////////////////////////////////////////
+  // The zygote is slow to respond; its reply will be discarded. If 
+  // it keeps falling behind, we stop using this zygote (it is 
+  // restarted once it has terminated).
+  ///////////////////////////////////////////////////////////////////
+
+  (d.zygoteLate)++;
+
+  if (d.zygoteLate > CLARAD_ZYGOTE_MAX_LATE) {
+
+    DaemonLog("ZYGT-ERROR PID: %10d         "
+              "Zygote failed to clone handler", d.zygotePid);
+
+    d.zygoteReady = -1;
+    kill(d.zygotePid, SIGTERM);
+  }
+
+  return -2;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// ReadLateClones
+//
+// Reads the replies to the clone requests we stopped waiting for. A
+// handler cloned nevertheless is not signalled (we don't track it and
+// its PID may already be reaped and reused): we closed our end of its
+// stream pipe (see spawnHandler), so it exits when it reads from it;
+// the main loop then reaps it as any other child.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+void
+  ReadLateClones
+    (void) {
+
+  pid_t pid;
+
+  while (d.zygoteLate > 0 && d.zygoteStream > -1 &&
+         recv(d.zygoteStream, &pid, sizeof(pid), MSG_DONTWAIT) == 
+            sizeof(pid)) {
+
+    (d.zygoteLate)--;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// FormatPeerName
+//
+// Formats the address of a client into a peer name buffer.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+void
+  FormatPeerName
+    (struct sockaddr_in6* client,
+     char* szPeerName) {
+
+  sprintf(szPeerName,
+          "IPV6 %02x%02x:%02x%02x:%02x%02x:%02x%02x:"
+          "%02x%02x:%02x%02x:%02x%02x:%02x%02x - " 
+          "IPV4 %03d:%03d:%03d:%03d",
+          (int)client->sin6_addr.s6_addr[0],  
+          (int)client->sin6_addr.s6_addr[1],
+          (int)client->sin6_addr.s6_addr[2],  
+          (int)client->sin6_addr.s6_addr[3],
+          (int)client->sin6_addr.s6_addr[4],  
+          (int)client->sin6_addr.s6_addr[5],
+          (int)client->sin6_addr.s6_addr[6],  
+          (int)client->sin6_addr.s6_addr[7],
+          (int)client->sin6_addr.s6_addr[8],  
+          (int)client->sin6_addr.s6_addr[9],
+          (int)client->sin6_addr.s6_addr[10], 
+          (int)client->sin6_addr.s6_addr[11],
+          (int)client->sin6_addr.s6_addr[12], 
+          (int)client->sin6_addr.s6_addr[13],
+          (int)client->sin6_addr.s6_addr[14], 
+          (int)client->sin6_addr.s6_addr[15],
+          (int)client->sin6_addr.s6_addr[12], 
+          (int)client->sin6_addr.s6_addr[13],
+          (int)client->sin6_addr.s6_addr[14], 
+          (int)client->sin6_addr.s6_addr[15]); 
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// LockLogClock / UnlockLogClock
+//
+// Fork handlers: the writer thread converts timestamps to local time 
+// while holding the clock lock, so that a handler is never forked while
+// the C library time zone lock is held by the writer thread.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+static void
+  LockLogClock
+    (void) {
+
+  pthread_mutex_lock(&(lg.clockLock));
+}
+
+static void
+  UnlockLogClock
+    (void) {
+
+  pthread_mutex_unlock(&(lg.clockLock));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// OpenDaemonLog
+//
+// Creates a new log file named after LOGFILE and the current time and
+// starts the log writer thread.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  OpenDaemonLog
+    (void) {
+
+  unsigned long i;
+
+  char szTimestamp[80];
+
+  struct tm tm;
+
+  sigset_t signals;
+  sigset_t previous;
+
+  time(&(lg.clock));
+  localtime_r(&(lg.clock), &tm);
+  strftime(szTimestamp, sizeof(szTimestamp), "%Y-%m-%d-%H-%M-%S", &tm);
+
+  sprintf(d.szLogFile, 
+          "%s-%s-log.txt",
+          d.szLogName, szTimestamp);    
+
+  lg.fd = open(d.szLogFile, 
+               O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 
+               0666);
+
+  if (lg.fd < 0) {
+    return CS_FAILURE;
+  }
+
+  lg.day = tm.tm_yday;
+  lg.stop = 0;
+  lg.head = 0;
+  lg.tail = 0;
+  lg.dropped = 0;
+
+  for (i = 0; i < CLARAD_LOG_RECORDS; i++) {
+    lg.records[i].sequence = i;
+  }
+
+  pthread_mutex_init(&(lg.clockLock), NULL);
+  pthread_atfork(LockLogClock, UnlockLogClock, UnlockLogClock);
+
+  // Signals must be delivered to the main thread, not to the writer
+
+  sigfillset(&signals);
+  pthread_sigmask(SIG_SETMASK, &signals, &previous);
+
+  if (pthread_create(&(lg.writer), NULL, DaemonLogWriter, NULL) != 0) {
+
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    close(lg.fd);
+    return CS_FAILURE;
+  }
+
+  pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+  return CS_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CloseDaemonLog
+//
+// Stops the writer thread once every pending record is written.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+void
+  CloseDaemonLog
+    (void) {
+
+  __atomic_store_n(&(lg.stop), 1, __ATOMIC_RELEASE);
+
+  pthread_join(lg.writer, NULL);
+  close(lg.fd);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// ReserveLogRecord
+//
+// Reserves the next record of the log ring. Several producers may 
+// reserve records concurrently (a signal handler may interrupt the 
+// dispatcher); a record is handed to the writer thread by 
+// PublishLogRecord. Returns NULL if the ring is full.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+static LOGRECORD*
+  ReserveLogRecord
+    (unsigned long* position) {
+
+  long diff;
+
+  unsigned long pos;
+  unsigned long seq;
+
+  LOGRECORD* pRecord;
+
+  pos = __atomic_load_n(&(lg.tail), __ATOMIC_RELAXED);
+
+  for (;;) {
+
+    pRecord = &(lg.records[pos & (CLARAD_LOG_RECORDS - 1)]);
+    seq = __atomic_load_n(&(pRecord->sequence), __ATOMIC_ACQUIRE);
+    diff = (long)seq - (long)pos;
+
+    if (diff == 0) {
+
+      if (__atomic_compare_exchange_n(&(lg.tail), &pos, pos + 1, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        *position = pos;
+        pRecord->when = __atomic_load_n(&(lg.clock), __ATOMIC_RELAXED);
+        return pRecord;
+      }
+    }
+    else {
+
+      if (diff < 0) {
+
+        // the writer thread has not caught up: discard the record
+
+        __atomic_add_fetch(&(lg.dropped), 1, __ATOMIC_RELAXED);
+        return NULL;
+      }
+
+      pos = __atomic_load_n(&(lg.tail), __ATOMIC_RELAXED);
+    }
+  }
+}
+
+static void
+  PublishLogRecord
+    (LOGRECORD* pRecord,
+     unsigned long position) {
+
+  __atomic_store_n(&(pRecord->sequence), position + 1, __ATOMIC_RELEASE);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// DaemonLog
+//
+// Adds a message to the daemon log; the writer thread prefixes it with
+// a timestamp and terminates it with a new line.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+void
+  DaemonLog
+    (char* szFormat, ...) {
+
+  unsigned long position;
+
+  va_list args;
+
+  LOGRECORD* pRecord;
+
+  if ((pRecord = ReserveLogRecord(&position)) == NULL) {
+    return;
+  }
+
+  pRecord->type = CLARAD_LOG_TEXT;
+
+  va_start(args, szFormat);
+  vsnprintf(pRecord->szText, CLARAD_LOG_TEXT_SIZE, szFormat, args);
+  va_end(args);
+
+  PublishLogRecord(pRecord, position);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// LogConnection
+//
+// Logs a connection handed over to a handler; the peer address is 
+// formatted by the writer thread.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+void
+  LogConnection
+    (pid_t pid,
+     struct sockaddr_in6* client) {
+
+  unsigned long position;
+
+  LOGRECORD* pRecord;
+
+  if ((pRecord = ReserveLogRecord(&position)) == NULL) {
+    return;
+  }
+
+  pRecord->type = CLARAD_LOG_CONN;
+  pRecord->pid = pid;
+  pRecord->peer = *client;
+
+  PublishLogRecord(pRecord, position);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// RotateDaemonLog
+//
+// Called by the writer thread when the day changes: starts a new log 
+// file and removes log files older than LOGFILE_RETAIN days.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+static void
+  RotateDaemonLog
+    (struct tm* tm) {
+
+  int fd;
+
+  char szTimestamp[80];
+  char szLogFile[2049];
+
+  strftime(szTimestamp, sizeof(szTimestamp), "%Y-%m-%d-%H-%M-%S", tm);
+
+  snprintf(szLogFile, sizeof(szLogFile),
+           "%s-%s-log.txt",
+           d.szLogName, szTimestamp);    
+
+  fd = open(szLogFile, 
+            O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 
+            0666);
+
+  if (fd >= 0) {
+
+    // the previous file is closed when the new one is in place
+
+    fd = __atomic_exchange_n(&(lg.fd), fd, __ATOMIC_RELAXED);
+    close(fd);
+
+    strcpy(d.szLogFile, szLogFile);
+  }
+
+  CleanupLogs(d.szLogDir, d.pszLogPattern, days);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// DaemonLogWriter
+//
+// Log writer thread: updates the log clock, formats the published 
+// records and writes them with a single writev() per batch.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+void*
+  DaemonLogWriter
+    (void* arg) {
+
+  int n;
+  int size;
+
+  unsigned long dropped;
+
+  char szTimestamp[80] = "";
+  char szPeerName[256];
+  char lines[CLARAD_LOG_BATCH + 1][CLARAD_LOG_LINE_SIZE];
+
+  time_t clock;
+  time_t formatted;
+
+  struct tm tm;
+  struct iovec iov[CLARAD_LOG_BATCH + 1];
+
+  LOGRECORD* pRecord;
+
+  formatted = 0;
+
+  for (;;) {
+
+    time(&clock);
+
+    if (clock != lg.clock) {
+      __atomic_store_n(&(lg.clock), clock, __ATOMIC_RELAXED);
+    }
+
+    n = 0;
+
+    while (n < CLARAD_LOG_BATCH) {
+
+      pRecord = &(lg.records[lg.head & (CLARAD_LOG_RECORDS - 1)]);
+
+      if (__atomic_load_n(&(pRecord->sequence), __ATOMIC_ACQUIRE) != 
+          lg.head + 1) {
+        break; // no record available
+      }
+
+      if (pRecord->when != formatted) {
+
+        pthread_mutex_lock(&(lg.clockLock));
+        localtime_r(&(pRecord->when), &tm);
+        pthread_mutex_unlock(&(lg.clockLock));
+
+        strftime(szTimestamp, sizeof(szTimestamp), 
+                 "%Y-%m-%d %H:%M:%S", &tm);
+
+        formatted = pRecord->when;
+
+        if (tm.tm_yday != lg.day) {
+
+          // write what belongs to the previous file
+
+          if (n > 0) {
+            writev(lg.fd, iov, n);
+            n = 0;
+          }
+
+          RotateDaemonLog(&tm);
+          lg.day = tm.tm_yday;
+        }
+      }
+
+      if (pRecord->type == CLARAD_LOG_CONN) {
+
+        FormatPeerName(&(pRecord->peer), szPeerName);
+
+        size = snprintf(lines[n], CLARAD_LOG_LINE_SIZE,
+                        "%s - CONN       HOST: %s PID:  "
+                        "%10d Connection received\n", 
+                        szTimestamp, szPeerName, pRecord->pid);
+      }
+      else {
+
+        size = snprintf(lines[n], CLARAD_LOG_LINE_SIZE,
+                        "%s - %s\n", 
+                        szTimestamp, pRecord->szText);
+      }
+
+      if (size >= CLARAD_LOG_LINE_SIZE) {
+        size = CLARAD_LOG_LINE_SIZE - 1;
+        lines[n][size - 1] = '\n';
+      }
+
+      iov[n].iov_base = lines[n];
+      iov[n].iov_len = size;
+      n++;
+
+      // hand the record back to the producers
+
+      __atomic_store_n(&(pRecord->sequence), 
+                       lg.head + CLARAD_LOG_RECORDS, 
+                       __ATOMIC_RELEASE);
+      (lg.head)++;
+    }
+
+    if ((dropped = 
+          __atomic_exchange_n(&(lg.dropped), 0, __ATOMIC_RELAXED)) > 0) {
+
+      size = snprintf(lines[n], CLARAD_LOG_LINE_SIZE,
+                      "%s - LOG-DROP   %lu records discarded: "
+                      "log buffer full\n", 
+                      szTimestamp, dropped);
+
+      iov[n].iov_base = lines[n];
+      iov[n].iov_len = size;
+      n++;
+    }
+
+    if (n > 0) {
+      writev(lg.fd, iov, n);
+    }
+
+    if (n >= CLARAD_LOG_BATCH) {
+      continue; // more records may be waiting
+    }
+
+    if (__atomic_load_n(&(lg.stop), __ATOMIC_ACQUIRE)) {
+      break;
+    }
+
+    poll(NULL, 0, CLARAD_LOG_FLUSH_INTERVAL);
+  }
+
+  return NULL;
+}
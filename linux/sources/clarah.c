@@ -31,9 +31,15 @@
 #define _GNU_SOURCE 
 
 #include <dlfcn.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sched.h>
 #include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/signal.h>
 #include <sys/socket.h>
 #include <syslog.h>
@@ -42,15 +48,69 @@
 
 #include <clarasoft/cfs.h>
 
+#define CLARAH_MAX_EVENTS            (64)
+#define CLARAH_DFT_MAX_CONNECTIONS   (256)
+
+// seconds allowed to serve queued connections after SIGTERM, in
+// acceptor mode
+#define CLARAH_DRAIN_TIMEOUT         (30)
+
+// milliseconds we stop accepting for when we are out of descriptors
+#define CLARAH_ACCEPT_BACKOFF        (1000)
+
+#ifndef SO_INCOMING_CPU
+#define SO_INCOMING_CPU              (49)
+#endif
+
 typedef void (*INPROCHANDLER)(CFS_SESSION* pSession);
 
+//////////////////////////////////////////////////////////////////////////////
+// Per-connection state used when running in event mode; sessions are
+// kept in a doubly linked list so they can be released on termination.
+//////////////////////////////////////////////////////////////////////////////
+
+typedef struct tagEVENTSESSION {
+
+  CFS_SESSION* pSession;
+  void* pUserData;
+  int connfd;
+  int interest;
+
+  // set until the TLS handshake completes; the handler is not yet
+  // aware of the session
+  int handshake;
+
+  struct tagEVENTSESSION* prev;
+  struct tagEVENTSESSION* next;
+
+} EVENTSESSION;
+
 void* pInprocServer;
 
 INPROCHANDLER pInprocHandler;
+INPROCEVENTHANDLER pInprocEventHandler;
+
+int epoll_fd;
+int numSessions;
+int numHandshakes;
+int maxSessions;
+int pendingCredits;
+
+// set by SIGTERM in event or acceptor mode; the loop does the cleanup
+volatile sig_atomic_t terminating;
+
+// set once the listening socket is closed on termination
+int draining;
+
+// time at which we stopped accepting for lack of descriptors
+time_t acceptPaused;
+
+EVENTSESSION* pSessions;
 
 
 int conn_fd;
 int stream_fd;
+int listen_fd = -1;
 time_t current_time;
 struct tm *local_time;
 pid_t pid;
@@ -61,6 +121,30 @@ CFSENV pEnv;
 
 void signalCatcher(int signal);
 
+int OpenListener(char* szPort, int backlog, int cpu);
+
+void RunAcceptLoop(void);
+
+int AcceptFailed(void);
+
+void StopAccepting(void);
+
+void AcceptEventSessions(void);
+
+void OpenEventSession(int connfd);
+
+void ContinueHandshake(EVENTSESSION* pes);
+
+void ExpireHandshakes(void);
+
+void AdvertiseCapacity(int count);
+
+void RunEventLoop(void);
+
+void CloseEventSession(EVENTSESSION* pes);
+
+int UpdateEventSession(EVENTSESSION* pes, int interest);
+
 int main(int argc, char **argv)
 {
   char buffer = 0; // dummy byte character
@@ -88,6 +172,12 @@ int main(int argc, char **argv)
   sigaction(SIGTERM, &sa, NULL);
   sigaction(SIGCHLD, &sa, NULL);
 
+  // The main daemon sends SIGHUP to have us reload the configurations
+
+  sa.sa_handler = signalCatcher;
+  sa.sa_flags = SA_RESTART;
+  sigaction(SIGHUP, &sa, NULL);
+
   pEnv = NULL;
   pRepo = NULL;
 
@@ -135,7 +225,41 @@ int main(int argc, char **argv)
 
   if (pInprocServer) {
 
-    if ((pszParam = CFSCFG_LookupParam(pConfig, "INPROCHANDLER")) == NULL) {
+    ///////////////////////////////////////////////////////////////////
+    // If the in-process server exports an event handler, this process
+    // will multiplex several connections; otherwise, each connection
+    // is handled to completion by the blocking handler.
+    ///////////////////////////////////////////////////////////////////
+
+    if ((pszParam = 
+            CFSCFG_LookupParam(pConfig, "INPROCEVENTHANDLER")) != NULL) {
+
+      pInprocEventHandler = dlsym(pInprocServer, pszParam);
+
+      if (dlerror() != NULL) {
+        dlclose(pInprocServer);
+        syslog(LOG_ERR, "Failed to retrieve export address for %s", pszParam);
+        closelog();
+        CFSRPS_CloseConfig(pRepo, &pConfig);
+        CFSRPS_Close(&pRepo);
+        exit(6);
+      }
+
+      if ((pszParam = 
+              CFSCFG_LookupParam(pConfig, "MAX_CONNECTIONS")) == NULL) {
+        maxSessions = CLARAH_DFT_MAX_CONNECTIONS;
+      }
+      else {
+        maxSessions = atoi(pszParam);
+        if (maxSessions < 1) {
+          maxSessions = 1;
+        }
+      }
+
+      syslog(LOG_INFO, "Running in event mode - max connections: %d",
+             maxSessions);
+    }
+    else if ((pszParam = CFSCFG_LookupParam(pConfig, "INPROCHANDLER")) == NULL) {
       dlclose(pInprocServer);
       syslog(LOG_ERR, "Failed to lookup INPROCHANDLER");
       closelog();
@@ -144,15 +268,18 @@ int main(int argc, char **argv)
       exit(5);
     }
 
-    pInprocHandler = dlsym(pInprocServer, pszParam);
+    else {
 
-    if (dlerror() != NULL) {
-      dlclose(pInprocServer);
-      syslog(LOG_ERR, "Failed to retrieve export address for %s", pszParam);
-      closelog();
-      CFSRPS_CloseConfig(pRepo, &pConfig);
-      CFSRPS_Close(&pRepo);
-      exit(6);
+      pInprocHandler = dlsym(pInprocServer, pszParam);
+
+      if (dlerror() != NULL) {
+        dlclose(pInprocServer);
+        syslog(LOG_ERR, "Failed to retrieve export address for %s", pszParam);
+        closelog();
+        CFSRPS_CloseConfig(pRepo, &pConfig);
+        CFSRPS_Close(&pRepo);
+        exit(6);
+      }
     }
   }
   else {
@@ -167,15 +294,60 @@ int main(int argc, char **argv)
 
   stream_fd = atoi(argv[1]);
 
+  /////////////////////////////////////////////////////////////////////
+  // In zygote mode ('Z'), this process is a template from which the
+  // main daemon obtains new handlers (see CFS_RunZygote); we go on
+  // only in a new handler.
+  /////////////////////////////////////////////////////////////////////
+
+  if (argv[2][0] == 'Z') {
+
+    syslog(LOG_INFO, "Running in zygote mode");
+
+    if ((stream_fd = CFS_RunZygote(stream_fd)) < 0) {
+      dlclose(pInprocServer);
+      CFS_CloseEnv(&pEnv);
+      syslog(LOG_INFO, "Zygote exiting");
+      closelog();
+      exit(0);
+    }
+
+    pid = getpid();
+  }
+
+  /////////////////////////////////////////////////////////////////////
+  // In acceptor mode ('A'), the main daemon does not hand over
+  // connections; we listen on the daemon port alongside the other
+  // handlers (SO_REUSEPORT) and report our status on the stream pipe.
+  /////////////////////////////////////////////////////////////////////
+
+  if (argc > 6 && argv[2][0] == 'A') {
+
+    if ((listen_fd = OpenListener(argv[4], 
+                                  atoi(argv[5]), 
+                                  atoi(argv[6]))) < 0) {
+      syslog(LOG_ERR, "Failed to listen on port %s: errno: %d", 
+             argv[4], errno);
+      closelog();
+      exit(9);
+    }
+  }
+
   /////////////////////////////////////////////////////////////////////
   // Try to send parent a byte; this indicates we are ready
   // to handle a client...
   /////////////////////////////////////////////////////////////////////
 
-  stream_fd = atoi(argv[1]);
-
   send(stream_fd, &buffer, 1, 0);
 
+  if (pInprocEventHandler != NULL) {
+    RunEventLoop();
+  }
+
+  if (listen_fd >= 0) {
+    RunAcceptLoop();
+  }
+
   for (;;)
   {
     /////////////////////////////////////////////////////////////////////
@@ -199,6 +371,12 @@ int main(int argc, char **argv)
 
       send(stream_fd, &buffer, 1, 0);
     }
+    else {
+
+      if (CS_DIAG(hResult) == CFS_DIAG_CONNCLOSE) {
+        break; // the main daemon no longer uses this handler
+      }
+    }
   }
 
   dlclose(pInprocServer);
@@ -218,8 +396,25 @@ void signalCatcher(int signal)
 {
   switch (signal)
   {
+    case SIGHUP:
+
+      CFSRPS_Reload();
+      break;
+
     case SIGTERM:
 
+      ///////////////////////////////////////////////////////////////
+      // In event mode, sessions are closed by the event loop: the
+      // event handler must not be called from here. In acceptor 
+      // mode, the loop also serves the connections queued on our
+      // listening socket before exiting.
+      ///////////////////////////////////////////////////////////////
+
+      if (pInprocEventHandler != NULL || listen_fd >= 0) {
+        terminating = 1;
+        break;
+      }
+
       if (pSession != NULL) {
         CFS_CloseChannel(&pSession);
       }
@@ -230,6 +425,11 @@ void signalCatcher(int signal)
 
       CFS_CloseEnv(&pEnv);
       close(stream_fd);
+
+      if (listen_fd >= 0) {
+        close(listen_fd);
+      }
+
       syslog(LOG_INFO, "SIGTERM received - Handler existing");
       closelog();
 
@@ -239,3 +439,788 @@ void signalCatcher(int signal)
   return;
 }
 
+/* --------------------------------------------------------------------------
+  RunEventLoop
+
+  Multiplexes several client sessions in this process. The main daemon
+  hands over a connection every time it reads a readiness byte from the
+  stream pipe; in this mode, we advertise the number of connections we
+  can still accept (see AdvertiseCapacity) so that the daemon considers
+  this handler available until MAX_CONNECTIONS sessions are active.
+-------------------------------------------------------------------------- */
+
+void RunEventLoop(void)
+{
+  int i;
+  int j;
+  int numEvents;
+  int numDescriptors;
+  int interest;
+  int timeout;
+
+  int descriptors[CFS_MAX_DESCRIPTORS];
+
+  time_t lastExpiry;
+  time_t drainDeadline;
+
+  sigset_t termMask;
+  sigset_t waitMask;
+
+  CSRESULT hResult;
+
+  EVENTSESSION* pes;
+
+  struct epoll_event ev;
+  struct epoll_event events[CLARAH_MAX_EVENTS];
+
+  numSessions = 0;
+  numHandshakes = 0;
+  pendingCredits = 0;
+  pSessions = NULL;
+  lastExpiry = 0;
+
+  /////////////////////////////////////////////////////////////////////
+  // SIGTERM is only delivered while we wait for events so that it 
+  // can't be missed between the time we check for it and the time
+  // we wait.
+  /////////////////////////////////////////////////////////////////////
+
+  sigemptyset(&termMask);
+  sigaddset(&termMask, SIGTERM);
+  sigprocmask(SIG_BLOCK, &termMask, &waitMask);
+  sigdelset(&waitMask, SIGTERM);
+
+  if ((epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+    syslog(LOG_ERR, "epoll_create1() failed: errno: %d", errno);
+    closelog();
+    exit(8);
+  }
+
+  // The stream pipe is identified by a NULL event pointer
+
+  ev.events = EPOLLIN;
+  ev.data.ptr = NULL;
+
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, stream_fd, &ev);
+
+  if (listen_fd >= 0) {
+
+    // The listening socket is identified by the address of its descriptor
+
+    fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL, 0) | O_NONBLOCK);
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = &listen_fd;
+
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+  }
+  else {
+
+    // We have already sent one readiness byte; advertise
+    // the remaining capacity.
+
+    AdvertiseCapacity(maxSessions - 1);
+  }
+
+  drainDeadline = 0;
+
+  for (;;)
+  {
+    if (terminating) {
+
+      /////////////////////////////////////////////////////////////////
+      // In acceptor mode, the connections queued on our listening
+      // socket would be reset when it is closed: we take them and
+      // serve our sessions until they end or the drain timeout 
+      // expires.
+      /////////////////////////////////////////////////////////////////
+
+      if (listen_fd >= 0) {
+        StopAccepting();
+        drainDeadline = time(NULL) + CLARAH_DRAIN_TIMEOUT;
+      }
+
+      if (!draining || numSessions == 0 || time(NULL) >= drainDeadline) {
+        break;
+      }
+    }
+
+    /////////////////////////////////////////////////////////////////////
+    // While handshakes are pending, while we are draining or while we
+    // stopped accepting for lack of descriptors, we wake up every 
+    // second.
+    /////////////////////////////////////////////////////////////////////
+
+    timeout = numHandshakes > 0 || draining || acceptPaused != 0 ? 
+                1000 : -1;
+
+    numEvents = epoll_pwait(epoll_fd, events, CLARAH_MAX_EVENTS, 
+                            timeout, &waitMask);
+
+    if (numEvents < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      syslog(LOG_ERR, "epoll_wait() failed: errno: %d", errno);
+      break;
+    }
+
+    for (i=0; i<numEvents; i++) {
+
+      if (events[i].data.ptr == &listen_fd) {
+        AcceptEventSessions();
+      }
+      else if (events[i].data.ptr == NULL) {
+
+        ///////////////////////////////////////////////////////////////
+        // The main daemon is handing over one or more connections
+        ///////////////////////////////////////////////////////////////
+
+        if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+          syslog(LOG_ERR, "stream pipe closed - Handler exiting");
+          closelog();
+          exit(0);
+        }
+
+        if (listen_fd >= 0) {
+          // we accept our own connections; nothing is sent on the pipe
+          continue;
+        }
+
+        numDescriptors = CFS_MAX_DESCRIPTORS;
+
+        hResult = CFS_ReceiveDescriptors(stream_fd, 
+                                         descriptors, 
+                                         &numDescriptors, 
+                                         0);
+
+        if (CS_FAIL(hResult)) {
+          continue;
+        }
+
+        for (j=0; j<numDescriptors; j++) {
+          OpenEventSession(descriptors[j]);
+        }
+      }
+      else {
+
+        pes = (EVENTSESSION*)events[i].data.ptr;
+
+        if (pes->handshake) {
+          ContinueHandshake(pes);
+          continue;
+        }
+
+        if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+
+          /////////////////////////////////////////////////////////////
+          // A hang-up is reported as readable so that the handler
+          // gets the connection close from its receive call. Secure
+          // sessions may hold decrypted data that won't trigger a
+          // readiness event; it must be consumed now.
+          /////////////////////////////////////////////////////////////
+
+          CFS_SetReadReady(pes->pSession);
+
+          do {
+            interest = pInprocEventHandler(pes->pSession, 
+                                           CFS_EVENT_READABLE, 
+                                           &(pes->pUserData));
+          }
+          while ((interest & CFS_EVENT_READABLE) &&
+                 !(interest & CFS_EVENT_CLOSE) &&
+                 CFS_QueryPendingSize(pes->pSession) > 0);
+
+          if (UpdateEventSession(pes, interest) < 0) {
+            CloseEventSession(pes);
+            continue;
+          }
+        }
+
+        if ((events[i].events & EPOLLOUT) && 
+            (pes->interest & CFS_EVENT_WRITABLE)) {
+
+          interest = pInprocEventHandler(pes->pSession, 
+                                         CFS_EVENT_WRITABLE, 
+                                         &(pes->pUserData));
+
+          if (UpdateEventSession(pes, interest) < 0) {
+            CloseEventSession(pes);
+            continue;
+          }
+        }
+      }
+    }
+
+    if (numHandshakes > 0 && time(NULL) != lastExpiry) {
+      lastExpiry = time(NULL);
+      ExpireHandshakes();
+    }
+
+    if (acceptPaused != 0 && listen_fd >= 0 &&
+        (time(NULL) - acceptPaused) * 1000 >= CLARAH_ACCEPT_BACKOFF) {
+
+      acceptPaused = 0;
+
+      if (numSessions < maxSessions) {
+
+        ev.events = EPOLLIN;
+        ev.data.ptr = &listen_fd;
+
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, listen_fd, &ev);
+      }
+    }
+
+    // Tell the main daemon about connection slots freed in this pass
+
+    if (pendingCredits > 0) {
+      AdvertiseCapacity(pendingCredits);
+      pendingCredits = 0;
+    }
+  }
+
+  if (terminating) {
+
+    if (numSessions > 0 && draining) {
+      syslog(LOG_WARNING, "drain timeout - closing %d sessions", 
+             numSessions);
+    }
+
+    syslog(LOG_INFO, "SIGTERM received - Handler existing");
+  }
+
+  while (pSessions != NULL) {
+    CloseEventSession(pSessions);
+  }
+
+  close(epoll_fd);
+  dlclose(pInprocServer);
+  CFS_CloseEnv(&pEnv);
+  close(stream_fd);
+
+  if (listen_fd >= 0) {
+    close(listen_fd);
+  }
+
+  closelog();
+
+  exit(0);
+}
+
+/* --------------------------------------------------------------------------
+  UpdateEventSession
+
+  Registers the events a session is interested in; returns -1 if the
+  session must be closed.
+-------------------------------------------------------------------------- */
+
+int UpdateEventSession(EVENTSESSION* pes, int interest)
+{
+  struct epoll_event ev;
+
+  interest &= (CFS_EVENT_READABLE | CFS_EVENT_WRITABLE | CFS_EVENT_CLOSE);
+
+  if (interest == CFS_EVENT_NONE || (interest & CFS_EVENT_CLOSE)) {
+    return -1;
+  }
+
+  if (interest == pes->interest) {
+    return 0;
+  }
+
+  ev.events = 0;
+  ev.data.ptr = pes;
+
+  if (interest & CFS_EVENT_READABLE) {
+    ev.events |= EPOLLIN;
+  }
+
+  if (interest & CFS_EVENT_WRITABLE) {
+    ev.events |= EPOLLOUT;
+  }
+
+  if (epoll_ctl(epoll_fd, 
+                pes->interest == CFS_EVENT_NONE ? 
+                  EPOLL_CTL_ADD : EPOLL_CTL_MOD,
+                pes->connfd, &ev) < 0) {
+    return -1;
+  }
+
+  pes->interest = interest;
+
+  return 0;
+}
+
+/* --------------------------------------------------------------------------
+  CloseEventSession
+
+  Notifies the handler and releases the session; the freed connection
+  slot is advertised to the main daemon at the end of the event loop
+  pass.
+-------------------------------------------------------------------------- */
+
+void CloseEventSession(EVENTSESSION* pes)
+{
+  char buffer = 0;
+
+  struct epoll_event ev;
+
+  if (pes->handshake) {
+    numHandshakes--;
+  }
+
+  if (pes->pSession != NULL) {
+
+    if (!pes->handshake) {
+      pInprocEventHandler(pes->pSession, 
+                          CFS_EVENT_CLOSE, 
+                          &(pes->pUserData));
+    }
+
+    if (pes->interest != CFS_EVENT_NONE) {
+      epoll_ctl(epoll_fd, EPOLL_CTL_DEL, pes->connfd, NULL);
+    }
+
+    CFS_CloseChannel(&(pes->pSession));
+  }
+
+  if (pes->prev != NULL) {
+    pes->prev->next = pes->next;
+  }
+  else {
+    pSessions = pes->next;
+  }
+
+  if (pes->next != NULL) {
+    pes->next->prev = pes->prev;
+  }
+
+  free(pes);
+
+  if (draining) {
+    // no longer accepting connections
+    numSessions--;
+  }
+  else if (listen_fd >= 0) {
+
+    ////////////////////////////////////////////////////////////////////
+    // Resume accepting connections if we were at full capacity
+    ////////////////////////////////////////////////////////////////////
+
+    if (numSessions-- == maxSessions) {
+
+      ev.events = EPOLLIN;
+      ev.data.ptr = &listen_fd;
+
+      epoll_ctl(epoll_fd, EPOLL_CTL_MOD, listen_fd, &ev);
+
+      buffer = CFS_HANDLER_READY;
+      send(stream_fd, &buffer, 1, 0);
+    }
+  }
+  else {
+
+    numSessions--;
+    pendingCredits++;
+  }
+}
+
+/* --------------------------------------------------------------------------
+  OpenEventSession
+
+  Initialises a session on a client connection and registers it for
+  event notifications.
+-------------------------------------------------------------------------- */
+
+void OpenEventSession(int connfd)
+{
+  EVENTSESSION* pes;
+
+  if ((pes = (EVENTSESSION*)malloc(sizeof(EVENTSESSION))) == NULL) {
+
+    syslog(LOG_ERR, "Failed to allocate session - connection dropped");
+    close(connfd);
+
+    if (listen_fd < 0) {
+      // the main daemon counted this connection against our capacity
+      pendingCredits++;
+    }
+
+    return;
+  }
+
+  pes->connfd = connfd;
+  pes->pUserData = NULL;
+  pes->interest = CFS_EVENT_NONE;
+  pes->handshake = 0;
+  pes->prev = NULL;
+  pes->next = pSessions;
+
+  if (pSessions != NULL) {
+    pSessions->prev = pes;
+  }
+
+  pSessions = pes;
+  numSessions++;
+
+  if ((pes->pSession = CFS_OpenChannelAsync(pEnv, connfd)) == NULL) {
+    // the channel closed the descriptor on failure
+    pes->connfd = -1;
+    CloseEventSession(pes);
+    return;
+  }
+
+  pes->handshake = 1;
+  numHandshakes++;
+
+  ContinueHandshake(pes);
+}
+
+/* --------------------------------------------------------------------------
+  ContinueHandshake
+
+  Advances the TLS handshake of a session without blocking; the 
+  handler is notified of the session once the handshake completes.
+-------------------------------------------------------------------------- */
+
+void ContinueHandshake(EVENTSESSION* pes)
+{
+  int interest;
+
+  interest = CFS_AcceptHandshake(pes->pSession);
+
+  if (interest == CFS_EVENT_OPEN) {
+
+    pes->handshake = 0;
+    numHandshakes--;
+
+    interest = pInprocEventHandler(pes->pSession, 
+                                   CFS_EVENT_OPEN, 
+                                   &(pes->pUserData));
+  }
+
+  if (UpdateEventSession(pes, interest) < 0) {
+    CloseEventSession(pes);
+  }
+}
+
+/* --------------------------------------------------------------------------
+  ExpireHandshakes
+
+  Closes the sessions whose handshake did not complete within the 
+  connect timeout of the environment.
+-------------------------------------------------------------------------- */
+
+void ExpireHandshakes(void)
+{
+  EVENTSESSION* pes;
+  EVENTSESSION* pNext;
+
+  for (pes = pSessions; pes != NULL; pes = pNext) {
+
+    pNext = pes->next;
+
+    if (pes->handshake) {
+      ContinueHandshake(pes);
+    }
+  }
+}
+
+/* --------------------------------------------------------------------------
+  AcceptEventSessions
+
+  Accepts pending connections on our listening socket until none are
+  left or we reach MAX_CONNECTIONS, in which case we stop listening for
+  connections and tell the main daemon we are busy.
+-------------------------------------------------------------------------- */
+
+void AcceptEventSessions(void)
+{
+  char buffer;
+
+  int connfd;
+
+  struct epoll_event ev;
+
+  while (numSessions < maxSessions) {
+
+    connfd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+
+    if (connfd < 0) {
+
+      if (errno == EINTR) {
+        continue;
+      }
+
+      if (AcceptFailed()) {
+
+        /////////////////////////////////////////////////////////////
+        // The listening socket would stay readable; we stop 
+        // watching it until the event loop resumes accepting.
+        /////////////////////////////////////////////////////////////
+
+        ev.events = 0;
+        ev.data.ptr = &listen_fd;
+
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, listen_fd, &ev);
+
+        acceptPaused = time(NULL);
+      }
+
+      // EAGAIN: no more pending connections
+      return;
+    }
+
+    OpenEventSession(connfd);
+  }
+
+  ev.events = 0;
+  ev.data.ptr = &listen_fd;
+
+  epoll_ctl(epoll_fd, EPOLL_CTL_MOD, listen_fd, &ev);
+
+  buffer = CFS_HANDLER_BUSY;
+  send(stream_fd, &buffer, 1, 0);
+}
+
+/* --------------------------------------------------------------------------
+  RunAcceptLoop
+
+  Accepts and handles connections one at a time on our own listening
+  socket; the main daemon is told when we are busy so it may start 
+  additional handlers. SIGTERM is only delivered while we wait for a
+  connection; we then serve the connections already queued on our
+  listening socket before exiting.
+-------------------------------------------------------------------------- */
+
+void RunAcceptLoop(void)
+{
+  char buffer;
+
+  time_t drainDeadline;
+
+  sigset_t termMask;
+  sigset_t waitMask;
+
+  struct pollfd fdset[1];
+
+  sigemptyset(&termMask);
+  sigaddset(&termMask, SIGTERM);
+  sigprocmask(SIG_BLOCK, &termMask, &waitMask);
+  sigdelset(&waitMask, SIGTERM);
+
+  fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL, 0) | O_NONBLOCK);
+
+  fdset[0].fd = listen_fd;
+  fdset[0].events = POLLIN;
+
+  drainDeadline = 0;
+
+  for (;;)
+  {
+    if (terminating && drainDeadline == 0) {
+      drainDeadline = time(NULL) + CLARAH_DRAIN_TIMEOUT;
+    }
+
+    if (drainDeadline == 0 && ppoll(fdset, 1, NULL, &waitMask) < 0) {
+      continue; // EINTR
+    }
+
+    conn_fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+
+    if (conn_fd < 0) {
+
+      if (errno == EINTR) {
+        continue;
+      }
+
+      if (drainDeadline != 0) {
+        break; // no more queued connections
+      }
+
+      if (AcceptFailed()) {
+        poll(NULL, 0, CLARAH_ACCEPT_BACKOFF);
+      }
+
+      continue;
+    }
+
+    buffer = CFS_HANDLER_BUSY;
+    send(stream_fd, &buffer, 1, 0);
+
+    if ((pSession = CFS_OpenChannel(pEnv, conn_fd)) != NULL) {
+
+      pInprocHandler(pSession); 
+
+      CFS_CloseChannel(&pSession);
+    }
+
+    buffer = CFS_HANDLER_READY;
+    send(stream_fd, &buffer, 1, 0);
+
+    if (drainDeadline != 0 && time(NULL) >= drainDeadline) {
+      syslog(LOG_WARNING, "drain timeout - queued connections dropped");
+      break;
+    }
+  }
+
+  close(listen_fd);
+  dlclose(pInprocServer);
+  CFS_CloseEnv(&pEnv);
+  close(stream_fd);
+  syslog(LOG_INFO, "SIGTERM received - Handler existing");
+  closelog();
+
+  exit(0);
+}
+
+/* --------------------------------------------------------------------------
+  AcceptFailed
+
+  Reports an accept() error; returns 1 if we ran out of descriptors or
+  memory, in which case the caller stops accepting for a while rather
+  than retrying at once.
+-------------------------------------------------------------------------- */
+
+int AcceptFailed(void)
+{
+  switch (errno)
+  {
+    case EAGAIN:
+    case ECONNABORTED:
+
+      return 0;
+
+    case EMFILE:
+    case ENFILE:
+    case ENOBUFS:
+    case ENOMEM:
+
+      syslog(LOG_ERR, "accept4() failed: errno: %d - "
+                      "pausing for %d ms", errno, CLARAH_ACCEPT_BACKOFF);
+      return 1;
+  }
+
+  syslog(LOG_ERR, "accept4() failed: errno: %d", errno);
+
+  return 0;
+}
+
+/* --------------------------------------------------------------------------
+  StopAccepting
+
+  Called in event mode on termination: the connections queued on our 
+  listening socket are opened as sessions, regardless of 
+  MAX_CONNECTIONS, and the socket is closed.
+-------------------------------------------------------------------------- */
+
+void StopAccepting(void)
+{
+  int connfd;
+
+  for (;;) {
+
+    connfd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+
+    if (connfd < 0) {
+
+      if (errno == EINTR) {
+        continue;
+      }
+
+      break;
+    }
+
+    OpenEventSession(connfd);
+  }
+
+  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, listen_fd, NULL);
+  close(listen_fd);
+
+  listen_fd = -1;
+  draining = 1;
+}
+
+/* --------------------------------------------------------------------------
+  OpenListener
+
+  Binds a listening socket to the daemon port; the port is shared with
+  the other handlers so the kernel distributes connections among them.
+  If a processor is specified, this process is bound to it and the
+  socket only favours connections processed on that processor.
+-------------------------------------------------------------------------- */
+
+int OpenListener(char* szPort, int backlog, int cpu)
+{
+  int fd;
+  int on;
+
+  cpu_set_t cpuSet;
+
+  struct sockaddr_in6 server;
+
+  if ((fd = socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+    return -1;
+  }
+
+  on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (void *)&on, sizeof(int));
+
+  if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (void *)&on, sizeof(int)) < 0) {
+    close(fd);
+    return -1;
+  }
+
+  if (cpu >= 0) {
+
+    CPU_ZERO(&cpuSet);
+    CPU_SET(cpu, &cpuSet);
+
+    if (sched_setaffinity(0, sizeof(cpu_set_t), &cpuSet) == 0) {
+      setsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, 
+                 (void *)&cpu, sizeof(int));
+    }
+  }
+
+  memset(&server, 0, sizeof(struct sockaddr_in6));
+
+  server.sin6_family = AF_INET6;
+  server.sin6_addr = in6addr_any;
+  server.sin6_port = htons(atoi(szPort));
+
+  if (bind(fd, (struct sockaddr *)&server, sizeof(server)) < 0) {
+    close(fd);
+    return -1;
+  }
+
+  if (listen(fd, backlog) < 0) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+/* --------------------------------------------------------------------------
+  AdvertiseCapacity
+
+  Tells the main daemon we can take count more connections; each byte
+  sent on the stream pipe accounts for up to 255 connections.
+-------------------------------------------------------------------------- */
+
+void AdvertiseCapacity(int count)
+{
+  unsigned char credits[16];
+
+  int i;
+
+  while (count > 0) {
+
+    for (i=0; i<16 && count > 0; i++) {
+      credits[i] = count > 255 ? 255 : (unsigned char)count;
+      count -= credits[i];
+    }
+
+    send(stream_fd, credits, i, 0);
+  }
+}
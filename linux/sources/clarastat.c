@@ -0,0 +1,179 @@
+/* ==========================================================================
+
+  Clarasoft Foundation Server - Linux
+  Handler scoreboard viewer
+
+  Distributed under the MIT license
+
+  Copyright (c) 2013 Clarasoft I.T. Solutions Inc.
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify,
+  merge, publish, distribute, sub license, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+  THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  Usage: clarastat <scoreboard file> [interval]
+
+  The scoreboard file is created by clarad in its runtime directory
+  (<RUNTIME_DIR>/<daemon configuration>/scoreboard, RUNTIME_DIR being
+  /run/clarad by default). Without an interval, the scoreboard is
+  printed once; otherwise, it is printed every interval seconds.
+
+========================================================================== */
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <clarasoft/cfs.h>
+
+void
+  PrintScoreboard
+    (CFS_SCOREBOARD* pScoreboard);
+
+int main(int argc, char** argv) {
+
+  int interval;
+
+  CFS_SCOREBOARD* pScoreboard;
+
+  if (argc < 2) {
+    fprintf(stderr, "usage: clarastat <scoreboard file> [interval]\n");
+    return 1;
+  }
+
+  interval = argc > 2 ? atoi(argv[2]) : 0;
+
+  if ((pScoreboard = CFS_OpenScoreboard(argv[1])) == NULL) {
+    fprintf(stderr, "clarastat: cannot open scoreboard %s\n", argv[1]);
+    return 1;
+  }
+
+  for (;;) {
+
+    PrintScoreboard(pScoreboard);
+
+    if (interval <= 0) {
+      break;
+    }
+
+    sleep(interval);
+    printf("\n");
+  }
+
+  CFS_CloseScoreboard(&pScoreboard);
+
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// PrintScoreboard
+//
+// Prints one line per used slot. The handlers update their slot while
+// we read it, so a line may mix values from two consecutive updates.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+void
+  PrintScoreboard
+    (CFS_SCOREBOARD* pScoreboard) {
+
+  int i;
+  int state;
+  int numBusy;
+  int numReady;
+  int numStarting;
+
+  time_t now;
+
+  char szPeer[INET6_ADDRSTRLEN];
+
+  static const char* pszState[] = { "FREE", "START", "READY", "BUSY" };
+
+  CFS_SCOREBOARD_SLOT* pSlot;
+
+  time(&now);
+
+  numBusy = 0;
+  numReady = 0;
+  numStarting = 0;
+
+  printf("clarad PID: %d  uptime: %lds\n\n",
+         pScoreboard->daemonPid, (long)(now - pScoreboard->started));
+
+  printf("%5s %10s %-6s %6s %12s %14s %14s %6s  %s\n",
+         "SLOT", "PID", "STATE", "CONN", "REQUESTS",
+         "BYTES IN", "BYTES OUT", "IDLE", "LAST PEER");
+
+  for (i = 0; i < pScoreboard->numSlots; i++) {
+
+    pSlot = &(pScoreboard->slots[i]);
+
+    state = __atomic_load_n(&(pSlot->state), __ATOMIC_RELAXED);
+
+    if (state == CFS_SCB_STATE_FREE || state > CFS_SCB_STATE_BUSY) {
+      continue;
+    }
+
+    switch (state) {
+      case CFS_SCB_STATE_STARTING:
+        numStarting++;
+        break;
+      case CFS_SCB_STATE_READY:
+        numReady++;
+        break;
+      default:
+        numBusy++;
+        break;
+    }
+
+    if (inet_ntop(AF_INET6, pSlot->peer, szPeer, sizeof(szPeer)) == NULL ||
+        !strcmp(szPeer, "::")) {
+      strcpy(szPeer, "-");
+    }
+    else {
+
+      // IPv4 peers are recorded as mapped addresses
+
+      if (!strncmp(szPeer, "::ffff:", 7) && strchr(szPeer, '.') != NULL) {
+        memmove(szPeer, szPeer + 7, strlen(szPeer + 7) + 1);
+      }
+    }
+
+    printf("%5d %10d %-6s %6d %12llu %14llu %14llu %6ld  %s\n",
+           i,
+           __atomic_load_n(&(pSlot->pid), __ATOMIC_RELAXED),
+           pszState[state],
+           __atomic_load_n(&(pSlot->connections), __ATOMIC_RELAXED),
+           (unsigned long long)
+             __atomic_load_n(&(pSlot->requests), __ATOMIC_RELAXED),
+           (unsigned long long)
+             __atomic_load_n(&(pSlot->bytesIn), __ATOMIC_RELAXED),
+           (unsigned long long)
+             __atomic_load_n(&(pSlot->bytesOut), __ATOMIC_RELAXED),
+           (long)(now -
+             __atomic_load_n(&(pSlot->lastActivity), __ATOMIC_RELAXED)),
+           szPeer);
+  }
+
+  printf("\n%d busy, %d ready, %d starting\n",
+         numBusy, numReady, numStarting);
+
+  fflush(stdout);
+}
@@ -91,7 +91,10 @@ typedef struct tagCSAP {
   CSWSCK pSession;
 
   CSJSON pJsonIn;
-  CSJSON pJsonOut;
+  CSJSONWRITER pJsonOut;
+
+  CSJSONPATH pCtlPath;
+  CSJSONPATH pHandshakePath;
 
   CSJSON_LSENTRY lse;
 
@@ -115,6 +118,14 @@ typedef struct tagCSAP {
 
 } CSAP;
 
+long
+  CSAP_PRIVATE_CtlFrame
+    (CSAP* This,
+     long dataSize,
+     long usrCtlSize,
+     char* szFmt,
+     char** lpszFrame);
+
 CSAP*
   CSAP_Constructor
     (void) {
@@ -137,10 +148,16 @@ CSAP*
   Instance->pOutDataSlab = (char*)malloc
                 ((Instance->outDataSlabSize + 1) * sizeof(char));
 
-  Instance->OutDataParts = CSLIST_Constructor();
+  Instance->OutDataParts = CSLIST_VectorConstructor(0);
+
+  // Inbound documents reuse the memory of the previous message;
+  // outbound control frames are written directly.
+
+  Instance->pJsonIn = CSJSON_PoolConstructor();
+  Instance->pJsonOut = CSJSONWRITER_Constructor();
 
-  Instance->pJsonIn = CSJSON_Constructor();
-  Instance->pJsonOut = CSJSON_Constructor();
+  Instance->pCtlPath = CSJSON_CompilePath("/ctl");
+  Instance->pHandshakePath = CSJSON_CompilePath("/handshake");
 
   return Instance;
 }
@@ -152,7 +169,9 @@ CSRESULT
   CSLIST_Destructor(&((*This)->OutDataParts));
   CSWSCK_Destructor(&((*This)->pSession));
   CSJSON_Destructor(&((*This)->pJsonIn));
-  CSJSON_Destructor(&((*This)->pJsonOut));
+  CSJSONWRITER_Destructor(&((*This)->pJsonOut));
+  CSJSON_FreePath(&((*This)->pCtlPath));
+  CSJSON_FreePath(&((*This)->pHandshakePath));
 
   free((*This)->pUsrCtlSlab);
   free((*This)->pOutDataSlab);
@@ -266,6 +285,7 @@ CSRESULT
   uint64_t size;
   
   char* pszParam;
+  char* pszService;
   char* szBuffer;
 
   // Reset outbound data, in case a send is
@@ -277,7 +297,7 @@ CSRESULT
 
   CSLIST_Clear(This->OutDataParts);
 
-  CSJSON_Init(This->pJsonOut, JSON_TYPE_OBJECT);
+  CSJSONWRITER_Reset(This->pJsonOut);
 
   This->pRepo = CFSRPS_Open(0);
 
@@ -287,27 +307,34 @@ CSRESULT
   }
   else {
 
-    if ((pszParam = CFSCFG_LookupParam(This->pConfig, "SERVICE")) != NULL) {
-      CSJSON_InsertString(This->pJsonOut, "/", "service", pszParam);
-    }
-    else {
+    if ((pszService = CFSCFG_LookupParam(This->pConfig, "SERVICE")) == NULL) {
       CFSRPS_CloseConfig(This->pRepo, &(This->pConfig));
       CFSRPS_Close(&(This->pRepo));
       return CS_FAILURE | CSAP_OPEN | CSAP_CONFIG;
     }
-    if ((pszParam = CFSCFG_LookupParam(This->pConfig, "U")) != NULL) {
-      CSJSON_InsertString(This->pJsonOut, "/", "u", pszParam);
+
+    // Members are written in ascending key order
+
+    CSJSONWRITER_BeginObject(This->pJsonOut, NULL);
+
+    if ((pszParam = CFSCFG_LookupParam(This->pConfig, "P")) != NULL) {
+      // decrypt password
+      CSJSONWRITER_String(This->pJsonOut, "p", pszParam);
     }
     else {
-      CSJSON_InsertString(This->pJsonOut, "/", "u", "");
+      CSJSONWRITER_String(This->pJsonOut, "p", "");
     }
-    if ((pszParam = CFSCFG_LookupParam(This->pConfig, "P")) != NULL) {
-      // decrypt password
-      CSJSON_InsertString(This->pJsonOut, "/", "p", pszParam);
+
+    CSJSONWRITER_String(This->pJsonOut, "service", pszService);
+
+    if ((pszParam = CFSCFG_LookupParam(This->pConfig, "U")) != NULL) {
+      CSJSONWRITER_String(This->pJsonOut, "u", pszParam);
     }
     else {
-      CSJSON_InsertString(This->pJsonOut, "/", "p", "");
+      CSJSONWRITER_String(This->pJsonOut, "u", "");
     }
+
+    CSJSONWRITER_EndObject(This->pJsonOut);
   }
 
   CFSRPS_CloseConfig(This->pRepo, &(This->pConfig));
@@ -319,7 +346,7 @@ CSRESULT
                             szService, 
                             0, 0))) {
 
-    size = (uint64_t)CSJSON_Serialize(This->pJsonOut, "/", &szBuffer, 0);
+    size = (uint64_t)CSJSONWRITER_Serialize(This->pJsonOut, &szBuffer);
 
     if (CS_SUCCEED(CSWSCK_Send(This->pSession,
                                CSWSCK_OP_TEXT,
@@ -335,9 +362,9 @@ CSRESULT
           return CS_FAILURE | CSAP_HANDSHAKE | CSAP_FORMAT;
         }
 
-        if (CS_FAIL(CSJSON_LookupKey
+        if (CS_FAIL(CSJSON_LookupPathKey
                                  (This->pJsonIn,
-                                  "/handshake", "status",
+                                  This->pHandshakePath, "status",
                                   &(This->lse)))) {
 
           return CS_FAILURE | CSAP_HANDSHAKE | CSAP_STATUS;
@@ -345,15 +372,15 @@ CSRESULT
 
         strcpy(status->szStatus, This->lse.szValue);
 
-        CSJSON_LookupKey(This->pJsonIn,
-                           "/handshake", "reason",
-                           &(This->lse));
+        CSJSON_LookupPathKey(This->pJsonIn,
+                             This->pHandshakePath, "reason",
+                             &(This->lse));
 
         strcpy(status->szReason, This->lse.szValue);
 
-        CSJSON_LookupKey(This->pJsonIn,
-                           "/handshake", "sid",
-                           &(This->lse));
+        CSJSON_LookupPathKey(This->pJsonIn,
+                             This->pHandshakePath, "sid",
+                             &(This->lse));
 
         strcpy(status->szSessionID, This->lse.szValue);
         strcpy(This->szSessionID, This->lse.szValue);
@@ -425,6 +452,8 @@ CSRESULT
 
   uint64_t Size;
 
+  int64_t ctlValue;
+
   if (CS_FAIL(CSWSCK_ReceiveAll(This->pSession, 
                                 &Size, 
                                 toSlices))) {
@@ -447,7 +476,7 @@ CSRESULT
     return CS_FAILURE;
   }
 
-  if (CS_FAIL(CSJSON_LookupKey(This->pJsonIn, "/ctl", "usrCtlSize", &(This->lse)))) {
+  if (CS_FAIL(CSJSON_LookupPathInt64(This->pJsonIn, This->pCtlPath, "usrCtlSize", &ctlValue))) {
 
     pCtlFrame->UsrCtlSize = 0;
     pCtlFrame->DataSize = 0;
@@ -457,9 +486,9 @@ CSRESULT
     return CS_FAILURE;
   }
 
-  pCtlFrame->UsrCtlSize = strtol(This->lse.szValue, 0, 10);
+  pCtlFrame->UsrCtlSize = ctlValue;
 
-  if (CS_FAIL(CSJSON_LookupKey(This->pJsonIn, "/ctl", "dataSize", &(This->lse)))) {
+  if (CS_FAIL(CSJSON_LookupPathInt64(This->pJsonIn, This->pCtlPath, "dataSize", &ctlValue))) {
 
     pCtlFrame->UsrCtlSize = 0;
     pCtlFrame->DataSize = 0;
@@ -469,9 +498,9 @@ CSRESULT
     return CS_FAILURE;
   }
 
-  pCtlFrame->DataSize = strtol(This->lse.szValue, 0, 10);
+  pCtlFrame->DataSize = ctlValue;
 
-  if (CS_FAIL(CSJSON_LookupKey(This->pJsonIn, "/ctl", "fmt", &(This->lse)))) {
+  if (CS_FAIL(CSJSON_LookupPathKey(This->pJsonIn, This->pCtlPath, "fmt", &(This->lse)))) {
 
     pCtlFrame->UsrCtlSize = 0;
     pCtlFrame->DataSize = 0;
@@ -565,8 +594,6 @@ CSRESULT
      char* szUsrCtlFrame,
      long iUsrCtlSize) {
 
-  char szSize[11];
-
   char* lpszFrame;
 
   long i;
@@ -575,6 +602,10 @@ CSRESULT
   long OutSize;
   long DataSize;
 
+  char operations[3];
+
+  struct iovec frames[3];
+
   // This resets the internal buffer, in case we call Send after this call
 
   if (This->outDataSlabSize < This->outDataSize) {
@@ -600,44 +631,28 @@ CSRESULT
   // Send control frame
   /////////////////////////////////////////////////////////////
 
-  CSJSON_Init(This->pJsonOut, JSON_TYPE_OBJECT);
-  CSJSON_MkDir(This->pJsonOut, "/", "ctl", JSON_TYPE_OBJECT);
-  sprintf(szSize, "%ld", This->outDataSize);
-  CSJSON_InsertNumeric(This->pJsonOut, "/ctl", "dataSize", szSize);
-  sprintf(szSize, "%ld", iUsrCtlSize);
-  CSJSON_InsertNumeric(This->pJsonOut, "/ctl", "usrCtlSize", szSize);
-  CSJSON_InsertString(This->pJsonOut, "/ctl", "fmt", "text");
-
-  OutSize = CSJSON_Serialize(This->pJsonOut, "/", &lpszFrame, 0);
-
-  CSWSCK_Send(This->pSession,
-              CSWSCK_OP_TEXT,
-              lpszFrame,
-              (uint64_t)OutSize,
-              CSWSCK_FIN_ON);
+  OutSize = CSAP_PRIVATE_CtlFrame(This, This->outDataSize,
+                                  iUsrCtlSize, "text", &lpszFrame);
 
   /////////////////////////////////////////////////////////////
-  // Send user control frame if any
+  // The user control frame (if any) and the data follow the
+  // control frame; all frames are sent in a single write.
   /////////////////////////////////////////////////////////////
 
-  if (szUsrCtlFrame != NULL && iUsrCtlSize > 0) {
+  operations[0] = CSWSCK_OP_TEXT;
+  frames[0].iov_base = lpszFrame;
+  frames[0].iov_len = (size_t)OutSize;
 
-    CSWSCK_Send(This->pSession,
-                CSWSCK_OP_TEXT,
-                szUsrCtlFrame,
-                (uint64_t)iUsrCtlSize,
-                CSWSCK_FIN_ON);
-  }
+  operations[1] = CSWSCK_OP_TEXT;
+  frames[1].iov_base = szUsrCtlFrame;
+  frames[1].iov_len = szUsrCtlFrame != NULL && iUsrCtlSize > 0 ? 
+                        (size_t)iUsrCtlSize : 0;
 
-  /////////////////////////////////////////////////////////////
-  // Send data
-  /////////////////////////////////////////////////////////////
+  operations[2] = CSWSCK_OP_TEXT;
+  frames[2].iov_base = This->pOutDataSlab;
+  frames[2].iov_len = (size_t)This->outDataSize;
 
-  CSWSCK_Send(This->pSession,
-              CSWSCK_OP_TEXT,
-              This->pOutDataSlab,
-              (uint64_t)This->outDataSize,
-              CSWSCK_FIN_ON);
+  CSWSCK_SendFrames(This->pSession, operations, frames, 3);
   
   CSLIST_Clear(This->OutDataParts);
 
@@ -653,8 +668,6 @@ CSRESULT
      long iUsrCtlSize,
      char fmt) {
 
-  char szSize[11];
-
   char* lpszFrame;
 
   long i;
@@ -663,6 +676,10 @@ CSRESULT
   long OutSize;
   long DataSize;
 
+  char operations[3];
+
+  struct iovec frames[3];
+
   // This resets the internal buffer, in case we call Send after this call
 
   if (This->outDataSlabSize < This->outDataSize) {
@@ -688,51 +705,35 @@ CSRESULT
   // Send control frame
   /////////////////////////////////////////////////////////////
 
-  CSJSON_Init(This->pJsonOut, JSON_TYPE_OBJECT);
-  CSJSON_MkDir(This->pJsonOut, "/", "ctl", JSON_TYPE_OBJECT);
-  sprintf(szSize, "%ld", This->outDataSize);
-  CSJSON_InsertNumeric(This->pJsonOut, "/ctl", "dataSize", szSize);
-  sprintf(szSize, "%ld", iUsrCtlSize);
-  CSJSON_InsertNumeric(This->pJsonOut, "/ctl", "usrCtlSize", szSize);
-
   if (fmt == CSAP_FMT_BINARY) {
-    CSJSON_InsertString(This->pJsonOut, "/ctl", "fmt", "binary");
+    OutSize = CSAP_PRIVATE_CtlFrame(This, This->outDataSize,
+                                    iUsrCtlSize, "binary", &lpszFrame);
   }
   else {
-    CSJSON_InsertString(This->pJsonOut, "/ctl", "fmt", "text");
+    OutSize = CSAP_PRIVATE_CtlFrame(This, This->outDataSize,
+                                    iUsrCtlSize, "text", &lpszFrame);
     fmt = CSWSCK_OP_TEXT; // this insures proper format
   }
 
-  OutSize = CSJSON_Serialize(This->pJsonOut, "/", &lpszFrame, 0);
-
-  CSWSCK_Send(This->pSession,
-              CSWSCK_OP_TEXT,
-              lpszFrame,
-              (uint64_t)OutSize,
-              CSWSCK_FIN_ON);
-
   /////////////////////////////////////////////////////////////
-  // Send user control frame if any
+  // The user control frame (if any) and the data follow the
+  // control frame; all frames are sent in a single write.
   /////////////////////////////////////////////////////////////
 
-  if (szUsrCtlFrame != NULL && iUsrCtlSize > 0) {
+  operations[0] = CSWSCK_OP_TEXT;
+  frames[0].iov_base = lpszFrame;
+  frames[0].iov_len = (size_t)OutSize;
 
-    CSWSCK_Send(This->pSession,
-                CSWSCK_OP_TEXT,
-                szUsrCtlFrame,
-                (uint64_t)iUsrCtlSize,
-                CSWSCK_FIN_ON);
-  }
+  operations[1] = CSWSCK_OP_TEXT;
+  frames[1].iov_base = szUsrCtlFrame;
+  frames[1].iov_len = szUsrCtlFrame != NULL && iUsrCtlSize > 0 ? 
+                        (size_t)iUsrCtlSize : 0;
 
-  /////////////////////////////////////////////////////////////
-  // Send data
-  /////////////////////////////////////////////////////////////
+  operations[2] = fmt;
+  frames[2].iov_base = This->pOutDataSlab;
+  frames[2].iov_len = (size_t)This->outDataSize;
 
-  CSWSCK_Send(This->pSession,
-              fmt,
-              This->pOutDataSlab,
-              (uint64_t)This->outDataSize,
-              CSWSCK_FIN_ON);
+  CSWSCK_SendFrames(This->pSession, operations, frames, 3);
   
   CSLIST_Clear(This->OutDataParts);
 
@@ -747,11 +748,13 @@ CSRESULT
      char* pData,
      long Size) {
 
-  char szDataSize[11];
-
   char* lpszFrame;
 
   long OutSize;
+
+  char operations[2];
+
+  struct iovec frames[2];
    
   if (pData == NULL) {
     return CS_FAILURE;
@@ -765,30 +768,21 @@ CSRESULT
   // Send control frame
   /////////////////////////////////////////////////////////////
 
-  CSJSON_Init(This->pJsonOut, JSON_TYPE_OBJECT);
-  CSJSON_MkDir(This->pJsonOut, "/", "ctl", JSON_TYPE_OBJECT);
-  sprintf(szDataSize, "%ld", Size);
-  CSJSON_InsertNumeric(This->pJsonOut, "/ctl", "dataSize", szDataSize);
-  CSJSON_InsertNumeric(This->pJsonOut, "/ctl", "usrCtlSize", "0");
-  CSJSON_InsertString(This->pJsonOut, "/ctl", "fmt", "text");
-
-  OutSize = CSJSON_Serialize(This->pJsonOut, "/", &lpszFrame, 0);
-
-  CSWSCK_Send(This->pSession,
-              CSWSCK_OP_TEXT,
-              lpszFrame,
-              (uint64_t)OutSize,
-              CSWSCK_FIN_ON);
+  OutSize = CSAP_PRIVATE_CtlFrame(This, Size, 0, "text", &lpszFrame);
 
   /////////////////////////////////////////////////////////////
-  // Send data
+  // The data follows the control frame in the same write
   /////////////////////////////////////////////////////////////
 
-  CSWSCK_Send(This->pSession,
-              CSWSCK_OP_TEXT,
-              pData,
-              (uint64_t)Size,
-              CSWSCK_FIN_ON);
+  operations[0] = CSWSCK_OP_TEXT;
+  frames[0].iov_base = lpszFrame;
+  frames[0].iov_len = (size_t)OutSize;
+
+  operations[1] = CSWSCK_OP_TEXT;
+  frames[1].iov_base = pData;
+  frames[1].iov_len = (size_t)Size;
+
+  CSWSCK_SendFrames(This->pSession, operations, frames, 2);
 
   return CS_SUCCESS;
 }
@@ -800,11 +794,13 @@ CSRESULT
      long Size,
      char fmt) {
 
-  char szDataSize[11];
-
   char* lpszFrame;
 
   long OutSize;
+
+  char operations[2];
+
+  struct iovec frames[2];
    
   if (pData == NULL) {
     return CS_FAILURE;
@@ -818,38 +814,63 @@ CSRESULT
   // Send control frame
   /////////////////////////////////////////////////////////////
 
-  CSJSON_Init(This->pJsonOut, JSON_TYPE_OBJECT);
-  CSJSON_MkDir(This->pJsonOut, "/", "ctl", JSON_TYPE_OBJECT);
-  sprintf(szDataSize, "%ld", Size);
-  CSJSON_InsertNumeric(This->pJsonOut, "/ctl", "dataSize", szDataSize);
-  CSJSON_InsertNumeric(This->pJsonOut, "/ctl", "usrCtlSize", "0");
-
   if (fmt == CSAP_FMT_BINARY) {
-    CSJSON_InsertString(This->pJsonOut, "/ctl", "fmt", "binary");
+    OutSize = CSAP_PRIVATE_CtlFrame(This, Size, 0, "binary", &lpszFrame);
   }
   else {
     fmt = CSWSCK_OP_TEXT; // this insures proper format
-    CSJSON_InsertString(This->pJsonOut, "/ctl", "fmt", "text");
+    OutSize = CSAP_PRIVATE_CtlFrame(This, Size, 0, "text", &lpszFrame);
   }
 
-  OutSize = CSJSON_Serialize(This->pJsonOut, "/", &lpszFrame, 0);
-
-  CSWSCK_Send(This->pSession,
-              CSWSCK_OP_TEXT,
-              lpszFrame,
-              (uint64_t)OutSize,
-              CSWSCK_FIN_ON);
-
   /////////////////////////////////////////////////////////////
-  // Send data
+  // The data follows the control frame in the same write
   /////////////////////////////////////////////////////////////
 
-  CSWSCK_Send(This->pSession,
-              fmt,
-              pData,
-              (uint64_t)Size,
-              CSWSCK_FIN_ON);
+  operations[0] = CSWSCK_OP_TEXT;
+  frames[0].iov_base = lpszFrame;
+  frames[0].iov_len = (size_t)OutSize;
+
+  operations[1] = fmt;
+  frames[1].iov_base = pData;
+  frames[1].iov_len = (size_t)Size;
+
+  CSWSCK_SendFrames(This->pSession, operations, frames, 2);
 
   return CS_SUCCESS;
 }
 
+//////////////////////////////////////////////////////////////////////////////
+//
+// CSAP_PRIVATE_CtlFrame
+//
+// Writes the control frame that precedes user data:
+//
+//   {"ctl":{"dataSize":n,"fmt":"text|binary","usrCtlSize":n}}
+//
+// and returns its size; the frame is in the writer buffer until the
+// next message.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+long
+  CSAP_PRIVATE_CtlFrame
+    (CSAP* This,
+     long dataSize,
+     long usrCtlSize,
+     char* szFmt,
+     char** lpszFrame) {
+
+  CSJSONWRITER_Reset(This->pJsonOut);
+
+  CSJSONWRITER_BeginObject(This->pJsonOut, NULL);
+  CSJSONWRITER_BeginObject(This->pJsonOut, "ctl");
+
+  CSJSONWRITER_Int64(This->pJsonOut, "dataSize", dataSize);
+  CSJSONWRITER_String(This->pJsonOut, "fmt", szFmt);
+  CSJSONWRITER_Int64(This->pJsonOut, "usrCtlSize", usrCtlSize);
+
+  CSJSONWRITER_EndObject(This->pJsonOut);
+  CSJSONWRITER_EndObject(This->pJsonOut);
+
+  return CSJSONWRITER_Serialize(This->pJsonOut, lpszFrame);
+}
@@ -147,12 +147,14 @@ CSRESULT
   CSJSON pJsonIn;
   CSJSON pJsonOut;
   CSMAP pFrameworkMethods;
-
   CSAPCTL CtlFrame;
 
-  pJsonIn = CSJSON_Constructor();
-  pJsonOut = CSJSON_Constructor();
-  pFrameworkMethods = CSMAP_Constructor();
+  // The documents of each request reuse the memory
+  // of the previous request
+
+  pJsonIn = CSJSON_PoolConstructor();
+  pJsonOut = CSJSON_PoolConstructor();
+  pFrameworkMethods = CSMAP_HashConstructor();
 
   openlog(basename("SDLC-RunService"), LOG_PID, LOG_LOCAL3);
 
@@ -408,8 +410,8 @@ CSRESULT
     return CS_FAILURE;
   }
 
-  pServiceMethods = CSMAP_Constructor();
-  pServiceTransactions = CSMAP_Constructor();
+  pServiceMethods = CSMAP_HashConstructor();
+  pServiceTransactions = CSMAP_HashConstructor();
 
   if (CS_FAIL(CSAPAPP_LoadService(lse.szValue, pServiceMethods, 
                                                pServiceTransactions))) {
@@ -148,7 +148,13 @@ int main(int argc, char** argv)
   sigaction(SIGTERM, &sa, NULL);
   sigaction(SIGCHLD, &sa, NULL);
 
-  inprocServerMap = CSMAP_Constructor();
+  // The main daemon sends SIGHUP to have us reload the configurations
+
+  sa.sa_handler = signalCatcher;
+  sa.sa_flags = SA_RESTART;
+  sigaction(SIGHUP, &sa, NULL);
+
+  inprocServerMap = CSMAP_HashConstructor();
 
   // Get broker repository configuration (making sure no more than 
   // CFSRPS_PATH_MAXBUFF chars are copied from the outside)
@@ -245,7 +251,7 @@ int main(int argc, char** argv)
 
       iServiceMode = CSAP_SERVICEMODE_ENUMERATION_LOAD;
 
-      if (CFSCFG_IterStart(pRepo, "SERVICES") == CS_SUCCESS) {
+      if (CFSCFG_IterStart(pConfig, "SERVICES") == CS_SUCCESS) {
 
         // Fetch the service handlers from
         // the SERVICES enumeration and store them in
@@ -280,6 +286,31 @@ int main(int argc, char** argv)
 
   stream_fd = atoi(argv[1]);
 
+  /////////////////////////////////////////////////////////////////////
+  // In zygote mode ('Z'), this process is a template from which the
+  // main daemon obtains new handlers (see CFS_RunZygote); we go on
+  // only in a new handler.
+  /////////////////////////////////////////////////////////////////////
+
+  /////////////////////////////////////////////////////////////////////
+  // Acceptor mode ('A', LISTEN_MODE *REUSEPORT) is not implemented by
+  // this handler; the main daemon refuses to start it in that mode.
+  /////////////////////////////////////////////////////////////////////
+
+  if (argv[2][0] == 'A') {
+    CFS_CloseEnv(&pEnv);
+    close(stream_fd);
+    goto CSAPBRKR_END;
+  }
+
+  if (argv[2][0] == 'Z') {
+
+    if ((stream_fd = CFS_RunZygote(stream_fd)) < 0) {
+      CFS_CloseEnv(&pEnv);
+      goto CSAPBRKR_END;
+    }
+  }
+
   for (;;) {
 
     /////////////////////////////////////////////////////////////////////
@@ -318,6 +349,12 @@ int main(int argc, char** argv)
 
       CSAP_CloseChannel(pCSAP);
     }
+    else {
+
+      if (CS_DIAG(hResult) == CFS_DIAG_CONNCLOSE) {
+        break; // the main daemon no longer uses this handler
+      }
+    }
   }
 
   close(stream_fd);
@@ -1024,6 +1061,11 @@ void signalCatcher(int signal)
 
   switch (signal)
   {
+    case SIGHUP:
+
+      CFSRPS_Reload();
+      break;
+
     case SIGTERM:
 
       if (pSession != NULL) {
@@ -784,7 +784,7 @@ CSHTTP*
 
   Instance->dataSlab[0] = 0;
 
-  Instance->DataFragments = CSLIST_Constructor();
+  Instance->DataFragments = CSLIST_VectorConstructor(0);
 
   return Instance;
 }
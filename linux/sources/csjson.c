@@ -28,26 +28,29 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 
 #include <clarasoft/cslib.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define JSON_SIMD_X86
+#endif
+
 #define JSON_SERIALIZE_SLAB  65536
 
-#define JSON_UNICODE_NOCONVERT   0
-#define JSON_UNICODE_CONVERT     1
-
-#define JSON_TOK_BOOL_FALSE      0
-#define JSON_TOK_BOOL_TRUE       1
-#define JSON_TOK_NULL            3
-#define JSON_TOK_LBRACE         10
-#define JSON_TOK_RBRACE         11
-#define JSON_TOK_LBRACKET       20
-#define JSON_TOK_RBRACKET       21
-#define JSON_TOK_COLON          30
-#define JSON_TOK_COMMA          31
-#define JSON_TOK_NUMERIC        51
-#define JSON_TOK_STRING         52
+#define JSON_PATH_BUFFER       256
+#define JSON_SCAN_PADDING       32
+
+// Numbers inserted as int64 or double are serialized in at most
+// JSON_NUMBER_SIZE characters.
+
+#define JSON_NUMBER_SIZE        32
+
+#define JSON_NUMBER_TEXT         0
+#define JSON_NUMBER_INT64        1
+#define JSON_NUMBER_DOUBLE       2
 
 #define JSON_TYPE_BOOL_FALSE     0
 #define JSON_TYPE_BOOL_TRUE      1
@@ -60,11 +63,45 @@
 
 #define JSON_PATH_SEP       '\x1B'
 
+#define JSON_EVENT_OBJECT       10
+#define JSON_EVENT_OBJECT_END   11
+#define JSON_EVENT_ARRAY        20
+#define JSON_EVENT_ARRAY_END    21
+
+#define JSON_OPER_READ          (0x00010000)
+
+#define JSON_DIAG_MOREDATA      (0x00000001)
+#define JSON_DIAG_ENDOFDATA     (0x00000002)
+#define JSON_DIAG_SYNTAX        (0x00000003)
+
+#define JSON_READ_ROOT           0
+#define JSON_READ_FIRSTMEMBER    1
+#define JSON_READ_MEMBER         2
+#define JSON_READ_FIRSTITEM      3
+#define JSON_READ_ITEM           4
+#define JSON_READ_NEXT           5
+#define JSON_READ_DONE           6
+
+#define JSON_IS_WS(c) \
+  ((c) == ' ' || (c) == '\t' || (c) == '\r' || (c) == '\n')
+
+// Single spaces are skipped inline; longer runs (indentation) are
+// skipped by the white space scanner.
+
+#define JSON_SKIP_WS(p) \
+  do { \
+    if (JSON_IS_WS(*(p))) { \
+      if (JSON_IS_WS((p)[1])) { \
+        (p) = g_CSJSON_SkipSpace((p) + 2); \
+      } \
+      else { \
+        (p)++; \
+      } \
+    } \
+  } while (0)
+
 typedef struct tagCSJSON
 {
-  CSLIST Tokens;
-  CSLIST unicodeTokens;
-
   void*  pIterListing;
 
   CSMAP Object;
@@ -75,16 +112,19 @@ typedef struct tagCSJSON
   long iterType;
 
   char* szSlab;
-  
-} CSJSON;
 
-typedef struct tagCSJSON_TOKENINFO
-{
-  int  type;
-  long size;
-  char *szToken;
+  char* szDocument;    // parsed copy of the input string
+  long  documentSize;
+
+  char* szPath;        // path of the object or array being parsed
+  long  pathSize;
+
+  CSARENA pArena;  // 0 if the instance is allocated on the heap
+  CSARENA pPool;   // arena owned by a pooled instance, 0 otherwise
 
-} CSJSON_TOKENINFO;
+  long generation; // changes whenever directories may have moved
+  
+} CSJSON;
 
 typedef struct tagCSJSON_DIRENTRY
 {
@@ -94,885 +134,713 @@ typedef struct tagCSJSON_DIRENTRY
 
 } CSJSON_DIRENTRY;
 
+// Listing entries start with the public CSJSON_LSENTRY members (CSJSON_Ls
+// hands them out as such). A number also keeps its binary value once it
+// is known: numType tells which member of number holds it. The text of
+// a number inserted as int64 or double is only formatted when it is
+// looked up (szValue is 0 until then).
+
 typedef struct tagCSJSON_LSENTRY
 {
   int   type;
+  int   numType;
   char* szKey;
   long  keySize;
   char* szValue;
   long  valueSize;
 
+  union {
+    int64_t intValue;
+    double  doubleValue;
+  } number;
+
 } CSJSON_LSENTRY;
 
-/* ---------------------------------------------------------------------------
- * private methods
- * -------------------------------------------------------------------------*/
+typedef struct tagCSJSONPATH
+{
+  char* szPath;     // internal representation of the path
+  long  pathSize;
+  long  length;
 
-long
-  CSJSON_PRIVATE_Serialize
-    (CSJSON* This,
-     char* szPath,
-     char** szOutStream,
-     long* curPos);
+  CSJSON_DIRENTRY* pdire;  // directory the path last resolved to
+  long generation;         // generation of the instance it resolved in
 
-CSRESULT
-  CSJSON_PRIVATE_O
-    (CSJSON* This,
-     long*  index,
-     char*  szPath,
-     long   len);
+} CSJSONPATH;
 
-CSRESULT
-  CSJSON_PRIVATE_A
-    (CSJSON* This,
-     long*  index,
-     char*  szPath,
-     long   len);
+typedef CSRESULT (*CSJSONWRITER_OUTPUTPROC)(void*, char*, long);
 
-CSRESULT
-  CSJSON_PRIVATE_VV
-    (CSJSON* This,
-     long*  index,
-     char*  szPath,
-     long len,
-     CSLIST  listing);
+typedef struct tagCSJSONWRITER
+{
+  char* szBuffer;
+  long  bufferSize;
+  long  curPos;
 
-CSRESULT
-  CSJSON_PRIVATE_IsNumeric
-    (char* szNumber);
+  char* pStack;     // type of each open object or array
+  long  stackSize;
+  long  depth;
 
-/* ---------------------------------------------------------------------------
- * implementation
- * ------------------------------------------------------------------------ */
+  int   bComma;     // a comma precedes the next value
+  int   bDone;      // the outermost object or array is closed
 
-CSJSON*
-  CSJSON_Constructor
-    (void) {
+  CSRESULT status;  // set when the output function fails
 
-  CSJSON *Instance;
+  CSJSONWRITER_OUTPUTPROC fOutput;
+  void* pOutputData;
 
-  Instance = (CSJSON *)malloc(sizeof(CSJSON));
+} CSJSONWRITER;
 
-  Instance->Tokens = CSLIST_Constructor();
-  Instance->unicodeTokens = CSLIST_Constructor();
-  Instance->Object = CSMAP_Constructor();
+typedef struct tagCSJSON_EVENT
+{
+  int   type;
+  long  depth;
+  char* szKey;
+  long  keySize;
+  char* szValue;
+  long  valueSize;
 
-  Instance->szSlab = (char*)malloc(JSON_SERIALIZE_SLAB * sizeof(char));
+} CSJSON_EVENT;
 
-  Instance->slabSize = JSON_SERIALIZE_SLAB;
-  Instance->nextSlabSize = 0;
-  Instance ->iterIndex = 0;
-  Instance->iterType = JSON_TYPE_UNKNOWN;
+typedef struct tagCSJSONREADER
+{
+  char* pBuffer;
+  long  bufferSize;
+  long  pos;        // first character not yet read
+  long  end;        // end of the input fed so far
 
-  Instance->pIterListing = NULL;
+  char* pStack;     // type of each open object or array
+  long  stackSize;
+  long  depth;
 
-  return Instance;
-}
+  int   state;      // what is expected next (JSON_READ_*)
 
-CSRESULT
-  CSJSON_Destructor
-    (CSJSON **This) {
+  CSRESULT status;  // set on ill-formed input
 
-  char *pszKey;
+} CSJSONREADER;
 
-  long valueSize;
-  long count;
-  long size;
-  long i;
+/* ---------------------------------------------------------------------------
+ * private methods
+ * -------------------------------------------------------------------------*/
 
-  CSJSON_DIRENTRY* pdire;
-  CSJSON_LSENTRY* plse;
+void
+  CSJSON_PRIVATE_Construct
+    (CSJSON* Instance);
 
-  if (This == 0 || *This == NULL) {
-    return CS_FAILURE;
-  }
+void*
+  CSJSON_PRIVATE_BufferMalloc
+    (CSJSON* This,
+     long size);
 
-  // Cleanup the previously built JSON object 
+void
+  CSJSON_PRIVATE_BufferFree
+    (CSJSON* This,
+     void* pData);
 
-  CSMAP_IterStart((*This)->Object, CSMAP_ASCENDING);
+void*
+  CSJSON_PRIVATE_Malloc
+    (CSJSON* This,
+     long size);
 
-  while (CS_SUCCEED(CSMAP_IterNext((*This)->Object, &pszKey,
-                                    (void **)(&pdire), &valueSize)))
-  {
-    if (pdire->Listing != 0)
-    {
-      if (pdire->type == JSON_TYPE_ARRAY) {
+void
+  CSJSON_PRIVATE_Free
+    (CSJSON* This,
+     void* pData);
 
-        count = CSLIST_Count(pdire->Listing);
+void
+  CSJSON_PRIVATE_Clear
+    (CSJSON* This);
 
-        for (i=0; i<count; i++) {
-          CSLIST_GetDataRef(pdire->Listing, (void**)(&plse), i);
-          free(plse->szKey);
-          free(plse->szValue);
-        }
+long
+  CSJSON_PRIVATE_Serialize
+    (CSJSON* This,
+     long pathLen,
+     char** szOutStream,
+     long* curPos);
 
-        CSLIST_Destructor(&(pdire->Listing));
-      }
-      else {
+CSRESULT
+  CSJSON_PRIVATE_ParseObject
+    (CSJSON* This,
+     char**  ppCur,
+     long    len);
 
-        CSMAP_IterStart(pdire->Listing, CSMAP_ASCENDING);
+CSRESULT
+  CSJSON_PRIVATE_ParseArray
+    (CSJSON* This,
+     char**  ppCur,
+     long    len);
 
-        while(CS_SUCCEED(CSMAP_IterNext(pdire->Listing, &pszKey,
-                                        (void**)(&plse), &size))) {
-          free(plse->szKey);
-          free(plse->szValue);
-        }
+CSRESULT
+  CSJSON_PRIVATE_ParseValue
+    (CSJSON* This,
+     char**  ppCur,
+     long    len,
+     CSJSON_LSENTRY* plse);
 
-        CSMAP_Destructor(&(pdire->Listing));
-      }
-    }
-  }
+CSRESULT
+  CSJSON_PRIVATE_ParseString
+    (char** ppCur,
+     char** pszString,
+     long*  pSize);
 
-  CSMAP_Destructor(&((*This)->Object));
+CSRESULT
+  CSJSON_PRIVATE_ParseNumber
+    (char** ppCur,
+     char** pszNumber,
+     long*  pSize);
 
-  CSLIST_Destructor(&((*This)->Tokens));
-  CSLIST_Clear((*This)->unicodeTokens);
-  CSLIST_Destructor(&((*This)->unicodeTokens));
+void
+  CSJSON_PRIVATE_ReservePath
+    (CSJSON* This,
+     long size);
 
-  // Cleanup other allocations
+char*
+  CSJSON_PRIVATE_InternalPath
+    (CSJSON* This,
+     char* szPath);
 
-  if ((*This)->szSlab) {
-    free((*This)->szSlab);
-  }
+long
+  CSJSON_PRIVATE_SubPath
+    (CSJSON* This,
+     long len,
+     char* szKey,
+     long keySize);
 
-  free(*This);
+long
+  CSJSON_PRIVATE_NextGeneration
+    (void);
 
-  *This = 0;
+CSJSON_DIRENTRY*
+  CSJSON_PRIVATE_ResolvePath
+    (CSJSON* This,
+     CSJSONPATH* pPath);
 
-  return CS_SUCCESS;
-}
+void
+  CSJSON_PRIVATE_GetEntry
+    (CSJSON* This,
+     CSJSON_LSENTRY* plse,
+     CSJSON_LSENTRY* lplse);
 
-///////////////////////////////////////////////////////////////////////////////
-///////////////////////////////////////////////////////////////////////////////
-///////////////////////////////////////////////////////////////////////////////
-// 
-// CSJSON_PRIVATE_Tokenize
-//
-// Breaks down a string into individual tokens. Some validations are done
-// at this point such as unicode point conversion to UTF-8 checking for valid
-// numeric values, proper control character escape sequences, etc.
-//
-///////////////////////////////////////////////////////////////////////////////
-///////////////////////////////////////////////////////////////////////////////
-///////////////////////////////////////////////////////////////////////////////
+CSJSON_LSENTRY*
+  CSJSON_PRIVATE_KeyEntry
+    (CSJSON_DIRENTRY* pdire,
+     char* szKey);
 
 CSRESULT
-  CSJSON_PRIVATE_Tokenize
-    (CSJSON *This,
-     char *szJsonString) {
+  CSJSON_PRIVATE_InsertNumber
+    (CSJSON* This,
+     char* szPath,
+     char* szKey,
+     CSJSON_LSENTRY* pNumber);
 
-  int Stop;
-  int haveDot;
-  int haveExp;
+void
+  CSJSON_PRIVATE_NumberText
+    (CSJSON* This,
+     CSJSON_LSENTRY* plse);
 
-  long n;
-  long k;
-  long t;
-  long tok_i;
-  long tok_j;
-  long cpyStart;
-  long cpyLen;
-  long curTokenIndex;
-  long tempIndex;
-  long startToken;
-  long unicodeTokenCount;
-  long unicodePoint;
-  long tokenOffset;
-
-  char szBoolBuffer[6];
-
-  char* pCurByte;
-
-  CSJSON_TOKENINFO ti;
-
-  struct UNICODETOKEN {
-    long cpyIndex;
-    char token[5];
-  } unicodeToken;
-
-  n = 0;
-  tokenOffset = 0;
-  pCurByte = szJsonString;
-
-  while (pCurByte[n] != 0) 
-  {
-    switch (szJsonString[n])
-    {
+CSRESULT
+  CSJSON_PRIVATE_GetInt64
+    (CSJSON_LSENTRY* plse,
+     int64_t* pValue);
 
-    case ',':
+CSRESULT
+  CSJSON_PRIVATE_GetDouble
+    (CSJSON_LSENTRY* plse,
+     double* pValue);
 
-      ti.szToken = 0;
-      ti.type = JSON_TOK_COMMA;
+CSRESULT
+  CSJSON_PRIVATE_ParseInt64
+    (char* szNumber,
+     int64_t* pValue);
 
-      CSLIST_Insert(This->Tokens, &ti,
-                    sizeof(CSJSON_TOKENINFO), CSLIST_BOTTOM);
-      tokenOffset++;
+long
+  CSJSON_PRIVATE_FormatNumber
+    (char* szOut,
+     CSJSON_LSENTRY* plse);
 
-      break;
+long
+  CSJSON_PRIVATE_FormatInt64
+    (char* szOut,
+     int64_t value);
 
-    case '{':
+long
+  CSJSON_PRIVATE_FormatDouble
+    (char* szOut,
+     double value);
 
-      ti.szToken = 0;
-      ti.type = JSON_TOK_LBRACE;
+void
+  CSJSON_PRIVATE_SelectScanners
+    (void);
 
-      CSLIST_Insert(This->Tokens, &ti,
-                    sizeof(CSJSON_TOKENINFO), CSLIST_BOTTOM);
-      tokenOffset++;
+char*
+  CSJSON_PRIVATE_ScanString
+    (char* p);
 
-      break;
+char*
+  CSJSON_PRIVATE_SkipSpace
+    (char* p);
 
-    case '}':
+#ifdef JSON_SIMD_X86
 
-      ti.szToken = 0;
-      ti.type = JSON_TOK_RBRACE;
+char*
+  CSJSON_PRIVATE_ScanStringSSE2
+    (char* p);
 
-      CSLIST_Insert(This->Tokens, &ti,
-                    sizeof(CSJSON_TOKENINFO), CSLIST_BOTTOM);
-      tokenOffset++;
+char*
+  CSJSON_PRIVATE_ScanStringAVX2
+    (char* p);
 
-      break;
+char*
+  CSJSON_PRIVATE_SkipSpaceSSE2
+    (char* p);
 
-    case '[':
+char*
+  CSJSON_PRIVATE_SkipSpaceAVX2
+    (char* p);
 
-      ti.szToken = 0;
-      ti.type = JSON_TOK_LBRACKET;
+#endif
 
-      CSLIST_Insert(This->Tokens, &ti,
-                    sizeof(CSJSON_TOKENINFO), CSLIST_BOTTOM);
-      tokenOffset++;
+/* ---------------------------------------------------------------------------
+ * Scanners selected for the processor when the library is loaded
+ * ------------------------------------------------------------------------ */
 
-      break;
+static char* (*g_CSJSON_ScanString)(char*) = CSJSON_PRIVATE_ScanString;
+static char* (*g_CSJSON_SkipSpace)(char*) = CSJSON_PRIVATE_SkipSpace;
 
-    case ']':
+// Instance generations are unique across instances so that a compiled
+// path never mistakes a new instance (possibly at the same address on a
+// reset arena) for the one it was resolved in.
 
-      ti.szToken = 0;
-      ti.type = JSON_TOK_RBRACKET;
+static long g_CSJSON_Generation = 0;
 
-      CSLIST_Insert(This->Tokens, &ti,
-                    sizeof(CSJSON_TOKENINFO), CSLIST_BOTTOM);
-      tokenOffset++;
+// Two-digit pairs for integer formatting
 
-      break;
+static const char g_CSJSON_Digits[] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
 
-    case ':':
+CSRESULT
+  CSJSON_PRIVATE_IsNumeric
+    (char* szNumber);
 
-      ti.szToken = 0;
-      ti.type = JSON_TOK_COLON;
+long
+  CSJSON_PRIVATE_Escape
+    (char* szOut,
+     char* szIn,
+     long  size);
 
-      CSLIST_Insert(This->Tokens, &ti,
-                    sizeof(CSJSON_TOKENINFO), CSLIST_BOTTOM);
-      tokenOffset++;
+CSRESULT
+  CSJSONWRITER_Reset
+    (CSJSONWRITER* This);
 
-      break;
+CSRESULT
+  CSJSONWRITER_PRIVATE_Begin
+    (CSJSONWRITER* This,
+     char* szKey,
+     int type);
 
-    case '"':
+CSRESULT
+  CSJSONWRITER_PRIVATE_End
+    (CSJSONWRITER* This,
+     int type);
 
-      Stop = 0;
-      tempIndex = 0;
-      n++;
-      startToken = n;
+CSRESULT
+  CSJSONWRITER_PRIVATE_Key
+    (CSJSONWRITER* This,
+     char* szKey,
+     long size);
 
-      CSLIST_Clear(This->unicodeTokens);
+CSRESULT
+  CSJSONWRITER_PRIVATE_Reserve
+    (CSJSONWRITER* This,
+     long size);
 
-      while (pCurByte[n] != 0 && !Stop)
-      {
-        ////////////////////////////////////////////////////////
-        //    We need to detect escaped characters;
-        ////////////////////////////////////////////////////////
+CSRESULT
+  CSJSONREADER_Reset
+    (CSJSONREADER* This);
 
-        switch (szJsonString[n])
-        {
-          case '\\':
+CSRESULT
+  CSJSONREADER_PRIVATE_Value
+    (CSJSONREADER* This,
+     char* p,
+     CSJSON_EVENT* pEvent);
 
-            tempIndex++;
-            n++; // examine next character
+CSRESULT
+  CSJSONREADER_PRIVATE_End
+    (CSJSONREADER* This,
+     CSJSON_EVENT* pEvent);
 
-            if (szJsonString[n] >= 0 && szJsonString[n] <= 0x1F) {
-              // Legal escape sequence
-              tempIndex++;
-              n++; // examine next character
-            }
-            else {
+char*
+  CSJSONREADER_PRIVATE_StringEnd
+    (char* p,
+     char* pEnd);
 
-              switch(szJsonString[n]) {
+int
+  CSJSONREADER_PRIVATE_IsComplete
+    (char* p,
+     char* pEnd);
 
-              case '/':
-              case '\\':
-              case 't':
-              case 'r':
-              case 'n':
-              case 'b':
-              case 'f':
-              case '"':
+/* ---------------------------------------------------------------------------
+ * implementation
+ * ------------------------------------------------------------------------ */
 
-                  // Legal escape sequence
-                  tempIndex++;
-                  n++; // examine next character
-                  break;
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_ArenaConstructor
+//
+// Creates an instance whose memory is entirely allocated from an arena:
+// tokens, keys, values and listings are then never released one by one
+// and the instance is discarded by resetting the arena (calling the
+// destructor is optional). Memory of a previous document is reclaimed
+// by the arena reset, not by CSJSON_Parse or CSJSON_Init; a typical
+// use is to reset the arena and construct the instances again for each
+// message. If pArena is 0, this is the same as CSJSON_Constructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-                case 'u':
+CSJSON*
+  CSJSON_ArenaConstructor
+    (CSARENA pArena) {
 
-                  // UNICODE escaped code point; next 4 characters must be numeric
+  CSJSON *Instance;
 
-                  tempIndex++;
-                  n++; // examine next character
-                  unicodeToken.cpyIndex = n;
+  if (pArena == 0) {
+    Instance = (CSJSON *)malloc(sizeof(CSJSON));
+  }
+  else {
+    Instance = (CSJSON *)CSARENA_Alloc(pArena, sizeof(CSJSON));
+  }
 
-                  for (k=0; k<4; k++) {
+  Instance->pArena = pArena;
+  Instance->pPool = 0;
 
-                    if (!((szJsonString[n] >= '0' && szJsonString[n] <= '9') ||  
-                          (szJsonString[n] >= 'a' && szJsonString[n] <= 'f') ||
-                          (szJsonString[n] >= 'A' && szJsonString[n] <= 'F'))) {
+  CSJSON_PRIVATE_Construct(Instance);
 
-                      goto CSJSON_PRIVATE_TOKENIZE_ERROR;
-                    }
+  return Instance;
+}
 
-                    unicodeToken.token[k] = szJsonString[n];
-                    tempIndex++;
-                    n++; // examine next character
-                  }
- 
-                  unicodeToken.token[k] = 0;
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_PoolConstructor
+//
+// Creates an instance that keeps its memory from one document to the
+// next. Directories, listings, keys and values are allocated from an
+// arena owned by the instance, and CSJSON_Parse and CSJSON_Init reset
+// that arena instead of releasing the previous document piece by piece.
+// The serialization slab, document and path buffers are kept and only
+// grow. Once the instance has seen a message, parsing or building another
+// one of the same shape allocates nothing (allocations larger than a
+// quarter of an arena block are the exception, see CSARENA_Reset).
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-                  CSLIST_Insert(This->unicodeTokens, 
-                         &unicodeToken, sizeof(unicodeToken), CSLIST_BOTTOM);     
+CSJSON*
+  CSJSON_PoolConstructor
+    (void) {
 
-                  break;
+  CSJSON *Instance;
 
-                default:
-                  goto CSJSON_PRIVATE_TOKENIZE_ERROR;
-              }
-            }
+  Instance = (CSJSON *)malloc(sizeof(CSJSON));
 
-            break;
+  Instance->pPool = CSARENA_Constructor(0);
+  Instance->pArena = Instance->pPool;
 
-          case '"':
+  CSJSON_PRIVATE_Construct(Instance);
 
-            Stop = 1;
-            break;
+  return Instance;
+}
 
-          default:
+CSJSON*
+  CSJSON_Constructor
+    (void) {
 
-            if (szJsonString[n] >= 0 && szJsonString[n] <= 0x1F) {
-                // non-escaped control character
-                goto CSJSON_PRIVATE_TOKENIZE_ERROR;
-            }
-            else {
-              // character is valid
-              tempIndex++;
-              n++; // examine next character
-            }
+  return CSJSON_ArenaConstructor(0);
+}
 
-            break;
-        }
-      }
+CSRESULT
+  CSJSON_Destructor
+    (CSJSON **This) {
 
-      if (szJsonString[n] == '"')
-      {
-        // We copy the buffer as a NULL-terminated string; to transfer binary
-        // data in a JSON string, one should encode the data in BASE-64. In this case,
-        // we might allocate more than needed but this is ok.
+  if (This == 0 || *This == NULL) {
+    return CS_FAILURE;
+  }
 
-        ti.szToken = (char*)malloc(tempIndex * sizeof(char) + 1);
+  // Documents of a pooled instance are released with its arena
 
-        // We convert unicode escape sequences ... if any
+  if ((*This)->pPool != 0) {
+    free((*This)->szSlab);
+    free((*This)->szDocument);
+    free((*This)->szPath);
+    CSARENA_Destructor(&((*This)->pPool));
+    free(*This);
+    *This = 0;
+    return CS_SUCCESS;
+  }
 
-        unicodeTokenCount = CSLIST_Count(This->unicodeTokens);
+  // Everything is released with the arena
 
-        if (unicodeTokenCount > 0) {
+  if ((*This)->pArena != 0) {
+    *This = 0;
+    return CS_SUCCESS;
+  }
 
-          ti.size = 0;
-          cpyStart = startToken;
-          curTokenIndex = 0;
+  // Cleanup the previously built JSON object 
 
-          for (t=0; t<unicodeTokenCount; t++) {
+  CSJSON_PRIVATE_Clear(*This);
 
-            CSLIST_Get(This->unicodeTokens, (void*)&unicodeToken, t);
+  CSMAP_Destructor(&((*This)->Object));
 
-            cpyLen = unicodeToken.cpyIndex - cpyStart - 2;
+  // Cleanup other allocations
 
-            if (cpyLen > 0) {
-              memcpy(&(ti.szToken[curTokenIndex]), &szJsonString[cpyStart], cpyLen);
-              curTokenIndex += cpyLen;
-              ti.size += cpyLen;
-            }
-            
-            cpyStart = unicodeToken.cpyIndex + 4;
+  if ((*This)->szSlab) {
+    free((*This)->szSlab);
+  }
 
-            // Convert code point text to integer
+  free((*This)->szDocument);
+  free((*This)->szPath);
 
-            unicodePoint = strtol(unicodeToken.token, 0, 16);
+  free(*This);
 
-            // convert code point to utf8 and copy to result buffer
+  *This = 0;
 
-            if (unicodePoint >= 0x00000000 && unicodePoint <=0x0000007F) {
-              // 1 byte
-              ti.szToken[curTokenIndex] = (char)(unicodePoint & 0x0000007F);
-              curTokenIndex += 1;
-              ti.size += 1;
-            }
-            else {
-              if (unicodePoint >= 0x00000080 && unicodePoint <= 0x000007FF) {
-                // 2 bytes
-                ti.szToken[curTokenIndex]   = (char)((unicodePoint >> 6 & 0x0000001F) | 0x000000C0);
-                ti.szToken[curTokenIndex+1] = (char)((unicodePoint & 0x0000003F) | 0x00000080);
-                curTokenIndex+=2;
-                ti.size += 2;
-              }
-              else {
-                if (unicodePoint >= 0x00000800 && unicodePoint <=0x0000FFFF) {
-                  // 3 bytes
-                  ti.szToken[curTokenIndex]   = (char)((unicodePoint >> 12 & 0x0000000F) | 0x000000E0);
-                  ti.szToken[curTokenIndex+1] = (char)((unicodePoint >> 6  & 0x0000003F) | 0x00000080);
-                  ti.szToken[curTokenIndex+2] = (char)((unicodePoint & 0x0000003F) | 0x00000080);
-                  curTokenIndex += 3;
-                  ti.size += 3;
-                }
-                else {
-                  if (unicodePoint >= 0x00010000 && unicodePoint <=0x001FFFFF) {
-                    // 4 bytes
-                    ti.szToken[curTokenIndex]   = (char)((unicodePoint >> 18 & 0x00000007) | 0x000000F0);
-                    ti.szToken[curTokenIndex+1] = (char)((unicodePoint >> 12 & 0x0000003F) | 0x00000080);
-                    ti.szToken[curTokenIndex+2] = (char)((unicodePoint >> 6  & 0x0000003F) | 0x00000080);
-                    ti.szToken[curTokenIndex+3] = (char)((unicodePoint & 0x0000003F) | 0x00000080);
-                    curTokenIndex += 4;
-                    ti.size += 4;
-                  }
-                  else {
-                    // invalid code point
-                    free(ti.szToken);
-                    goto CSJSON_PRIVATE_TOKENIZE_ERROR;
-                  }
-                }
-              }
-            }
-          }
-
-          // Copy tail end of the token
-          cpyLen = n - cpyStart;
-          if (cpyLen > 0) {
-            memcpy(&(ti.szToken[curTokenIndex]), &szJsonString[cpyStart], cpyLen);
-            ti.size += cpyLen;
-          }
-
-          ti.size += 1;
-        }
-        else {
-          ti.size = tempIndex + 1;
-          memcpy(ti.szToken, &(szJsonString[startToken]), tempIndex);
-        }
-
-        ti.szToken[ti.size-1] = 0;
-
-        // We must clean up escape characters (\)
-        // note that the token size includes the NULL.
-  
-        for (tok_i=0, tok_j=0; tok_i<ti.size; tok_i++, tok_j++) {
-
-          if (ti.szToken[tok_i] == '\\') {
-
-            // if this is not a unicode escape sequence ...
-
-            if (ti.szToken[tok_i+1] != 'u') {
-          
-              tok_i++;
-              switch(ti.szToken[tok_i]) {
-                case '\\':
-                  ti.szToken[tok_j] = '\\';
-                  break;
-                case '"':
-                  ti.szToken[tok_j] = '"';
-                  break;
-                case '/':
-                  ti.szToken[tok_j] = '/';
-                  break;
-                case 'b':
-                  ti.szToken[tok_j] = '\b';
-                  break;
-                case 'f':
-                  ti.szToken[tok_j] = '\f';
-                  break;
-                case 'n':
-                  ti.szToken[tok_j] = '\n';
-                  break;
-                case 'r':
-                  ti.szToken[tok_j] = '\r';
-                  break;
-                case 't':
-                  ti.szToken[tok_j] = '\t';
-                  break;
-                default:
-                  ti.szToken[tok_j] = ti.szToken[tok_i];
-                  break;
-              }
-            }
-          }
-          else {
-            ti.szToken[tok_j] = ti.szToken[tok_i];
-          }
-        }
+  return CS_SUCCESS;
+}
 
-        ti.size = tok_j;
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_PRIVATE_Construct
+//
+// Initializes an instance once its arena (if any) is set. The
+// serialization slab is allocated by the first CSJSON_Serialize: an
+// instance that only parses never needs it.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-        ti.type = JSON_TOK_STRING;
+void
+  CSJSON_PRIVATE_Construct
+    (CSJSON* Instance) {
 
-        CSLIST_Insert(This->Tokens, &ti,
-                      sizeof(CSJSON_TOKENINFO), CSLIST_BOTTOM);
-        tokenOffset++;
-      }
-      else
-      {
-        goto CSJSON_PRIVATE_TOKENIZE_ERROR;
-      }
+  Instance->Object = CSMAP_ArenaHashConstructor(Instance->pArena);
 
-      break;
+  Instance->szSlab = 0;
+  Instance->slabSize = 0;
 
-    default:
+  Instance->szDocument = 0;
+  Instance->documentSize = 0;
 
-      if ((szJsonString[n] >= '0' && szJsonString[n] <= '9') ||
-          (szJsonString[n] == '-'))
-      {
-        // Token may be numeric
-
-        tempIndex = 1;  // there is at least one digit
-        startToken = n;
-
-        Stop = 0;
-        haveDot = 0;
-        haveExp = 0;
-
-        n++;
-        while (pCurByte[n] != 0 && !Stop)
-        {
-          switch (szJsonString[n])
-          {
-            case '\t':
-            case '\r':
-            case '\n':
-            case ' ':
-            case ',':
-            case ':':
-            case '[':
-            case ']':
-            case '{':
-            case '}':
-
-              n--;
-              Stop = 1;
-              break;
+  Instance->szPath =
+    (char*)CSJSON_PRIVATE_BufferMalloc(Instance,
+                                       JSON_PATH_BUFFER * sizeof(char));
+  Instance->pathSize = JSON_PATH_BUFFER;
+  Instance->nextSlabSize = 0;
+  Instance ->iterIndex = 0;
+  Instance->iterType = JSON_TYPE_UNKNOWN;
 
-            default:
-
-              switch(szJsonString[n]) {
-
-                case '.':
-
-                  // Only one dot and it must precede the exponent character and
-                  // follow a digit
-
-                  if (!haveDot && !haveExp) {
-
-                    if (szJsonString[startToken] == '-') {
-
-                      // There must be at least one digit in between the 
-                      // minus sign and the dot... if dot is at index 1,
-                      // then it's an error.
-
-                      if (tempIndex == 1) {
-                        goto CSJSON_PRIVATE_TOKENIZE_ERROR;
-                      }
-
-                      // check that if first digit is zero, then there are no
-                      // other digits between the zero and the dot
-
-                      if (szJsonString[startToken+1] == '0') {
-                        if (tempIndex == 2) {
-                          // Ok, number starts with
-                          // -0 and next character is dot
-                          tempIndex++;
-                          n++;
-                        }
-                        else {
-                          goto CSJSON_PRIVATE_TOKENIZE_ERROR;
-                        }
-                      }
-                      else {
-                        // Ok, number starts with - and some non-zero digit
-                        tempIndex++;
-                        n++;
-                      }
-                    }
-                    else {
-                      if (szJsonString[startToken] == '0') {
-                        if (tempIndex == 1) {
-                          // Ok, number starts with 0 and
-                          // next character is dot
-                          tempIndex++;
-                          n++;
-                        }
-                        else {
-                          goto CSJSON_PRIVATE_TOKENIZE_ERROR;
-                        }
-
-                      }
-                      else {
-                        // Ok, number starts some non-zero digit
-                        tempIndex++;
-                        n++;
-                      }
-                    }
-
-                    haveDot = 1;
-                  }
-                  else {
-                    goto CSJSON_PRIVATE_TOKENIZE_ERROR;
-                  }
+  Instance->pIterListing = NULL;
 
-                  break;
+  Instance->generation = CSJSON_PRIVATE_NextGeneration();
+}
 
-                case '+':
-                case '-':
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_PRIVATE_BufferMalloc
+//
+// Allocates an instance buffer (serialization slab, document or path).
+// Buffers live where the instance lives: on the arena of an arena
+// instance, on the heap otherwise; a pooled instance resets its arena
+// with each document but keeps its buffers.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-                  // This must immediately follow the exponent character
-                  if (szJsonString[startToken+tempIndex-1] == 'e' ||
-                      szJsonString[startToken+tempIndex-1] == 'E') {
-                    tempIndex++;
-                    n++;
-                  }
-                  else {
-                    goto CSJSON_PRIVATE_TOKENIZE_ERROR;
-                  }
+void*
+  CSJSON_PRIVATE_BufferMalloc
+    (CSJSON* This,
+     long size) {
 
-                  break;
+  if (This->pArena == 0 || This->pPool != 0) {
+    return malloc(size);
+  }
 
-                case 'e':
-                case 'E':
+  return CSARENA_Alloc(This->pArena, size);
+}
 
-                  if (!haveExp) {
+void
+  CSJSON_PRIVATE_BufferFree
+    (CSJSON* This,
+     void* pData) {
 
-                    // This character must be preceded by a digit
+  if (This->pArena == 0 || This->pPool != 0) {
+    free(pData);
+  }
+}
 
-                    if (szJsonString[startToken+tempIndex-1] >= '0' &&
-                        szJsonString[startToken+tempIndex-1] <= '9') {
-                      tempIndex++;
-                      haveExp = 1;
-                      n++;
-                    }
-                    else {
-                      goto CSJSON_PRIVATE_TOKENIZE_ERROR; 
-                    }
-                  }
-                  else {
-                    goto CSJSON_PRIVATE_TOKENIZE_ERROR;
-                  }
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_PRIVATE_Malloc
+//
+// Allocates from the instance arena, if any.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-                  break;
+void*
+  CSJSON_PRIVATE_Malloc
+    (CSJSON* This,
+     long size) {
 
-                default:
+  if (This->pArena == 0) {
+    return malloc(size);
+  }
 
-                  if ((szJsonString[n] >= '0' && szJsonString[n] <= '9'))
-                  {
-                    if (szJsonString[startToken+tempIndex-1] == 'E' ||
-                        szJsonString[startToken+tempIndex-1] == 'e') {
-
-                      // If the previous character is the exponent
-                      // and we have a zero, we can ignore it because
-                      // exponenets don't have leading zeroes
-
-                      if (szJsonString[n] != '0') {
-                        tempIndex++;
-                      }
-                    }
-                    else {
-                      tempIndex++;
-                    }
-                    n++;
-                  }
-                  else {
-                    goto CSJSON_PRIVATE_TOKENIZE_ERROR;
-                  }
+  return CSARENA_Alloc(This->pArena, size);
+}
 
-                  break;
-              }
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_PRIVATE_Free
+//
+// Arena memory is only released with the arena. Keys and values that
+// refer to the parsed document buffer are not released individually.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-              break;
-          }
-        }
+void
+  CSJSON_PRIVATE_Free
+    (CSJSON* This,
+     void* pData) {
 
-        //////////////////////////////////////////////////////////////
-        // Check following cases:
-        // 
-        // 1) last digit is e, E +, - or dot
-        // 2) leading zero not immediately followed by a dot
-        //////////////////////////////////////////////////////////////
-
-        if (szJsonString[startToken + tempIndex-1] == 'e' ||
-            szJsonString[startToken + tempIndex-1] == 'E' ||
-            szJsonString[startToken + tempIndex-1] == '+' ||
-            szJsonString[startToken + tempIndex-1] == '-' ||
-            szJsonString[startToken + tempIndex-1] == '.') {
-          goto CSJSON_PRIVATE_TOKENIZE_ERROR;
-        }
+  if (This->pArena == 0) {
+    if ((char*)pData >= This->szDocument &&
+        (char*)pData < This->szDocument + This->documentSize) {
+      return;
+    }
+    free(pData);
+  }
+}
 
-        if (szJsonString[startToken] == '0') {
-          if (tempIndex > 1) {
-            if (szJsonString[startToken+1] != '.' &&
-                szJsonString[startToken+1] != 'e' &&
-                szJsonString[startToken+1] != 'E') {
-              goto CSJSON_PRIVATE_TOKENIZE_ERROR;
-            }
-          }
-        }
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_PRIVATE_Clear
+//
+// Removes all directories from the object and releases their listings;
+// on an arena, the listings are simply abandoned.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-        if (szJsonString[startToken] == '-') {
-          if (szJsonString[startToken+1] == '0') {
-            if (tempIndex > 2) {
-              if (szJsonString[startToken+2] != '.' &&
-                  szJsonString[startToken+2] != 'e' &&
-                  szJsonString[startToken+2] != 'E') {
-                goto CSJSON_PRIVATE_TOKENIZE_ERROR;
-              }
-            }
-          }
-        }
+void
+  CSJSON_PRIVATE_Clear
+    (CSJSON* This) {
 
-        ti.type = JSON_TOK_NUMERIC;
-        ti.size = tempIndex + 1;
-        ti.szToken = (char*)malloc((ti.size) * sizeof(char));
-        memcpy(ti.szToken, &(szJsonString[startToken]), ti.size-1);
-        ti.szToken[ti.size-1] = 0;
+  char *pszKey;
 
-        CSLIST_Insert(This->Tokens, &ti,
-                        sizeof(CSJSON_TOKENINFO), CSLIST_BOTTOM);
-        tokenOffset++;
-      }
-      else {
+  long valueSize;
+  long count;
+  long size;
+  long i;
 
-        if ((szJsonString[n] == 'f') ||
-            (szJsonString[n] == 't') ||
-            (szJsonString[n] == 'n'))
-        {
+  CSJSON_DIRENTRY* pdire;
+  CSJSON_LSENTRY* plse;
 
-          // Could be null or a boolean token
+  This->generation = CSJSON_PRIVATE_NextGeneration();
 
-          tempIndex = 0;
-          szBoolBuffer[tempIndex] = szJsonString[n];
-          startToken = n;
-          tempIndex++;
+  // The whole document of a pooled instance is in its arena
 
-          Stop = 0;
+  if (This->pPool != 0) {
+    CSARENA_Reset(This->pPool);
+    This->Object = CSMAP_ArenaHashConstructor(This->pPool);
+    This->pIterListing = NULL;
+    return;
+  }
 
-          n++;
-          while (pCurByte[n] != 0 && !Stop && tempIndex < 6) 
-          {
-            switch (szJsonString[n])
-            {
-              case '\t':
-              case '\r':
-              case '\n':
-              case ' ':
-              case ',':
-              case ':':
-              case '[':
-              case ']':
-              case '{':
-              case '}':
-
-                n--;
-                Stop = 1;
-                break;
+  if (This->pArena != 0) {
+    CSMAP_Clear(This->Object);
+    return;
+  }
 
-              default:
+  CSMAP_IterStart(This->Object, CSMAP_ASCENDING);
 
-                szBoolBuffer[tempIndex] = szJsonString[n];
-                tempIndex++;
-                n++;
-                break;
-            }
-          }
+  while (CS_SUCCEED(CSMAP_IterNext(This->Object, &pszKey,
+                                    (void **)(&pdire), &valueSize)))
+  {
+    if (pdire->Listing != 0)
+    {
+      if (pdire->type == JSON_TYPE_ARRAY) {
 
-          szBoolBuffer[tempIndex] = 0;
+        count = CSLIST_Count(pdire->Listing);
 
-          if (!strcmp(szBoolBuffer, "false")) {
+        for (i=0; i<count; i++) {
+          CSLIST_GetDataRef(pdire->Listing, (void**)(&plse), i);
+          CSJSON_PRIVATE_Free(This, plse->szKey);
+          CSJSON_PRIVATE_Free(This, plse->szValue);
+        }
 
-            ti.type = JSON_TOK_BOOL_FALSE;
-            ti.szToken = 0;
-            CSLIST_Insert(This->Tokens, &ti,
-                          sizeof(CSJSON_TOKENINFO), CSLIST_BOTTOM);
-            tokenOffset++;
-          }
-          else if (!strcmp(szBoolBuffer, "true")) {
+        CSLIST_Destructor(&(pdire->Listing));
+      }
+      else {
 
-            ti.type = JSON_TOK_BOOL_TRUE;
-            ti.szToken = 0;
-            CSLIST_Insert(This->Tokens, &ti,
-                          sizeof(CSJSON_TOKENINFO), CSLIST_BOTTOM);
-            tokenOffset++;
-          }
-          else if (!strcmp(szBoolBuffer, "null")) {
+        CSMAP_IterStart(pdire->Listing, CSMAP_ASCENDING);
 
-            ti.type = JSON_TOK_NULL;
-            ti.szToken = 0;
-            CSLIST_Insert(This->Tokens, &ti,
-                          sizeof(CSJSON_TOKENINFO), CSLIST_BOTTOM);
-            tokenOffset++;
-          }
-          else {
-            goto CSJSON_PRIVATE_TOKENIZE_ERROR;
-          }
+        while(CS_SUCCEED(CSMAP_IterNext(pdire->Listing, &pszKey,
+                                        (void**)(&plse), &size))) {
+          CSJSON_PRIVATE_Free(This, plse->szKey);
+          CSJSON_PRIVATE_Free(This, plse->szValue);
         }
-        else {
 
-          // We can accept white spaces between tokens and ignore them,
-          // otherwise, the JSON is invalid.
-
-          if (!((szJsonString[n] == ' ')  ||
-                (szJsonString[n] == '\t') ||
-                (szJsonString[n] == '\r') ||
-                (szJsonString[n] == '\n')))
-          {
-            goto CSJSON_PRIVATE_TOKENIZE_ERROR;
-          }
-        }
+        CSMAP_Destructor(&(pdire->Listing));
       }
-
-      break;
     }
-
-    n++;
-
-  }
-
-  This->nextSlabSize = (n >= JSON_SERIALIZE_SLAB ? (n+1) : JSON_SERIALIZE_SLAB);
-
-  if (This->nextSlabSize > This->slabSize) {
-    This->slabSize = This->nextSlabSize;
-    free(This->szSlab);
-    This->szSlab = (char*)malloc((This->nextSlabSize + 1) * sizeof(char));
   }
 
-  return CS_SUCCESS;
-
-  CSJSON_PRIVATE_TOKENIZE_ERROR:
-
-  This->nextSlabSize = (n >= JSON_SERIALIZE_SLAB ? (n+1) : JSON_SERIALIZE_SLAB);
-
-  if (This->nextSlabSize > This->slabSize) {
-    This->slabSize = This->nextSlabSize;
-    free(This->szSlab);
-    This->szSlab = (char*)malloc((This->nextSlabSize + 1) * sizeof(char));
-  }
-   
-  return CS_FAILURE;
+  CSMAP_Clear(This->Object);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
-// 
+//
 // CSJSON_Parse
 //
-// Validates the input string as a JSON formated string.
+// Validates the input string as a JSON formated string and builds the
+// object from it.
+//
+// The input is parsed in a single pass: the string is copied into a
+// document buffer owned by the instance and keys and values are unescaped
+// and NULL terminated in place within that buffer; listing entries refer
+// to it directly. The buffer is kept from one parse to the next and only
+// grows when a larger document is parsed.
 //
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
@@ -985,18 +853,9 @@ CSRESULT
      int parseMode)
 {
   CSRESULT Rc;
-  CSJSON_DIRENTRY*  pdire;
-  CSJSON_LSENTRY* plse;
-  CSJSON_TOKENINFO* pti;
-
-  char* pszKey;
 
-  char rootPath[2];
+  char* pCur;
 
-  long valueSize;
-  long index;
-  long count;
-  long i;
   long size;
 
   if (pJsonString == 0) {
@@ -1005,916 +864,1092 @@ CSRESULT
 
   // Cleanup the previous object
 
-  CSMAP_IterStart(This->Object, CSMAP_ASCENDING);
-
-  while (CS_SUCCEED(CSMAP_IterNext(This->Object, &pszKey,
-                                    (void **)(&pdire), &valueSize)))
-  {
-    if (pdire->Listing != 0)
-    {
-      if (pdire->type == JSON_TYPE_ARRAY) {
+  CSJSON_PRIVATE_Clear(This);
 
-        count = CSLIST_Count(pdire->Listing);
+  size = strlen(pJsonString) + 1;
 
-        for (i=0; i<count; i++) {
-          CSLIST_GetDataRef(pdire->Listing, (void**)(&plse), i);
-          free(plse->szKey);
-          free(plse->szValue);
-        }
+  if (size + JSON_SCAN_PADDING > This->documentSize) {
+    CSJSON_PRIVATE_BufferFree(This, This->szDocument);
+    This->szDocument =
+      (char*)CSJSON_PRIVATE_BufferMalloc(This,
+                        (size + JSON_SCAN_PADDING) * sizeof(char));
+    This->documentSize = size + JSON_SCAN_PADDING;
+  }
 
-        CSLIST_Destructor(&(pdire->Listing));
-      }
-      else {
+  memcpy(This->szDocument, pJsonString, size);
 
-        CSMAP_IterStart(pdire->Listing, CSMAP_ASCENDING);
+  This->nextSlabSize = 0;
 
-        while(CS_SUCCEED(CSMAP_IterNext(pdire->Listing, &pszKey,
-                                        (void**)(&plse), &size))) {
-          free(plse->szKey);
-          free(plse->szValue);
-        }
+  This->szPath[0] = JSON_PATH_SEP;
+  This->szPath[1] = 0;
 
-        CSMAP_Destructor(&(pdire->Listing));
-      }
-    }
-  }
+  pCur = This->szDocument;
 
-  CSLIST_Clear(This->Tokens);
-  CSMAP_Clear(This->Object);
+  JSON_SKIP_WS(pCur);
 
-  // Let's see if this is a valid JSON string
+  switch(*pCur) {
 
-  if (CS_SUCCEED(CSJSON_PRIVATE_Tokenize(This, pJsonString)))
-  {
-      // Get first token to determine JSON type
-    if (CS_SUCCEED(CSLIST_GetDataRef(This->Tokens, (void**)(&pti), 0))) {
+    case '{':
 
-      index = 1;  // advance token read index
-      
-      switch(pti->type) {
-
-        case JSON_TOK_LBRACE:
-          // This is a JSON object
-          rootPath[0] = JSON_PATH_SEP;
-          rootPath[1] = 0; 
-          if (CS_FAIL(CSJSON_PRIVATE_O(This, &index, rootPath, 1))) {
-            goto CSJSON_PARSE_FAILURE_CLEANUP;
-          }
+      pCur++;
+      Rc = CSJSON_PRIVATE_ParseObject(This, &pCur, 1);
+      break;
 
-          break;
+    case '[':
 
-        case JSON_TOK_LBRACKET:
-          // This is a JSON array
-          rootPath[0] = JSON_PATH_SEP;
-          rootPath[1] = 0; 
-          if (CS_FAIL(Rc = CSJSON_PRIVATE_A(This, &index, rootPath, 1))) {
-            goto CSJSON_PARSE_FAILURE_CLEANUP;
-          }
+      pCur++;
+      Rc = CSJSON_PRIVATE_ParseArray(This, &pCur, 1);
+      break;
 
-          break;
+    default:
 
-        default:
+      Rc = CS_FAILURE;
+      break;
+  }
 
-          // the string is not a valid JSON string
-          goto CSJSON_PARSE_FAILURE_CLEANUP;
-      }
+  if (CS_SUCCEED(Rc)) {
 
-      ////////////////////////////////////////////////////
-      //
-      // Consider this: {}}}}} or []]]]]]
-      //
-      // The CSJSON_PRIVATE_O/A functions will return success
-      // because it will find a matching }/] to the first {/[
-      // and return immediately, not examining what follows.
-      //
-      // We need to check if there are remaining tokens and
-      // if there are some, then the JSON is ill-formed.
-      ////////////////////////////////////////////////////
-
-      if (index == CSLIST_Count(This->Tokens))
-      {
-        return CS_SUCCESS;
-      }
-    }
-  }
+    // Consider this: {}}}}} or []]]]]]; only white space
+    // may follow the root object or array.
 
-  ///////////////////////////////////////////////////////////////
-  // Branching label
-  CSJSON_PARSE_FAILURE_CLEANUP:
+    JSON_SKIP_WS(pCur);
 
-  // Tokenization or parse has failed ... some tokens are invalid 
-  // and we need to cleanup token values; the object might have 
-  // been partially built so we need to clean it as well.
+    if (*pCur == 0) {
 
-  count = CSLIST_Count(This->Tokens);
+      // Serialization slab size: what was computed while parsing
+      // plus some room for further insertions.
 
-  for (i=0; i<count; i++) {
-    CSLIST_GetDataRef(This->Tokens, (void**)(&pti), i);
+      This->nextSlabSize +=
+        (size > JSON_SERIALIZE_SLAB ? size : JSON_SERIALIZE_SLAB);
 
-    free(pti->szToken);
+      return CS_SUCCESS;
+    }
   }
 
-  CSLIST_Clear(This->Tokens);
+  // The object might have been partially built
 
-  /////////////////////////////////////////////////////////////////
-  // We may need to cleanup the object; at this point, listing 
-  // entries all point to token fields because we are parsing a 
-  // string.
-  //
-  // The object may be partially built such that deep cleaning the
-  // Object listing entries will leave tokens unaffected with
-  // token buffers left un-freed. So in this particualr case, we
-  // cleanup the tokens and simply clear the object of its
-  // listing entries.
-  //
-  // In a situation where the string is parsed successfully,
-  // then doing a deep cleaning of the Object is appropriate.
-  /////////////////////////////////////////////////////////////////
+  CSJSON_PRIVATE_Clear(This);
 
-  CSMAP_IterStart(This->Object, CSMAP_ASCENDING);
-
-  while (CS_SUCCEED(CSMAP_IterNext(This->Object, &pszKey,
-                                    (void **)(&pdire), &valueSize)))
-  {
-    if (pdire->Listing != 0)
-    {
-      if (pdire->type == JSON_TYPE_ARRAY) {
-        CSLIST_Destructor(&(pdire->Listing));
-      }
-      else {
-        CSMAP_Destructor(&(pdire->Listing));
-      }
-    }
-  }
-
-  CSMAP_Clear(This->Object);
-
-  return CS_FAILURE;
-}
+  return CS_FAILURE;
+}
 
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
-// 
-// CSJSON_PRIVATE_O
 //
-// Determines if a set of tokens is a well formed JSON object.
+// CSJSON_PRIVATE_ParseObject
+//
+// Parses the members of an object up to and including the closing brace;
+// the opening brace has been consumed by the caller. The object path is
+// the first len characters of the instance path buffer.
 //
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 
 CSRESULT
-  CSJSON_PRIVATE_O
+  CSJSON_PRIVATE_ParseObject
     (CSJSON* This,
-     long* index,
-     char* szPath,
-     long  len) {
+     char**  ppCur,
+     long    len) {
 
-  CSRESULT Rc;
-  CSLIST Listing;
-  CSJSON_TOKENINFO* pti;
   CSJSON_DIRENTRY dire;
+  CSJSON_LSENTRY lse;
+  CSMAP Listing;
 
-  long vv;
-  char* szNewPath;
+  char* pCur;
 
-  vv = 0;
+  long childLen;
+  long numItems;
 
-  // Since this is an object, the directory listing will be a map
-  Listing = CSMAP_Constructor();
+  Listing = CSMAP_ArenaConstructor(This->pArena);
+  numItems = 0;
 
-  szNewPath = (char*)malloc((len * sizeof(char)) + 1);
-  memcpy(szNewPath, szPath, len+1);
+  pCur = *ppCur;
 
-  while (CS_SUCCEED(Rc = CSJSON_PRIVATE_VV(This, index,
-                                          szNewPath, len, Listing))) {
- 
-    // We check for an empty object; in this case, the VV function
-    // will fetch the matching right brace for this object rather
-    // than the code that follows the call to VV. 
-
-    if (CS_DIAG(Rc) == JSON_TOK_RBRACE) {
-      // maybe this is an empty object
-      if (vv == 0) {
-        // This is the end of the object and there was no variable/value
-        dire.type = JSON_TYPE_OBJECT;
-        dire.Listing = Listing;
-        dire.numItems  = vv;
-
-        CSMAP_Insert(This->Object, szNewPath,
-                   (void*)(&dire), sizeof(CSJSON_DIRENTRY));
-
-        This->nextSlabSize += 2; // because we need 2 braces
-        free(szNewPath);
-        return CS_SUCCESS;
-      }
-      else {
+  JSON_SKIP_WS(pCur);
 
-        Rc = CS_FAILURE;
-        goto CSJSON_PRIVATE_O_FAILURE;
-      }
-    }
+  if (*pCur != '}') {
 
-    // Read next token; we MUST have either a comma or a right brace
-    Rc = CSLIST_GetDataRef(This->Tokens, (void**)(&pti), *index);
+    for (;;) {
 
-    if (CS_FAIL(Rc)) {
+      if (*pCur != '"') {
+        goto CSJSON_PRIVATE_PARSEOBJECT_FAILURE;
+      }
 
-      goto CSJSON_PRIVATE_O_FAILURE;
-    }
+      pCur++;
 
-    switch(pti->type) {
-   
-      case JSON_TOK_COMMA:
-    
-        vv++;
-        (*index)++;
-        (This->nextSlabSize)++;  // for the comma
-        break;
+      if (CS_FAIL(CSJSON_PRIVATE_ParseString(&pCur,
+                                             &(lse.szKey),
+                                             &(lse.keySize)))) {
+        goto CSJSON_PRIVATE_PARSEOBJECT_FAILURE;
+      }
 
-      case JSON_TOK_RBRACE:
+      JSON_SKIP_WS(pCur);
 
-        vv++;
-        (*index)++;
-        // This is the end of the object
-        dire.type = JSON_TYPE_OBJECT;
-        dire.Listing = Listing;
-        dire.numItems  = vv;
+      if (*pCur != ':') {
+        goto CSJSON_PRIVATE_PARSEOBJECT_FAILURE;
+      }
 
-        CSMAP_Insert(This->Object, szNewPath,
-                   (void*)(&dire), sizeof(CSJSON_DIRENTRY));
+      pCur++;
 
-        This->nextSlabSize += 2; // because we need 2 braces
-        free(szNewPath);
-        return CS_SUCCESS;
+      JSON_SKIP_WS(pCur);
 
-      default:
+      childLen = 0;
 
-        // Wrong token type
-        goto CSJSON_PRIVATE_O_FAILURE;
-    }
-  }
+      if (*pCur == '{' || *pCur == '[') {
 
-  CSJSON_PRIVATE_O_FAILURE:
+        // Path of the inner object or array
 
-  free(szNewPath);
-  return Rc;
-}
+        if (lse.keySize == 1) {
+          // empty key
+          CSJSON_PRIVATE_ReservePath(This, len + 2);
+          This->szPath[len] = JSON_PATH_SEP;
+          childLen = len + 1;
+        }
+        else {
+          CSJSON_PRIVATE_ReservePath(This, len + lse.keySize + 1);
+          childLen = len;
+          if (This->szPath[len-1] != JSON_PATH_SEP) {
+            This->szPath[childLen++] = JSON_PATH_SEP;
+          }
+          memcpy(This->szPath + childLen, lse.szKey, lse.keySize - 1);
+          childLen += lse.keySize - 1;
+        }
 
-///////////////////////////////////////////////////////////////////////////////
-///////////////////////////////////////////////////////////////////////////////
-///////////////////////////////////////////////////////////////////////////////
-// 
-// CSJSON_PRIVATE_VV
-//
-// Determines if a set of tokens is a well formed variable/value pair within 
-// a JSON object
-//
-///////////////////////////////////////////////////////////////////////////////
-///////////////////////////////////////////////////////////////////////////////
-///////////////////////////////////////////////////////////////////////////////
+        This->szPath[childLen] = 0;
+      }
 
-CSRESULT
-  CSJSON_PRIVATE_VV
-    (CSJSON* This,
-     long*  index,
-     char*  szPath,
-     long   len,
-     CSMAP  Listing) {
+      if (CS_FAIL(CSJSON_PRIVATE_ParseValue(This, &pCur, childLen, &lse))) {
+        goto CSJSON_PRIVATE_PARSEOBJECT_FAILURE;
+      }
 
-  char* pNewPath;
+      CSMAP_InsertKeyRef(Listing, lse.szKey,
+                         (void*)&lse, sizeof(CSJSON_LSENTRY));
 
-  long newPathLen;
+      // Serialized size: "key":value
 
-  CSRESULT Rc;
-  CSJSON_TOKENINFO* pti;
-  CSJSON_TOKENINFO* ls_pti;
-  CSJSON_LSENTRY lse;
+      switch(lse.type) {
 
-  Rc = CSLIST_GetDataRef(This->Tokens,
-                           (void**)(&pti), *index);
+        case JSON_TYPE_STRING:
+          This->nextSlabSize += lse.keySize + lse.valueSize + 5;
+          break;
 
-  if (Rc == CS_SUCCESS) {
+        case JSON_TYPE_NUMERIC:
+          This->nextSlabSize += lse.keySize + lse.valueSize + 3;
+          break;
 
-    if (pti->type == JSON_TOK_STRING) {
+        case JSON_TYPE_BOOL_FALSE:
+          This->nextSlabSize += lse.keySize + 8;
+          break;
 
-      ls_pti = pti; // This is a pointer to the token and will be inserted
-                    // into the directory listing; this avoids copying
-                    // the pointer to the token value as well as its size.
+        case JSON_TYPE_BOOL_TRUE:
+        case JSON_TYPE_NULL:
+          This->nextSlabSize += lse.keySize + 7;
+          break;
 
-      (*index)++;
+        default:
+          This->nextSlabSize += lse.keySize + 3;
+          break;
+      }
 
-      Rc = CSLIST_GetDataRef(This->Tokens, (void**)(&pti), *index);
+      numItems++;
 
-      // No need to check for success; if we fail reading
-      // a token, then the type will remain JSON_TOK_STRING and
-      // the next condition will fail.
+      JSON_SKIP_WS(pCur);
 
-      if (pti->type == JSON_TOK_COLON) {
+      if (*pCur == ',') {
+        This->nextSlabSize++;
+        pCur++;
+        JSON_SKIP_WS(pCur);
+        continue;
+      }
 
-        (*index)++;
+      if (*pCur == '}') {
+        break;
+      }
 
-        Rc = CSLIST_GetDataRef(This->Tokens,
-                             (void**)(&pti), *index);
+      goto CSJSON_PRIVATE_PARSEOBJECT_FAILURE;
+    }
+  }
 
-        // No need to check for success again; if we fail reading
-        // a token, then the type will remain JSON_TOK_COLON and
-        // the next condition will fall to the default case and fail.
+  // Skip right brace
 
-        switch(pti->type) {
+  pCur++;
 
-          case JSON_TOK_LBRACE:
+  // Inner objects may have grown the path buffer
+  // and appended to the current path.
 
-            if (len > 1) {
-              // We are not at root
-              if (ls_pti->size == 1) {
-                // Key is empty
-                newPathLen = len + 2; // must include NULL 
-                pNewPath = (char*)malloc(newPathLen * sizeof(char));
-                memcpy(pNewPath, szPath, len);
-                pNewPath[len] = JSON_PATH_SEP;
-                pNewPath[len+1] = 0;
-              }
-              else {
-                if (szPath[len-1] == JSON_PATH_SEP) {
-                  // path ends with the path separator; 
-                  //we don't add another path separator
-                  newPathLen = len + ls_pti->size; // already includes NULL 
-                  pNewPath = (char*)malloc(newPathLen * sizeof(char));
-                  memcpy(pNewPath, szPath, len);
-                  memcpy(&pNewPath[len], ls_pti->szToken, ls_pti->size);
-                }
-                else {
-                  newPathLen = len + 1 + ls_pti->size; // already includes NULL 
-                  pNewPath = (char*)malloc(newPathLen * sizeof(char));
-                  memcpy(pNewPath, szPath, len);
-                  pNewPath[len] = JSON_PATH_SEP;
-                  memcpy(&pNewPath[len+1], ls_pti->szToken, ls_pti->size);
-                }
-              }
-            }
-            else {
-              //we are root
-              if (ls_pti->size == 1) {
-                // Key is empty
-                newPathLen = 3;
-                pNewPath = (char*)malloc(newPathLen * sizeof(char));
-                pNewPath[0] = JSON_PATH_SEP;
-                pNewPath[1] = JSON_PATH_SEP;
-                pNewPath[2] = 0;
-              }
-              else {
-                newPathLen = 1 + ls_pti->size; // already includes NULL 
-                pNewPath = (char*)malloc(newPathLen * sizeof(char));
-                pNewPath[0] = JSON_PATH_SEP;
-                memcpy(&pNewPath[1], ls_pti->szToken, ls_pti->size);
-              }
-            }
+  This->szPath[len] = 0;
 
-            (*index)++;
-            Rc = CSJSON_PRIVATE_O(This, index, pNewPath, newPathLen-1)
-                        | JSON_TOK_LBRACE;
+  dire.type = JSON_TYPE_OBJECT;
+  dire.numItems = numItems;
+  dire.Listing = Listing;
 
-            free(pNewPath);
+  CSMAP_Insert(This->Object, This->szPath,
+               (void*)&dire, sizeof(CSJSON_DIRENTRY));
 
-            lse.szKey = ls_pti->szToken;
-            lse.keySize = ls_pti->size;
-            lse.szValue = 0;
-            lse.type = JSON_TYPE_OBJECT;
+  This->nextSlabSize += 2;
 
-            CSMAP_InsertKeyRef(Listing, ls_pti->szToken,
-                         (void*)(&lse), sizeof(CSJSON_LSENTRY));
+  *ppCur = pCur;
 
-            // because we need 2 double quotes, a colon and the key value
-            This->nextSlabSize = This->nextSlabSize + ls_pti->size + 3;
+  return CS_SUCCESS;
 
-            break;
+  ///////////////////////////////////////////////////////////
+  // Branching Label
+  CSJSON_PRIVATE_PARSEOBJECT_FAILURE:
 
-          case JSON_TOK_LBRACKET:
+  CSMAP_Destructor(&Listing);
 
-            if (len > 1) {
-              // we are not at the root
-              if (ls_pti->size == 1) {
-                // Key is empty
-                newPathLen = len + 2; // must include NULL 
-                pNewPath = (char*)malloc(newPathLen * sizeof(char));
-                memcpy(pNewPath, szPath, len);
-                pNewPath[len] = JSON_PATH_SEP;
-                pNewPath[len+1] = 0;
-              }
-              else {
-                if (szPath[len-1] == JSON_PATH_SEP) {
-                  // path ends with the path separator; 
-                  //we don't add another path separator
-                  newPathLen = len + ls_pti->size; // already includes NULL 
-                  pNewPath = (char*)malloc(newPathLen * sizeof(char));
-                  memcpy(pNewPath, szPath, len);
-                  memcpy(&pNewPath[len], ls_pti->szToken, ls_pti->size);
-                }
-                else {
-                  newPathLen = len + 1 + ls_pti->size; // already includes NULL 
-                  pNewPath = (char*)malloc(newPathLen * sizeof(char));
-                  memcpy(pNewPath, szPath, len);
-                  pNewPath[len] = JSON_PATH_SEP;
-                  memcpy(&pNewPath[len+1], ls_pti->szToken, ls_pti->size);
-                }
-              }
-            }
-            else {
-              //we are at the root
-              if (ls_pti->size == 1) {
-                // Key is empty
-                newPathLen = 3;
-                pNewPath = (char*)malloc(newPathLen * sizeof(char));
-                pNewPath[0] = JSON_PATH_SEP;
-                pNewPath[1] = JSON_PATH_SEP;
-                pNewPath[2] = 0;
-              }
-              else {
-                newPathLen = 1 + ls_pti->size; // already includes NULL 
-                pNewPath = (char*)malloc(newPathLen * sizeof(char));
-                pNewPath[0] = JSON_PATH_SEP;
-                memcpy(&pNewPath[1], ls_pti->szToken, ls_pti->size);
-              }
-            }
+  *ppCur = pCur;
 
-            (*index)++;
-            Rc = CSJSON_PRIVATE_A(This, index, pNewPath, newPathLen-1)
-                        | JSON_TOK_LBRACKET;
+  return CS_FAILURE;
+}
 
-            free(pNewPath);
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+//
+// CSJSON_PRIVATE_ParseArray
+//
+// Parses the values of an array up to and including the closing bracket;
+// the opening bracket has been consumed by the caller. The array path is
+// the first len characters of the instance path buffer.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-            lse.szKey = ls_pti->szToken;
-            lse.keySize = ls_pti->size;
-            lse.szValue = 0;
-            lse.type = JSON_TYPE_ARRAY;
+CSRESULT
+  CSJSON_PRIVATE_ParseArray
+    (CSJSON* This,
+     char**  ppCur,
+     long    len) {
 
-            CSMAP_InsertKeyRef(Listing, ls_pti->szToken,
-                         (void*)(&lse), sizeof(CSJSON_LSENTRY));
+  CSJSON_DIRENTRY dire;
+  CSJSON_LSENTRY lse;
+  CSLIST Listing;
 
-            // because we need 2 double quotes, a colon and the key value
-            This->nextSlabSize = This->nextSlabSize + ls_pti->size + 3;
+  char* pCur;
 
-            break;
+  long childLen;
+  long numItems;
+  long index;
 
-          case JSON_TOK_STRING:
+  char szIndex[21];
 
-            lse.szKey = ls_pti->szToken;
-            lse.keySize = ls_pti->size;
-            lse.type = JSON_TYPE_STRING;
-            lse.szValue = pti->szToken;
-            lse.valueSize = pti->size;
+  Listing = CSLIST_ArenaConstructor(This->pArena, 0);
+  numItems = 0;
 
-            CSMAP_InsertKeyRef(Listing, ls_pti->szToken,
-                         (void*)(&lse), sizeof(CSJSON_LSENTRY));
+  lse.szKey = 0;
+  lse.keySize = 0;
 
-            // because we need 4 double quotes, a colon and the key/value pair
-            This->nextSlabSize = This->nextSlabSize +
-                                    ls_pti->size + pti->size + 5;
+  pCur = *ppCur;
 
-            (*index)++;
+  JSON_SKIP_WS(pCur);
 
-            Rc = CS_SUCCESS | JSON_TOK_STRING;
+  if (*pCur != ']') {
 
-            break;
+    for (;;) {
 
-          case JSON_TOK_NUMERIC:
+      childLen = 0;
 
-            lse.szKey = ls_pti->szToken;
-            lse.keySize = ls_pti->size;
-            lse.type = JSON_TYPE_NUMERIC;
-            lse.szValue = pti->szToken;
-            lse.valueSize = pti->size;
+      if (*pCur == '{' || *pCur == '[') {
 
-            CSMAP_InsertKeyRef(Listing, ls_pti->szToken,
-                         (void*)(&lse), sizeof(CSJSON_LSENTRY));
+        // Path of the inner object or array: the current
+        // path followed by the index of the array element.
 
-            // because we need 2 double quotes, a colon and the key/value pair
-            This->nextSlabSize = This->nextSlabSize +
-                                       ls_pti->size + pti->size + 3;
+        index = numItems;
+        childLen = sizeof(szIndex);
 
-            (*index)++;
+        do {
+          szIndex[--childLen] = (char)('0' + index % 10);
+          index /= 10;
+        } while (index > 0);
 
-            Rc = CS_SUCCESS | JSON_TOK_NUMERIC;
+        CSJSON_PRIVATE_ReservePath(This,
+                                   len + sizeof(szIndex) - childLen + 2);
 
-            break;
+        index = childLen;
+        childLen = len;
 
-          case JSON_TOK_BOOL_FALSE:
+        if (This->szPath[len-1] != JSON_PATH_SEP) {
+          This->szPath[childLen++] = JSON_PATH_SEP;
+        }
 
-            lse.szKey = ls_pti->szToken;
-            lse.keySize = ls_pti->size;
-            lse.type = JSON_TYPE_BOOL_FALSE;
-            lse.szValue = 0;
+        memcpy(This->szPath + childLen, szIndex + index,
+               sizeof(szIndex) - index);
+        childLen += sizeof(szIndex) - index;
 
-            CSMAP_InsertKeyRef(Listing, ls_pti->szToken,
-                         (void*)(&lse), sizeof(CSJSON_LSENTRY));
+        This->szPath[childLen] = 0;
+      }
 
-            // because we need 2 double quotes, a colon and the key/value pair
-            This->nextSlabSize = This->nextSlabSize + ls_pti->size + 8;
+      if (CS_FAIL(CSJSON_PRIVATE_ParseValue(This, &pCur, childLen, &lse))) {
+        goto CSJSON_PRIVATE_PARSEARRAY_FAILURE;
+      }
 
-            (*index)++;
+      CSLIST_Insert(Listing, (void*)&lse,
+                    sizeof(CSJSON_LSENTRY), CSLIST_BOTTOM);
 
-            Rc = CS_SUCCESS | JSON_TOK_BOOL_FALSE;
+      // Serialized size of the value
 
-            break;
+      switch(lse.type) {
 
-          case JSON_TOK_BOOL_TRUE:
+        case JSON_TYPE_STRING:
+          This->nextSlabSize += lse.valueSize + 2;
+          break;
 
-            lse.szKey = ls_pti->szToken;
-            lse.keySize = ls_pti->size;
-            lse.type = JSON_TOK_BOOL_TRUE;
-            lse.szValue = 0;
+        case JSON_TYPE_NUMERIC:
+          This->nextSlabSize += lse.valueSize + 2;
+          break;
 
-            CSMAP_InsertKeyRef(Listing, ls_pti->szToken,
-                         (void*)(&lse), sizeof(CSJSON_LSENTRY));
+        case JSON_TYPE_BOOL_FALSE:
+        case JSON_TYPE_BOOL_TRUE:
+        case JSON_TYPE_NULL:
+          This->nextSlabSize += 5;
+          break;
+      }
 
-            // because we need 2 double quotes, a colon and the key/value pair
-            This->nextSlabSize = This->nextSlabSize + ls_pti->size + 7;
+      numItems++;
 
-            (*index)++;
+      JSON_SKIP_WS(pCur);
 
-            Rc = CS_SUCCESS | JSON_TOK_BOOL_TRUE;
+      if (*pCur == ',') {
+        This->nextSlabSize++;
+        pCur++;
+        JSON_SKIP_WS(pCur);
+        continue;
+      }
 
-            break;
+      if (*pCur == ']') {
+        break;
+      }
 
-          case JSON_TOK_NULL:
+      goto CSJSON_PRIVATE_PARSEARRAY_FAILURE;
+    }
+  }
 
-            lse.szKey = ls_pti->szToken;
-            lse.keySize = ls_pti->size;
-            lse.type = JSON_TYPE_NULL;
-            lse.szValue = 0;
+  // Skip right bracket
 
-            CSMAP_InsertKeyRef(Listing, ls_pti->szToken,
-                         (void*)(&lse), sizeof(CSJSON_LSENTRY));
+  pCur++;
 
-            // because we need 2 double quotes, a colon and the key/value pair
-            This->nextSlabSize = This->nextSlabSize + ls_pti->size + 7;
+  This->szPath[len] = 0;
 
-            (*index)++;
+  dire.type = JSON_TYPE_ARRAY;
+  dire.numItems = numItems;
+  dire.Listing = Listing;
 
-            Rc = CS_SUCCESS | JSON_TOK_NULL;
+  CSMAP_Insert(This->Object, This->szPath,
+               (void*)&dire, sizeof(CSJSON_DIRENTRY));
 
-            break;
+  This->nextSlabSize += 2;
 
-          default:
+  *ppCur = pCur;
 
-            Rc = CS_FAILURE;
+  return CS_SUCCESS;
 
-            break;
-        }
-      }
-      else {
-        Rc = CS_FAILURE;
-      }
-    }
-    else {
+  ///////////////////////////////////////////////////////////
+  // Branching Label
+  CSJSON_PRIVATE_PARSEARRAY_FAILURE:
 
-      // We started with a left brace and the token is not a string.
-      // maybe it's an empty object so we check for a matching right
-      // brace; if it is a matching brace, then it is ok. Otherwise,
-      // the variable/value pair (and therefore the object) is invalid 
+  CSLIST_Destructor(&Listing);
 
-      if(pti->type == JSON_TOK_RBRACE) {
-        (*index)++;
-        Rc = CS_SUCCESS | pti->type;
-      }
-      else {
-        Rc = CS_FAILURE;
-      }
-    }
-  }
+  *ppCur = pCur;
 
-  return Rc;
+  return CS_FAILURE;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
-// 
-// CSJSON_PRIVATE_A
 //
-// Determines if a set of tokens is a well formed JSON array 
+// CSJSON_PRIVATE_ParseValue
+//
+// Parses any value and sets the type and value of the listing entry.
+// If the value is an object or an array, its path has been written
+// by the caller in the instance path buffer and is len characters long.
 //
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 
 CSRESULT
-  CSJSON_PRIVATE_A
+  CSJSON_PRIVATE_ParseValue
     (CSJSON* This,
-     long*  index,
-     char*  szPath,
-     long   len) {
+     char**  ppCur,
+     long    len,
+     CSJSON_LSENTRY* plse) {
 
-  CSRESULT Rc;
-  CSJSON_TOKENINFO* pti;
-  CSJSON_DIRENTRY dire;
-  CSJSON_LSENTRY lse;
-  CSJSON_LSENTRY* plse;
-  CSLIST Listing;
+  char* pCur;
 
-  long indexLen;
-  long start;
-  long curIndex;
-  long commaFlag;
-  long newPathLen;
-  long count;
-  long i;
+  pCur = *ppCur;
 
-  char* szNewPath;
+  plse->szValue = 0;
+  plse->valueSize = 0;
+  plse->numType = JSON_NUMBER_TEXT;
 
-  char szIndex[11];
+  switch(*pCur) {
 
-  Listing = CSLIST_Constructor();
+    case '{':
 
-  start = *index;
-  curIndex = 0;
-  commaFlag = 1;
+      plse->type = JSON_TYPE_OBJECT;
+      (*ppCur)++;
+      return CSJSON_PRIVATE_ParseObject(This, ppCur, len);
 
-  while (1) {
+    case '[':
 
-    if (CS_SUCCEED(CSLIST_GetDataRef(This->Tokens,
-                        (void**)(&pti), start))) {
+      plse->type = JSON_TYPE_ARRAY;
+      (*ppCur)++;
+      return CSJSON_PRIVATE_ParseArray(This, ppCur, len);
 
-      switch (pti->type) {
+    case '"':
 
-        case JSON_TOK_LBRACE:
+      plse->type = JSON_TYPE_STRING;
+      (*ppCur)++;
+      return CSJSON_PRIVATE_ParseString(ppCur,
+                                        &(plse->szValue),
+                                        &(plse->valueSize));
 
-          if (commaFlag == 1) {
+    case 't':
 
-            if (len > 1) {
-              
-              // If the path ends with a slash, then the parent
-              // has a null (empty) key. In this case,
-              // we don't add another slash
+      if (pCur[1] == 'r' && pCur[2] == 'u' && pCur[3] == 'e') {
+        plse->type = JSON_TYPE_BOOL_TRUE;
+        *ppCur = pCur + 4;
+        return CS_SUCCESS;
+      }
 
-              if (szPath[len-1] == JSON_PATH_SEP) {
+      return CS_FAILURE;
 
-                // allocate enough space for path and
-                // 10 digits and the NULL
+    case 'f':
 
-                szNewPath = (char*)malloc((len + 11) * sizeof(char));
-                memcpy(szNewPath, szPath, len);
-                sprintf(szIndex, "%ld", curIndex);
-                indexLen = strlen(szIndex) + 1; // take NULL into account
-                memcpy(&szNewPath[len], szIndex, indexLen);
-                newPathLen = len + indexLen;
-              }
-              else {
+      if (pCur[1] == 'a' && pCur[2] == 'l' &&
+          pCur[3] == 's' && pCur[4] == 'e') {
+        plse->type = JSON_TYPE_BOOL_FALSE;
+        *ppCur = pCur + 5;
+        return CS_SUCCESS;
+      }
 
-                // allocate enough space for path, a slash,
-                // 10 digits and the NULL
+      return CS_FAILURE;
 
-                szNewPath = (char*)malloc((len + 12) * sizeof(char));
-                memcpy(szNewPath, szPath, len);
-                szNewPath[len] = JSON_PATH_SEP; //'/';
-                sprintf(szIndex, "%ld", curIndex);
-                indexLen = strlen(szIndex) + 1;  // take NULL into account
-                memcpy(&szNewPath[len+1], szIndex, indexLen);
-                newPathLen = len + 1 + indexLen;
-              }
-            }
-            else {
-              // we are at the root; allocate enough space for
-              // path, 10 digits and the NULL
-              szNewPath = (char*)malloc(len + 11 * sizeof(char));
-              memcpy(szNewPath, szPath, len);
-              sprintf(szIndex, "%ld", curIndex);
-              indexLen = strlen(szIndex) + 1;  // take NULL into account
-              memcpy(&szNewPath[len], szIndex, indexLen);
-              newPathLen = len + indexLen;
-            }
+    case 'n':
 
-            start++;
-            Rc = CSJSON_PRIVATE_O(This, &start, szNewPath, newPathLen-1);
-            free(szNewPath);
-
-            curIndex++;
-            commaFlag = 0;
-            lse.szKey = 0;
-            lse.szValue = 0;
-            lse.type = JSON_TYPE_OBJECT;
-            CSLIST_Insert(Listing, (void*)(&lse),
-                          sizeof(CSJSON_LSENTRY), CSLIST_BOTTOM);
-          }
-          else {
-            goto CSJSON_PRIVATE_A_CLEANUP;
-          }
+      if (pCur[1] == 'u' && pCur[2] == 'l' && pCur[3] == 'l') {
+        plse->type = JSON_TYPE_NULL;
+        *ppCur = pCur + 4;
+        return CS_SUCCESS;
+      }
 
-          break;
+      return CS_FAILURE;
 
-        case JSON_TOK_LBRACKET:
+    default:
 
-          if (commaFlag == 1) {
+      plse->type = JSON_TYPE_NUMERIC;
+      return CSJSON_PRIVATE_ParseNumber(ppCur,
+                                        &(plse->szValue),
+                                        &(plse->valueSize));
+  }
+}
 
-            if (len > 1) {
-              
-              // If the path ends with a slash, then the parent
-              // has a null (empty) key. In this case,
-              // we don't add another slash
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+//
+// CSJSON_PRIVATE_ParseString
+//
+// Unescapes a string in place; the opening quote has been consumed by the
+// caller. The string is NULL terminated where its closing quote (or the
+// last unescaped character) was. Unicode code points are converted to
+// UTF-8. The returned size includes the NULL terminator.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-              if (szPath[len-1] == JSON_PATH_SEP) {
+CSRESULT
+  CSJSON_PRIVATE_ParseString
+    (char** ppCur,
+     char** pszString,
+     long*  pSize) {
 
-                // allocate enough space for path and
-                // 10 digits and the NULL
+  unsigned char* pIn;
+  unsigned char* pOut;
+  unsigned char* pNext;
 
-                szNewPath = (char*)malloc((len + 11) * sizeof(char));
-                memcpy(szNewPath, szPath, len);
-                sprintf(szIndex, "%ld", curIndex);
-                indexLen = strlen(szIndex) + 1; // take NULL into account
-                memcpy(&szNewPath[len], szIndex, indexLen);
-                newPathLen = len + indexLen;
-              }
-              else {
+  long codePoint;
+  int i;
 
-                // allocate enough space for path, a slash,
-                // 10 digits and the NULL
+  pIn = (unsigned char*)(*ppCur);
+  *pszString = *ppCur;
 
-                szNewPath = (char*)malloc(len + 12 * sizeof(char));
-                memcpy(szNewPath, szPath, len);
-                szNewPath[len] = JSON_PATH_SEP;
-                sprintf(szIndex, "%ld", curIndex);
-                indexLen = strlen(szIndex) + 1;  // take NULL into account
-                memcpy(&szNewPath[len+1], szIndex, indexLen);
-                newPathLen = len + 1 + indexLen;
-              }
-            }
-            else {
-              // we are at the root; allocate enough space for
-              // path, 10 digits and the NULL
-              szNewPath = (char*)malloc(len + 11 * sizeof(char));
-              memcpy(szNewPath, szPath, len);
-              sprintf(szIndex, "%ld", curIndex);
-              indexLen = strlen(szIndex) + 1;  // take NULL into account
-              memcpy(&szNewPath[len], szIndex, indexLen);
-              newPathLen = len + indexLen;
-            }
+  // Most strings have no escape sequence: they are
+  // left as is and only need to be terminated.
 
-            start++;
-            Rc = CSJSON_PRIVATE_A(This, &start, szNewPath, newPathLen-1);
-            free(szNewPath);
+  pIn = (unsigned char*)g_CSJSON_ScanString((char*)pIn);
 
-            curIndex++;
-            commaFlag = 0;
+  pOut = pIn;
 
-            lse.szKey = 0;
-            lse.szValue = 0;
-            lse.type = JSON_TYPE_ARRAY;
-            CSLIST_Insert(Listing, (void*)(&lse),
-                          sizeof(CSJSON_LSENTRY), CSLIST_BOTTOM);
-          }
-          else {
-            goto CSJSON_PRIVATE_A_CLEANUP;
-          }
+  while (*pIn != '"') {
 
-          break;
+    // Control characters must be escaped; this
+    // also catches an unterminated string.
 
-        case JSON_TOK_COMMA:
+    if (*pIn < 0x20) {
+      return CS_FAILURE;
+    }
 
-          if (commaFlag == 0) {
-            commaFlag = 1;
-            start++;
-            // because we need room for the comma
-            (This->nextSlabSize)++;
-          }
-          else {
-            goto CSJSON_PRIVATE_A_CLEANUP;
-          }
+    if (*pIn != '\\') {
+      pNext = (unsigned char*)g_CSJSON_ScanString((char*)pIn);
+      memmove(pOut, pIn, pNext - pIn);
+      pOut += pNext - pIn;
+      pIn = pNext;
+      continue;
+    }
 
-          break;
+    pIn++;
+
+    switch(*pIn) {
 
-        case JSON_TOK_RBRACKET:
+      case '"':
+      case '\\':
+      case '/':
+        *pOut++ = *pIn;
+        break;
 
-          if ((commaFlag == 0 && curIndex > 0) ||
-              (commaFlag == 1 && curIndex == 0)) {
+      case 'b':
+        *pOut++ = '\b';
+        break;
 
-            // allocate enough space for path
+      case 'f':
+        *pOut++ = '\f';
+        break;
 
-            szNewPath = (char*)malloc((len + 1) * sizeof(char));
-            memcpy(szNewPath, szPath, len+1);
+      case 'n':
+        *pOut++ = '\n';
+        break;
 
-            dire.type = JSON_TYPE_ARRAY;
-            dire.Listing = Listing;
-            dire.numItems  = curIndex;
+      case 'r':
+        *pOut++ = '\r';
+        break;
 
-            CSMAP_Insert(This->Object, szNewPath,
-                        (void*)(&dire), sizeof(CSJSON_DIRENTRY));
+      case 't':
+        *pOut++ = '\t';
+        break;
 
-            free(szNewPath);
+      case 'u':
 
-            // because we need 2 brackets
-            This->nextSlabSize += 2;
+        codePoint = 0;
 
-            *index = start + 1;
-            Rc = CS_SUCCESS;
-            goto CSJSON_PRIVATE_A_END;
+        for (i=1; i<5; i++) {
+          codePoint <<= 4;
+          if (pIn[i] >= '0' && pIn[i] <= '9') {
+            codePoint |= pIn[i] - '0';
+          }
+          else if (pIn[i] >= 'a' && pIn[i] <= 'f') {
+            codePoint |= pIn[i] - 'a' + 10;
+          }
+          else if (pIn[i] >= 'A' && pIn[i] <= 'F') {
+            codePoint |= pIn[i] - 'A' + 10;
           }
           else {
-            goto CSJSON_PRIVATE_A_CLEANUP;
+            return CS_FAILURE;
           }
+        }
 
-          break;
-
-        default:
+        pIn += 4;
 
-          if (commaFlag == 1) {
+        if (codePoint < 0x80) {
+          *pOut++ = (unsigned char)codePoint;
+        }
+        else if (codePoint < 0x800) {
+          *pOut++ = (unsigned char)(0xC0 | (codePoint >> 6));
+          *pOut++ = (unsigned char)(0x80 | (codePoint & 0x3F));
+        }
+        else {
+          *pOut++ = (unsigned char)(0xE0 | (codePoint >> 12));
+          *pOut++ = (unsigned char)(0x80 | ((codePoint >> 6) & 0x3F));
+          *pOut++ = (unsigned char)(0x80 | (codePoint & 0x3F));
+        }
 
-            if (pti->type == JSON_TOK_STRING) {
+        break;
 
-              lse.szKey = 0;
-              lse.szValue = pti->szToken;
-              lse.valueSize = pti->size;
-              lse.type = pti->type;
-              CSLIST_Insert(Listing, (void*)(&lse),
-                            sizeof(CSJSON_LSENTRY), CSLIST_BOTTOM);
-              // because we need (maybe) 2 double quotes and the value
-              This->nextSlabSize = This->nextSlabSize + lse.valueSize + 2;
+      default:
 
-              start++;
-              curIndex++;
-            }
-            else if ( pti->type == JSON_TOK_NUMERIC) {
-
-              lse.szKey = 0;
-              lse.szValue = pti->szToken;
-              lse.valueSize = pti->size;
-              lse.type = pti->type;
-              CSLIST_Insert(Listing, (void*)(&lse),
-                            sizeof(CSJSON_LSENTRY), CSLIST_BOTTOM);
-              // because we need (maybe) 2 double quotes and the value
-              This->nextSlabSize = This->nextSlabSize + lse.valueSize + 2;
-
-              start++;
-              curIndex++;
-            }
-            else if (pti->type == JSON_TOK_BOOL_FALSE ||
-                     pti->type == JSON_TOK_BOOL_TRUE ||
-                     pti->type == JSON_TOK_NULL) {
-
-              lse.szKey = 0;
-              lse.szValue = 0;
-              lse.type = pti->type;
-              CSLIST_Insert(Listing, (void*)(&lse),
-                            sizeof(CSJSON_LSENTRY), CSLIST_BOTTOM);
-              // because we need up to the max value size
-              This->nextSlabSize = This->nextSlabSize + 5;
-
-              start++;
-              curIndex++;
-            }
-            else {
-              //CS_FAILURE... leave the loop
-              goto CSJSON_PRIVATE_A_CLEANUP;
-            }
+        // An escaped control character stands for itself
 
-            commaFlag = 0;
-            break;
-        }
-        else {
-          //CS_FAILURE... leave the loop
-          goto CSJSON_PRIVATE_A_CLEANUP;
+        if (*pIn == 0 || *pIn >= 0x20) {
+          return CS_FAILURE;
         }
-      }
-    }
+
+        *pOut++ = *pIn;
+        break;
+    }
+
+    pIn++;
+  }
+
+  *pOut = 0;
+
+  *pSize = (long)((char*)pOut - *pszString) + 1;
+  *ppCur = (char*)(pIn + 1);
+
+  return CS_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+//
+// CSJSON_PRIVATE_ParseNumber
+//
+// Validates a numeric value. Since the character that precedes a number
+// (a colon, a comma, a left bracket or white space) has already been
+// consumed, the number is moved back by one position to make room for
+// its NULL terminator. The returned size includes the NULL terminator.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  CSJSON_PRIVATE_ParseNumber
+    (char** ppCur,
+     char** pszNumber,
+     long*  pSize) {
+
+  char* pStart;
+  char* pCur;
+
+  long size;
+
+  pStart = pCur = *ppCur;
+
+  if (*pCur == '-') {
+    pCur++;
+  }
+
+  if (*pCur == '0') {
+    pCur++;
+  }
+  else if (*pCur >= '1' && *pCur <= '9') {
+    do {
+      pCur++;
+    } while (*pCur >= '0' && *pCur <= '9');
+  }
+  else {
+    return CS_FAILURE;
+  }
+
+  if (*pCur == '.') {
+    pCur++;
+    if (*pCur < '0' || *pCur > '9') {
+      return CS_FAILURE;
+    }
+    do {
+      pCur++;
+    } while (*pCur >= '0' && *pCur <= '9');
+  }
+
+  if (*pCur == 'e' || *pCur == 'E') {
+    pCur++;
+    if (*pCur == '+' || *pCur == '-') {
+      pCur++;
+    }
+    if (*pCur < '0' || *pCur > '9') {
+      return CS_FAILURE;
+    }
+    do {
+      pCur++;
+    } while (*pCur >= '0' && *pCur <= '9');
+  }
+
+  size = (long)(pCur - pStart);
+
+  memmove(pStart - 1, pStart, size);
+  pStart[size-1] = 0;
+
+  *pszNumber = pStart - 1;
+  *pSize = size + 1;
+  *ppCur = pCur;
+
+  return CS_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+//
+// CSJSON_PRIVATE_ReservePath
+//
+// Makes sure the path buffer can hold at least size characters.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+void
+  CSJSON_PRIVATE_ReservePath
+    (CSJSON* This,
+     long size) {
+
+  char* szPath;
+
+  if (size <= This->pathSize) {
+    return;
+  }
+
+  if (size < This->pathSize * 2) {
+    size = This->pathSize * 2;
+  }
+
+  szPath = (char*)CSJSON_PRIVATE_BufferMalloc(This, size * sizeof(char));
+  memcpy(szPath, This->szPath, This->pathSize);
+
+  CSJSON_PRIVATE_BufferFree(This, This->szPath);
+
+  This->szPath = szPath;
+  This->pathSize = size;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+//
+// CSJSON_PRIVATE_InternalPath
+//
+// Converts a submitted path to its internal representation (the internal
+// path separator is the ESC character) in the instance path buffer and
+// returns the buffer; the path is valid until the buffer is used again.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+char*
+  CSJSON_PRIVATE_InternalPath
+    (CSJSON* This,
+     char* szPath) {
+
+  long len;
+  long i;
+
+  len = strlen(szPath);
+
+  CSJSON_PRIVATE_ReservePath(This, len + 1);
+
+  for (i=0; i<len; i++) {
+    if (szPath[i] == szPath[0]) {
+      This->szPath[i] = JSON_PATH_SEP;
+    }
     else {
-      //CS_FAILURE... leave the loop
-      goto CSJSON_PRIVATE_A_CLEANUP;
+      This->szPath[i] = szPath[i];
     }
   }
 
-  ///////////////////////////////////////////////////////////
-  // Branching Label
-  CSJSON_PRIVATE_A_CLEANUP:
-  //
-  // We need to cleanup the listing and destroy it. Note that
-  // the listing points to tokens and since they will be
-  // released by the CSJSON_Parse method, we must NOT
-  // release the tokens referenced by the listing entries. 
-  ///////////////////////////////////////////////////////////
+  This->szPath[len] = 0;
 
-  count = CSLIST_Count(Listing);
+  return This->szPath;
+}
 
-  for (i=0; i<count; i++) {
-    
-    CSLIST_GetDataRef(Listing, (void**)(&plse), i);
-  
-    if (plse->szKey != 0) {
-      free(plse->szKey);
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+//
+// CSJSON_PRIVATE_SubPath
+//
+// Appends a key (or an array index) to the first len characters of the
+// instance path buffer, the way directories are named when they are
+// created, and returns the length of the resulting path.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+long
+  CSJSON_PRIVATE_SubPath
+    (CSJSON* This,
+     long len,
+     char* szKey,
+     long keySize) {
+
+  CSJSON_PRIVATE_ReservePath(This, len + keySize + 2);
+
+  if (keySize == 0 || len == 0 || This->szPath[len-1] != JSON_PATH_SEP) {
+    This->szPath[len++] = JSON_PATH_SEP;
+  }
+
+  memcpy(This->szPath + len, szKey, keySize);
+  len += keySize;
+
+  This->szPath[len] = 0;
+
+  return len;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+//
+// CSJSON_PRIVATE_SelectScanners
+//
+// Chooses the string and white space scanners for the processor the
+// library is loaded on: AVX2 or SSE2 on x86, byte by byte elsewhere.
+//
+// The vector scanners examine 16 or 32 bytes at a time and may read past
+// the NULL terminator of the document; the document buffer is padded with
+// JSON_SCAN_PADDING bytes for that purpose. They stop at the NULL
+// terminator since it is neither white space nor an ordinary string
+// character.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+__attribute__((constructor))
+void
+  CSJSON_PRIVATE_SelectScanners
+    (void) {
+
+  g_CSJSON_ScanString = CSJSON_PRIVATE_ScanString;
+  g_CSJSON_SkipSpace = CSJSON_PRIVATE_SkipSpace;
+
+#ifdef JSON_SIMD_X86
+
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx2")) {
+    g_CSJSON_ScanString = CSJSON_PRIVATE_ScanStringAVX2;
+    g_CSJSON_SkipSpace = CSJSON_PRIVATE_SkipSpaceAVX2;
+  }
+  else if (__builtin_cpu_supports("sse2")) {
+    g_CSJSON_ScanString = CSJSON_PRIVATE_ScanStringSSE2;
+    g_CSJSON_SkipSpace = CSJSON_PRIVATE_SkipSpaceSSE2;
+  }
+
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+//
+// CSJSON_PRIVATE_ScanString
+//
+// Returns the address of the first quote, backslash or control character
+// (including the NULL terminator) of a string.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+char*
+  CSJSON_PRIVATE_ScanString
+    (char* p) {
+
+  while (*p != '"' && *p != '\\' && *(unsigned char*)p >= 0x20) {
+    p++;
+  }
+
+  return p;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+//
+// CSJSON_PRIVATE_SkipSpace
+//
+// Returns the address of the first character that is not white space.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+char*
+  CSJSON_PRIVATE_SkipSpace
+    (char* p) {
+
+  while (JSON_IS_WS(*p)) {
+    p++;
+  }
+
+  return p;
+}
+
+#ifdef JSON_SIMD_X86
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+//
+// CSJSON_PRIVATE_ScanStringSSE2
+// CSJSON_PRIVATE_ScanStringAVX2
+//
+// Vector versions of CSJSON_PRIVATE_ScanString. There is no unsigned
+// byte comparison: a byte is a control character if max(byte, 0x1F)
+// is 0x1F.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+char*
+  CSJSON_PRIVATE_ScanStringSSE2
+    (char* p) {
+
+  __m128i quote;
+  __m128i backslash;
+  __m128i control;
+  __m128i chunk;
+
+  int mask;
+
+  quote = _mm_set1_epi8('"');
+  backslash = _mm_set1_epi8('\\');
+  control = _mm_set1_epi8(0x1F);
+
+  for (;;) {
+
+    chunk = _mm_loadu_si128((__m128i*)p);
+
+    mask = _mm_movemask_epi8(
+             _mm_or_si128(
+               _mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                            _mm_cmpeq_epi8(chunk, backslash)),
+               _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control)));
+
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
     }
+
+    p += 16;
   }
+}
 
-  CSLIST_Destructor(&Listing);
+__attribute__((target("avx2")))
+char*
+  CSJSON_PRIVATE_ScanStringAVX2
+    (char* p) {
 
-  Rc = CS_FAILURE;
+  __m256i quote;
+  __m256i backslash;
+  __m256i control;
+  __m256i chunk;
 
-  ///////////////////////////////////////////////////////////
-  // Branching Label
-  CSJSON_PRIVATE_A_END:
+  unsigned int mask;
 
-  return Rc;
+  quote = _mm256_set1_epi8('"');
+  backslash = _mm256_set1_epi8('\\');
+  control = _mm256_set1_epi8(0x1F);
+
+  for (;;) {
+
+    chunk = _mm256_loadu_si256((__m256i*)p);
+
+    mask = (unsigned int)_mm256_movemask_epi8(
+             _mm256_or_si256(
+               _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote),
+                               _mm256_cmpeq_epi8(chunk, backslash)),
+               _mm256_cmpeq_epi8(_mm256_max_epu8(chunk, control), control)));
+
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+
+    p += 32;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+//
+// CSJSON_PRIVATE_SkipSpaceSSE2
+// CSJSON_PRIVATE_SkipSpaceAVX2
+//
+// Vector versions of CSJSON_PRIVATE_SkipSpace.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+char*
+  CSJSON_PRIVATE_SkipSpaceSSE2
+    (char* p) {
+
+  __m128i space;
+  __m128i tab;
+  __m128i cr;
+  __m128i lf;
+  __m128i chunk;
+
+  int mask;
+
+  space = _mm_set1_epi8(' ');
+  tab = _mm_set1_epi8('\t');
+  cr = _mm_set1_epi8('\r');
+  lf = _mm_set1_epi8('\n');
+
+  for (;;) {
+
+    chunk = _mm_loadu_si128((__m128i*)p);
+
+    mask = _mm_movemask_epi8(
+             _mm_or_si128(
+               _mm_or_si128(_mm_cmpeq_epi8(chunk, space),
+                            _mm_cmpeq_epi8(chunk, tab)),
+               _mm_or_si128(_mm_cmpeq_epi8(chunk, cr),
+                            _mm_cmpeq_epi8(chunk, lf))));
+
+    mask = ~mask & 0xFFFF;
+
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+
+    p += 16;
+  }
+}
+
+__attribute__((target("avx2")))
+char*
+  CSJSON_PRIVATE_SkipSpaceAVX2
+    (char* p) {
+
+  __m256i space;
+  __m256i tab;
+  __m256i cr;
+  __m256i lf;
+  __m256i chunk;
+
+  unsigned int mask;
+
+  space = _mm256_set1_epi8(' ');
+  tab = _mm256_set1_epi8('\t');
+  cr = _mm256_set1_epi8('\r');
+  lf = _mm256_set1_epi8('\n');
+
+  for (;;) {
+
+    chunk = _mm256_loadu_si256((__m256i*)p);
+
+    mask = (unsigned int)_mm256_movemask_epi8(
+             _mm256_or_si256(
+               _mm256_or_si256(_mm256_cmpeq_epi8(chunk, space),
+                               _mm256_cmpeq_epi8(chunk, tab)),
+               _mm256_or_si256(_mm256_cmpeq_epi8(chunk, cr),
+                               _mm256_cmpeq_epi8(chunk, lf))));
+
+    mask = ~mask;
+
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+
+    p += 32;
+  }
 }
 
+#endif
+
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
@@ -1934,8 +1969,6 @@ CSRESULT
      CSJSON_DIRENTRY* pdire) {
 
   long size;
-  long len;
-  long i;
 
   char* tempPath;
 
@@ -1950,24 +1983,9 @@ CSRESULT
     return CS_FAILURE;
   }
 
-  ///////////////////////////////////////////////////////////////////
-  // Convert submitted path to internal representation. The
-  // internal path separator is the ESC character. 
-  ///////////////////////////////////////////////////////////////////
+  // Convert submitted path to internal representation
 
-  len = strlen(szPath); 
-  tempPath = (char*)malloc(len * sizeof(char) + 1);
-  i=0;
-  while (szPath[i] != 0) {
-    if (szPath[i] == szPath[0]) {
-      tempPath[i] = JSON_PATH_SEP;
-    }
-    else {
-      tempPath[i] = szPath[i];
-    }
-    i++;
-  }
-  tempPath[i] = 0;
+  tempPath = CSJSON_PRIVATE_InternalPath(This, szPath);
 
   if (CS_SUCCEED(CSMAP_Lookup(This->Object,
                              tempPath,
@@ -1979,7 +1997,6 @@ CSRESULT
 
       pdire->numItems = lpdire->numItems;
       pdire->type = lpdire->type;
-      free(tempPath);
       return CS_SUCCESS;
     }
   }
@@ -1988,8 +2005,6 @@ CSRESULT
     pdire->type = JSON_TYPE_UNKNOWN;
   }
 
-  free(tempPath);
-
   pdire->Listing = 0;
   pdire->numItems = 0;
   pdire->type = JSON_TYPE_UNKNOWN;
@@ -2016,8 +2031,6 @@ CSRESULT CSJSON_LookupKey
    CSJSON_LSENTRY* plse) {
 
   long size;
-  long len;
-  long i;
 
   char* tempPath;
 
@@ -2035,24 +2048,9 @@ CSRESULT CSJSON_LookupKey
     return CS_FAILURE;
   }
 
-  ///////////////////////////////////////////////////////////////////
-  // Convert submitted path to internal representation. The
-  // internal path separator is the ESC character. 
-  ///////////////////////////////////////////////////////////////////
+  // Convert submitted path to internal representation
 
-  len = strlen(szPath); 
-  tempPath = (char*)malloc(len * sizeof(char) + 1);
-  i=0;
-  while (szPath[i] != 0) {
-    if (szPath[i] == szPath[0]) {
-      tempPath[i] = JSON_PATH_SEP;
-    }
-    else {
-      tempPath[i] = szPath[i];
-    }
-    i++;
-  }
-  tempPath[i] = 0;
+  tempPath = CSJSON_PRIVATE_InternalPath(This, szPath);
 
   if (CS_SUCCEED(CSMAP_Lookup(This->Object,
                              tempPath,
@@ -2066,21 +2064,8 @@ CSRESULT CSJSON_LookupKey
                                   (void**)(&lplse),
                                   &size))) {
 
-        plse->type = lplse->type;
-        plse->szKey = lplse->szKey;
-        plse->keySize = lplse->keySize;
-
-        if (lplse->type == JSON_TYPE_STRING ||
-            lplse->type == JSON_TYPE_NUMERIC) {
-          plse->szValue = lplse->szValue;
-          plse->valueSize = lplse->valueSize;
-        }
-        else {
-          plse->szValue = 0;
-          plse->valueSize = 0;
-        }
+        CSJSON_PRIVATE_GetEntry(This, plse, lplse);
 
-        free(tempPath);
         return CS_SUCCESS;
       }
       else {
@@ -2089,8 +2074,6 @@ CSRESULT CSJSON_LookupKey
     }
   }
 
-  free(tempPath);
-
   plse->keySize = 0;
   plse->szKey = 0;
   plse->szValue = 0;
@@ -2120,8 +2103,6 @@ CSRESULT
      CSJSON_LSENTRY* plse) {
 
   long size;
-  long len;
-  long i;
 
   char* tempPath;
 
@@ -2139,24 +2120,9 @@ CSRESULT
     return CS_FAILURE;
   }
 
-  ///////////////////////////////////////////////////////////////////
-  // Convert submitted path to internal representation. The
-  // internal path separator is the ESC character. 
-  ///////////////////////////////////////////////////////////////////
+  // Convert submitted path to internal representation
 
-  len = strlen(szPath); 
-  tempPath = (char*)malloc(len * sizeof(char) + 1);
-  i=0;
-  while (szPath[i] != 0) {
-    if (szPath[i] == szPath[0]) {
-      tempPath[i] = JSON_PATH_SEP;
-    }
-    else {
-      tempPath[i] = szPath[i];
-    }
-    i++;
-  }
-  tempPath[i] = 0;
+  tempPath = CSJSON_PRIVATE_InternalPath(This, szPath);
 
   if (CS_SUCCEED(CSMAP_Lookup(This->Object,
                              tempPath,
@@ -2169,21 +2135,8 @@ CSRESULT
                                   (void**)(&lplse),
                                   index))) {
 
-          plse->type = lplse->type;
-          plse->szKey = lplse->szKey;
-          plse->keySize = lplse->keySize;
+        CSJSON_PRIVATE_GetEntry(This, plse, lplse);
 
-        if (lplse->type == JSON_TYPE_STRING ||
-            lplse->type == JSON_TYPE_NUMERIC) {
-          plse->szValue = lplse->szValue;
-          plse->valueSize = lplse->valueSize;
-        }
-        else {
-          plse->szValue = 0;
-          plse->valueSize = 0;
-        }
-  
-        free(tempPath);
         return CS_SUCCESS;     
       }
       else {
@@ -2198,8 +2151,6 @@ CSRESULT
   plse->type = JSON_TYPE_UNKNOWN;
   plse->valueSize = 0;
 
-  free(tempPath);
-
   return CS_FAILURE;
 }
 
@@ -2207,1867 +2158,3400 @@ CSRESULT
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 // 
-// CSJSON_Dump
+// CSJSON_LookupInt64
+// CSJSON_LookupDouble
 //
-// Displays the JSON instance structure as a tree (terminals are not shown).
+// Retrieves a numeric value from an object at a specified path as a
+// binary value. The text of a parsed number is converted on the first
+// lookup only. CSJSON_LookupInt64 fails if the number is not an
+// integer or does not fit in 64 bits. The value is 0 on failure.
 //
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 
 CSRESULT
-  CSJSON_Dump
+  CSJSON_LookupInt64
     (CSJSON* This,
-     char sep) {
+     char* szPath,
+     char* szKey,
+     int64_t* pValue) {
 
-  long count;
-  long i, j;
   long size;
-  long tempKeyLen;
-  char* szKey;
-  char* tempKey;
-  
-  CSJSON_DIRENTRY* pdire;
-  CSJSON_LSENTRY* pls;
 
-  CSMAP_IterStart(This->Object, CSMAP_ASCENDING);
+  CSJSON_LSENTRY* lplse;
+  CSJSON_DIRENTRY* lpdire;
 
-  while(CS_SUCCEED(CSMAP_IterNext(This->Object, &szKey,
-                                  (void**)(&pdire), &size)))
-  {
+  if (pValue == 0) {
+    return CS_FAILURE;
+  }
 
-    if (szKey[0] != 0) {
+  if (szPath != 0 && szKey != 0 &&
+      CS_SUCCEED(CSMAP_Lookup(This->Object,
+                              CSJSON_PRIVATE_InternalPath(This, szPath),
+                              (void**)(&lpdire),
+                              &size)) &&
+      (lplse = CSJSON_PRIVATE_KeyEntry(lpdire, szKey)) != 0) {
 
-      ///////////////////////////////////////////////////////////////////
-      // Convert submitted path to internal representation. The
-      // internal path separator is the ESC character. 
-      ///////////////////////////////////////////////////////////////////
+    return CSJSON_PRIVATE_GetInt64(lplse, pValue);
+  }
 
-      switch (pdire->type) {
-        case JSON_TYPE_STRING:
-          printf("\n%s : STRING", szKey);
-          break;
-        case JSON_TYPE_NUMERIC:
-          printf("\n%s : NUMERIC", szKey);
-          break;
-        case JSON_TYPE_BOOL_FALSE:
-          printf("\n%s : BOOL", szKey);
-          break;
-        case JSON_TYPE_BOOL_TRUE:
-          printf("\n%s : BOOL", szKey);
-          break;
-        case JSON_TYPE_NULL:
-          printf("\n%s : NULL", szKey);
-          break;
-        case JSON_TYPE_ARRAY:
+  *pValue = 0;
 
-          tempKeyLen = strlen(szKey); 
-          tempKey = (char*)malloc(tempKeyLen * sizeof(char) + 1);
-          j=0;
-          while (szKey[j] != 0) {
-            if (szKey[j] == JSON_PATH_SEP) {
-              tempKey[j] = sep;
-            }
-            else {
-              tempKey[j] = szKey[j];
-            }
-            j++;
-          }
-          tempKey[j] = 0;
+  return CS_FAILURE;
+}
 
-          printf("\n%s : <ARRAY>", tempKey);
-          free(tempKey);
+CSRESULT
+  CSJSON_LookupDouble
+    (CSJSON* This,
+     char* szPath,
+     char* szKey,
+     double* pValue) {
 
-          count = CSLIST_Count(pdire->Listing);
+  long size;
 
-          for (i=0; i<count; i++) {
+  CSJSON_LSENTRY* lplse;
+  CSJSON_DIRENTRY* lpdire;
 
-            CSLIST_GetDataRef(pdire->Listing, (void**)(&pls), i);
+  if (pValue == 0) {
+    return CS_FAILURE;
+  }
 
-            switch (pls->type) {
-              case JSON_TYPE_STRING:
-                printf("\n\tSTRING");
-                break;
-              case JSON_TYPE_NUMERIC:
-                printf("\n\tNUMERIC");
-                break;
-              case JSON_TYPE_BOOL_FALSE:
-                printf("\n\tBOOL");
-                break;
-              case JSON_TYPE_BOOL_TRUE:
-                printf("\n\tBOOL");
-                break;
-              case JSON_TYPE_NULL:
-                printf("\n\tNULL");
-                break;
-              case JSON_TYPE_ARRAY:
-                printf("\n\t<ARRAY>");
-                break;
-              case JSON_TYPE_OBJECT:
-                printf("\n\t<OBJECT>");
-                break;
-              default:
-                printf("\n\t<UNKNOWN>");
-                break;
-            }
-          }
+  if (szPath != 0 && szKey != 0 &&
+      CS_SUCCEED(CSMAP_Lookup(This->Object,
+                              CSJSON_PRIVATE_InternalPath(This, szPath),
+                              (void**)(&lpdire),
+                              &size)) &&
+      (lplse = CSJSON_PRIVATE_KeyEntry(lpdire, szKey)) != 0) {
 
-          break;
+    return CSJSON_PRIVATE_GetDouble(lplse, pValue);
+  }
 
-        case JSON_TYPE_OBJECT:
+  *pValue = 0;
 
-          tempKeyLen = strlen(szKey); 
-          tempKey = (char*)malloc(tempKeyLen * sizeof(char) + 1);
-          j=0;
-          while (szKey[j] != 0) {
-            if (szKey[j] == JSON_PATH_SEP) {
-              tempKey[j] = sep;
-            }
-            else {
-              tempKey[j] = szKey[j];
-            }
-            j++;
-          }
-          tempKey[j] = 0;
+  return CS_FAILURE;
+}
 
-          printf("\n%s : <OBJECT>", tempKey);
-          free(tempKey);
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_CompilePath
+//
+// Converts a path to its internal representation once so that it can be
+// used in any number of lookups, on any instance. The handle also
+// remembers the directory it last resolved to: further lookups in the
+// same instance do not search for the path again until the instance
+// directories change (parse, init or mkdir).
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-          CSMAP_IterStart(pdire->Listing, CSMAP_ASCENDING);
+CSJSONPATH*
+  CSJSON_CompilePath
+    (char* szPath) {
 
-          while (CS_SUCCEED(CSMAP_IterNext(pdire->Listing, &szKey,
-                                           (void**)(&pls), &size))) {
+  CSJSONPATH* Instance;
 
-            switch (pls->type) {
+  long len;
+  long i;
 
-              case JSON_TYPE_STRING:
-                printf("\n\t%s : STRING", pls->szKey);
-                break;
-              case JSON_TYPE_NUMERIC:
-                printf("\n\t%s : NUMERIC", pls->szKey);
-                break;
-              case JSON_TYPE_BOOL_FALSE:
-                printf("\n\t%s : BOOL", pls->szKey);
-                break;
-              case JSON_TYPE_BOOL_TRUE:
-                printf("\n\t%s : BOOL", pls->szKey);
-                break;
-              case JSON_TYPE_NULL:
-                printf("\n\t%s : NULL", pls->szKey);
-                break;
-              case JSON_TYPE_ARRAY:
-                printf("\n\t%s : <ARRAY>", pls->szKey);
-                break;
-              case JSON_TYPE_OBJECT:
-                printf("\n\t%s : <OBJECT>", szKey);
-                break;
-              default:
-                printf("\n\t<UNKNOWN>");
-                break;
-            }
-          }
+  if (szPath == 0 || szPath[0] == 0) {
+    return 0;
+  }
 
-          break;
-        default:
-          printf("<UNKNOWN>");
-          break;
-      }
+  len = strlen(szPath);
+
+  Instance = (CSJSONPATH*)malloc(sizeof(CSJSONPATH));
+
+  Instance->pathSize = len + 1;
+  Instance->szPath = (char*)malloc(Instance->pathSize * sizeof(char));
+
+  ///////////////////////////////////////////////////////////////////
+  // Convert submitted path to internal representation. The
+  // internal path separator is the ESC character. 
+  ///////////////////////////////////////////////////////////////////
+
+  for (i=0; i<len; i++) {
+    if (szPath[i] == szPath[0]) {
+      Instance->szPath[i] = JSON_PATH_SEP;
+    }
+    else {
+      Instance->szPath[i] = szPath[i];
     }
   }
 
-  return CS_SUCCESS;
+  Instance->szPath[len] = 0;
+  Instance->length = len;
+
+  Instance->pdire = 0;
+  Instance->generation = 0;
+
+  return Instance;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 // 
-// CSJSON_Init
+// CSJSON_CompileChildPath
 //
-// Creates an empty JSON instance (either an object or an array).
+// Compiles the path of the object or array found under key in the
+// directory of a compiled path (array elements are keyed by their index).
 //
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 
-CSRESULT
-  CSJSON_Init
-    (CSJSON* This,
-     long type) {
+CSJSONPATH*
+  CSJSON_CompileChildPath
+    (CSJSONPATH* pParent,
+     char* szKey) {
 
-  CSRESULT Rc;
+  CSJSONPATH* Instance;
 
-  CSJSON_DIRENTRY dire;
-  CSJSON_DIRENTRY* pdire;
-  CSJSON_LSENTRY* plse;
+  long keySize;
+  long len;
 
-  char* pszKey;
+  if (pParent == 0 || szKey == 0) {
+    return 0;
+  }
 
-  char szRoot[2];
+  keySize = strlen(szKey);
 
-  long valueSize;
-  long count;
-  long i;
-  long size;
+  Instance = (CSJSONPATH*)malloc(sizeof(CSJSONPATH));
 
-  Rc = CS_SUCCESS;
+  Instance->pathSize = pParent->length + keySize + 2;
+  Instance->szPath = (char*)malloc(Instance->pathSize * sizeof(char));
 
-  This->nextSlabSize = 2;
+  memcpy(Instance->szPath, pParent->szPath, pParent->length);
+  len = pParent->length;
 
-  // Cleanup the previous object
+  // Same rules as when the directories are created: an empty key
+  // always adds a separator.
 
-  CSMAP_IterStart(This->Object, CSMAP_ASCENDING);
+  if (keySize == 0 || Instance->szPath[len-1] != JSON_PATH_SEP) {
+    Instance->szPath[len++] = JSON_PATH_SEP;
+  }
 
-  while (CS_SUCCEED(CSMAP_IterNext(This->Object, &pszKey,
-                                    (void **)(&pdire), &valueSize)))
-  {
-    if (pdire->Listing != 0)
-    {
-      if (pdire->type == JSON_TYPE_ARRAY) {
+  memcpy(Instance->szPath + len, szKey, keySize);
+  len += keySize;
 
-        count = CSLIST_Count(pdire->Listing);
+  Instance->szPath[len] = 0;
+  Instance->length = len;
 
-        for (i=0; i<count; i++) {
-          CSLIST_GetDataRef(pdire->Listing, (void**)(&plse), i);
-            free(plse->szKey);
-            free(plse->szValue);
-        }
+  Instance->pdire = 0;
+  Instance->generation = 0;
 
-        CSLIST_Destructor(&(pdire->Listing));
-      }
-      else {
+  return Instance;
+}
 
-        CSMAP_IterStart(pdire->Listing, CSMAP_ASCENDING);
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_FreePath
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-        while(CS_SUCCEED(CSMAP_IterNext(pdire->Listing, &pszKey,
-                                        (void**)(&plse), &size))) {
-          free(plse->szKey);
-          free(plse->szValue);
-        }
+CSRESULT
+  CSJSON_FreePath
+    (CSJSONPATH** This) {
 
-        CSMAP_Destructor(&(pdire->Listing));
-      }
-    }
+  if (This == 0 || *This == 0) {
+    return CS_FAILURE;
   }
 
-  CSMAP_Clear(This->Object);
-
-  szRoot[0] = JSON_PATH_SEP;
-  szRoot[1] = 0;
-
-  dire.type = type;
-  dire.numItems  = 0;
+  free((*This)->szPath);
+  free(*This);
 
-  switch(type) {
+  *This = 0;
 
-    case JSON_TYPE_ARRAY:
+  return CS_SUCCESS;
+}
 
-      dire.Listing = CSLIST_Constructor();
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_LookupPathDir
+//
+// Same as CSJSON_LookupDir, from a compiled path.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-      CSMAP_Insert(This->Object, szRoot,
-                        (void*)(&dire), sizeof(CSJSON_DIRENTRY));
+CSRESULT
+  CSJSON_LookupPathDir
+    (CSJSON* This,
+     CSJSONPATH* pPath,
+     CSJSON_DIRENTRY* pdire) {
 
-      break;
+  CSJSON_DIRENTRY* lpdire;
 
-    case JSON_TYPE_OBJECT:
+  // The caller's directory entry has no listing
 
-      dire.Listing = CSMAP_Constructor();
+  if (pdire == 0) {
+    return CS_FAILURE;
+  }
 
-        CSMAP_Insert(This->Object, szRoot,
-                    (void*)(&dire), sizeof(CSJSON_DIRENTRY));
-      break;
+  if (pPath == 0 ||
+      (lpdire = CSJSON_PRIVATE_ResolvePath(This, pPath)) == 0) {
 
-    default:
+    pdire->numItems = 0;
+    pdire->type = JSON_TYPE_UNKNOWN;
 
-      Rc = CS_FAILURE;
-      break;
+    return CS_FAILURE;
   }
 
-  return Rc;
+  pdire->numItems = lpdire->numItems;
+  pdire->type = lpdire->type;
+
+  return CS_SUCCESS;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 // 
-// CSJSON_Serialize
+// CSJSON_LookupPathKey
 //
-// Returns the string representation of the JSON instance.
+// Same as CSJSON_LookupKey, from a compiled path: retrieves the value
+// found under key in the object the path resolves to.
 //
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 
-long
-  CSJSON_Serialize
+CSRESULT
+  CSJSON_LookupPathKey
     (CSJSON* This,
-     char* szPath,
-     char** szOutStream,
-     int mode) {
+     CSJSONPATH* pPath,
+     char* szKey,
+     CSJSON_LSENTRY* plse) {
 
-  long curPos;
-  long len;
-  long i;
+  long size;
 
-  char* tempPath;
+  CSJSON_LSENTRY* lplse;
+  CSJSON_DIRENTRY* lpdire;
 
-  if (szPath == 0 || szOutStream == 0) {
+  if (plse == 0) {
     return CS_FAILURE;
   }
 
-  ////////////////////////////////////////////////////////////////////////
-  // Allocate slab if the present one is too small:
-  // note that the slab size may be actually larger than the actual
-  // output stream. This is ok because we will return the actual size
-  // of the output stream and as long as the slab is large enough,
-  // it will be fine.
-  ////////////////////////////////////////////////////////////////////////
-
-  if (This->nextSlabSize > This->slabSize) {
-    This->slabSize = This->nextSlabSize;
-    free(This->szSlab);
-    This->szSlab = (char*)malloc((This->slabSize +1) *sizeof(char));
-  }
-
-  ////////////////////////////////////////////////////////////////////////
-  // We hand over the slab to the caller; it is under agreement
-  // that the caller will not use the slab other than for reading it
-  // and/or copying it. Caller should not write
-  // into the slab nor deallocate it
-  ////////////////////////////////////////////////////////////////////////
-
-  *szOutStream = This->szSlab;
-  curPos = 0;
+  if (pPath != 0 && szKey != 0 &&
+      (lpdire = CSJSON_PRIVATE_ResolvePath(This, pPath)) != 0 &&
+      lpdire->type == JSON_TYPE_OBJECT) {
 
-  ///////////////////////////////////////////////////////////////////
-  // Convert submitted path to internal representation. The
-  // internal path separator is the ESC character. 
-  ///////////////////////////////////////////////////////////////////
+    if (CS_SUCCEED(CSMAP_Lookup(lpdire->Listing,
+                                szKey,
+                                (void**)(&lplse),
+                                &size))) {
 
-  len = strlen(szPath); 
-  tempPath = (char*)malloc(len * sizeof(char) + 1);
-  i=0;
-  while (szPath[i] != 0) {
-    if (szPath[i] == szPath[0]) {
-      tempPath[i] = JSON_PATH_SEP;
-    }
-    else {
-      tempPath[i] = szPath[i];
+      CSJSON_PRIVATE_GetEntry(This, plse, lplse);
+      return CS_SUCCESS;
     }
-    i++;
   }
-  tempPath[i] = 0;
 
-  CSJSON_PRIVATE_Serialize(This, tempPath, szOutStream, &curPos);
-  free(tempPath);
-  (*szOutStream)[curPos] = 0;
+  CSJSON_PRIVATE_GetEntry(This, plse, 0);
 
-  return curPos;
+  return CS_FAILURE;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 // 
-// CSJSON_PRIVATE_Serialize
+// CSJSON_LookupPathIndex
 //
-// REcursively converts the JSON instance into its string representation.
+// Same as CSJSON_LookupIndex, from a compiled path.
 //
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 
-long
-  CSJSON_PRIVATE_Serialize
+CSRESULT
+  CSJSON_LookupPathIndex
     (CSJSON* This,
-     char* szPath,
-     char** szOutStream,
-     long* curPos) {
+     CSJSONPATH* pPath,
+     long index,
+     CSJSON_LSENTRY* plse) {
 
-  long count;
-  long i;
-  long size;
-  long pathLen;
-  long indexLen;
-  long ti, tj; 
+  CSJSON_LSENTRY* lplse;
+  CSJSON_DIRENTRY* lpdire;
 
-  char* szKey;
-  char* szSubPath;
+  if (plse == 0) {
+    return CS_FAILURE;
+  }
 
-  char szIndex[11];
+  if (pPath != 0 &&
+      (lpdire = CSJSON_PRIVATE_ResolvePath(This, pPath)) != 0 &&
+      lpdire->type == JSON_TYPE_ARRAY) {
 
-  CSJSON_DIRENTRY* dire;
-  CSJSON_LSENTRY* pls;
+    if (CS_SUCCEED(CSLIST_GetDataRef(lpdire->Listing,
+                                     (void**)(&lplse),
+                                     index))) {
 
-  if(CS_SUCCEED(CSMAP_Lookup(This->Object, szPath, 
-                             (void**)(&dire), &size))) {
+      CSJSON_PRIVATE_GetEntry(This, plse, lplse);
+      return CS_SUCCESS;
+    }
+  }
 
-    switch (dire->type) {
+  CSJSON_PRIVATE_GetEntry(This, plse, 0);
 
-      case JSON_TYPE_ARRAY:
+  return CS_FAILURE;
+}
 
-        (*szOutStream)[*curPos] = '[';
-        (*curPos)++;
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_LookupPathInt64
+// CSJSON_LookupPathDouble
+//
+// Same as CSJSON_LookupInt64 and CSJSON_LookupDouble, from a compiled
+// path.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-        if (dire->Listing != 0) {
+CSRESULT
+  CSJSON_LookupPathInt64
+    (CSJSON* This,
+     CSJSONPATH* pPath,
+     char* szKey,
+     int64_t* pValue) {
 
-          count = CSLIST_Count(dire->Listing);
+  CSJSON_LSENTRY* lplse;
+  CSJSON_DIRENTRY* lpdire;
 
-          for (i=0; i<count; i++) {
+  if (pValue == 0) {
+    return CS_FAILURE;
+  }
 
-            CSLIST_GetDataRef(dire->Listing, (void**)(&pls), i);
+  if (pPath != 0 && szKey != 0 &&
+      (lpdire = CSJSON_PRIVATE_ResolvePath(This, pPath)) != 0 &&
+      (lplse = CSJSON_PRIVATE_KeyEntry(lpdire, szKey)) != 0) {
 
-            if (pls->type == JSON_TYPE_STRING) {
- 
-              (*szOutStream)[*curPos] = '"';
-              (*curPos)++;
+    return CSJSON_PRIVATE_GetInt64(lplse, pValue);
+  }
 
-              tj = pls->valueSize-1;    
-              for (ti=0; ti<tj; ti++) {
+  *pValue = 0;
 
-                switch(pls->szValue[ti]) {
+  return CS_FAILURE;
+}
 
-                  case '"':
-                    (*szOutStream)[*curPos] = '\\';
-                    (*curPos)++;
-                    (*szOutStream)[*curPos] = '"';
-                    (*curPos)++;
-                    break;
+CSRESULT
+  CSJSON_LookupPathDouble
+    (CSJSON* This,
+     CSJSONPATH* pPath,
+     char* szKey,
+     double* pValue) {
 
-                  case '\b':
-                    (*szOutStream)[*curPos] = '\\';
-                    (*curPos)++;
-                    (*szOutStream)[*curPos] = 'b';
-                    (*curPos)++;
-                    break;
+  CSJSON_LSENTRY* lplse;
+  CSJSON_DIRENTRY* lpdire;
 
-                  case '\f':
-                    (*szOutStream)[*curPos] = '\\';
-                    (*curPos)++;
-                    (*szOutStream)[*curPos] = 'f';
-                    (*curPos)++;
-                    break;
+  if (pValue == 0) {
+    return CS_FAILURE;
+  }
 
-                  case '\n':
-                    (*szOutStream)[*curPos] = '\\';
-                    (*curPos)++;
-                    (*szOutStream)[*curPos] = 'n';
-                    (*curPos)++;
-                    break;
+  if (pPath != 0 && szKey != 0 &&
+      (lpdire = CSJSON_PRIVATE_ResolvePath(This, pPath)) != 0 &&
+      (lplse = CSJSON_PRIVATE_KeyEntry(lpdire, szKey)) != 0) {
 
-                  case '\r':
-                    (*szOutStream)[*curPos] = '\\';
-                    (*curPos)++;
-                    (*szOutStream)[*curPos] = 'r';
-                    (*curPos)++;
-                    break;
+    return CSJSON_PRIVATE_GetDouble(lplse, pValue);
+  }
 
-                  case '\t':
-                    (*szOutStream)[*curPos] = '\\';
-                    (*curPos)++;
-                    (*szOutStream)[*curPos] = 't';
-                    (*curPos)++;
-                    break;
+  *pValue = 0;
 
-                  case '\\':
-                    if (pls->szValue[ti+1] == 'u') {
-                      (*szOutStream)[*curPos] = pls->szValue[ti];
-                      (*curPos)++;
-                    }
-                    else {
-                      (*szOutStream)[*curPos] = '\\';
-                      (*curPos)++;
-                      (*szOutStream)[*curPos] = pls->szValue[ti];
-                      (*curPos)++;
-                    }
-                    break;
+  return CS_FAILURE;
+}
 
-                  default:
-                    (*szOutStream)[*curPos] = pls->szValue[ti];
-                    (*curPos)++;
-                    break;
-                }
-              }
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_PRIVATE_ResolvePath
+//
+// Returns the directory of a compiled path, searching for it only if the
+// path was last resolved in another instance or before the directories
+// of this instance changed.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-              (*szOutStream)[*curPos] = '"';
-              (*curPos)++;
-            }
-            else {
+CSJSON_DIRENTRY*
+  CSJSON_PRIVATE_ResolvePath
+    (CSJSON* This,
+     CSJSONPATH* pPath) {
 
-              switch (pls->type) {
+  long size;
 
-                case JSON_TYPE_NUMERIC:
+  if (pPath->generation == This->generation) {
+    return pPath->pdire;
+  }
 
-                  memcpy(&(*szOutStream)[*curPos],
-                         pls->szValue, pls->valueSize-1);
-                  (*curPos) += (pls->valueSize-1);
-                  break;
+  if (CS_FAIL(CSMAP_Lookup(This->Object,
+                           pPath->szPath,
+                           (void**)(&(pPath->pdire)),
+                           &size))) {
+    pPath->pdire = 0;
+  }
 
-                case JSON_TYPE_BOOL_FALSE:
+  pPath->generation = This->generation;
 
-                  memcpy(&(*szOutStream)[*curPos], "false", 5);
-                  (*curPos) += 5;
-                  break;
+  return pPath->pdire;
+}
 
-                case JSON_TYPE_BOOL_TRUE:
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_PRIVATE_GetEntry
+//
+// Copies a listing entry to the caller; clears the caller entry if the
+// listing entry is 0. Only strings and numbers have values; the text of
+// a number inserted as int64 or double is formatted on the first lookup.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-                  memcpy(&(*szOutStream)[*curPos], "true", 4);
-                  (*curPos) += 4;
-                  break;
+void
+  CSJSON_PRIVATE_GetEntry
+    (CSJSON* This,
+     CSJSON_LSENTRY* plse,
+     CSJSON_LSENTRY* lplse) {
 
-                case JSON_TYPE_NULL:
+  if (lplse == 0) {
+    plse->keySize = 0;
+    plse->szKey = 0;
+    plse->szValue = 0;
+    plse->type = JSON_TYPE_UNKNOWN;
+    plse->valueSize = 0;
+    return;
+  }
 
-                  memcpy(&(*szOutStream)[*curPos], "null", 4);
-                  (*curPos) += 4;
-                  break;
+  plse->type = lplse->type;
+  plse->szKey = lplse->szKey;
+  plse->keySize = lplse->keySize;
 
-                case JSON_TYPE_ARRAY:
+  if (lplse->type == JSON_TYPE_NUMERIC && lplse->szValue == 0) {
+    CSJSON_PRIVATE_NumberText(This, lplse);
+  }
 
-                  sprintf(szIndex, "%ld", i);
-                  pathLen = strlen(szPath);
-                  indexLen = strlen(szIndex);
-                  szSubPath =
-                     (char*)malloc((pathLen + indexLen + 3) * sizeof(char));
-
-                  memcpy(szSubPath, szPath, pathLen);
-
-                  if (pathLen > 1) { // we are not root path
-                    if (szPath[pathLen-1] == JSON_PATH_SEP) {
-                      memcpy(&szSubPath[pathLen], szIndex, indexLen);
-                      szSubPath[pathLen + indexLen] = 0;
-                    }
-                    else {
-                      szSubPath[pathLen] = JSON_PATH_SEP;
-                      memcpy(&szSubPath[pathLen+1], szIndex, indexLen);
-                      szSubPath[pathLen + 1 + indexLen] = 0;
-                    }
-                  }
-                  else {
-                    memcpy(&szSubPath[pathLen], szIndex, indexLen);
-                    szSubPath[pathLen + indexLen] = 0;
-                  }
+  if (lplse->type == JSON_TYPE_STRING ||
+      lplse->type == JSON_TYPE_NUMERIC) {
+    plse->szValue = lplse->szValue;
+    plse->valueSize = lplse->valueSize;
+  }
+  else {
+    plse->szValue = 0;
+    plse->valueSize = 0;
+  }
+}
 
-                  CSJSON_PRIVATE_Serialize
-                                   (This, szSubPath, szOutStream, curPos);
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_PRIVATE_KeyEntry
+//
+// Returns the listing entry of a key in an object directory, 0 if the
+// directory is not an object or does not have the key.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-                  free(szSubPath);
+CSJSON_LSENTRY*
+  CSJSON_PRIVATE_KeyEntry
+    (CSJSON_DIRENTRY* pdire,
+     char* szKey) {
 
-                  break;
+  long size;
 
-                case JSON_TYPE_OBJECT:
+  CSJSON_LSENTRY* plse;
 
-                  sprintf(szIndex, "%ld", i);
-                  pathLen = strlen(szPath);
-                  indexLen = strlen(szIndex);
-                  szSubPath =
-                    (char*)malloc((pathLen + indexLen + 3) * sizeof(char));
-
-                  memcpy(szSubPath, szPath, pathLen);
-
-                  if (pathLen > 1) { // we are not root path
-
-                    if (szPath[pathLen-1] == JSON_PATH_SEP) {
-                      memcpy(&szSubPath[pathLen], szIndex, indexLen);
-                      szSubPath[pathLen + indexLen] = 0;
-                    }
-                    else {
-                      szSubPath[pathLen] = JSON_PATH_SEP;
-                      memcpy(&szSubPath[pathLen+1], szIndex, indexLen);
-                      szSubPath[pathLen + 1 + indexLen] = 0;
-                    }
-                  }
-                  else {
-                    memcpy(&szSubPath[pathLen], szIndex, indexLen);
-                    szSubPath[pathLen + indexLen] = 0;
-                  }
+  if (pdire->type != JSON_TYPE_OBJECT ||
+      CS_FAIL(CSMAP_Lookup(pdire->Listing,
+                           szKey,
+                           (void**)(&plse),
+                           &size))) {
+    return 0;
+  }
 
-                  CSJSON_PRIVATE_Serialize
-                                   (This, szSubPath, szOutStream, curPos);
+  return plse;
+}
 
-                  free(szSubPath);
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_PRIVATE_NumberText
+//
+// Formats the text of a number inserted as int64 or double; the text is
+// kept in the entry until the entry is released.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-                  break;
+void
+  CSJSON_PRIVATE_NumberText
+    (CSJSON* This,
+     CSJSON_LSENTRY* plse) {
 
-                default:
+  char szNumber[JSON_NUMBER_SIZE];
 
-                  break;
-              }
-            }
+  long size;
 
-            (*szOutStream)[*curPos] = ',';
-            (*curPos)++;
-          }
+  size = CSJSON_PRIVATE_FormatNumber(szNumber, plse);
 
-          // to erase dangling comma after last element, if there are some
-          if (count > 0) {
-            (*curPos)--;
-          }
-        }
+  plse->szValue = (char*)CSJSON_PRIVATE_Malloc(This, (size+1) * sizeof(char));
+  memcpy(plse->szValue, szNumber, size);
+  plse->szValue[size] = 0;
+  plse->valueSize = size+1;
+}
 
-        (*szOutStream)[*curPos] = ']';
-        (*curPos)++;
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_PRIVATE_GetInt64
+// CSJSON_PRIVATE_GetDouble
+//
+// Returns the binary value of a number. A number that only has its text
+// is converted once and the result kept in the entry: integers that
+// fit in 64 bits are kept as such, other numbers as doubles.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-        break;
+CSRESULT
+  CSJSON_PRIVATE_GetInt64
+    (CSJSON_LSENTRY* plse,
+     int64_t* pValue) {
 
-      case JSON_TYPE_OBJECT:
+  double value;
 
-        (*szOutStream)[*curPos] = '{';
-        (*curPos)++;
+  if (plse->type != JSON_TYPE_NUMERIC) {
+    *pValue = 0;
+    return CS_FAILURE;
+  }
 
-        CSMAP_IterStart(dire->Listing, CSMAP_ASCENDING);
-        count = 0;
+  if (plse->numType == JSON_NUMBER_TEXT) {
+    if (CS_SUCCEED(CSJSON_PRIVATE_ParseInt64(plse->szValue,
+                                             &(plse->number.intValue)))) {
+      plse->numType = JSON_NUMBER_INT64;
+    }
+    else {
+      plse->number.doubleValue = strtod(plse->szValue, 0);
+      plse->numType = JSON_NUMBER_DOUBLE;
+    }
+  }
 
-        while(CS_SUCCEED(CSMAP_IterNext(dire->Listing, &szKey,
-                                        (void**)(&pls), &size))) {
+  if (plse->numType == JSON_NUMBER_INT64) {
+    *pValue = plse->number.intValue;
+    return CS_SUCCESS;
+  }
 
-          count++;
+  // A double is returned if it is an integer within range; the bounds
+  // (-2^63 and 2^63) are excluded since larger integers round to them.
 
-          // Copy key with escape sequences
+  value = plse->number.doubleValue;
 
-          (*szOutStream)[*curPos] = '"';
-          (*curPos)++;
+  if (value > -9223372036854775808.0 && value < 9223372036854775808.0 &&
+      value == (double)(int64_t)value) {
+    *pValue = (int64_t)value;
+    return CS_SUCCESS;
+  }
 
-          tj = pls->keySize-1;    
-          for (ti=0; ti<tj; ti++) {
+  *pValue = 0;
 
-            switch(pls->szKey[ti]) {
+  return CS_FAILURE;
+}
 
-              case '"':
-                (*szOutStream)[*curPos] = '\\';
-                (*curPos)++;
-                (*szOutStream)[*curPos] = '"';
-                (*curPos)++;
-                break;
+CSRESULT
+  CSJSON_PRIVATE_GetDouble
+    (CSJSON_LSENTRY* plse,
+     double* pValue) {
 
-              case '\b':
-                (*szOutStream)[*curPos] = '\\';
-                (*curPos)++;
-                (*szOutStream)[*curPos] = 'b';
-                (*curPos)++;
-                break;
+  int64_t intValue;
 
-              case '\f':
-                (*szOutStream)[*curPos] = '\\';
-                (*curPos)++;
-                (*szOutStream)[*curPos] = 'f';
-                (*curPos)++;
-                break;
+  if (CS_SUCCEED(CSJSON_PRIVATE_GetInt64(plse, &intValue)) &&
+      plse->numType == JSON_NUMBER_INT64) {
+    *pValue = (double)intValue;
+    return CS_SUCCESS;
+  }
 
-              case '\n':
-                (*szOutStream)[*curPos] = '\\';
-                (*curPos)++;
-                (*szOutStream)[*curPos] = 'n';
-                (*curPos)++;
-                break;
+  if (plse->type != JSON_TYPE_NUMERIC) {
+    *pValue = 0;
+    return CS_FAILURE;
+  }
 
-              case '\r':
-                (*szOutStream)[*curPos] = '\\';
-                (*curPos)++;
-                (*szOutStream)[*curPos] = 'r';
-                (*curPos)++;
-                break;
+  *pValue = plse->number.doubleValue;
 
-              case '\t':
-                (*szOutStream)[*curPos] = '\\';
-                (*curPos)++;
-                (*szOutStream)[*curPos] = 't';
-                (*curPos)++;
-                break;
+  return CS_SUCCESS;
+}
 
-              case '\\':
-                if (pls->szKey[ti+1] == 'u') {
-                  (*szOutStream)[*curPos] = pls->szKey[ti];
-                  (*curPos)++;
-                }
-                else {
-                  (*szOutStream)[*curPos] = '\\';
-                  (*curPos)++;
-                  (*szOutStream)[*curPos] = pls->szKey[ti];
-                  (*curPos)++;
-                }
-                break;
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_PRIVATE_ParseInt64
+//
+// Converts the text of a (valid) number if it is an integer that fits
+// in 64 bits; fails otherwise.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-              default:
-                (*szOutStream)[*curPos] = pls->szKey[ti];
-                (*curPos)++;
-                break;
-            }
-          }
+CSRESULT
+  CSJSON_PRIVATE_ParseInt64
+    (char* szNumber,
+     int64_t* pValue) {
 
-          (*szOutStream)[*curPos] = '"';
-          (*curPos)++;
-          (*szOutStream)[*curPos] = ':';
-          (*curPos)++;
+  uint64_t value;
+  uint64_t limit;
 
-          if (pls->type == JSON_TYPE_STRING) {
+  int digit;
+  int negative;
 
-            (*szOutStream)[*curPos] = '"';
-            (*curPos)++;
+  negative = 0;
 
-            // Copy string value with escape sequences
+  if (*szNumber == '-') {
+    negative = 1;
+    szNumber++;
+  }
 
-            tj = pls->valueSize-1;    
-            for (ti=0; ti<tj; ti++) {
+  if (*szNumber < '0' || *szNumber > '9') {
+    return CS_FAILURE;
+  }
 
-              switch(pls->szValue[ti]) {
+  limit = negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+  value = 0;
 
-                case '"':
-                  (*szOutStream)[*curPos] = '\\';
-                  (*curPos)++;
-                  (*szOutStream)[*curPos] = '"';
-                  (*curPos)++;
-                  break;
+  do {
 
-                case '\b':
-                  (*szOutStream)[*curPos] = '\\';
-                  (*curPos)++;
-                  (*szOutStream)[*curPos] = 'b';
-                  (*curPos)++;
-                  break;
+    digit = *szNumber - '0';
 
-                case '\f':
-                  (*szOutStream)[*curPos] = '\\';
-                  (*curPos)++;
-                  (*szOutStream)[*curPos] = 'f';
-                  (*curPos)++;
-                  break;
+    if (value > (limit - digit) / 10) {
+      return CS_FAILURE;
+    }
 
-                case '\n':
-                  (*szOutStream)[*curPos] = '\\';
-                  (*curPos)++;
-                  (*szOutStream)[*curPos] = 'n';
-                  (*curPos)++;
-                  break;
+    value = value * 10 + digit;
+    szNumber++;
 
-                case '\r':
-                  (*szOutStream)[*curPos] = '\\';
-                  (*curPos)++;
-                  (*szOutStream)[*curPos] = 'r';
-                  (*curPos)++;
-                  break;
+  } while (*szNumber >= '0' && *szNumber <= '9');
 
-                case '\t':
-                  (*szOutStream)[*curPos] = '\\';
-                  (*curPos)++;
-                  (*szOutStream)[*curPos] = 't';
-                  (*curPos)++;
-                  break;
-                case '\\':
-                  if (pls->szValue[ti+1] == 'u') {
-                    (*szOutStream)[*curPos] = pls->szValue[ti];
-                    (*curPos)++;
-                  }
-                  else {
-                    (*szOutStream)[*curPos] = '\\';
-                    (*curPos)++;
-                    (*szOutStream)[*curPos] = pls->szValue[ti];
-                    (*curPos)++;
-                  }
-                  break;
+  // Fractions and exponents are left to strtod
 
-                default:
-                  (*szOutStream)[*curPos] = pls->szValue[ti];
-                  (*curPos)++;
-                  break;
-              }
-            }
+  if (*szNumber != 0) {
+    return CS_FAILURE;
+  }
 
-            (*szOutStream)[*curPos] = '"';
-            (*curPos)++;
-          }
-          else {
+  *pValue = negative ? (int64_t)(0 - value) : (int64_t)value;
 
-            switch (pls->type) {
+  return CS_SUCCESS;
+}
 
-              case JSON_TYPE_NUMERIC:
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_PRIVATE_FormatNumber
+// CSJSON_PRIVATE_FormatInt64
+// CSJSON_PRIVATE_FormatDouble
+//
+// Write the text of a binary number (at most JSON_NUMBER_SIZE characters,
+// not NULL terminated) and return its size.
+//
+// Integers are formatted two digits at a time. Doubles that hold an
+// integer (up to 2^53) are formatted as integers; other doubles use the
+// shortest of 15 or 17 significant digits that converts back to the
+// same value.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-                memcpy(&(*szOutStream)[*curPos], pls->szValue, pls->valueSize-1);
-                (*curPos) += (pls->valueSize-1);
+long
+  CSJSON_PRIVATE_FormatNumber
+    (char* szOut,
+     CSJSON_LSENTRY* plse) {
 
-                break;
-              case JSON_TYPE_BOOL_FALSE:
+  switch(plse->numType) {
 
-                memcpy(&(*szOutStream)[*curPos], "false", 5);
-                (*curPos) += 5;
+    case JSON_NUMBER_INT64:
+      return CSJSON_PRIVATE_FormatInt64(szOut, plse->number.intValue);
 
-                break;
-              case JSON_TYPE_BOOL_TRUE:
+    case JSON_NUMBER_DOUBLE:
+      return CSJSON_PRIVATE_FormatDouble(szOut, plse->number.doubleValue);
+  }
 
-                memcpy(&(*szOutStream)[*curPos], "true", 4);
-                (*curPos) += 4;
-                break;
+  return 0;
+}
 
-              case JSON_TYPE_NULL:
+long
+  CSJSON_PRIVATE_FormatInt64
+    (char* szOut,
+     int64_t value) {
 
-                memcpy(&(*szOutStream)[*curPos], "null", 4);
-                (*curPos) += 4;
-                break;
+  char szDigits[20];
+  char* p;
 
-              case JSON_TYPE_ARRAY:
+  uint64_t u;
+  long i;
+  long size;
 
-                pathLen = strlen(szPath);
-                szSubPath =
-                   (char*)malloc((pathLen + pls->keySize + 3) * sizeof(char));
-
-                if (pathLen > 1) { // we are not root path
-                  if (pls->keySize == 1) { // Key is empty
-                    szSubPath =
-                      (char*)malloc((pathLen + 2) * sizeof(char));
-                    memcpy(szSubPath, szPath, pathLen);
-                    szSubPath[pathLen] = JSON_PATH_SEP;
-                    szSubPath[pathLen+1] = 0;
-                  }
-                  else {
-                    if(szPath[pathLen-1] == JSON_PATH_SEP) {
-                      szSubPath =
-                        (char*)malloc((pathLen + pls->keySize) * sizeof(char));
-                      memcpy(szSubPath, szPath, pathLen);
-                      memcpy(&szSubPath[pathLen], pls->szKey, pls->keySize);
-                    }
-                    else {
-                      szSubPath =
-                        (char*)malloc((pathLen + pls->keySize + 1) * sizeof(char));
-                      memcpy(szSubPath, szPath, pathLen);
-                      szSubPath[pathLen] = JSON_PATH_SEP;
-                      memcpy(&szSubPath[pathLen+1], pls->szKey, pls->keySize);
-                    }
-                  }
-                }
-                else {
-                  // we are at root
-                  if (pls->keySize == 1) { // Key is empty
-                    szSubPath =
-                      (char*)malloc(3 * sizeof(char));
-                    szSubPath[0] = JSON_PATH_SEP;
-                    szSubPath[1] = JSON_PATH_SEP;
-                    szSubPath[2] = 0;
-                  }
-                  else {
-                    szSubPath =
-                      (char*)malloc((pls->keySize + 1) * sizeof(char));
-                    szSubPath[0] = JSON_PATH_SEP;
-                    memcpy(&szSubPath[1], pls->szKey, pls->keySize);
-                  }
-                }
+  u = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+  p = szDigits + sizeof(szDigits);
 
-                // serialize subtree
-                CSJSON_PRIVATE_Serialize
-                       (This, szSubPath, szOutStream, curPos);
+  while (u >= 100) {
+    i = (long)(u % 100) * 2;
+    u /= 100;
+    *--p = g_CSJSON_Digits[i + 1];
+    *--p = g_CSJSON_Digits[i];
+  }
 
-                free(szSubPath);
+  if (u >= 10) {
+    i = (long)u * 2;
+    *--p = g_CSJSON_Digits[i + 1];
+    *--p = g_CSJSON_Digits[i];
+  }
+  else {
+    *--p = (char)('0' + u);
+  }
 
-                break;
+  size = 0;
 
-              case JSON_TYPE_OBJECT:
+  if (value < 0) {
+    szOut[size++] = '-';
+  }
 
-                pathLen = strlen(szPath);
+  memcpy(szOut + size, p, szDigits + sizeof(szDigits) - p);
 
-                if (pathLen > 1) { // we are not root path
-                  if (pls->keySize == 1) { // Key is empty
-                    szSubPath =
-                      (char*)malloc((pathLen + 2) * sizeof(char));
-                    memcpy(szSubPath, szPath, pathLen);
-                    szSubPath[pathLen] = JSON_PATH_SEP;
-                    szSubPath[pathLen+1] = 0;
-                  }
-                  else {
-                    if(szPath[pathLen-1] == JSON_PATH_SEP) {
-                      szSubPath =
-                        (char*)malloc((pathLen + pls->keySize) * sizeof(char));
-                      memcpy(szSubPath, szPath, pathLen);
-                      memcpy(&szSubPath[pathLen], pls->szKey, pls->keySize);
-                    }
-                    else {
-                      szSubPath =
-                        (char*)malloc((pathLen + pls->keySize + 1) * sizeof(char));
-                      memcpy(szSubPath, szPath, pathLen);
-                      szSubPath[pathLen] = JSON_PATH_SEP;
-                      memcpy(&szSubPath[pathLen+1], pls->szKey, pls->keySize);
-                    }
-                  }
-                }
-                else {
-                  // we are at root
-                  if (pls->keySize == 1) { // Key is empty
-                    szSubPath =
-                      (char*)malloc(3 * sizeof(char));
-                    szSubPath[0] = JSON_PATH_SEP;
-                    szSubPath[1] = JSON_PATH_SEP;
-                    szSubPath[2] = 0;
-                  }
-                  else {
-                    szSubPath =
-                      (char*)malloc((pls->keySize + 1) * sizeof(char));
-                    szSubPath[0] = JSON_PATH_SEP;
-                    memcpy(&szSubPath[1], pls->szKey, pls->keySize);
-                  }
-                }
+  return size + (szDigits + sizeof(szDigits) - p);
+}
 
-                // serialize subtree
-                CSJSON_PRIVATE_Serialize
-                     (This, szSubPath, szOutStream, curPos);
+long
+  CSJSON_PRIVATE_FormatDouble
+    (char* szOut,
+     double value) {
 
-                free(szSubPath);
+  char szNumber[JSON_NUMBER_SIZE];
 
-                break;
+  long size;
 
-              default:
-                break;
-            }
-          }
+  if (value >= -9007199254740992.0 && value <= 9007199254740992.0 &&
+      value == (double)(int64_t)value) {
+    return CSJSON_PRIVATE_FormatInt64(szOut, (int64_t)value);
+  }
 
-          (*szOutStream)[*curPos] = ',';
-          (*curPos)++;
-        }
+  size = sprintf(szNumber, "%.15g", value);
 
-        // to erase dangling comma after last element, if there are some
-        if (count > 0) {
-          (*curPos)--;
-        }
+  if (strtod(szNumber, 0) != value) {
+    size = sprintf(szNumber, "%.17g", value);
+  }
 
-        (*szOutStream)[*curPos] = '}';
-        (*curPos)++;
+  memcpy(szOut, szNumber, size);
 
-        break;
+  return size;
+}
 
-      default:
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_PRIVATE_NextGeneration
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-        break;
-    }
-  }
+long
+  CSJSON_PRIVATE_NextGeneration
+    (void) {
 
-  return *curPos;
+  return __atomic_add_fetch(&g_CSJSON_Generation, 1, __ATOMIC_RELAXED);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 // 
-// CSJSON_InsertBool
+// CSJSON_Dump
 //
-// Inserts a boolean value into the JSON instance under a path.
+// Displays the JSON instance structure as a tree (terminals are not shown).
 //
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 
 CSRESULT
-  CSJSON_InsertBool
+  CSJSON_Dump
     (CSJSON* This,
-     char*   szPath,
-     char*   szKey,
-     int     boolValue) {
+     char sep) {
 
-  long keySize;
+  long count;
+  long i, j;
   long size;
-  long len;
-  long i;
+  long tempKeyLen;
+  char* szKey;
+  char* tempKey;
+  
+  CSJSON_DIRENTRY* pdire;
+  CSJSON_LSENTRY* pls;
 
-  char* tempPath;
+  CSMAP_IterStart(This->Object, CSMAP_ASCENDING);
 
-  CSJSON_DIRENTRY* ppve;
-  CSJSON_LSENTRY lse;
-  CSJSON_LSENTRY* plse;
+  while(CS_SUCCEED(CSMAP_IterNext(This->Object, &szKey,
+                                  (void**)(&pdire), &size)))
+  {
+
+    if (szKey[0] != 0) {
+
+      ///////////////////////////////////////////////////////////////////
+      // Convert submitted path to internal representation. The
+      // internal path separator is the ESC character. 
+      ///////////////////////////////////////////////////////////////////
+
+      switch (pdire->type) {
+        case JSON_TYPE_STRING:
+          printf("\n%s : STRING", szKey);
+          break;
+        case JSON_TYPE_NUMERIC:
+          printf("\n%s : NUMERIC", szKey);
+          break;
+        case JSON_TYPE_BOOL_FALSE:
+          printf("\n%s : BOOL", szKey);
+          break;
+        case JSON_TYPE_BOOL_TRUE:
+          printf("\n%s : BOOL", szKey);
+          break;
+        case JSON_TYPE_NULL:
+          printf("\n%s : NULL", szKey);
+          break;
+        case JSON_TYPE_ARRAY:
+
+          tempKeyLen = strlen(szKey); 
+          tempKey = (char*)malloc(tempKeyLen * sizeof(char) + 1);
+          j=0;
+          while (szKey[j] != 0) {
+            if (szKey[j] == JSON_PATH_SEP) {
+              tempKey[j] = sep;
+            }
+            else {
+              tempKey[j] = szKey[j];
+            }
+            j++;
+          }
+          tempKey[j] = 0;
+
+          printf("\n%s : <ARRAY>", tempKey);
+          free(tempKey);
+
+          count = CSLIST_Count(pdire->Listing);
+
+          for (i=0; i<count; i++) {
+
+            CSLIST_GetDataRef(pdire->Listing, (void**)(&pls), i);
+
+            switch (pls->type) {
+              case JSON_TYPE_STRING:
+                printf("\n\tSTRING");
+                break;
+              case JSON_TYPE_NUMERIC:
+                printf("\n\tNUMERIC");
+                break;
+              case JSON_TYPE_BOOL_FALSE:
+                printf("\n\tBOOL");
+                break;
+              case JSON_TYPE_BOOL_TRUE:
+                printf("\n\tBOOL");
+                break;
+              case JSON_TYPE_NULL:
+                printf("\n\tNULL");
+                break;
+              case JSON_TYPE_ARRAY:
+                printf("\n\t<ARRAY>");
+                break;
+              case JSON_TYPE_OBJECT:
+                printf("\n\t<OBJECT>");
+                break;
+              default:
+                printf("\n\t<UNKNOWN>");
+                break;
+            }
+          }
+
+          break;
+
+        case JSON_TYPE_OBJECT:
+
+          tempKeyLen = strlen(szKey); 
+          tempKey = (char*)malloc(tempKeyLen * sizeof(char) + 1);
+          j=0;
+          while (szKey[j] != 0) {
+            if (szKey[j] == JSON_PATH_SEP) {
+              tempKey[j] = sep;
+            }
+            else {
+              tempKey[j] = szKey[j];
+            }
+            j++;
+          }
+          tempKey[j] = 0;
+
+          printf("\n%s : <OBJECT>", tempKey);
+          free(tempKey);
+
+          CSMAP_IterStart(pdire->Listing, CSMAP_ASCENDING);
+
+          while (CS_SUCCEED(CSMAP_IterNext(pdire->Listing, &szKey,
+                                           (void**)(&pls), &size))) {
+
+            switch (pls->type) {
+
+              case JSON_TYPE_STRING:
+                printf("\n\t%s : STRING", pls->szKey);
+                break;
+              case JSON_TYPE_NUMERIC:
+                printf("\n\t%s : NUMERIC", pls->szKey);
+                break;
+              case JSON_TYPE_BOOL_FALSE:
+                printf("\n\t%s : BOOL", pls->szKey);
+                break;
+              case JSON_TYPE_BOOL_TRUE:
+                printf("\n\t%s : BOOL", pls->szKey);
+                break;
+              case JSON_TYPE_NULL:
+                printf("\n\t%s : NULL", pls->szKey);
+                break;
+              case JSON_TYPE_ARRAY:
+                printf("\n\t%s : <ARRAY>", pls->szKey);
+                break;
+              case JSON_TYPE_OBJECT:
+                printf("\n\t%s : <OBJECT>", szKey);
+                break;
+              default:
+                printf("\n\t<UNKNOWN>");
+                break;
+            }
+          }
+
+          break;
+        default:
+          printf("<UNKNOWN>");
+          break;
+      }
+    }
+  }
+
+  return CS_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_Init
+//
+// Creates an empty JSON instance (either an object or an array).
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  CSJSON_Init
+    (CSJSON* This,
+     long type) {
+
+  CSRESULT Rc;
+
+  CSJSON_DIRENTRY dire;
+
+  char szRoot[2];
+
+  Rc = CS_SUCCESS;
+
+  This->nextSlabSize = 2;
+
+  // Cleanup the previous object
+
+  CSJSON_PRIVATE_Clear(This);
+
+  szRoot[0] = JSON_PATH_SEP;
+  szRoot[1] = 0;
+
+  dire.type = type;
+  dire.numItems  = 0;
+
+  switch(type) {
+
+    case JSON_TYPE_ARRAY:
+
+      dire.Listing = CSLIST_ArenaConstructor(This->pArena, 0);
+
+      CSMAP_Insert(This->Object, szRoot,
+                        (void*)(&dire), sizeof(CSJSON_DIRENTRY));
+
+      break;
+
+    case JSON_TYPE_OBJECT:
+
+      dire.Listing = CSMAP_ArenaConstructor(This->pArena);
+
+        CSMAP_Insert(This->Object, szRoot,
+                    (void*)(&dire), sizeof(CSJSON_DIRENTRY));
+      break;
+
+    default:
+
+      Rc = CS_FAILURE;
+      break;
+  }
+
+  return Rc;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_Serialize
+//
+// Returns the string representation of the JSON instance.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+long
+  CSJSON_Serialize
+    (CSJSON* This,
+     char* szPath,
+     char** szOutStream,
+     int mode) {
+
+  long curPos;
+  long len;
+
+  if (szPath == 0 || szOutStream == 0) {
+    return CS_FAILURE;
+  }
+
+  ////////////////////////////////////////////////////////////////////////
+  // Allocate slab if the present one is too small:
+  // note that the slab size may be actually larger than the actual
+  // output stream. This is ok because we will return the actual size
+  // of the output stream and as long as the slab is large enough,
+  // it will be fine.
+  ////////////////////////////////////////////////////////////////////////
+
+  if (This->szSlab == 0 || This->nextSlabSize > This->slabSize) {
+    This->slabSize = This->nextSlabSize > JSON_SERIALIZE_SLAB ?
+                            This->nextSlabSize : JSON_SERIALIZE_SLAB;
+    CSJSON_PRIVATE_BufferFree(This, This->szSlab);
+    This->szSlab =
+      (char*)CSJSON_PRIVATE_BufferMalloc(This,
+                                  (This->slabSize + 1) * sizeof(char));
+  }
+
+  ////////////////////////////////////////////////////////////////////////
+  // We hand over the slab to the caller; it is under agreement
+  // that the caller will not use the slab other than for reading it
+  // and/or copying it. Caller should not write
+  // into the slab nor deallocate it
+  ////////////////////////////////////////////////////////////////////////
+
+  *szOutStream = This->szSlab;
+  curPos = 0;
+
+  // Convert submitted path to internal representation
+
+  len = strlen(szPath);
+  CSJSON_PRIVATE_InternalPath(This, szPath);
+
+  CSJSON_PRIVATE_Serialize(This, len, szOutStream, &curPos);
+  (*szOutStream)[curPos] = 0;
+
+  return curPos;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_PRIVATE_Serialize
+//
+// REcursively converts the JSON instance into its string representation.
+// The path of the subtree is the first pathLen characters of the instance
+// path buffer.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+long
+  CSJSON_PRIVATE_Serialize
+    (CSJSON* This,
+     long pathLen,
+     char** szOutStream,
+     long* curPos) {
+
+  long count;
+  long i;
+  long size;
+  long indexLen;
+
+  char* szKey;
+
+  char szIndex[21];
+
+  CSJSON_DIRENTRY* dire;
+  CSJSON_LSENTRY* pls;
+
+  if(CS_SUCCEED(CSMAP_Lookup(This->Object, This->szPath, 
+                             (void**)(&dire), &size))) {
+
+    switch (dire->type) {
+
+      case JSON_TYPE_ARRAY:
+
+        (*szOutStream)[*curPos] = '[';
+        (*curPos)++;
+
+        if (dire->Listing != 0) {
+
+          count = CSLIST_Count(dire->Listing);
+
+          for (i=0; i<count; i++) {
+
+            CSLIST_GetDataRef(dire->Listing, (void**)(&pls), i);
+
+            if (pls->type == JSON_TYPE_STRING) {
+ 
+              (*szOutStream)[*curPos] = '"';
+              (*curPos)++;
+
+              (*curPos) += CSJSON_PRIVATE_Escape(&(*szOutStream)[*curPos],
+                                                 pls->szValue, pls->valueSize-1);
+
+              (*szOutStream)[*curPos] = '"';
+              (*curPos)++;
+            }
+            else {
+
+              switch (pls->type) {
+
+                case JSON_TYPE_NUMERIC:
+
+                  if (pls->szValue == 0) {
+                    (*curPos) += CSJSON_PRIVATE_FormatNumber
+                                   (&(*szOutStream)[*curPos], pls);
+                    break;
+                  }
+
+                  memcpy(&(*szOutStream)[*curPos],
+                         pls->szValue, pls->valueSize-1);
+                  (*curPos) += (pls->valueSize-1);
+                  break;
+
+                case JSON_TYPE_BOOL_FALSE:
+
+                  memcpy(&(*szOutStream)[*curPos], "false", 5);
+                  (*curPos) += 5;
+                  break;
+
+                case JSON_TYPE_BOOL_TRUE:
+
+                  memcpy(&(*szOutStream)[*curPos], "true", 4);
+                  (*curPos) += 4;
+                  break;
+
+                case JSON_TYPE_NULL:
+
+                  memcpy(&(*szOutStream)[*curPos], "null", 4);
+                  (*curPos) += 4;
+                  break;
+
+                case JSON_TYPE_ARRAY:
+                case JSON_TYPE_OBJECT:
+
+                  // Serialize the subtree; array elements are
+                  // named after their index
+
+                  indexLen = sprintf(szIndex, "%ld", i);
+
+                  CSJSON_PRIVATE_Serialize
+                      (This,
+                       CSJSON_PRIVATE_SubPath(This, pathLen, szIndex, indexLen),
+                       szOutStream, curPos);
+
+                  break;
+
+                default:
+
+                  break;
+              }
+            }
+
+            (*szOutStream)[*curPos] = ',';
+            (*curPos)++;
+          }
+
+          // to erase dangling comma after last element, if there are some
+          if (count > 0) {
+            (*curPos)--;
+          }
+        }
+
+        (*szOutStream)[*curPos] = ']';
+        (*curPos)++;
+
+        break;
+
+      case JSON_TYPE_OBJECT:
+
+        (*szOutStream)[*curPos] = '{';
+        (*curPos)++;
+
+        CSMAP_IterStart(dire->Listing, CSMAP_ASCENDING);
+        count = 0;
+
+        while(CS_SUCCEED(CSMAP_IterNext(dire->Listing, &szKey,
+                                        (void**)(&pls), &size))) {
+
+          count++;
+
+          // Copy key with escape sequences
+
+          (*szOutStream)[*curPos] = '"';
+          (*curPos)++;
+
+          (*curPos) += CSJSON_PRIVATE_Escape(&(*szOutStream)[*curPos],
+                                             pls->szKey, pls->keySize-1);
+
+          (*szOutStream)[*curPos] = '"';
+          (*curPos)++;
+          (*szOutStream)[*curPos] = ':';
+          (*curPos)++;
+
+          if (pls->type == JSON_TYPE_STRING) {
+
+            (*szOutStream)[*curPos] = '"';
+            (*curPos)++;
+
+            // Copy string value with escape sequences
+
+            (*curPos) += CSJSON_PRIVATE_Escape(&(*szOutStream)[*curPos],
+                                               pls->szValue, pls->valueSize-1);
+
+            (*szOutStream)[*curPos] = '"';
+            (*curPos)++;
+          }
+          else {
+
+            switch (pls->type) {
+
+              case JSON_TYPE_NUMERIC:
+
+                if (pls->szValue == 0) {
+                  (*curPos) += CSJSON_PRIVATE_FormatNumber
+                                 (&(*szOutStream)[*curPos], pls);
+                  break;
+                }
+
+                memcpy(&(*szOutStream)[*curPos], pls->szValue, pls->valueSize-1);
+                (*curPos) += (pls->valueSize-1);
+
+                break;
+              case JSON_TYPE_BOOL_FALSE:
+
+                memcpy(&(*szOutStream)[*curPos], "false", 5);
+                (*curPos) += 5;
+
+                break;
+              case JSON_TYPE_BOOL_TRUE:
+
+                memcpy(&(*szOutStream)[*curPos], "true", 4);
+                (*curPos) += 4;
+                break;
+
+              case JSON_TYPE_NULL:
+
+                memcpy(&(*szOutStream)[*curPos], "null", 4);
+                (*curPos) += 4;
+                break;
+
+              case JSON_TYPE_ARRAY:
+              case JSON_TYPE_OBJECT:
+
+                // serialize subtree
+
+                CSJSON_PRIVATE_Serialize
+                    (This,
+                     CSJSON_PRIVATE_SubPath(This, pathLen,
+                                            pls->szKey, pls->keySize-1),
+                     szOutStream, curPos);
+
+                break;
+
+              default:
+                break;
+            }
+          }
+
+          (*szOutStream)[*curPos] = ',';
+          (*curPos)++;
+        }
+
+        // to erase dangling comma after last element, if there are some
+        if (count > 0) {
+          (*curPos)--;
+        }
+
+        (*szOutStream)[*curPos] = '}';
+        (*curPos)++;
+
+        break;
+
+      default:
+
+        break;
+    }
+  }
+
+  return *curPos;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_InsertBool
+//
+// Inserts a boolean value into the JSON instance under a path.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  CSJSON_InsertBool
+    (CSJSON* This,
+     char*   szPath,
+     char*   szKey,
+     int     boolValue) {
+
+  long keySize;
+  long size;
+
+  char* tempPath;
+
+  CSJSON_DIRENTRY* ppve;
+  CSJSON_LSENTRY lse;
+  CSJSON_LSENTRY* plse;
+
+  if (szPath == 0) {
+    return CS_FAILURE;
+  }
+
+  if (boolValue != JSON_TYPE_BOOL_FALSE) {
+    boolValue = JSON_TYPE_BOOL_TRUE;
+  }
+
+  // Convert submitted path to internal representation
+
+  tempPath = CSJSON_PRIVATE_InternalPath(This, szPath);
+
+  if (CS_SUCCEED(CSMAP_Lookup(This->Object,
+                              tempPath,
+                              (void**)(&ppve),
+                              &size)))
+  {
+
+    switch(ppve->type) {
+
+      case JSON_TYPE_ARRAY:
+
+        lse.szKey = 0;
+        lse.keySize = 0;
+        lse.szValue = 0;
+        lse.type = boolValue;
+        lse.valueSize = 0;
+
+        CSLIST_Insert(ppve->Listing, (void*)(&lse),
+                      sizeof(CSJSON_LSENTRY), CSLIST_BOTTOM);
+
+        ppve->numItems++;
+        This->nextSlabSize = This->nextSlabSize + 6;
+
+        break;
+
+      case JSON_TYPE_OBJECT:
+
+        if (szKey == 0) {
+          return CS_FAILURE;
+        } 
+
+        if (CS_SUCCEED(CSMAP_Lookup(ppve->Listing,
+                                    szKey,
+                                    (void**)(&plse),
+                                    &size))) {
+
+          // replace existing key
+
+          switch(plse->type) {
+            case JSON_TYPE_STRING:
+              CSJSON_PRIVATE_Free(This, plse->szValue);
+              This->nextSlabSize = This->nextSlabSize - plse->valueSize -2;
+              break;
+            case JSON_TYPE_NUMERIC:
+              CSJSON_PRIVATE_Free(This, plse->szValue);
+              This->nextSlabSize = This->nextSlabSize - plse->valueSize;
+              break;
+            case JSON_TYPE_BOOL_FALSE:
+              This->nextSlabSize = This->nextSlabSize - 5;
+              break;
+            case JSON_TYPE_BOOL_TRUE:
+              This->nextSlabSize = This->nextSlabSize - 5;
+              break;
+            case JSON_TYPE_NULL:
+              This->nextSlabSize = This->nextSlabSize - 4;
+              break;
+            case JSON_TYPE_ARRAY:
+              // Cannot replace tree with value (yet)
+              return CS_FAILURE;
+            case JSON_TYPE_OBJECT:
+              // Cannot replace tree with value (yet)
+              return CS_FAILURE;
+          }
+
+          plse->valueSize = 0;
+          plse->szValue = 0;
+          plse->type = boolValue;
+          This->nextSlabSize = This->nextSlabSize + 5;
+        }
+        else {
+
+          keySize = strlen(szKey);
+
+          lse.keySize = keySize+1;
+          lse.szKey = (char*)CSJSON_PRIVATE_Malloc(This, lse.keySize * sizeof(char));
+          memcpy(lse.szKey, szKey, lse.keySize);
+          lse.valueSize = 0;
+          lse.szValue = 0;
+          lse.type = boolValue;
+
+          CSMAP_InsertKeyRef(ppve->Listing, lse.szKey,
+                       (void*)(&lse), sizeof(CSJSON_LSENTRY));
+
+          ppve->numItems++;
+
+          // We can potentially expand the string value if there are
+          // characters that must be escaped. To be on the safe side,
+          // we assume the worst case where every character would 
+          // need to be escaped.
+
+          This->nextSlabSize = This->nextSlabSize + (keySize * 2) +  + 9;
+        }
+
+        break;
+
+      default:
+
+        return CS_FAILURE;
+    }
+
+    return CS_SUCCESS;
+  }
+  else {
+  }
+
+  return CS_FAILURE;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_InsertNull
+//
+// Inserts a null value into the JSON instance under a path.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  CSJSON_InsertNull
+    (CSJSON* This,
+     char*   szPath,
+     char*   szKey) {
+
+  CSJSON_DIRENTRY* ppve;
+  CSJSON_LSENTRY lse;
+  CSJSON_LSENTRY* plse;
+
+  long keySize;
+  long size;
+
+  char* tempPath;
+
+  if (szPath == 0) {
+    return CS_FAILURE;
+  }
+
+  // Convert submitted path to internal representation
+
+  tempPath = CSJSON_PRIVATE_InternalPath(This, szPath);
+
+  if (CS_SUCCEED(CSMAP_Lookup(This->Object,
+                              tempPath,
+                              (void**)(&ppve),
+                              &size)))
+  {
+
+    switch(ppve->type) {
+
+      case JSON_TYPE_ARRAY:
+
+        lse.szKey = 0;
+        lse.keySize = 0;
+        lse.szValue = 0;
+        lse.type = JSON_TYPE_NULL;
+        lse.valueSize = 0;
+
+        CSLIST_Insert(ppve->Listing, (void*)(&lse),
+                      sizeof(CSJSON_LSENTRY), CSLIST_BOTTOM);
+
+        ppve->numItems++;
+        This->nextSlabSize = This->nextSlabSize + 5;
+
+        break;
+
+      case JSON_TYPE_OBJECT:
+
+        if (szKey == 0) {
+          return CS_FAILURE;
+        } 
+
+        // Check if key exists
+
+        if (CS_SUCCEED(CSMAP_Lookup(ppve->Listing,
+                                    szKey,
+                                    (void**)(&plse),
+                                    &size))) {
+
+          // replace existing key
+
+          switch(plse->type) {
+            case JSON_TYPE_STRING:
+              CSJSON_PRIVATE_Free(This, plse->szValue);
+              This->nextSlabSize = This->nextSlabSize - plse->valueSize -2;
+              break;
+            case JSON_TYPE_NUMERIC:
+              CSJSON_PRIVATE_Free(This, plse->szValue);
+              This->nextSlabSize = This->nextSlabSize - plse->valueSize;
+              break;
+            case JSON_TYPE_BOOL_FALSE:
+              This->nextSlabSize = This->nextSlabSize - 5;
+              break;
+            case JSON_TYPE_BOOL_TRUE:
+              This->nextSlabSize = This->nextSlabSize - 5;
+              break;
+            case JSON_TYPE_NULL:
+              This->nextSlabSize = This->nextSlabSize - 4;
+              break;
+            case JSON_TYPE_ARRAY:
+              // Cannot replace tree with value (yet)
+              return CS_FAILURE;
+            case JSON_TYPE_OBJECT:
+              // Cannot replace tree with value (yet)
+              return CS_FAILURE;
+          }
+
+          plse->valueSize = 0;
+          plse->szValue = 0;
+          plse->type = JSON_TYPE_NULL;
+          This->nextSlabSize = This->nextSlabSize + 5;
+
+        }
+        else {
+
+          keySize = strlen(szKey);
+
+          lse.keySize = keySize+1;
+          lse.szKey = (char*)CSJSON_PRIVATE_Malloc(This, lse.keySize * sizeof(char));
+          memcpy(lse.szKey, szKey, lse.keySize);
+          lse.valueSize = 0;
+          lse.szValue = 0;
+          lse.type = JSON_TYPE_NULL;
+
+          CSMAP_InsertKeyRef(ppve->Listing, lse.szKey,
+                       (void*)(&lse), sizeof(CSJSON_LSENTRY));
+
+          ppve->numItems++;
+
+          // We can potentially expand the string value if there are
+          // characters that must be escaped. To be on the safe side,
+          // we assume the worst case where every character would 
+          // need to be escaped.
+
+          This->nextSlabSize = This->nextSlabSize + (keySize * 2) + 8;
+        }
+
+        break;
+
+      default:
+
+        return CS_FAILURE;
+    }
+
+    return CS_SUCCESS;
+  }
+  else {
+  }
+
+  return CS_FAILURE;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_InsertNumeric
+//
+// Inserts a numeric value into the JSON instance under a path.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  CSJSON_InsertNumeric
+    (CSJSON* This,
+     char*   szPath,
+     char*   szKey,
+     char*   szValue) {
+
+  CSJSON_LSENTRY number;
+
+  if (CS_FAIL(CSJSON_PRIVATE_IsNumeric(szValue))) {
+    return CS_FAILURE;
+  }
+
+  number.numType = JSON_NUMBER_TEXT;
+  number.szValue = szValue;
+
+  return CSJSON_PRIVATE_InsertNumber(This, szPath, szKey, &number);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_InsertInt64
+// CSJSON_InsertDouble
+//
+// Inserts a numeric value into the JSON instance under a path without
+// converting it to text: the number is formatted when the instance is
+// serialized or when its text is looked up. Infinite and NaN values
+// cannot be represented in JSON and are rejected.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  CSJSON_InsertInt64
+    (CSJSON* This,
+     char*   szPath,
+     char*   szKey,
+     int64_t value) {
+
+  CSJSON_LSENTRY number;
+
+  number.numType = JSON_NUMBER_INT64;
+  number.number.intValue = value;
+  number.szValue = 0;
+
+  return CSJSON_PRIVATE_InsertNumber(This, szPath, szKey, &number);
+}
+
+CSRESULT
+  CSJSON_InsertDouble
+    (CSJSON* This,
+     char*   szPath,
+     char*   szKey,
+     double  value) {
+
+  CSJSON_LSENTRY number;
+
+  if (value != value || value - value != 0) {
+    return CS_FAILURE;
+  }
+
+  number.numType = JSON_NUMBER_DOUBLE;
+  number.number.doubleValue = value;
+  number.szValue = 0;
+
+  return CSJSON_PRIVATE_InsertNumber(This, szPath, szKey, &number);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_PRIVATE_InsertNumber
+//
+// Inserts a number given either as (valid) text or as a binary value;
+// pNumber->szValue is 0 in the latter case.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  CSJSON_PRIVATE_InsertNumber
+    (CSJSON* This,
+     char*   szPath,
+     char*   szKey,
+     CSJSON_LSENTRY* pNumber) {
+
+  CSJSON_DIRENTRY* ppve;
+  CSJSON_LSENTRY lse;
+  CSJSON_LSENTRY* plse;
+
+  long valueSize;
+  long keySize;
+  long size;
+
+  char* tempPath;
+
+  if (szPath == 0) {
+    return CS_FAILURE;
+  }
+
+  // Convert submitted path to internal representation
+
+  tempPath = CSJSON_PRIVATE_InternalPath(This, szPath);
+
+  if (CS_SUCCEED(CSMAP_Lookup(This->Object,
+                              tempPath,
+                              (void**)(&ppve),
+                              &size)))
+  {
+
+    // Serialized size of the value
+
+    valueSize = pNumber->szValue != 0 ?
+                  strlen(pNumber->szValue) : JSON_NUMBER_SIZE;
+
+    lse.type = JSON_TYPE_NUMERIC;
+    lse.numType = pNumber->numType;
+    lse.number = pNumber->number;
+
+    if (pNumber->szValue != 0) {
+      lse.valueSize = valueSize+1;
+      lse.szValue = (char*)CSJSON_PRIVATE_Malloc(This, lse.valueSize * sizeof(char));
+      memcpy(lse.szValue, pNumber->szValue, lse.valueSize);
+    }
+    else {
+      lse.valueSize = 0;
+      lse.szValue = 0;
+    }
+
+    switch(ppve->type) {
+
+      case JSON_TYPE_ARRAY:
+
+        lse.szKey = 0;
+        lse.keySize = 0;
+
+        CSLIST_Insert(ppve->Listing, (void*)(&lse),
+                      sizeof(CSJSON_LSENTRY), CSLIST_BOTTOM);
+
+        ppve->numItems++;
+        This->nextSlabSize = This->nextSlabSize + valueSize + 1;
+
+        break;
+
+      case JSON_TYPE_OBJECT:
+
+        if (szKey == 0) {
+          CSJSON_PRIVATE_Free(This, lse.szValue);
+          return CS_FAILURE;
+        } 
+
+        // Check if key exists
+
+        if (CS_SUCCEED(CSMAP_Lookup(ppve->Listing,
+                                    szKey,
+                                    (void**)(&plse),
+                                    &size))) {
+
+          // replace existing key
+
+          switch(plse->type) {
+            case JSON_TYPE_STRING:
+              CSJSON_PRIVATE_Free(This, plse->szValue);
+              This->nextSlabSize = This->nextSlabSize - plse->valueSize -2;
+              break;
+            case JSON_TYPE_NUMERIC:
+              CSJSON_PRIVATE_Free(This, plse->szValue);
+              This->nextSlabSize = This->nextSlabSize - plse->valueSize;
+              break;
+            case JSON_TYPE_BOOL_FALSE:
+              This->nextSlabSize = This->nextSlabSize - 5;
+              break;
+            case JSON_TYPE_BOOL_TRUE:
+              This->nextSlabSize = This->nextSlabSize - 4;
+              break;
+            case JSON_TYPE_NULL:
+              This->nextSlabSize = This->nextSlabSize - 4;
+              break;
+            case JSON_TYPE_ARRAY:
+              // Cannot replace tree with value (yet)
+              CSJSON_PRIVATE_Free(This, lse.szValue);
+              return CS_FAILURE;
+            case JSON_TYPE_OBJECT:
+              // Cannot replace tree with value (yet)
+              CSJSON_PRIVATE_Free(This, lse.szValue);
+              return CS_FAILURE;
+          }
+
+          lse.szKey = plse->szKey;
+          lse.keySize = plse->keySize;
+          *plse = lse;
+          This->nextSlabSize = This->nextSlabSize + valueSize + 4;
+
+        }
+        else {
+
+          keySize = strlen(szKey);
+
+          lse.keySize = keySize+1;
+          lse.szKey = (char*)CSJSON_PRIVATE_Malloc(This, lse.keySize * sizeof(char));
+          memcpy(lse.szKey, szKey, lse.keySize);
+
+          CSMAP_InsertKeyRef(ppve->Listing, lse.szKey,
+                       (void*)(&lse), sizeof(CSJSON_LSENTRY));
+
+          ppve->numItems++;
+
+          // We can potentially expand the string value if there are
+          // characters that must be escaped. To be on the safe side,
+          // we assume the worst case where every character would 
+          // need to be escaped.
+
+          This->nextSlabSize = This->nextSlabSize + 
+                           (keySize * 2) + valueSize + 4;
+        }
+
+        break;
+
+      default:
+
+        CSJSON_PRIVATE_Free(This, lse.szValue);
+        return CS_FAILURE;
+    }
+
+    return CS_SUCCESS;
+  }
+  else {
+  }
+
+  return CS_FAILURE;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_InsertString
+//
+// Inserts a string value into the JSON instance under a path.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  CSJSON_InsertString
+    (CSJSON* This,
+     char*  szPath,
+     char*  szKey,
+     char*  szValue) {
+
+  CSJSON_DIRENTRY* ppve;
+  CSJSON_LSENTRY lse;
+  CSJSON_LSENTRY* plse;
+
+  long valueSize;
+  long keySize;
+  long size;
+
+  char* tempPath;
+
+  if (szPath == 0 || szValue == 0) {
+    return CS_FAILURE;
+  }
+
+  // Convert submitted path to internal representation
+
+  tempPath = CSJSON_PRIVATE_InternalPath(This, szPath);
+
+  if (CS_SUCCEED(CSMAP_Lookup(This->Object,
+                              tempPath,
+                              (void**)(&ppve),
+                              &size)))
+  {
+
+    valueSize = strlen(szValue);
+
+    switch(ppve->type) {
+
+      case JSON_TYPE_ARRAY:
+
+        lse.szKey = 0;
+        lse.keySize = 0;
+        lse.szValue = (char*)CSJSON_PRIVATE_Malloc(This, (valueSize+1) * sizeof(char));
+        memcpy(lse.szValue, szValue, valueSize+1);
+        lse.type = JSON_TYPE_STRING;
+        lse.valueSize = valueSize+1;
+        CSLIST_Insert(ppve->Listing, (void*)(&lse),
+                      sizeof(CSJSON_LSENTRY), CSLIST_BOTTOM);
+
+        ppve->numItems++;
+
+        // We can potentially expand the string value if there are
+        // characters that must be escaped. To be on the safe side,
+        // we assume the worst case where every character would 
+        // need to be escaped.
+
+        This->nextSlabSize = This->nextSlabSize + (2 * valueSize) + 3;
+
+        break;
+
+      case JSON_TYPE_OBJECT:
+
+        if (szKey == 0) {
+          return CS_FAILURE;
+        } 
+
+        // Check if key exists
+
+        if (CS_SUCCEED(CSMAP_Lookup(ppve->Listing,
+                                    szKey,
+                                    (void**)(&plse),
+                                    &size))) {
+ 
+          switch(plse->type) {
+            case JSON_TYPE_STRING:
+              CSJSON_PRIVATE_Free(This, plse->szValue);
+              This->nextSlabSize = This->nextSlabSize - plse->valueSize -2;
+              break;
+            case JSON_TYPE_NUMERIC:
+              CSJSON_PRIVATE_Free(This, plse->szValue);
+              This->nextSlabSize = This->nextSlabSize - plse->valueSize;
+              break;
+            case JSON_TYPE_BOOL_FALSE:
+              This->nextSlabSize = This->nextSlabSize - 5;
+              break;
+            case JSON_TYPE_BOOL_TRUE:
+              This->nextSlabSize = This->nextSlabSize - 4;
+              break;
+            case JSON_TYPE_NULL:
+              This->nextSlabSize = This->nextSlabSize - 4;
+              break;
+            case JSON_TYPE_ARRAY:
+              // Cannot replace tree with value (yet)
+              return CS_FAILURE;
+            case JSON_TYPE_OBJECT:
+              // Cannot replace tree with value (yet)
+              return CS_FAILURE;
+          }
+
+          plse->valueSize = valueSize+1;
+          plse->szValue = (char*)CSJSON_PRIVATE_Malloc(This, plse->valueSize * sizeof(char));
+          memcpy(plse->szValue, szValue, plse->valueSize);
+          plse->type = JSON_TYPE_STRING;
+
+          // We can potentially expand the string value if there are
+          // characters that must be escaped. To be on the safe side,
+          // we assume the worst case where every character would 
+          // need to be escaped.
+
+          This->nextSlabSize = This->nextSlabSize + (valueSize * 2) + 6;
+
+        }
+        else {
+
+          keySize = strlen(szKey);
+
+          lse.keySize = keySize+1;
+          lse.szKey = (char*)CSJSON_PRIVATE_Malloc(This, lse.keySize * sizeof(char));
+          memcpy(lse.szKey, szKey, lse.keySize);
+          lse.valueSize = valueSize+1;
+          lse.szValue = (char*)CSJSON_PRIVATE_Malloc(This, (lse.valueSize) * sizeof(char));
+          memcpy(lse.szValue, szValue, lse.valueSize);
+          lse.type = JSON_TYPE_STRING;
+
+          CSMAP_InsertKeyRef(ppve->Listing, lse.szKey,
+                       (void*)(&lse), sizeof(CSJSON_LSENTRY));
+
+
+          ppve->numItems++;
+
+          // We can potentially expand the string value if there are
+          // characters that must be escaped. To be on the safe side,
+          // we assume the worst case where every character would 
+          // need to be escaped.
+
+          This->nextSlabSize = This->nextSlabSize + 
+                               (keySize *2 ) + (valueSize * 2) + 6;
+        }
+
+        break;
+
+      default:
+
+        return CS_FAILURE;
+    }
+
+    return CS_SUCCESS;
+  }
+  else {
+  }
+
+  return CS_FAILURE;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_MkDir
+//
+// Creates a directory (path) into the JSON instance under an existing path.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  CSJSON_MkDir
+    (CSJSON* This,
+     char*  szPath,
+     char*  szKey,
+     int    type) {
+
+  CSRESULT Rc;
+  CSJSON_DIRENTRY* ppdire;
+  CSJSON_DIRENTRY dire;
+  CSJSON_LSENTRY lse;
+
+  char* tempPath;
+
+  char szIndex[21];
+
+  long size;
+  long len;
+  long indexLen;
+  long keySize;
+
+  if (type != JSON_TYPE_ARRAY && type != JSON_TYPE_OBJECT) {
+    return CS_FAILURE;
+  }
 
   if (szPath == 0) {
     return CS_FAILURE;
   }
 
-  if (boolValue != JSON_TYPE_BOOL_FALSE) {
-    boolValue = JSON_TYPE_BOOL_TRUE;
-  }
+  // Convert submitted path to internal representation
+
+  len = strlen(szPath);
+  tempPath = CSJSON_PRIVATE_InternalPath(This, szPath);
+
+  if (CS_SUCCEED(CSMAP_Lookup(This->Object,
+                              tempPath,
+                              (void**)(&ppdire),
+                              &size)))
+  {
+    switch (ppdire->type) {
+
+      case JSON_TYPE_ARRAY:
+
+        // Array elements are named after their index
+
+        indexLen = sprintf(szIndex, "%ld", ppdire->numItems);
+        CSJSON_PRIVATE_SubPath(This, len, szIndex, indexLen);
+
+        lse.szKey = 0;
+        lse.szValue = 0;
+        lse.type = type;
+        lse.keySize = 0;
+        lse.valueSize = 0;
+
+        CSLIST_Insert(ppdire->Listing, (void*)(&lse),
+                      sizeof(CSJSON_LSENTRY), CSLIST_BOTTOM);
+
+        ppdire->numItems++;
+
+        dire.type = type;
+        dire.numItems = 0;
+
+        if (type == JSON_TYPE_ARRAY) {
+          dire.Listing = CSLIST_ArenaConstructor(This->pArena, 0);
+        }
+        else {
+          dire.Listing = CSMAP_ArenaConstructor(This->pArena);
+        }
+
+        CSMAP_Insert(This->Object, This->szPath,
+                     (void*)(&dire), sizeof(CSJSON_DIRENTRY));
+
+        // Inserting may have moved the other directories
+
+        This->generation = CSJSON_PRIVATE_NextGeneration();
+
+        This->nextSlabSize += 3; // two braces/brackets and possibly a comma
+
+        Rc = CS_SUCCESS;
+        break;
+
+      case JSON_TYPE_OBJECT:
+
+        if (szKey == 0) {
+          return CS_FAILURE;
+        }
+
+        // Check if key already exists under the path
+        if (CS_SUCCEED(CSMAP_Lookup(ppdire->Listing,
+                                    szKey,
+                                    (void**)(&lse),
+                                    &size))) {
+          return CS_FAILURE;
+        }
+
+        keySize = strlen(szKey);
+
+        CSJSON_PRIVATE_SubPath(This, len, szKey, keySize);
+
+        lse.szKey = (char*)CSJSON_PRIVATE_Malloc(This, (keySize+1) * sizeof(char));
+        memcpy(lse.szKey, szKey, keySize+1);
+        lse.keySize = keySize+1;
+        lse.type = type;
+        lse.valueSize = 0;
+        lse.szValue = 0;
+
+        CSMAP_Insert(ppdire->Listing, lse.szKey,
+                       (void*)(&lse), sizeof(CSJSON_LSENTRY));
+
+        ppdire->numItems++;
+
+        dire.type = type;
+        dire.numItems = 0;
+
+        if (type == JSON_TYPE_ARRAY) {
+          dire.Listing = CSLIST_ArenaConstructor(This->pArena, 0);
+        }
+        else {
+          dire.Listing = CSMAP_ArenaConstructor(This->pArena);
+        }
+
+        CSMAP_Insert(This->Object, This->szPath,
+                      (void*)(&dire), sizeof(CSJSON_DIRENTRY));
+
+        // Inserting may have moved the other directories
+
+        This->generation = CSJSON_PRIVATE_NextGeneration();
+
+        // two braces/brackets and possibly a comma and a colon
+        This->nextSlabSize = This->nextSlabSize + lse.keySize + 6;
+
+        Rc = CS_SUCCESS;
+ 
+        break;
+
+      default:
+        Rc = CS_FAILURE;
+    }
+  }
+  else {
+    Rc = CS_FAILURE;
+  }
+
+  return Rc;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_Rm
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  CSJSON_Rm
+    (CSJSON* This,
+     char*  szPath,
+     char*  szKey,
+     int    type) {
+
+  return CS_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_ParseAt
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  CSJSON_ParseAt
+    (CSJSON* This,
+     char*  szPath,
+     char*  szKey,
+     char* str) {
 
-  ///////////////////////////////////////////////////////////////////
-  // Convert submitted path to internal representation. The
-  // internal path separator is the ESC character. 
-  ///////////////////////////////////////////////////////////////////
+  return CS_SUCCESS;
+}
 
-  len = strlen(szPath); 
-  tempPath = (char*)malloc(len * sizeof(char) + 1);
-  i=0;
-  while (szPath[i] != 0) {
-    if (szPath[i] == szPath[0]) {
-      tempPath[i] = JSON_PATH_SEP;
-    }
-    else {
-      tempPath[i] = szPath[i];
-    }
-    i++;
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_IterStart
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  CSJSON_IterStart
+    (CSJSON* This,
+     char*  szPath, 
+     CSJSON_DIRENTRY* pDire) {
+
+  CSJSON_DIRENTRY* ppve;
+
+  long size;
+
+  char* tempPath;
+
+  if (szPath == NULL || pDire == NULL) {
+    return CS_FAILURE;
   }
-  tempPath[i] = 0;
+
+  // Convert submitted path to internal representation
+
+  tempPath = CSJSON_PRIVATE_InternalPath(This, szPath);
 
   if (CS_SUCCEED(CSMAP_Lookup(This->Object,
                               tempPath,
                               (void**)(&ppve),
                               &size)))
   {
-    free(tempPath);
 
     switch(ppve->type) {
 
       case JSON_TYPE_ARRAY:
+        This->iterIndex = 0;
+        This->iterType = JSON_TYPE_ARRAY;
+        This->pIterListing = ppve->Listing;
+        pDire->Listing = 0;
+        pDire->numItems = ppve->numItems;
+        pDire->type = ppve->type;
+        return CS_SUCCESS;
 
-        lse.szKey = 0;
-        lse.keySize = 0;
-        lse.szValue = 0;
-        lse.type = boolValue;
-        lse.valueSize = 0;
+      case JSON_TYPE_OBJECT:
+        This->iterIndex = 0;
+        This->iterType = JSON_TYPE_OBJECT;
+        This->pIterListing = ppve->Listing;
+        pDire->Listing = 0;
+        pDire->numItems = 0;
+        pDire->type = ppve->type;
+        CSMAP_IterStart((CSMAP*)(This->pIterListing), CSMAP_ASCENDING);
+        return CS_SUCCESS;
 
-        CSLIST_Insert(ppve->Listing, (void*)(&lse),
-                      sizeof(CSJSON_LSENTRY), CSLIST_BOTTOM);
+      default:
+        This->iterIndex = 0;
+        This->iterType = JSON_TYPE_UNKNOWN;
+        This->pIterListing = NULL;
+        pDire->Listing = 0;
+        pDire->numItems = 0;
+        pDire->type = ppve->type;
+        return CS_FAILURE;
+    }
+  }
+  else {
+    This->iterIndex = 0;
+    This->iterType = JSON_TYPE_UNKNOWN;
+    This->pIterListing = NULL;
+    pDire->Listing = 0;
+    pDire->numItems = 0;
+    pDire->type = JSON_TYPE_UNKNOWN;
+  }
 
-        ppve->numItems++;
-        This->nextSlabSize = This->nextSlabSize + 6;
+  return CS_FAILURE;
+}
 
-        break;
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_IterNext
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-      case JSON_TYPE_OBJECT:
+CSRESULT
+  CSJSON_IterNext
+    (CSJSON* This,
+     CSJSON_LSENTRY* plse) {
 
-        if (szKey == 0) {
-          return CS_FAILURE;
-        } 
+  char* szKey;
 
-        if (CS_SUCCEED(CSMAP_Lookup(ppve->Listing,
-                                    szKey,
-                                    (void**)(&plse),
-                                    &size))) {
+  long size;
 
-          // replace existing key
+  CSJSON_LSENTRY* lplse;
 
-          switch(plse->type) {
-            case JSON_TYPE_STRING:
-              free(plse->szValue);
-              This->nextSlabSize = This->nextSlabSize - plse->valueSize -2;
-              break;
-            case JSON_TYPE_NUMERIC:
-              free(plse->szValue);
-              This->nextSlabSize = This->nextSlabSize - plse->valueSize;
-              break;
-            case JSON_TYPE_BOOL_FALSE:
-              This->nextSlabSize = This->nextSlabSize - 5;
-              break;
-            case JSON_TYPE_BOOL_TRUE:
-              This->nextSlabSize = This->nextSlabSize - 5;
-              break;
-            case JSON_TYPE_NULL:
-              This->nextSlabSize = This->nextSlabSize - 4;
-              break;
-            case JSON_TYPE_ARRAY:
-              // Cannot replace tree with value (yet)
-              return CS_FAILURE;
-            case JSON_TYPE_OBJECT:
-              // Cannot replace tree with value (yet)
-              return CS_FAILURE;
-          }
+  if (plse == NULL) {
+    return CS_FAILURE;
+  }  
 
-          plse->valueSize = 0;
-          plse->szValue = 0;
-          plse->type = boolValue;
-          This->nextSlabSize = This->nextSlabSize + 5;
-        }
-        else {
+  if (This->pIterListing == NULL) {
+    return CS_FAILURE;
+  }
 
-          keySize = strlen(szKey);
+  switch(This->iterType) {
 
-          lse.keySize = keySize+1;
-          lse.szKey = (char*)malloc(lse.keySize * sizeof(char));
-          memcpy(lse.szKey, szKey, lse.keySize);
-          lse.valueSize = 0;
-          lse.szValue = 0;
-          lse.type = boolValue;
+    case JSON_TYPE_ARRAY:
 
-          CSMAP_InsertKeyRef(ppve->Listing, lse.szKey,
-                       (void*)(&lse), sizeof(CSJSON_LSENTRY));
+      if (CS_SUCCEED(CSLIST_GetDataRef((CSLIST*)(This->pIterListing),
+                                       (void**)(&lplse),
+                                       This->iterIndex))) {
 
-          ppve->numItems++;
+        (This->iterIndex)++;
+      }
+      else {
+        plse->szValue = 0;
+        plse->type = JSON_TYPE_UNKNOWN;
+        plse->szKey = 0;
+        plse->keySize = 0;
+        return CS_FAILURE;     
+      }   
 
-          // We can potentially expand the string value if there are
-          // characters that must be escaped. To be on the safe side,
-          // we assume the worst case where every character would 
-          // need to be escaped.
+      break;
+
+    case JSON_TYPE_OBJECT:
+      
+      if (CS_FAIL(CSMAP_IterNext((CSMAP*)(This->pIterListing), 
+                                     &szKey,
+                                     (void**)(&lplse), &size))) {
+        plse->szValue = 0;
+        plse->type = JSON_TYPE_UNKNOWN;
+        plse->szKey = 0;
+        plse->keySize = 0;
+        return CS_FAILURE;     
+      }
+
+      break;
+
+    default:
+
+      return CS_FAILURE;
+  }
+
+  CSJSON_PRIVATE_GetEntry(This, plse, lplse);
+
+  return CS_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// 
+// CSJSON_Ls
+//
+// Returns a listing of information structures for all values 
+// under an existing path.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  CSJSON_Ls
+    (CSJSON* This,
+     char* szPath,
+     CSLIST listing) {
+
+  CSJSON_DIRENTRY* pve;
+  CSJSON_LSENTRY* plse;
+
+  char* szKey;
+
+  long size;
+  long count;
+  long i;
+
+  char* tempPath;
+
+  if (szPath == 0) {
+    return CS_FAILURE;
+  }
+
+  CSLIST_Clear(listing);
+
+  // Convert submitted path to internal representation
+
+  tempPath = CSJSON_PRIVATE_InternalPath(This, szPath);
+
+  if(CS_SUCCEED(CSMAP_Lookup(This->Object, tempPath, (void**)(&pve), &size)))  {
+
+    if (pve->type == JSON_TYPE_OBJECT) {
+
+      CSMAP_IterStart(pve->Listing, CSMAP_ASCENDING);
+
+      while(CS_SUCCEED(CSMAP_IterNext(pve->Listing, &szKey,
+                                      (void**)(&plse), &size))) {
 
-          This->nextSlabSize = This->nextSlabSize + (keySize * 2) +  + 9;
+        if (plse->type == JSON_TYPE_NUMERIC && plse->szValue == 0) {
+          CSJSON_PRIVATE_NumberText(This, plse);
         }
 
-        break;
+        // insert address of listing node
+        CSLIST_Insert(listing, (void*)(&plse), sizeof(plse), CSLIST_BOTTOM);
+      }
+    }
+    else {
 
-      default:
+      if (pve->type == JSON_TYPE_ARRAY) {
 
-        return CS_FAILURE;
-    }
+        count = CSLIST_Count(pve->Listing);
 
-    return CS_SUCCESS;
+        for (i=0; i<count; i++) {
+          CSLIST_GetDataRef(pve->Listing, (void**)(&plse), i);
+          if (plse->type == JSON_TYPE_NUMERIC && plse->szValue == 0) {
+            CSJSON_PRIVATE_NumberText(This, plse);
+          }
+          CSLIST_Insert(listing, (void*)(&plse), sizeof(plse), CSLIST_BOTTOM);
+        }
+      }
+      else {
+        return JSON_TYPE_UNKNOWN;
+      }
+    }
   }
   else {
-    free(tempPath);
+    return JSON_TYPE_UNKNOWN;
   }
 
-  return CS_FAILURE;
+  return pve->type;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 // 
-// CSJSON_InsertNull
+// CSJSON_PRIVATE_IsNumeric
 //
-// Inserts a null value into the JSON instance under a path.
+// Validates the format of a numeric value
 //
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 
-CSRESULT
-  CSJSON_InsertNull
-    (CSJSON* This,
-     char*   szPath,
-     char*   szKey) {
-
-  CSJSON_DIRENTRY* ppve;
-  CSJSON_LSENTRY lse;
-  CSJSON_LSENTRY* plse;
+CSRESULT CSJSON_PRIVATE_IsNumeric(char* szNumber) {
 
-  long keySize;
-  long size;
-  long len;
-  long i;
+  long n;
 
-  char* tempPath;
+  int haveDot;
+  int haveExp;
 
-  if (szPath == 0) {
-    return CS_FAILURE;
-  }
+  haveDot = 0;
+  haveExp = 0;
+  n=0;
 
-  ///////////////////////////////////////////////////////////////////
-  // Convert submitted path to internal representation. The
-  // internal path separator is the ESC character. 
-  ///////////////////////////////////////////////////////////////////
+  if ((szNumber[n] >= '0' && szNumber[n] <= '9') ||
+        (szNumber[n] == '-'))
+  {
+    haveDot = 0;
+    haveExp = 0;
 
-  len = strlen(szPath); 
-  tempPath = (char*)malloc(len * sizeof(char) + 1);
-  i=0;
-  while (szPath[i] != 0) {
-    if (szPath[i] == szPath[0]) {
-      tempPath[i] = JSON_PATH_SEP;
-    }
-    else {
-      tempPath[i] = szPath[i];
-    }
-    i++;
-  }
-  tempPath[i] = 0;
+    n++;
+    while (szNumber[n] != 0) {
 
-  if (CS_SUCCEED(CSMAP_Lookup(This->Object,
-                              tempPath,
-                              (void**)(&ppve),
-                              &size)))
-  {
-    free(tempPath);
+      switch (szNumber[n])
+      {
+        case '0':
+        case '1':
+        case '2':
+        case '3':
+        case '4':
+        case '5':
+        case '6':
+        case '7':
+        case '8':
+        case '9':
+          n++;
+          break;
 
-    switch(ppve->type) {
+        case '.':
 
-      case JSON_TYPE_ARRAY:
+          // Only one dot and it must precede the exponent character
 
-        lse.szKey = 0;
-        lse.keySize = 0;
-        lse.szValue = 0;
-        lse.type = JSON_TYPE_NULL;
-        lse.valueSize = 0;
+          if (!haveDot && !haveExp) {
 
-        CSLIST_Insert(ppve->Listing, (void*)(&lse),
-                      sizeof(CSJSON_LSENTRY), CSLIST_BOTTOM);
+            // check that if first digit is zero, then there are no
+            // other digits between the zero and the dot
 
-        ppve->numItems++;
-        This->nextSlabSize = This->nextSlabSize + 5;
+            if (szNumber[0] == '-') {
+              if (szNumber[1] == '0') {
+                if (n != 2) {
+                  //number starts with -0
+                  //but next character is not dot
+                  return CS_FAILURE;
+                }
+                else {
+                  n++;
+                }
+              }
+              else {
+                n++;
+              }
+            }
+            else {
+              if (szNumber[0] == '0') {
+                if (n != 1) {
+                  //number starts with 0 but next character is not dot
+                  return CS_FAILURE;
+                }
+                else {
+                  n++;
+                }
+              }
+              else {
+                n++;
+              }
+            }
 
-        break;
+            haveDot = 1;
+          }
+          else {
+            return CS_FAILURE;
+          }
 
-      case JSON_TYPE_OBJECT:
+          break;
 
-        if (szKey == 0) {
-          return CS_FAILURE;
-        } 
+        case '+':
+        case '-':
 
-        // Check if key exists
+          // This must immediately follow the exponent character
+          if (szNumber[n-1] == 'e' || szNumber[n-1] == 'E') {
+            n++;
+          }
+          else {
+            return CS_FAILURE;
+          }
 
-        if (CS_SUCCEED(CSMAP_Lookup(ppve->Listing,
-                                    szKey,
-                                    (void**)(&plse),
-                                    &size))) {
+          break;
 
-          // replace existing key
+        case 'e':
+        case 'E':
 
-          switch(plse->type) {
-            case JSON_TYPE_STRING:
-              free(plse->szValue);
-              This->nextSlabSize = This->nextSlabSize - plse->valueSize -2;
-              break;
-            case JSON_TYPE_NUMERIC:
-              free(plse->szValue);
-              This->nextSlabSize = This->nextSlabSize - plse->valueSize;
-              break;
-            case JSON_TYPE_BOOL_FALSE:
-              This->nextSlabSize = This->nextSlabSize - 5;
-              break;
-            case JSON_TYPE_BOOL_TRUE:
-              This->nextSlabSize = This->nextSlabSize - 5;
-              break;
-            case JSON_TYPE_NULL:
-              This->nextSlabSize = This->nextSlabSize - 4;
-              break;
-            case JSON_TYPE_ARRAY:
-              // Cannot replace tree with value (yet)
-              return CS_FAILURE;
-            case JSON_TYPE_OBJECT:
-              // Cannot replace tree with value (yet)
+          if (!haveExp) {
+            // This character must be preceded by a digit
+            if (szNumber[n-1] >= '0' && szNumber[n-1] <= '9') {
+              haveExp = 1;
+              n++;
+            }
+            else {
               return CS_FAILURE;
+            }
+          }
+          else {
+            return CS_FAILURE;
           }
 
-          plse->valueSize = 0;
-          plse->szValue = 0;
-          plse->type = JSON_TYPE_NULL;
-          This->nextSlabSize = This->nextSlabSize + 5;
+          break;
+
+        default:
+
+          return CS_FAILURE;
+      }
+    }
+  }
+  else {
+    return CS_FAILURE;
+  } 
+
+  //////////////////////////////////////////////////////////////
+  // Check following cases:
+  // 
+  // 1) last digit is e, E +, - or dot
+  // 2) leading zero not immediately followed by a dot
+  //////////////////////////////////////////////////////////////
+
+  if (szNumber[n-1] == 'e' ||
+      szNumber[n-1] == 'E' ||
+      szNumber[n-1] == '+' ||
+      szNumber[n-1] == '-' ||
+      szNumber[n-1] == '.') {
+    return CS_FAILURE;
+  }
+
+  return CS_SUCCESS;
+}
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+//
+// CSJSON_PRIVATE_Escape
+//
+// Copies size characters of a key or string value with escape sequences,
+// the way CSJSON_Serialize does, and returns the number of characters
+// written. The output must have room for twice the input size.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+long
+  CSJSON_PRIVATE_Escape
+    (char* szOut,
+     char* szIn,
+     long  size) {
+
+  long i;
+  long n;
+
+  for (i=0, n=0; i<size; i++) {
+
+    switch(szIn[i]) {
+
+      case '"':
+        szOut[n++] = '\\';
+        szOut[n++] = '"';
+        break;
+
+      case '\b':
+        szOut[n++] = '\\';
+        szOut[n++] = 'b';
+        break;
+
+      case '\f':
+        szOut[n++] = '\\';
+        szOut[n++] = 'f';
+        break;
+
+      case '\n':
+        szOut[n++] = '\\';
+        szOut[n++] = 'n';
+        break;
+
+      case '\r':
+        szOut[n++] = '\\';
+        szOut[n++] = 'r';
+        break;
+
+      case '\t':
+        szOut[n++] = '\\';
+        szOut[n++] = 't';
+        break;
 
+      case '\\':
+        // A unicode escape sequence is left as is
+        if (szIn[i+1] == 'u') {
+          szOut[n++] = '\\';
         }
         else {
+          szOut[n++] = '\\';
+          szOut[n++] = '\\';
+        }
+        break;
 
-          keySize = strlen(szKey);
+      default:
+        szOut[n++] = szIn[i];
+        break;
+    }
+  }
 
-          lse.keySize = keySize+1;
-          lse.szKey = (char*)malloc(lse.keySize * sizeof(char));
-          memcpy(lse.szKey, szKey, lse.keySize);
-          lse.valueSize = 0;
-          lse.szValue = 0;
-          lse.type = JSON_TYPE_NULL;
+  return n;
+}
 
-          CSMAP_InsertKeyRef(ppve->Listing, lse.szKey,
-                       (void*)(&lse), sizeof(CSJSON_LSENTRY));
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+//
+// CSJSONWRITER_Constructor
+//
+// Creates a forward-only JSON writer. Objects, arrays and values are
+// appended to an output buffer as they are written, without building a
+// document. The output is the same as what CSJSON_Serialize would produce
+// for the same document, provided the members of each object are written
+// in ascending key order (the order in which CSJSON_Serialize lists them)
+// and keys are unique within an object.
+//
+// The output is retrieved with CSJSONWRITER_Serialize or, if an output
+// function is set with CSJSONWRITER_SetOutput, handed to that function
+// whenever the buffer fills up and when CSJSONWRITER_Flush is called.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-          ppve->numItems++;
+CSJSONWRITER*
+  CSJSONWRITER_Constructor
+    (void) {
 
-          // We can potentially expand the string value if there are
-          // characters that must be escaped. To be on the safe side,
-          // we assume the worst case where every character would 
-          // need to be escaped.
+  CSJSONWRITER* Instance;
 
-          This->nextSlabSize = This->nextSlabSize + (keySize * 2) + 8;
-        }
+  Instance = (CSJSONWRITER*)malloc(sizeof(CSJSONWRITER));
 
-        break;
+  Instance->szBuffer =
+    (char*)malloc((JSON_SERIALIZE_SLAB + 1) * sizeof(char));
+  Instance->bufferSize = JSON_SERIALIZE_SLAB;
 
-      default:
+  Instance->pStack = (char*)malloc(JSON_PATH_BUFFER * sizeof(char));
+  Instance->stackSize = JSON_PATH_BUFFER;
 
-        return CS_FAILURE;
-    }
+  Instance->fOutput = NULL;
+  Instance->pOutputData = NULL;
 
-    return CS_SUCCESS;
-  }
-  else {
-    free(tempPath);
-  }
+  CSJSONWRITER_Reset(Instance);
 
-  return CS_FAILURE;
+  return Instance;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
-// 
-// CSJSON_InsertNumeric
 //
-// Inserts a numeric value into the JSON instance under a path.
+// CSJSONWRITER_Destructor
 //
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 
 CSRESULT
-  CSJSON_InsertNumeric
-    (CSJSON* This,
-     char*   szPath,
-     char*   szKey,
-     char*   szValue) {
-
-  CSJSON_DIRENTRY* ppve;
-  CSJSON_LSENTRY lse;
-  CSJSON_LSENTRY* plse;
-
-  long valueSize;
-  long keySize;
-  long size;
-  long len;
-  long i;
-
-  char* tempPath;
+  CSJSONWRITER_Destructor
+    (CSJSONWRITER** This) {
 
-  if (szPath == 0) {
+  if (This == 0 || *This == NULL) {
     return CS_FAILURE;
   }
 
-  ///////////////////////////////////////////////////////////////////
-  // Convert submitted path to internal representation. The
-  // internal path separator is the ESC character. 
-  ///////////////////////////////////////////////////////////////////
+  free((*This)->szBuffer);
+  free((*This)->pStack);
+  free(*This);
 
-  len = strlen(szPath); 
-  tempPath = (char*)malloc(len * sizeof(char) + 1);
-  i=0;
-  while (szPath[i] != 0) {
-    if (szPath[i] == szPath[0]) {
-      tempPath[i] = JSON_PATH_SEP;
-    }
-    else {
-      tempPath[i] = szPath[i];
-    }
-    i++;
-  }
-  tempPath[i] = 0;
+  *This = 0;
 
-  if (CS_FAIL(CSJSON_PRIVATE_IsNumeric(szValue))) {
-    return CS_FAILURE;
-  }
+  return CS_SUCCESS;
+}
 
-  if (CS_SUCCEED(CSMAP_Lookup(This->Object,
-                              tempPath,
-                              (void**)(&ppve),
-                              &size)))
-  {
-    free(tempPath);
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+//
+// CSJSONWRITER_Reset
+//
+// Discards the output written so far so that a new document can be
+// written; the buffer and the output function are kept.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-    valueSize = strlen(szValue);
+CSRESULT
+  CSJSONWRITER_Reset
+    (CSJSONWRITER* This) {
 
-    switch(ppve->type) {
+  This->curPos = 0;
+  This->depth = 0;
+  This->bComma = 0;
+  This->bDone = 0;
+  This->status = CS_SUCCESS;
 
-      case JSON_TYPE_ARRAY:
+  This->szBuffer[0] = 0;
 
-        lse.szKey = 0;
-        lse.keySize = 0;
-        lse.szValue = (char*)malloc((valueSize+1) * sizeof(char));
-        memcpy(lse.szValue, szValue, valueSize+1);
-        lse.type = JSON_TYPE_NUMERIC;
-        lse.valueSize = valueSize+1;
+  return CS_SUCCESS;
+}
 
-        CSLIST_Insert(ppve->Listing, (void*)(&lse),
-                      sizeof(CSJSON_LSENTRY), CSLIST_BOTTOM);
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+//
+// CSJSONWRITER_SetOutput
+//
+// Sets the function that receives the output, for example to write it
+// to a session as it is produced; NULL keeps the output in the writer
+// buffer.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-        ppve->numItems++;
-        This->nextSlabSize = This->nextSlabSize + valueSize + 1;
+CSRESULT
+  CSJSONWRITER_SetOutput
+    (CSJSONWRITER* This,
+     CSJSONWRITER_OUTPUTPROC fOutput,
+     void* pOutputData) {
 
-        break;
+  This->fOutput = fOutput;
+  This->pOutputData = pOutputData;
 
-      case JSON_TYPE_OBJECT:
+  return CS_SUCCESS;
+}
 
-        if (szKey == 0) {
-          return CS_FAILURE;
-        } 
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+//
+// CSJSONWRITER_Flush
+//
+// Hands the buffered output to the output function, if any.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-        // Check if key exists
+CSRESULT
+  CSJSONWRITER_Flush
+    (CSJSONWRITER* This) {
 
-        if (CS_SUCCEED(CSMAP_Lookup(ppve->Listing,
-                                    szKey,
-                                    (void**)(&plse),
-                                    &size))) {
+  if (This->fOutput == NULL || CS_FAIL(This->status)) {
+    return This->status;
+  }
 
-          // replace existing key
+  if (This->curPos > 0) {
 
-          switch(plse->type) {
-            case JSON_TYPE_STRING:
-              free(plse->szValue);
-              This->nextSlabSize = This->nextSlabSize - plse->valueSize -2;
-              break;
-            case JSON_TYPE_NUMERIC:
-              free(plse->szValue);
-              This->nextSlabSize = This->nextSlabSize - plse->valueSize;
-              break;
-            case JSON_TYPE_BOOL_FALSE:
-              This->nextSlabSize = This->nextSlabSize - 5;
-              break;
-            case JSON_TYPE_BOOL_TRUE:
-              This->nextSlabSize = This->nextSlabSize - 4;
-              break;
-            case JSON_TYPE_NULL:
-              This->nextSlabSize = This->nextSlabSize - 4;
-              break;
-            case JSON_TYPE_ARRAY:
-              // Cannot replace tree with value (yet)
-              return CS_FAILURE;
-            case JSON_TYPE_OBJECT:
-              // Cannot replace tree with value (yet)
-              return CS_FAILURE;
-          }
+    This->status = This->fOutput(This->pOutputData,
+                                 This->szBuffer,
+                                 This->curPos);
+    This->curPos = 0;
+    This->szBuffer[0] = 0;
+  }
 
-          plse->valueSize = valueSize+1;
-          plse->szValue = (char*)malloc(plse->valueSize * sizeof(char));
-          memcpy(plse->szValue, szValue, plse->valueSize);
-          plse->type = JSON_TYPE_NUMERIC;
-          This->nextSlabSize = This->nextSlabSize + valueSize + 4;
+  return This->status;
+}
 
-        }
-        else {
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+//
+// CSJSONWRITER_Serialize
+//
+// Returns the size of the buffered output and a reference to it; unless
+// an output function is set, this is the whole document. As with
+// CSJSON_Serialize, the buffer belongs to the writer: the caller may
+// read or copy it but must not modify or free it.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-          keySize = strlen(szKey);
+long
+  CSJSONWRITER_Serialize
+    (CSJSONWRITER* This,
+     char** szOutStream) {
 
-          lse.keySize = keySize+1;
-          lse.szKey = (char*)malloc(lse.keySize * sizeof(char));
-          memcpy(lse.szKey, szKey, lse.keySize);
-          lse.valueSize = valueSize+1;
-          lse.szValue = (char*)malloc((lse.valueSize) * sizeof(char));
-          memcpy(lse.szValue, szValue, lse.valueSize);
-          lse.type = JSON_TYPE_NUMERIC;
+  This->szBuffer[This->curPos] = 0;
+  *szOutStream = This->szBuffer;
 
-          CSMAP_InsertKeyRef(ppve->Listing, lse.szKey,
-                       (void*)(&lse), sizeof(CSJSON_LSENTRY));
+  return This->curPos;
+}
 
-          ppve->numItems++;
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+//
+// CSJSONWRITER_BeginObject
+// CSJSONWRITER_BeginArray
+// CSJSONWRITER_EndObject
+// CSJSONWRITER_EndArray
+//
+// Opens and closes objects and arrays. The key is the member name of the
+// object or array within its parent object; it is ignored within an
+// array and for the outermost object or array.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-          // We can potentially expand the string value if there are
-          // characters that must be escaped. To be on the safe side,
-          // we assume the worst case where every character would 
-          // need to be escaped.
+CSRESULT
+  CSJSONWRITER_BeginObject
+    (CSJSONWRITER* This,
+     char* szKey) {
 
-          This->nextSlabSize = This->nextSlabSize + 
-                           (keySize * 2) + valueSize + 4;
-        }
+  return CSJSONWRITER_PRIVATE_Begin(This, szKey, JSON_TYPE_OBJECT);
+}
 
-        break;
+CSRESULT
+  CSJSONWRITER_BeginArray
+    (CSJSONWRITER* This,
+     char* szKey) {
 
-      default:
+  return CSJSONWRITER_PRIVATE_Begin(This, szKey, JSON_TYPE_ARRAY);
+}
 
-        return CS_FAILURE;
-    }
+CSRESULT
+  CSJSONWRITER_EndObject
+    (CSJSONWRITER* This) {
 
-    return CS_SUCCESS;
-  }
-  else {
-    free(tempPath);
-  }
+  return CSJSONWRITER_PRIVATE_End(This, JSON_TYPE_OBJECT);
+}
 
-  return CS_FAILURE;
+CSRESULT
+  CSJSONWRITER_EndArray
+    (CSJSONWRITER* This) {
+
+  return CSJSONWRITER_PRIVATE_End(This, JSON_TYPE_ARRAY);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
-// 
-// CSJSON_InsertString
 //
-// Inserts a string value into the JSON instance under a path.
+// CSJSONWRITER_String
+// CSJSONWRITER_Numeric
+// CSJSONWRITER_Bool
+// CSJSONWRITER_Null
+//
+// Writes a value; the key is required within an object and ignored
+// within an array. Numeric values are given as strings and validated
+// as CSJSON_InsertNumeric does.
 //
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 
 CSRESULT
-  CSJSON_InsertString
-    (CSJSON* This,
-     char*  szPath,
-     char*  szKey,
-     char*  szValue) {
-
-  CSJSON_DIRENTRY* ppve;
-  CSJSON_LSENTRY lse;
-  CSJSON_LSENTRY* plse;
+  CSJSONWRITER_String
+    (CSJSONWRITER* This,
+     char* szKey,
+     char* szValue) {
 
-  long valueSize;
-  long keySize;
   long size;
-  long len;
-  long i;
 
-  char* tempPath;
+  if (szValue == NULL) {
+    return CS_FAILURE;
+  }
+
+  size = strlen(szValue);
+
+  if (CS_FAIL(CSJSONWRITER_PRIVATE_Key(This, szKey, size * 2 + 2))) {
+    return CS_FAILURE;
+  }
+
+  This->szBuffer[This->curPos++] = '"';
+  This->curPos += CSJSON_PRIVATE_Escape(This->szBuffer + This->curPos,
+                                        szValue, size);
+  This->szBuffer[This->curPos++] = '"';
+
+  return CS_SUCCESS;
+}
+
+CSRESULT
+  CSJSONWRITER_Numeric
+    (CSJSONWRITER* This,
+     char* szKey,
+     char* szValue) {
+
+  long size;
 
-  if (szPath == 0 || szValue == 0) {
+  if (szValue == NULL || CS_FAIL(CSJSON_PRIVATE_IsNumeric(szValue))) {
     return CS_FAILURE;
   }
 
-  ///////////////////////////////////////////////////////////////////
-  // Convert submitted path to internal representation. The
-  // internal path separator is the ESC character. 
-  ///////////////////////////////////////////////////////////////////
+  size = strlen(szValue);
 
-  len = strlen(szPath); 
-  tempPath = (char*)malloc(len * sizeof(char) + 1);
-  i=0;
-  while (szPath[i] != 0) {
-    if (szPath[i] == szPath[0]) {
-      tempPath[i] = JSON_PATH_SEP;
-    }
-    else {
-      tempPath[i] = szPath[i];
-    }
-    i++;
+  if (CS_FAIL(CSJSONWRITER_PRIVATE_Key(This, szKey, size))) {
+    return CS_FAILURE;
   }
-  tempPath[i] = 0;
-
-  if (CS_SUCCEED(CSMAP_Lookup(This->Object,
-                              tempPath,
-                              (void**)(&ppve),
-                              &size)))
-  {
-    free(tempPath);
 
-    valueSize = strlen(szValue);
+  memcpy(This->szBuffer + This->curPos, szValue, size);
+  This->curPos += size;
 
-    switch(ppve->type) {
+  return CS_SUCCESS;
+}
 
-      case JSON_TYPE_ARRAY:
+CSRESULT
+  CSJSONWRITER_Bool
+    (CSJSONWRITER* This,
+     char* szKey,
+     int value) {
 
-        lse.szKey = 0;
-        lse.keySize = 0;
-        lse.szValue = (char*)malloc((valueSize+1) * sizeof(char));
-        memcpy(lse.szValue, szValue, valueSize+1);
-        lse.type = JSON_TYPE_STRING;
-        lse.valueSize = valueSize+1;
-        CSLIST_Insert(ppve->Listing, (void*)(&lse),
-                      sizeof(CSJSON_LSENTRY), CSLIST_BOTTOM);
+  if (CS_FAIL(CSJSONWRITER_PRIVATE_Key(This, szKey, 5))) {
+    return CS_FAILURE;
+  }
 
-        ppve->numItems++;
+  if (value) {
+    memcpy(This->szBuffer + This->curPos, "true", 4);
+    This->curPos += 4;
+  }
+  else {
+    memcpy(This->szBuffer + This->curPos, "false", 5);
+    This->curPos += 5;
+  }
 
-        // We can potentially expand the string value if there are
-        // characters that must be escaped. To be on the safe side,
-        // we assume the worst case where every character would 
-        // need to be escaped.
+  return CS_SUCCESS;
+}
 
-        This->nextSlabSize = This->nextSlabSize + (2 * valueSize) + 3;
+CSRESULT
+  CSJSONWRITER_Null
+    (CSJSONWRITER* This,
+     char* szKey) {
 
-        break;
+  if (CS_FAIL(CSJSONWRITER_PRIVATE_Key(This, szKey, 4))) {
+    return CS_FAILURE;
+  }
 
-      case JSON_TYPE_OBJECT:
+  memcpy(This->szBuffer + This->curPos, "null", 4);
+  This->curPos += 4;
 
-        if (szKey == 0) {
-          return CS_FAILURE;
-        } 
+  return CS_SUCCESS;
+}
 
-        // Check if key exists
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+//
+// CSJSONWRITER_Int64
+// CSJSONWRITER_Double
+//
+// Writes a binary number without an intermediate string, formatted as
+// by CSJSON_Serialize. Infinite and NaN values are rejected.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-        if (CS_SUCCEED(CSMAP_Lookup(ppve->Listing,
-                                    szKey,
-                                    (void**)(&plse),
-                                    &size))) {
- 
-          switch(plse->type) {
-            case JSON_TYPE_STRING:
-              free(plse->szValue);
-              This->nextSlabSize = This->nextSlabSize - plse->valueSize -2;
-              break;
-            case JSON_TYPE_NUMERIC:
-              free(plse->szValue);
-              This->nextSlabSize = This->nextSlabSize - plse->valueSize;
-              break;
-            case JSON_TYPE_BOOL_FALSE:
-              This->nextSlabSize = This->nextSlabSize - 5;
-              break;
-            case JSON_TYPE_BOOL_TRUE:
-              This->nextSlabSize = This->nextSlabSize - 4;
-              break;
-            case JSON_TYPE_NULL:
-              This->nextSlabSize = This->nextSlabSize - 4;
-              break;
-            case JSON_TYPE_ARRAY:
-              // Cannot replace tree with value (yet)
-              return CS_FAILURE;
-            case JSON_TYPE_OBJECT:
-              // Cannot replace tree with value (yet)
-              return CS_FAILURE;
-          }
+CSRESULT
+  CSJSONWRITER_Int64
+    (CSJSONWRITER* This,
+     char* szKey,
+     int64_t value) {
 
-          plse->valueSize = valueSize+1;
-          plse->szValue = (char*)malloc(plse->valueSize * sizeof(char));
-          memcpy(plse->szValue, szValue, plse->valueSize);
-          plse->type = JSON_TYPE_STRING;
+  if (CS_FAIL(CSJSONWRITER_PRIVATE_Key(This, szKey, JSON_NUMBER_SIZE))) {
+    return CS_FAILURE;
+  }
 
-          // We can potentially expand the string value if there are
-          // characters that must be escaped. To be on the safe side,
-          // we assume the worst case where every character would 
-          // need to be escaped.
+  This->curPos += CSJSON_PRIVATE_FormatInt64(This->szBuffer + This->curPos,
+                                             value);
 
-          This->nextSlabSize = This->nextSlabSize + (valueSize * 2) + 6;
+  return CS_SUCCESS;
+}
 
-        }
-        else {
+CSRESULT
+  CSJSONWRITER_Double
+    (CSJSONWRITER* This,
+     char* szKey,
+     double value) {
 
-          keySize = strlen(szKey);
+  if (value != value || value - value != 0) {
+    return CS_FAILURE;
+  }
 
-          lse.keySize = keySize+1;
-          lse.szKey = (char*)malloc(lse.keySize * sizeof(char));
-          memcpy(lse.szKey, szKey, lse.keySize);
-          lse.valueSize = valueSize+1;
-          lse.szValue = (char*)malloc((lse.valueSize) * sizeof(char));
-          memcpy(lse.szValue, szValue, lse.valueSize);
-          lse.type = JSON_TYPE_STRING;
+  if (CS_FAIL(CSJSONWRITER_PRIVATE_Key(This, szKey, JSON_NUMBER_SIZE))) {
+    return CS_FAILURE;
+  }
 
-          CSMAP_InsertKeyRef(ppve->Listing, lse.szKey,
-                       (void*)(&lse), sizeof(CSJSON_LSENTRY));
+  This->curPos += CSJSON_PRIVATE_FormatDouble(This->szBuffer + This->curPos,
+                                              value);
 
+  return CS_SUCCESS;
+}
 
-          ppve->numItems++;
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+//
+// CSJSONWRITER_PRIVATE_Begin
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-          // We can potentially expand the string value if there are
-          // characters that must be escaped. To be on the safe side,
-          // we assume the worst case where every character would 
-          // need to be escaped.
+CSRESULT
+  CSJSONWRITER_PRIVATE_Begin
+    (CSJSONWRITER* This,
+     char* szKey,
+     int type) {
 
-          This->nextSlabSize = This->nextSlabSize + 
-                               (keySize *2 ) + (valueSize * 2) + 6;
-        }
+  char* pStack;
 
-        break;
+  if (This->depth == 0) {
 
-      default:
+    // The outermost object or array
 
-        return CS_FAILURE;
+    if (This->bDone || CS_FAIL(CSJSONWRITER_PRIVATE_Reserve(This, 1))) {
+      return CS_FAILURE;
     }
-
-    return CS_SUCCESS;
   }
   else {
-    free(tempPath);
+
+    if (CS_FAIL(CSJSONWRITER_PRIVATE_Key(This, szKey, 1))) {
+      return CS_FAILURE;
+    }
   }
 
-  return CS_FAILURE;
+  if (This->depth == This->stackSize) {
+    pStack = (char*)malloc(This->stackSize * 2 * sizeof(char));
+    memcpy(pStack, This->pStack, This->stackSize);
+    free(This->pStack);
+    This->pStack = pStack;
+    This->stackSize *= 2;
+  }
+
+  This->pStack[This->depth++] = (char)type;
+  This->szBuffer[This->curPos++] = type == JSON_TYPE_OBJECT ? '{' : '[';
+  This->bComma = 0;
+
+  return CS_SUCCESS;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
-// 
-// CSJSON_MkDir
 //
-// Creates a directory (path) into the JSON instance under an existing path.
+// CSJSONWRITER_PRIVATE_End
 //
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 
 CSRESULT
-  CSJSON_MkDir
-    (CSJSON* This,
-     char*  szPath,
-     char*  szKey,
-     int    type) {
+  CSJSONWRITER_PRIVATE_End
+    (CSJSONWRITER* This,
+     int type) {
 
-  CSRESULT Rc;
-  CSJSON_DIRENTRY* ppdire;
-  CSJSON_DIRENTRY dire;
-  CSJSON_LSENTRY lse;
+  if (This->depth == 0 || This->pStack[This->depth-1] != (char)type) {
+    return CS_FAILURE;
+  }
 
-  char* szNewPath;
-  char* tempPath;
+  if (CS_FAIL(CSJSONWRITER_PRIVATE_Reserve(This, 1))) {
+    return CS_FAILURE;
+  }
 
-  char szIndex[11];
+  This->depth--;
+  This->szBuffer[This->curPos++] = type == JSON_TYPE_OBJECT ? '}' : ']';
+  This->bComma = 1;
+
+  if (This->depth == 0) {
+    This->bDone = 1;
+  }
+
+  return CS_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+//
+// CSJSONWRITER_PRIVATE_Key
+//
+// Writes the separating comma and, within an object, the key of the
+// value that follows; size is the room needed for the value itself.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  CSJSONWRITER_PRIVATE_Key
+    (CSJSONWRITER* This,
+     char* szKey,
+     long size) {
 
-  long i;
-  long size;
-  long len;
-  long indexLen;
-  long totalSize;
   long keySize;
 
-  if (type != JSON_TYPE_ARRAY && type != JSON_TYPE_OBJECT) {
-    return CS_FAILURE;
-  }
+  // Values can only be written within an object or array
 
-  if (szPath == 0) {
+  if (This->depth == 0) {
     return CS_FAILURE;
   }
 
-  ///////////////////////////////////////////////////////////////////
-  // Convert submitted path to internal representation. The
-  // internal path separator is the ESC character. 
-  ///////////////////////////////////////////////////////////////////
+  if (This->pStack[This->depth-1] == JSON_TYPE_OBJECT) {
 
-  len = strlen(szPath); 
-  tempPath = (char*)malloc(len * sizeof(char) + 1);
-  i=0;
-  while (szPath[i] != 0) {
-    if (szPath[i] == szPath[0]) {
-      tempPath[i] = JSON_PATH_SEP;
-    }
-    else {
-      tempPath[i] = szPath[i];
+    if (szKey == NULL) {
+      return CS_FAILURE;
     }
-    i++;
-  }
-  tempPath[i] = 0;
 
-  if (CS_SUCCEED(CSMAP_Lookup(This->Object,
-                              tempPath,
-                              (void**)(&ppdire),
-                              &size)))
-  {
-    switch (ppdire->type) {
+    keySize = strlen(szKey);
 
-      case JSON_TYPE_ARRAY:
+    if (CS_FAIL(CSJSONWRITER_PRIVATE_Reserve(This,
+                                             keySize * 2 + 4 + size))) {
+      return CS_FAILURE;
+    }
 
-        sprintf(szIndex, "%ld", ppdire->numItems);
-        indexLen = strlen(szIndex);
-        totalSize = len + indexLen + 2;
+    if (This->bComma) {
+      This->szBuffer[This->curPos++] = ',';
+    }
 
-        szNewPath = (char*)malloc(totalSize * sizeof(char));
-        memcpy(szNewPath, tempPath, len);
+    This->szBuffer[This->curPos++] = '"';
+    This->curPos += CSJSON_PRIVATE_Escape(This->szBuffer + This->curPos,
+                                          szKey, keySize);
+    This->szBuffer[This->curPos++] = '"';
+    This->szBuffer[This->curPos++] = ':';
+  }
+  else {
 
-        if (tempPath[1] == 0) { 
-          // we are at root
-          memcpy(&szNewPath[1], szIndex, indexLen);
-          szNewPath[len + indexLen] = 0;
-        }
-        else {
-          if (tempPath[len-1] == JSON_PATH_SEP) {
-            memcpy(&szNewPath[len], szIndex, indexLen);
-            szNewPath[len + indexLen] = 0;
-          }
-          else {
-            szNewPath[len] = JSON_PATH_SEP;
-            memcpy(&szNewPath[len+1], szIndex, indexLen);
-            szNewPath[len + 1 + indexLen] = 0;
-          }
-        }
+    if (CS_FAIL(CSJSONWRITER_PRIVATE_Reserve(This, 1 + size))) {
+      return CS_FAILURE;
+    }
 
-        lse.szKey = 0;
-        lse.szValue = 0;
-        lse.type = type;
-        lse.keySize = 0;
-        lse.valueSize = 0;
+    if (This->bComma) {
+      This->szBuffer[This->curPos++] = ',';
+    }
+  }
 
-        CSLIST_Insert(ppdire->Listing, (void*)(&lse),
-                      sizeof(CSJSON_LSENTRY), CSLIST_BOTTOM);
+  This->bComma = 1;
 
-        ppdire->numItems++;
+  return CS_SUCCESS;
+}
 
-        dire.type = type;
-        dire.numItems = 0;
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+//
+// CSJSONWRITER_PRIVATE_Reserve
+//
+// Makes room for size more characters in the buffer; the buffered output
+// is first handed to the output function, if any, and the buffer grows
+// if this is not enough.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-        if (type == JSON_TYPE_ARRAY) {
-          dire.Listing = CSLIST_Constructor();
-        }
-        else {
-          dire.Listing = CSMAP_Constructor();
-        }
+CSRESULT
+  CSJSONWRITER_PRIVATE_Reserve
+    (CSJSONWRITER* This,
+     long size) {
 
-        CSMAP_Insert(This->Object, szNewPath,
-                     (void*)(&dire), sizeof(CSJSON_DIRENTRY));
+  char* szBuffer;
 
-        This->nextSlabSize += 3; // two braces/brackets and possibly a comma
+  long newSize;
 
-        Rc = CS_SUCCESS;
-        break;
+  if (CS_FAIL(This->status)) {
+    return CS_FAILURE;
+  }
 
-      case JSON_TYPE_OBJECT:
+  if (This->curPos + size <= This->bufferSize) {
+    return CS_SUCCESS;
+  }
 
-        if (szKey == 0) {
-          free(tempPath);
-          return CS_FAILURE;
-        }
+  if (This->fOutput != NULL) {
+    if (CS_FAIL(CSJSONWRITER_Flush(This))) {
+      return CS_FAILURE;
+    }
+    if (size <= This->bufferSize) {
+      return CS_SUCCESS;
+    }
+  }
 
-        // Check if key already exists under the path
-        if (CS_SUCCEED(CSMAP_Lookup(ppdire->Listing,
-                                    szKey,
-                                    (void**)(&lse),
-                                    &size))) {
-          free(tempPath);
-          return CS_FAILURE;
-        }
+  newSize = This->bufferSize * 2;
 
-        keySize = strlen(szKey);
+  if (newSize < This->curPos + size) {
+    newSize = This->curPos + size;
+  }
 
-        if (len > 1) {  // we are not at root path
-          if (keySize == 0) { // Key is empty
-            szNewPath = (char*)malloc((len + 2) * sizeof(char));
-            memcpy(szNewPath, tempPath, len);
-            szNewPath[len] = JSON_PATH_SEP;
-            szNewPath[len+1] = 0;
-          }
-          else {
-            if (tempPath[len-1] == JSON_PATH_SEP) {
-              szNewPath = (char*)malloc((len + keySize + 1) * sizeof(char));
-              memcpy(szNewPath, tempPath, len);
-              memcpy(&szNewPath[len], szKey, keySize);
-              szNewPath[len + keySize] = 0;
-            }
-            else {
-              szNewPath = (char*)malloc((len + keySize + 2) * sizeof(char));
-              memcpy(szNewPath, tempPath, len);
-              szNewPath[len] = JSON_PATH_SEP;
-              memcpy(&szNewPath[len+1], szKey, keySize);
-              szNewPath[len + keySize + 1] = 0;
-            }
-          }
-        }
-        else {
-          if (keySize == 0) { // Key is empty
-            szNewPath = (char*)malloc(3 * sizeof(char));
-            szNewPath[0] = JSON_PATH_SEP;
-            szNewPath[1] = JSON_PATH_SEP;
-            szNewPath[2] = 0;
-          }
-          else {
-            szNewPath = (char*)malloc((keySize + 2) * sizeof(char));
-            szNewPath[0] = JSON_PATH_SEP;
-            memcpy(&szNewPath[1], szKey, keySize);
-            szNewPath[keySize + 1] = 0;
-          }
-        }
+  szBuffer = (char*)malloc((newSize + 1) * sizeof(char));
+  memcpy(szBuffer, This->szBuffer, This->curPos);
+  free(This->szBuffer);
 
-        lse.szKey = (char*)malloc((keySize+1) * sizeof(char));
-        memcpy(lse.szKey, szKey, keySize+1);
-        lse.keySize = keySize+1;
-        lse.type = type;
-        lse.valueSize = 0;
-        lse.szValue = 0;
+  This->szBuffer = szBuffer;
+  This->bufferSize = newSize;
 
-        CSMAP_Insert(ppdire->Listing, lse.szKey,
-                       (void*)(&lse), sizeof(CSJSON_LSENTRY));
+  return CS_SUCCESS;
+}
 
-        ppdire->numItems++;
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+//
+// CSJSONREADER_Constructor
+//
+// Creates an incremental (pull) JSON reader. Input is fed in chunks of
+// any size with CSJSONREADER_Feed, as it arrives from a session, and
+// CSJSONREADER_Next returns the document one event at a time: the
+// beginning and end of objects and arrays and individual values. Only
+// the input not yet returned as events is kept, so the memory used
+// depends on the chunk size and the largest single value rather than
+// on the document size.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-        dire.type = type;
-        dire.numItems = 0;
+CSJSONREADER*
+  CSJSONREADER_Constructor
+    (void) {
 
-        if (type == JSON_TYPE_ARRAY) {
-          dire.Listing = CSLIST_Constructor();
-        }
-        else {
-          dire.Listing = CSMAP_Constructor();
-        }
+  CSJSONREADER* Instance;
 
-        CSMAP_Insert(This->Object, szNewPath,
-                      (void*)(&dire), sizeof(CSJSON_DIRENTRY));
+  Instance = (CSJSONREADER*)malloc(sizeof(CSJSONREADER));
 
-        // two braces/brackets and possibly a comma and a colon
-        This->nextSlabSize = This->nextSlabSize + lse.keySize + 6;
+  Instance->pBuffer =
+    (char*)malloc(JSON_SERIALIZE_SLAB * sizeof(char));
+  Instance->bufferSize = JSON_SERIALIZE_SLAB;
 
-        Rc = CS_SUCCESS;
- 
-        break;
+  Instance->pStack = (char*)malloc(JSON_PATH_BUFFER * sizeof(char));
+  Instance->stackSize = JSON_PATH_BUFFER;
 
-      default:
-        Rc = CS_FAILURE;
-    }
-  }
-  else {
-    Rc = CS_FAILURE;
-  }
+  CSJSONREADER_Reset(Instance);
 
-  free(tempPath);
-  return Rc;
+  return Instance;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
-// 
-// CSJSON_Rm
+//
+// CSJSONREADER_Destructor
 //
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 
 CSRESULT
-  CSJSON_Rm
-    (CSJSON* This,
-     char*  szPath,
-     char*  szKey,
-     int    type) {
+  CSJSONREADER_Destructor
+    (CSJSONREADER** This) {
+
+  if (This == 0 || *This == NULL) {
+    return CS_FAILURE;
+  }
+
+  free((*This)->pBuffer);
+  free((*This)->pStack);
+  free(*This);
+
+  *This = 0;
 
   return CS_SUCCESS;
 }
@@ -4075,19 +5559,29 @@ CSRESULT
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
-// 
-// CSJSON_ParseAt
+//
+// CSJSONREADER_Reset
+//
+// Discards any pending input so that a new document can be read.
 //
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 
 CSRESULT
-  CSJSON_ParseAt
-    (CSJSON* This,
-     char*  szPath,
-     char*  szKey,
-     char* str) {
+  CSJSONREADER_Reset
+    (CSJSONREADER* This) {
+
+  // Input starts at offset 1: CSJSON_PRIVATE_ParseNumber moves
+  // numbers back by one character.
+
+  This->pos = 1;
+  This->end = 1;
+  This->pBuffer[1] = 0;
+
+  This->depth = 0;
+  This->state = JSON_READ_ROOT;
+  This->status = CS_SUCCESS;
 
   return CS_SUCCESS;
 }
@@ -4095,434 +5589,480 @@ CSRESULT
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
-// 
-// CSJSON_IterStart
+//
+// CSJSONREADER_Feed
+//
+// Appends a chunk of input. The input already returned as events is
+// discarded first, which invalidates the key and value of the last
+// event.
 //
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 
 CSRESULT
-  CSJSON_IterStart
-    (CSJSON* This,
-     char*  szPath, 
-     CSJSON_DIRENTRY* pDire) {
-
-  CSJSON_DIRENTRY* ppve;
+  CSJSONREADER_Feed
+    (CSJSONREADER* This,
+     char* pData,
+     long size) {
 
-  long size;
-  long len;
-  long i;
+  char* pBuffer;
 
-  char* tempPath;
+  long remaining;
+  long newSize;
 
-  if (szPath == NULL || pDire == NULL) {
+  if (pData == NULL || size < 0) {
     return CS_FAILURE;
   }
 
-  ///////////////////////////////////////////////////////////////////
-  // Convert submitted path to internal representation. The
-  // internal path separator is the ESC character. 
-  ///////////////////////////////////////////////////////////////////
+  remaining = This->end - This->pos;
 
-  len = strlen(szPath); 
-  tempPath = (char*)malloc(len * sizeof(char) + 1);
-  i=0;
-  while (szPath[i] != 0) {
-    if (szPath[i] == szPath[0]) {
-      tempPath[i] = JSON_PATH_SEP;
-    }
-    else {
-      tempPath[i] = szPath[i];
-    }
-    i++;
+  if (This->pos > 1) {
+    memmove(This->pBuffer + 1, This->pBuffer + This->pos, remaining);
+    This->pos = 1;
+    This->end = 1 + remaining;
   }
-  tempPath[i] = 0;
-
-  if (CS_SUCCEED(CSMAP_Lookup(This->Object,
-                              tempPath,
-                              (void**)(&ppve),
-                              &size)))
-  {
-    free(tempPath);
 
-    switch(ppve->type) {
+  // The string and white space scanners may read past the end
+  // of the input.
 
-      case JSON_TYPE_ARRAY:
-        This->iterIndex = 0;
-        This->iterType = JSON_TYPE_ARRAY;
-        This->pIterListing = ppve->Listing;
-        pDire->Listing = 0;
-        pDire->numItems = ppve->numItems;
-        pDire->type = ppve->type;
-        return CS_SUCCESS;
+  if (This->end + size + JSON_SCAN_PADDING > This->bufferSize) {
 
-      case JSON_TYPE_OBJECT:
-        This->iterIndex = 0;
-        This->iterType = JSON_TYPE_OBJECT;
-        This->pIterListing = ppve->Listing;
-        pDire->Listing = 0;
-        pDire->numItems = 0;
-        pDire->type = ppve->type;
-        CSMAP_IterStart((CSMAP*)(This->pIterListing), CSMAP_ASCENDING);
-        return CS_SUCCESS;
+    newSize = This->bufferSize * 2;
 
-      default:
-        This->iterIndex = 0;
-        This->iterType = JSON_TYPE_UNKNOWN;
-        This->pIterListing = NULL;
-        pDire->Listing = 0;
-        pDire->numItems = 0;
-        pDire->type = ppve->type;
-        return CS_FAILURE;
+    if (newSize < This->end + size + JSON_SCAN_PADDING) {
+      newSize = This->end + size + JSON_SCAN_PADDING;
     }
-  }
-  else {
-    free(tempPath);
-    This->iterIndex = 0;
-    This->iterType = JSON_TYPE_UNKNOWN;
-    This->pIterListing = NULL;
-    pDire->Listing = 0;
-    pDire->numItems = 0;
-    pDire->type = JSON_TYPE_UNKNOWN;
+
+    pBuffer = (char*)malloc(newSize * sizeof(char));
+    memcpy(pBuffer, This->pBuffer, This->end);
+    free(This->pBuffer);
+
+    This->pBuffer = pBuffer;
+    This->bufferSize = newSize;
   }
 
-  return CS_FAILURE;
+  memcpy(This->pBuffer + This->end, pData, size);
+  This->end += size;
+  This->pBuffer[This->end] = 0;
+
+  return CS_SUCCESS;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
-// 
-// CSJSON_IterNext
+//
+// CSJSONREADER_Next
+//
+// Returns the next event. The event type is JSON_EVENT_OBJECT or
+// JSON_EVENT_ARRAY when an object or array begins,
+// JSON_EVENT_OBJECT_END or JSON_EVENT_ARRAY_END when it ends, or the
+// JSON_TYPE_* type of a value. The key is set for object members and
+// the value for strings and numbers; as with CSJSON_LSENTRY, sizes
+// include the NULL terminator. The depth is the number of objects and
+// arrays that enclose the event. Keys and values are valid until the
+// next call to CSJSONREADER_Feed.
+//
+// Returns:
+//
+//   CS_SUCCESS
+//   CS_FAILURE | JSON_OPER_READ | JSON_DIAG_MOREDATA:  feed more input
+//   CS_FAILURE | JSON_OPER_READ | JSON_DIAG_ENDOFDATA: document complete
+//   CS_FAILURE | JSON_OPER_READ | JSON_DIAG_SYNTAX:    ill-formed input
 //
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 
 CSRESULT
-  CSJSON_IterNext
-    (CSJSON* This,
-     CSJSON_LSENTRY* plse) {
-
-  char* szKey;
+  CSJSONREADER_Next
+    (CSJSONREADER* This,
+     CSJSON_EVENT* pEvent) {
 
-  long size;
+  char* p;
+  char* pEnd;
+  char* pValue;
 
-  CSJSON_LSENTRY* lplse;
+  if (CS_FAIL(This->status)) {
+    return This->status;
+  }
 
-  if (plse == NULL) {
-    return CS_FAILURE;
-  }  
+  pEvent->szKey = 0;
+  pEvent->keySize = 0;
 
-  if (This->pIterListing == NULL) {
-    return CS_FAILURE;
-  }
+  for (;;) {
 
-  switch(This->iterType) {
+    p = This->pBuffer + This->pos;
+    pEnd = This->pBuffer + This->end;
 
-    case JSON_TYPE_ARRAY:
+    JSON_SKIP_WS(p);
 
-      if (CS_SUCCEED(CSLIST_GetDataRef((CSLIST*)(This->pIterListing),
-                                       (void**)(&lplse),
-                                       This->iterIndex))) {
+    This->pos = p - This->pBuffer;
 
-        plse->szKey = 0;
-        plse->keySize = 0;
-        (This->iterIndex)++;
+    if (p == pEnd) {
+      if (This->state == JSON_READ_DONE) {
+        return CS_FAILURE | JSON_OPER_READ | JSON_DIAG_ENDOFDATA;
       }
-      else {
-        plse->szValue = 0;
-        plse->type = JSON_TYPE_UNKNOWN;
-        plse->szKey = 0;
-        plse->keySize = 0;
-        return CS_FAILURE;     
-      }   
+      return CS_FAILURE | JSON_OPER_READ | JSON_DIAG_MOREDATA;
+    }
 
-      break;
+    switch(This->state) {
 
-    case JSON_TYPE_OBJECT:
-      
-      if (CS_FAIL(CSMAP_IterNext((CSMAP*)(This->pIterListing), 
-                                     &szKey,
-                                     (void**)(&lplse), &size))) {
-        plse->szValue = 0;
-        plse->type = JSON_TYPE_UNKNOWN;
-        plse->szKey = 0;
-        plse->keySize = 0;
-        return CS_FAILURE;     
-      }
+      case JSON_READ_ROOT:
+
+        if (*p != '{' && *p != '[') {
+          goto CSJSONREADER_NEXT_SYNTAX;
+        }
+
+        return CSJSONREADER_PRIVATE_Value(This, p, pEvent);
+
+      case JSON_READ_NEXT:
+
+        if (*p == ',') {
+          This->pos++;
+          This->state =
+            This->pStack[This->depth-1] == JSON_TYPE_OBJECT ?
+                                    JSON_READ_MEMBER : JSON_READ_ITEM;
+          continue;
+        }
+
+        if ((*p == '}' && This->pStack[This->depth-1] == JSON_TYPE_OBJECT) ||
+            (*p == ']' && This->pStack[This->depth-1] == JSON_TYPE_ARRAY)) {
+          return CSJSONREADER_PRIVATE_End(This, pEvent);
+        }
+
+        goto CSJSONREADER_NEXT_SYNTAX;
+
+      case JSON_READ_FIRSTMEMBER:
+
+        if (*p == '}') {
+          return CSJSONREADER_PRIVATE_End(This, pEvent);
+        }
+
+        // fall through
+
+      case JSON_READ_MEMBER:
+
+        if (*p != '"') {
+          goto CSJSONREADER_NEXT_SYNTAX;
+        }
+
+        // Nothing is consumed until the key, the colon and
+        // the value (or the beginning of an object or array)
+        // are all available.
+
+        if ((pValue = CSJSONREADER_PRIVATE_StringEnd(p + 1, pEnd)) == NULL) {
+          return CS_FAILURE | JSON_OPER_READ | JSON_DIAG_MOREDATA;
+        }
+
+        if (*pValue != '"') {
+          goto CSJSONREADER_NEXT_SYNTAX;
+        }
+
+        pValue++;
+        JSON_SKIP_WS(pValue);
+
+        if (pValue == pEnd) {
+          return CS_FAILURE | JSON_OPER_READ | JSON_DIAG_MOREDATA;
+        }
+
+        if (*pValue != ':') {
+          goto CSJSONREADER_NEXT_SYNTAX;
+        }
+
+        pValue++;
+        JSON_SKIP_WS(pValue);
+
+        if (!CSJSONREADER_PRIVATE_IsComplete(pValue, pEnd)) {
+          return CS_FAILURE | JSON_OPER_READ | JSON_DIAG_MOREDATA;
+        }
+
+        p++;
+
+        if (CS_FAIL(CSJSON_PRIVATE_ParseString(&p,
+                                               &(pEvent->szKey),
+                                               &(pEvent->keySize)))) {
+          goto CSJSONREADER_NEXT_SYNTAX;
+        }
+
+        return CSJSONREADER_PRIVATE_Value(This, pValue, pEvent);
+
+      case JSON_READ_FIRSTITEM:
+
+        if (*p == ']') {
+          return CSJSONREADER_PRIVATE_End(This, pEvent);
+        }
+
+        // fall through
+
+      case JSON_READ_ITEM:
 
-      plse->szKey = lplse->szKey;
-      plse->keySize = lplse->keySize;
+        if (!CSJSONREADER_PRIVATE_IsComplete(p, pEnd)) {
+          return CS_FAILURE | JSON_OPER_READ | JSON_DIAG_MOREDATA;
+        }
 
-      break;
+        return CSJSONREADER_PRIVATE_Value(This, p, pEvent);
 
-    default:
+      default:
 
-      return CS_FAILURE;
+        // Only white space may follow the document
+
+        goto CSJSONREADER_NEXT_SYNTAX;
+    }
   }
 
-  plse->type = lplse->type;
+  ///////////////////////////////////////////////////////////
+  // Branching Label
+  CSJSONREADER_NEXT_SYNTAX:
 
-  if (lplse->type == JSON_TYPE_STRING ||
-      lplse->type == JSON_TYPE_NUMERIC) {
-    plse->szValue = lplse->szValue;
-    plse->valueSize = lplse->valueSize;
-  }
-  else {
-    plse->szValue = 0;
-    plse->valueSize = 0;
-  }
+  This->status = CS_FAILURE | JSON_OPER_READ | JSON_DIAG_SYNTAX;
 
-  return CS_SUCCESS;
+  return This->status;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
-// 
-// CSJSON_Ls
 //
-// Returns a listing of information structures for all values 
-// under an existing path.
+// CSJSONREADER_PRIVATE_Value
+//
+// Reads a value, or the beginning of an object or array, that is known
+// to be complete.
 //
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 
 CSRESULT
-  CSJSON_Ls
-    (CSJSON* This,
-     char* szPath,
-     CSLIST listing) {
+  CSJSONREADER_PRIVATE_Value
+    (CSJSONREADER* This,
+     char* p,
+     CSJSON_EVENT* pEvent) {
 
-  CSJSON_DIRENTRY* pve;
-  CSJSON_LSENTRY* plse;
+  CSRESULT Rc;
 
-  char* szKey;
+  char* pStack;
 
-  long size;
-  long count;
-  long i;
-  long len;
+  pEvent->depth = This->depth;
+  pEvent->szValue = 0;
+  pEvent->valueSize = 0;
 
-  char* tempPath;
+  Rc = CS_SUCCESS;
 
-  if (szPath == 0) {
-    return CS_FAILURE;
-  }
+  switch(*p) {
 
-  CSLIST_Clear(listing);
+    case '{':
+    case '[':
 
-  ///////////////////////////////////////////////////////////////////
-  // Convert submitted path to internal representation. The
-  // internal path separator is the ESC character. 
-  ///////////////////////////////////////////////////////////////////
+      if (This->depth == This->stackSize) {
+        pStack = (char*)malloc(This->stackSize * 2 * sizeof(char));
+        memcpy(pStack, This->pStack, This->stackSize);
+        free(This->pStack);
+        This->pStack = pStack;
+        This->stackSize *= 2;
+      }
 
-  len = strlen(szPath); 
-  tempPath = (char*)malloc(len * sizeof(char) + 1);
-  i=0;
-  while (szPath[i] != 0) {
-    if (szPath[i] == szPath[0]) {
-      tempPath[i] = JSON_PATH_SEP;
-    }
-    else {
-      tempPath[i] = szPath[i];
-    }
-    i++;
-  }
-  tempPath[i] = 0;
+      if (*p == '{') {
+        pEvent->type = JSON_EVENT_OBJECT;
+        This->pStack[This->depth++] = JSON_TYPE_OBJECT;
+        This->state = JSON_READ_FIRSTMEMBER;
+      }
+      else {
+        pEvent->type = JSON_EVENT_ARRAY;
+        This->pStack[This->depth++] = JSON_TYPE_ARRAY;
+        This->state = JSON_READ_FIRSTITEM;
+      }
 
-  if(CS_SUCCEED(CSMAP_Lookup(This->Object, tempPath, (void**)(&pve), &size)))  {
+      This->pos = p + 1 - This->pBuffer;
 
-    if (pve->type == JSON_TYPE_OBJECT) {
+      return CS_SUCCESS;
 
-      CSMAP_IterStart(pve->Listing, CSMAP_ASCENDING);
+    case '"':
 
-      while(CS_SUCCEED(CSMAP_IterNext(pve->Listing, &szKey,
-                                      (void**)(&plse), &size))) {
+      pEvent->type = JSON_TYPE_STRING;
+      p++;
+      Rc = CSJSON_PRIVATE_ParseString(&p,
+                                      &(pEvent->szValue),
+                                      &(pEvent->valueSize));
+      break;
 
-        // insert address of listing node
-        CSLIST_Insert(listing, (void*)(&plse), sizeof(plse), CSLIST_BOTTOM);
-      }
-    }
-    else {
+    case 't':
 
-      if (pve->type == JSON_TYPE_ARRAY) {
+      pEvent->type = JSON_TYPE_BOOL_TRUE;
+      if (memcmp(p, "true", 4) != 0) {
+        Rc = CS_FAILURE;
+      }
+      p += 4;
+      break;
 
-        count = CSLIST_Count(pve->Listing);
+    case 'f':
 
-        for (i=0; i<count; i++) {
-          CSLIST_GetDataRef(pve->Listing, (void**)(&plse), i);
-          CSLIST_Insert(listing, (void*)(&plse), sizeof(plse), CSLIST_BOTTOM);
-        }
+      pEvent->type = JSON_TYPE_BOOL_FALSE;
+      if (memcmp(p, "false", 5) != 0) {
+        Rc = CS_FAILURE;
       }
-      else {
-        free(tempPath);
-        return JSON_TYPE_UNKNOWN;
+      p += 5;
+      break;
+
+    case 'n':
+
+      pEvent->type = JSON_TYPE_NULL;
+      if (memcmp(p, "null", 4) != 0) {
+        Rc = CS_FAILURE;
       }
-    }
+      p += 4;
+      break;
+
+    default:
+
+      pEvent->type = JSON_TYPE_NUMERIC;
+      Rc = CSJSON_PRIVATE_ParseNumber(&p,
+                                      &(pEvent->szValue),
+                                      &(pEvent->valueSize));
+      break;
   }
-  else {
-    free(tempPath);
-    return JSON_TYPE_UNKNOWN;
+
+  if (CS_FAIL(Rc)) {
+    This->status = CS_FAILURE | JSON_OPER_READ | JSON_DIAG_SYNTAX;
+    return This->status;
   }
 
-  free(tempPath);
-  return pve->type;
+  This->pos = p - This->pBuffer;
+  This->state = JSON_READ_NEXT;
+
+  return CS_SUCCESS;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
-// 
-// CSJSON_PRIVATE_IsNumeric
 //
-// Validates the format of a numeric value
+// CSJSONREADER_PRIVATE_End
+//
+// Reads the end of the current object or array.
 //
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 
-CSRESULT CSJSON_PRIVATE_IsNumeric(char* szNumber) {
+CSRESULT
+  CSJSONREADER_PRIVATE_End
+    (CSJSONREADER* This,
+     CSJSON_EVENT* pEvent) {
 
-  long n;
+  This->depth--;
 
-  int haveDot;
-  int haveExp;
+  pEvent->type = This->pStack[This->depth] == JSON_TYPE_OBJECT ?
+                          JSON_EVENT_OBJECT_END : JSON_EVENT_ARRAY_END;
+  pEvent->depth = This->depth;
+  pEvent->szValue = 0;
+  pEvent->valueSize = 0;
 
-  haveDot = 0;
-  haveExp = 0;
-  n=0;
+  This->pos++;
+  This->state = This->depth == 0 ? JSON_READ_DONE : JSON_READ_NEXT;
 
-  if ((szNumber[n] >= '0' && szNumber[n] <= '9') ||
-        (szNumber[n] == '-'))
-  {
-    haveDot = 0;
-    haveExp = 0;
+  return CS_SUCCESS;
+}
 
-    n++;
-    while (szNumber[n] != 0) {
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+//
+// CSJSONREADER_PRIVATE_StringEnd
+//
+// Returns the closing quote of a string (or a control character, which
+// fails when the string is read) or NULL if the string continues past
+// the input fed so far.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-      switch (szNumber[n])
-      {
-        case '0':
-        case '1':
-        case '2':
-        case '3':
-        case '4':
-        case '5':
-        case '6':
-        case '7':
-        case '8':
-        case '9':
-          n++;
-          break;
+char*
+  CSJSONREADER_PRIVATE_StringEnd
+    (char* p,
+     char* pEnd) {
 
-        case '.':
+  for (;;) {
 
-          // Only one dot and it must precede the exponent character
+    p = g_CSJSON_ScanString(p);
 
-          if (!haveDot && !haveExp) {
+    if (p >= pEnd) {
+      return NULL;
+    }
 
-            // check that if first digit is zero, then there are no
-            // other digits between the zero and the dot
+    if (*p != '\\') {
+      return p;
+    }
 
-            if (szNumber[0] == '-') {
-              if (szNumber[1] == '0') {
-                if (n != 2) {
-                  //number starts with -0
-                  //but next character is not dot
-                  return CS_FAILURE;
-                }
-                else {
-                  n++;
-                }
-              }
-              else {
-                n++;
-              }
-            }
-            else {
-              if (szNumber[0] == '0') {
-                if (n != 1) {
-                  //number starts with 0 but next character is not dot
-                  return CS_FAILURE;
-                }
-                else {
-                  n++;
-                }
-              }
-              else {
-                n++;
-              }
-            }
+    // Skip the escape sequence; a unicode escape
+    // sequence must be complete.
 
-            haveDot = 1;
-          }
-          else {
-            return CS_FAILURE;
-          }
+    if (p + 1 >= pEnd) {
+      return NULL;
+    }
 
-          break;
+    if (p[1] == 'u') {
+      if (p + 6 > pEnd) {
+        return NULL;
+      }
+      p += 6;
+    }
+    else {
+      p += 2;
+    }
+  }
+}
 
-        case '+':
-        case '-':
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+//
+// CSJSONREADER_PRIVATE_IsComplete
+//
+// Determines if the value that starts at p is entirely within the input
+// fed so far. Since a number has no terminator, it is complete only once
+// the character that follows it has been fed.
+//
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
 
-          // This must immediately follow the exponent character
-          if (szNumber[n-1] == 'e' || szNumber[n-1] == 'E') {
-            n++;
-          }
-          else {
-            return CS_FAILURE;
-          }
+int
+  CSJSONREADER_PRIVATE_IsComplete
+    (char* p,
+     char* pEnd) {
 
-          break;
+  if (p >= pEnd) {
+    return 0;
+  }
 
-        case 'e':
-        case 'E':
+  switch(*p) {
 
-          if (!haveExp) {
-            // This character must be preceded by a digit
-            if (szNumber[n-1] >= '0' && szNumber[n-1] <= '9') {
-              haveExp = 1;
-              n++;
-            }
-            else {
-              return CS_FAILURE;
-            }
-          }
-          else {
-            return CS_FAILURE;
-          }
+    case '{':
+    case '[':
+      return 1;
 
-          break;
+    case '"':
+      return CSJSONREADER_PRIVATE_StringEnd(p + 1, pEnd) != NULL;
 
-        default:
+    case 't':
+    case 'n':
+      return p + 4 <= pEnd;
 
-          return CS_FAILURE;
-      }
-    }
-  }
-  else {
-    return CS_FAILURE;
-  } 
+    case 'f':
+      return p + 5 <= pEnd;
 
-  //////////////////////////////////////////////////////////////
-  // Check following cases:
-  // 
-  // 1) last digit is e, E +, - or dot
-  // 2) leading zero not immediately followed by a dot
-  //////////////////////////////////////////////////////////////
+    default:
 
-  if (szNumber[n-1] == 'e' ||
-      szNumber[n-1] == 'E' ||
-      szNumber[n-1] == '+' ||
-      szNumber[n-1] == '-' ||
-      szNumber[n-1] == '.') {
-    return CS_FAILURE;
-  }
+      while (p < pEnd &&
+             ((*p >= '0' && *p <= '9') ||
+              *p == '-' || *p == '+' || *p == '.' ||
+              *p == 'e' || *p == 'E')) {
+        p++;
+      }
 
-  return CS_SUCCESS;
+      return p < pEnd;
+  }
 }
\ No newline at end of file
@@ -28,6 +28,8 @@
 #ifndef __CLARASOFT_CSLIB_CSJSON_H__
 #define __CLARASOFT_CSLIB_CSJSON_H__
 
+#include <stdint.h>
+
 #include <clarasoft/cslib.h>
 
 #define JSON_UNICODE_NOCONVERT   0
@@ -42,7 +44,25 @@
 #define JSON_TYPE_STRING        52
 #define JSON_TYPE_UNKNOWN       99
 
+#define JSON_EVENT_OBJECT       10
+#define JSON_EVENT_OBJECT_END   11
+#define JSON_EVENT_ARRAY        20
+#define JSON_EVENT_ARRAY_END    21
+
+#define JSON_OPER_READ          (0x00010000)
+
+#define JSON_DIAG_MOREDATA      (0x00000001)
+#define JSON_DIAG_ENDOFDATA     (0x00000002)
+#define JSON_DIAG_SYNTAX        (0x00000003)
+
 typedef void* CSJSON;
+typedef void* CSJSONWRITER;
+typedef void* CSJSONREADER;
+typedef void* CSJSONPATH;
+
+typedef CSRESULT (*CSJSONWRITER_OUTPUTPROC)(void* pOutputData,
+                                            char* pData,
+                                            long size);
 
 typedef struct tagCSJSON_DIRENTRY
 {
@@ -61,10 +81,29 @@ typedef struct tagCSJSON_LSENTRY
 
 } CSJSON_LSENTRY;
 
+typedef struct tagCSJSON_EVENT
+{
+  int   type;
+  long  depth;
+  char* szKey;
+  long  keySize;
+  char* szValue;
+  long  valueSize;
+
+} CSJSON_EVENT;
+
 CSJSON
   CSJSON_Constructor
     (void);
 
+CSJSON
+  CSJSON_ArenaConstructor
+    (CSARENA pArena);
+
+CSJSON
+  CSJSON_PoolConstructor
+    (void);
+
 CSRESULT
   CSJSON_Destructor
     (CSJSON*);
@@ -95,6 +134,67 @@ CSRESULT
      long index,
      CSJSON_LSENTRY* plse);
 
+CSRESULT
+  CSJSON_LookupInt64
+    (CSJSON This,
+     char* szPath,
+     char* szKey,
+     int64_t* pValue);
+
+CSRESULT
+  CSJSON_LookupDouble
+    (CSJSON This,
+     char* szPath,
+     char* szKey,
+     double* pValue);
+
+CSJSONPATH
+  CSJSON_CompilePath
+    (char* szPath);
+
+CSJSONPATH
+  CSJSON_CompileChildPath
+    (CSJSONPATH pParent,
+     char* szKey);
+
+CSRESULT
+  CSJSON_FreePath
+    (CSJSONPATH* This);
+
+CSRESULT
+  CSJSON_LookupPathDir
+    (CSJSON This,
+     CSJSONPATH pPath,
+     CSJSON_DIRENTRY* pdire);
+
+CSRESULT
+  CSJSON_LookupPathKey
+    (CSJSON This,
+     CSJSONPATH pPath,
+     char* szKey,
+     CSJSON_LSENTRY* plse);
+
+CSRESULT
+  CSJSON_LookupPathIndex
+    (CSJSON This,
+     CSJSONPATH pPath,
+     long index,
+     CSJSON_LSENTRY* plse);
+
+CSRESULT
+  CSJSON_LookupPathInt64
+    (CSJSON This,
+     CSJSONPATH pPath,
+     char* szKey,
+     int64_t* pValue);
+
+CSRESULT
+  CSJSON_LookupPathDouble
+    (CSJSON This,
+     CSJSONPATH pPath,
+     char* szKey,
+     double* pValue);
+
 CSRESULT
   CSJSON_Init
     (CSJSON This,
@@ -120,6 +220,20 @@ CSRESULT
      char*   szKey,
      char*   szValue);
 
+CSRESULT
+  CSJSON_InsertInt64
+    (CSJSON This,
+     char*   szPath,
+     char*   szKey,
+     int64_t value);
+
+CSRESULT
+  CSJSON_InsertDouble
+    (CSJSON This,
+     char*   szPath,
+     char*   szKey,
+     double  value);
+
 CSRESULT
   CSJSON_InsertString
     (CSJSON This,
@@ -169,4 +283,107 @@ long
      char* szOutStream,
      long size);
 
+CSJSONWRITER
+  CSJSONWRITER_Constructor
+    (void);
+
+CSRESULT
+  CSJSONWRITER_Destructor
+    (CSJSONWRITER* This);
+
+CSRESULT
+  CSJSONWRITER_Reset
+    (CSJSONWRITER This);
+
+CSRESULT
+  CSJSONWRITER_SetOutput
+    (CSJSONWRITER This,
+     CSJSONWRITER_OUTPUTPROC fOutput,
+     void* pOutputData);
+
+CSRESULT
+  CSJSONWRITER_Flush
+    (CSJSONWRITER This);
+
+long
+  CSJSONWRITER_Serialize
+    (CSJSONWRITER This,
+     char** szOutStream);
+
+CSRESULT
+  CSJSONWRITER_BeginObject
+    (CSJSONWRITER This,
+     char* szKey);
+
+CSRESULT
+  CSJSONWRITER_EndObject
+    (CSJSONWRITER This);
+
+CSRESULT
+  CSJSONWRITER_BeginArray
+    (CSJSONWRITER This,
+     char* szKey);
+
+CSRESULT
+  CSJSONWRITER_EndArray
+    (CSJSONWRITER This);
+
+CSRESULT
+  CSJSONWRITER_String
+    (CSJSONWRITER This,
+     char* szKey,
+     char* szValue);
+
+CSRESULT
+  CSJSONWRITER_Numeric
+    (CSJSONWRITER This,
+     char* szKey,
+     char* szValue);
+
+CSRESULT
+  CSJSONWRITER_Int64
+    (CSJSONWRITER This,
+     char* szKey,
+     int64_t value);
+
+CSRESULT
+  CSJSONWRITER_Double
+    (CSJSONWRITER This,
+     char* szKey,
+     double value);
+
+CSRESULT
+  CSJSONWRITER_Bool
+    (CSJSONWRITER This,
+     char* szKey,
+     int value);
+
+CSRESULT
+  CSJSONWRITER_Null
+    (CSJSONWRITER This,
+     char* szKey);
+
+CSJSONREADER
+  CSJSONREADER_Constructor
+    (void);
+
+CSRESULT
+  CSJSONREADER_Destructor
+    (CSJSONREADER* This);
+
+CSRESULT
+  CSJSONREADER_Reset
+    (CSJSONREADER This);
+
+CSRESULT
+  CSJSONREADER_Feed
+    (CSJSONREADER This,
+     char* pData,
+     long size);
+
+CSRESULT
+  CSJSONREADER_Next
+    (CSJSONREADER This,
+     CSJSON_EVENT* pEvent);
+
 #endif
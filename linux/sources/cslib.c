@@ -57,9 +57,21 @@ typedef long CSRESULT;
 #define CSLIST_TOP                     (0x00000000)   // at the beginning
 #define CSLIST_BOTTOM                  (0x7FFFFFFF)   // at the end
 
+#define CSLIST_VECTOR_MINITEMS         (0x00000010)
+
+#define CSARENA_BLOCKSIZE              (0x00010000)   // default block size
+#define CSARENA_ALIGNMENT              (0x00000010)
+
+#define CSARENA_ALIGN(n) \
+          (((n) + CSARENA_ALIGNMENT - 1) & ~((long)CSARENA_ALIGNMENT - 1))
+
 #define CSMAP_ASCENDING                (0x0000001)
 #define CSMAP_DESCENDING               (0x0000002)
 
+#define CSMAP_HASH_MINSLOTS            (0x00000010)
+#define CSMAP_HASH_INLINEKEY           (0x00000018)   // inline key size
+#define CSMAP_HASH_REMOVED             (0xFFFFFFFF)   // removed slot
+
 #define B64_MASK_11                    (0xFC)
 #define B64_MASK_12                    (0x03)
 #define B64_MASK_21                    (0xF0)
@@ -86,6 +98,34 @@ typedef long CSRESULT;
 #define CSSYS_UUID_LOWERCASE           (0x00000001)
 #define CSSYS_UUID_DASHES              (0x00000002)
 
+/* ---------------------------------------------------------------------------
+  An arena is a chain of blocks; allocations are carved from the current
+  block and the blocks that follow it are free. Allocations larger than
+  a quarter of the block size get a block of their own, inserted after
+  the current block; these are released when the arena is reset.
+--------------------------------------------------------------------------- */
+
+typedef struct tagCSARENABLOCK {
+
+  struct tagCSARENABLOCK* next;
+
+  long size;
+  long used;
+
+} CSARENABLOCK;
+
+#define CSARENA_BLOCKDATA(b) \
+          ((char*)(b) + CSARENA_ALIGN(sizeof(CSARENABLOCK)))
+
+typedef struct tagCSARENA {
+
+  CSARENABLOCK* first;
+  CSARENABLOCK* current;
+
+  long blockSize;
+
+} CSARENA;
+
 typedef struct tagCSLISTNODE {
 
   struct tagCSLISTNODE * previous;
@@ -98,6 +138,13 @@ typedef struct tagCSLISTNODE {
 
 typedef CSLISTNODE* PCSLISTNODE;
 
+typedef struct tagCSLISTITEM {
+
+  void* data;
+  long dataSize;
+
+} CSLISTITEM;
+
 typedef struct tagCSLIST {
 
   PCSLISTNODE first;
@@ -107,6 +154,15 @@ typedef struct tagCSLIST {
   long numItems;
   long curIndex;
 
+  /* Vector (see CSLIST_VectorConstructor); the nodes are then unused */
+
+  char* pItems;    // items, or CSLISTITEM if items have different sizes
+  long  itemSize;  // 0 if items have different sizes
+  long  slotSize;  // 0 if the list is not a vector
+  long  capacity;
+
+  CSARENA* pArena; // 0 if the list is allocated on the heap
+
 } CSLIST;
 
 typedef struct tagCSMAPNODE {
@@ -132,10 +188,51 @@ typedef struct tagCSMAPNODE {
 
 typedef CSMAPNODE* pAVLTREE;
 
+/* ---------------------------------------------------------------------------
+  Hash map entries are kept in insertion order, which is the order of
+  iteration; slots hold an entry index + 1 (0 for an empty slot) and are
+  probed linearly. There are twice as many slots as entries so that the
+  load factor never exceeds one half.
+--------------------------------------------------------------------------- */
+
+typedef struct tagCSMAPENTRY {
+
+  char* key;       // 0 if the key is in inlineKey
+  char* value;
+  long  valueSize;
+  long  keySize;   // 0 if the key is referenced, -1 if the entry is removed
+
+  uint32_t hash;
+
+  char inlineKey[CSMAP_HASH_INLINEKEY];
+
+} CSMAPENTRY;
+
+#define CSMAP_ENTRYKEY(e)  ((e)->key != 0 ? (e)->key : (e)->inlineKey)
+
+typedef struct tagCSMAPHASH {
+
+  CSMAPENTRY* entries;
+  long numEntries;       // including removed entries
+  long numRemoved;
+
+  uint32_t* slots;
+  long numSlots;         // a power of two
+
+  CSARENA* pArena;
+
+} CSMAPHASH;
+
 typedef struct tagCSMAP {
 
    pAVLTREE tree;
 
+   /* Hash map (see CSMAP_HashConstructor); the tree is then unused */
+
+   CSMAPHASH* hash;
+
+   CSARENA* pArena;  // 0 if the map is allocated on the heap
+
    /* For iterator */
 
    CSLIST* keys;
@@ -147,14 +244,57 @@ typedef struct tagCSMAP {
   private prototypes
 --------------------------------------------------------------------------- */
 
+CSARENABLOCK*
+  CSARENA_PRIVATE_NewBlock
+    (long size);
+
+void*
+  CSARENA_PRIVATE_Malloc
+    (CSARENA* This,
+     long     size);
+
+void*
+  CSARENA_PRIVATE_Realloc
+    (CSARENA* This,
+     void*    pData,
+     long     oldSize,
+     long     newSize);
+
+void
+  CSARENA_PRIVATE_Free
+    (CSARENA* This,
+     void*    pData);
+
 CSRESULT
   CSLIST_PRIVATE_Goto
     (CSLIST* This,
      long    index);
 
+char*
+  CSLIST_PRIVATE_VectorSlot
+    (CSLIST* This,
+     long    index);
+
+void
+  CSLIST_PRIVATE_VectorClear
+    (CSLIST* This);
+
+CSRESULT
+  CSLIST_PRIVATE_VectorInsert
+    (CSLIST* This,
+     void*   value,
+     long    valueSize,
+     long    index);
+
+CSRESULT
+  CSLIST_PRIVATE_VectorRemove
+    (CSLIST* This,
+     long    index);
+
 pAVLTREE
   CSMAP_PRIVATE_Insert
-     (pAVLTREE Tree,
+     (CSARENA* pArena,
+       pAVLTREE Tree,
        pAVLTREE parent,
        char*    key,
        void*    value,
@@ -162,7 +302,8 @@ pAVLTREE
 
 pAVLTREE
   CSMAP_PRIVATE_InsertKeyRef
-     (pAVLTREE Tree,
+     (CSARENA* pArena,
+       pAVLTREE Tree,
        pAVLTREE parent,
        char*    key,
        void*    value,
@@ -170,7 +311,8 @@ pAVLTREE
 
 pAVLTREE
   CSMAP_PRIVATE_Remove
-    (pAVLTREE Tree,
+    (CSARENA* pArena,
+       pAVLTREE Tree,
        char* key);
 
 CSRESULT
@@ -210,7 +352,8 @@ void
 
 void
   CSMAP_PRIVATE_Clear
-     (pAVLTREE Tree);
+     (CSARENA* pArena,
+      pAVLTREE Tree);
 
 long
   CSMAP_PRIVATE_Height
@@ -230,6 +373,291 @@ pAVLTREE
       CSLIST* keys,
       long mode);
 
+uint32_t
+  CSMAP_PRIVATE_Hash
+     (char* key);
+
+long
+  CSMAP_PRIVATE_HashFind
+     (CSMAPHASH* This,
+      char*      key,
+      uint32_t   hash);
+
+void
+  CSMAP_PRIVATE_HashResize
+     (CSMAPHASH* This);
+
+CSRESULT
+  CSMAP_PRIVATE_HashInsert
+     (CSMAPHASH* This,
+      char*      key,
+      void*      value,
+      long       valueSize,
+      int        keyRef);
+
+void
+  CSMAP_PRIVATE_HashRemove
+     (CSMAPHASH* This,
+      char*      key);
+
+CSRESULT
+  CSMAP_PRIVATE_HashLookup
+     (CSMAPHASH* This,
+      char*      key,
+      void**     value,
+      long*      valueSize);
+
+void
+  CSMAP_PRIVATE_HashClear
+     (CSMAPHASH* This);
+
+/* --------------------------------------------------------------------------
+   CSARENA_Constructor
+   Creates a region allocator. Memory obtained from an arena is not
+   released individually: it is reclaimed all at once by CSARENA_Reset
+   or CSARENA_Destructor. A blockSize of 0 selects the default size.
+-------------------------------------------------------------------------- */
+
+CSARENA*
+  CSARENA_Constructor
+    (long blockSize) {
+
+  CSARENA* pArena;
+
+  if (blockSize <= 0) {
+    blockSize = CSARENA_BLOCKSIZE;
+  }
+
+  pArena = (CSARENA*)malloc(sizeof(CSARENA));
+
+  pArena->blockSize = CSARENA_ALIGN(blockSize);
+  pArena->first = CSARENA_PRIVATE_NewBlock(pArena->blockSize);
+  pArena->current = pArena->first;
+
+  return pArena;
+}
+
+/* --------------------------------------------------------------------------
+   CSARENA_Destructor
+   Releases an arena and everything that was allocated from it.
+-------------------------------------------------------------------------- */
+
+CSRESULT
+  CSARENA_Destructor
+    (CSARENA** This) {
+
+  CSARENABLOCK* pBlock;
+  CSARENABLOCK* pNextBlock;
+
+  if (This == NULL || *This == NULL) {
+    return CS_FAILURE;
+  }
+
+  pBlock = (*This)->first;
+
+  while (pBlock != 0) {
+    pNextBlock = pBlock->next;
+    free(pBlock);
+    pBlock = pNextBlock;
+  }
+
+  free(*This);
+  *This = 0;
+
+  return CS_SUCCESS;
+}
+
+/* --------------------------------------------------------------------------
+   CSARENA_Alloc
+   Allocates memory from an arena; the memory is suitably aligned for
+   any type. Returns NULL if the memory cannot be allocated.
+-------------------------------------------------------------------------- */
+
+void*
+  CSARENA_Alloc
+    (CSARENA* This,
+     long     size) {
+
+  void* pData;
+
+  CSARENABLOCK* pBlock;
+
+  if (size <= 0) {
+    size = CSARENA_ALIGNMENT;
+  }
+
+  size = CSARENA_ALIGN(size);
+
+  pBlock = This->current;
+
+  if (pBlock->used + size <= pBlock->size) {
+    pData = CSARENA_BLOCKDATA(pBlock) + pBlock->used;
+    pBlock->used += size;
+    return pData;
+  }
+
+  if (size > This->blockSize / 4) {
+
+    // Large allocations get their own block
+
+    if ((pBlock = CSARENA_PRIVATE_NewBlock(size)) == 0) {
+      return NULL;
+    }
+
+    pBlock->used = size;
+    pBlock->next = This->current->next;
+    This->current->next = pBlock;
+
+    return CSARENA_BLOCKDATA(pBlock);
+  }
+
+  // Skip large blocks to get to the next free block, if any
+
+  while (pBlock->next != 0 && pBlock->next->used > 0) {
+    pBlock = pBlock->next;
+  }
+
+  if (pBlock->next == 0) {
+    if ((pBlock->next = CSARENA_PRIVATE_NewBlock(This->blockSize)) == 0) {
+      return NULL;
+    }
+  }
+
+  This->current = pBlock->next;
+  This->current->used = size;
+
+  return CSARENA_BLOCKDATA(This->current);
+}
+
+/* --------------------------------------------------------------------------
+   CSARENA_Reset
+   Makes all the memory of an arena available again; blocks are kept for
+   subsequent allocations except those that were made for large
+   allocations. Everything allocated from the arena, including the
+   instances constructed on it, must no longer be used.
+-------------------------------------------------------------------------- */
+
+void
+  CSARENA_Reset
+    (CSARENA* This) {
+
+  CSARENABLOCK* pBlock;
+  CSARENABLOCK* pNextBlock;
+
+  pBlock = This->first;
+  pBlock->used = 0;
+
+  while ((pNextBlock = pBlock->next) != 0) {
+
+    if (pNextBlock->size != This->blockSize) {
+      pBlock->next = pNextBlock->next;
+      free(pNextBlock);
+    }
+    else {
+      pNextBlock->used = 0;
+      pBlock = pNextBlock;
+    }
+  }
+
+  This->current = This->first;
+}
+
+/* --------------------------------------------------------------------------
+   CSARENA_PRIVATE_NewBlock
+-------------------------------------------------------------------------- */
+
+CSARENABLOCK*
+  CSARENA_PRIVATE_NewBlock
+    (long size) {
+
+  CSARENABLOCK* pBlock;
+
+  pBlock = (CSARENABLOCK*)malloc(CSARENA_ALIGN(sizeof(CSARENABLOCK)) + size);
+
+  if (pBlock != 0) {
+    pBlock->next = 0;
+    pBlock->size = size;
+    pBlock->used = 0;
+  }
+
+  return pBlock;
+}
+
+/* --------------------------------------------------------------------------
+   CSARENA_PRIVATE_Malloc
+   For internal use by containers that may be constructed on an arena;
+   allocates from the heap if there is no arena.
+-------------------------------------------------------------------------- */
+
+void*
+  CSARENA_PRIVATE_Malloc
+    (CSARENA* This,
+     long     size) {
+
+  if (This == 0) {
+    return malloc(size);
+  }
+
+  return CSARENA_Alloc(This, size);
+}
+
+/* --------------------------------------------------------------------------
+   CSARENA_PRIVATE_Realloc
+   For internal use by containers that may be constructed on an arena;
+   the last allocation of the current block is grown in place.
+-------------------------------------------------------------------------- */
+
+void*
+  CSARENA_PRIVATE_Realloc
+    (CSARENA* This,
+     void*    pData,
+     long     oldSize,
+     long     newSize) {
+
+  char* pNewData;
+
+  CSARENABLOCK* pBlock;
+
+  if (This == 0) {
+    return realloc(pData, newSize);
+  }
+
+  pBlock = This->current;
+
+  if (pData != 0 &&
+      (char*)pData + CSARENA_ALIGN(oldSize) ==
+                          CSARENA_BLOCKDATA(pBlock) + pBlock->used &&
+      (char*)pData - CSARENA_BLOCKDATA(pBlock) + CSARENA_ALIGN(newSize) <=
+                          pBlock->size) {
+
+    pBlock->used = (char*)pData - CSARENA_BLOCKDATA(pBlock) +
+                   CSARENA_ALIGN(newSize);
+    return pData;
+  }
+
+  if ((pNewData = (char*)CSARENA_Alloc(This, newSize)) != 0 && pData != 0) {
+    memcpy(pNewData, pData, oldSize < newSize ? oldSize : newSize);
+  }
+
+  return pNewData;
+}
+
+/* --------------------------------------------------------------------------
+   CSARENA_PRIVATE_Free
+   For internal use by containers that may be constructed on an arena;
+   arena memory is only released by resetting the arena.
+-------------------------------------------------------------------------- */
+
+void
+  CSARENA_PRIVATE_Free
+    (CSARENA* This,
+     void*    pData) {
+
+  if (This == 0) {
+    free(pData);
+  }
+}
+
 /* --------------------------------------------------------------------------
    CSLIST_Constructor
    Creates an instance of type CSLIST.
@@ -250,9 +678,75 @@ CSLIST*
   pList->numItems = 0;
   pList->curIndex = 0;
 
+  pList->pItems   = 0;
+  pList->itemSize = 0;
+  pList->slotSize = 0;
+  pList->capacity = 0;
+
+  pList->pArena = 0;
+
+  return pList;
+}
+
+/* --------------------------------------------------------------------------
+   CSLIST_ArenaConstructor
+   Creates a vector CSLIST (see CSLIST_VectorConstructor) whose memory,
+   including the instance itself, is allocated from an arena. Removed
+   items are only reclaimed when the arena is reset and the destructor
+   does not need to be called. If pArena is 0, this is the same as
+   CSLIST_VectorConstructor.
+-------------------------------------------------------------------------- */
+
+CSLIST*
+  CSLIST_ArenaConstructor
+    (CSARENA* pArena,
+     long     itemSize) {
+
+  CSLIST* pList;
+
+  pList = (CSLIST*)CSARENA_PRIVATE_Malloc(pArena, sizeof(CSLIST));
+
+  pList->first   = 0;
+  pList->last    = 0;
+  pList->current = 0;
+
+  pList->numItems = 0;
+  pList->curIndex = 0;
+
+  pList->pArena = pArena;
+
+  if (itemSize > 0) {
+    pList->itemSize = itemSize;
+    pList->slotSize = itemSize;
+  }
+  else {
+    pList->itemSize = 0;
+    pList->slotSize = sizeof(CSLISTITEM);
+  }
+
+  pList->capacity = CSLIST_VECTOR_MINITEMS;
+  pList->pItems = (char*)CSARENA_PRIVATE_Malloc(pArena,
+                                          pList->capacity * pList->slotSize);
+
   return pList;
 }
 
+/* --------------------------------------------------------------------------
+   CSLIST_VectorConstructor
+   Creates an instance of type CSLIST whose items are kept in a growable
+   array: items are accessed by index in constant time. If itemSize is
+   not zero, all items have that size and are stored in the array
+   itself; pointers returned by CSLIST_GetDataRef are then only valid 
+   until the list is modified.
+-------------------------------------------------------------------------- */
+
+CSLIST*
+  CSLIST_VectorConstructor
+    (long itemSize) {
+
+  return CSLIST_ArenaConstructor(0, itemSize);
+}
+
 /* --------------------------------------------------------------------------
    CSLIST_Destructor
    Releases the resources of an instance of type CSLIST.
@@ -270,6 +764,21 @@ CSRESULT
     return CS_FAILURE;
   }
 
+  if ((*This)->slotSize > 0)
+  {
+    // Nothing to release for a list constructed on an arena
+
+    if ((*This)->pArena == 0) {
+      CSLIST_PRIVATE_VectorClear(*This);
+      free((*This)->pItems);
+      free(*This);
+    }
+
+    *This = 0;
+
+    return CS_SUCCESS;
+  }
+
   pCurNode = (*This)->first;
   for (i=0; i<(*This)->numItems; i++) {
 
@@ -303,6 +812,12 @@ void
   CSLISTNODE* pCurNode;
   CSLISTNODE* pNextNode;
 
+  if (This->slotSize > 0)
+  {
+    CSLIST_PRIVATE_VectorClear(This);
+    return;
+  }
+
   if (This->first != 0) {
 
     pCurNode = This->first;
@@ -373,6 +888,11 @@ CSRESULT
     }
   }
 
+  if (This->slotSize > 0)
+  {
+    return CSLIST_PRIVATE_VectorInsert(This, value, valueSize, index);
+  }
+
   // Allocate new node
 
   NewNode = (CSLISTNODE*)malloc(sizeof(CSLISTNODE));
@@ -466,6 +986,11 @@ CSRESULT
     return CS_FAILURE;
   }
 
+  if (This->slotSize > 0)
+  {
+    return CSLIST_PRIVATE_VectorRemove(This, index);
+  }
+
   if (This->numItems > 0)
   {
     CSLIST_PRIVATE_Goto(This, index);
@@ -556,6 +1081,8 @@ CSRESULT
      void*   value,
      long index)
 {
+  char* pSlot;
+
   if (index >= This->numItems) {
     if (index == CSLIST_BOTTOM) {
       index = This->numItems-1;
@@ -567,6 +1094,21 @@ CSRESULT
 
   if (This->numItems > 0)
   {
+    if (This->slotSize > 0)
+    {
+      pSlot = CSLIST_PRIVATE_VectorSlot(This, index);
+
+      if (This->itemSize > 0) {
+        memcpy(value, pSlot, This->itemSize);
+      }
+      else {
+        memcpy(value, ((CSLISTITEM*)pSlot)->data,
+                      ((CSLISTITEM*)pSlot)->dataSize);
+      }
+
+      return CS_SUCCESS;
+    }
+
     CSLIST_PRIVATE_Goto(This, index);
     memcpy(value, This->current->data,
                 This->current->dataSize);
@@ -592,6 +1134,8 @@ CSRESULT
      void**  value,
      long    index)
 {
+  char* pSlot;
+
   if (index >= This->numItems) {
     if (index == CSLIST_BOTTOM) {
       index = This->numItems-1;
@@ -603,6 +1147,20 @@ CSRESULT
 
   if (This->numItems > 0)
   {
+    if (This->slotSize > 0)
+    {
+      pSlot = CSLIST_PRIVATE_VectorSlot(This, index);
+
+      if (This->itemSize > 0) {
+        *value = pSlot;
+      }
+      else {
+        *value = ((CSLISTITEM*)pSlot)->data;
+      }
+
+      return CS_SUCCESS;
+    }
+
     CSLIST_PRIVATE_Goto(This, index);
 
     if (This->current->dataSize > 0)
@@ -633,8 +1191,40 @@ CSRESULT
      long    valueSize,
      long    index)
 {
+  CSLISTITEM* pItem;
+
   if (This->numItems > 0)
   {
+    if (This->slotSize > 0)
+    {
+      if (This->itemSize > 0)
+      {
+        if (valueSize != This->itemSize) {
+          return CS_FAILURE;
+        }
+
+        memcpy(CSLIST_PRIVATE_VectorSlot(This, index), value, valueSize);
+        return CS_SUCCESS;
+      }
+
+      pItem = (CSLISTITEM*)CSLIST_PRIVATE_VectorSlot(This, index);
+
+      CSARENA_PRIVATE_Free(This->pArena, pItem->data);
+
+      if (valueSize > 0)
+      {
+        pItem->data = (void*)CSARENA_PRIVATE_Malloc(This->pArena, valueSize);
+        memcpy(pItem->data, value, valueSize);
+      }
+      else
+      {
+        pItem->data = 0;
+      }
+
+      pItem->dataSize = valueSize;
+      return CS_SUCCESS;
+    }
+
     CSLIST_PRIVATE_Goto(This, index);
 
     if (This->current->dataSize > 0)
@@ -675,6 +1265,15 @@ long
 
   if (This->numItems > 0)
   {
+    if (This->slotSize > 0)
+    {
+      if (This->itemSize > 0) {
+        return This->itemSize;
+      }
+
+      return ((CSLISTITEM*)CSLIST_PRIVATE_VectorSlot(This, index))->dataSize;
+    }
+
     CSLIST_PRIVATE_Goto(This, index);
 
     return This->current->dataSize;
@@ -735,27 +1334,251 @@ CSRESULT
   return CS_SUCCESS;
 }
 
+/* --------------------------------------------------------------------------
+   CSLIST_PRIVATE_VectorSlot
+   For internal use by a vector CSLIST; returns the address of the array
+   slot of an item. Like CSLIST_PRIVATE_Goto, an index that is negative
+   or past the end of the list designates the last item.
+-------------------------------------------------------------------------- */
+
+char*
+  CSLIST_PRIVATE_VectorSlot
+    (CSLIST* This,
+     long index)
+{
+  if (index < 0 || index > (This->numItems - 1))
+  {
+    index = This->numItems - 1;
+  }
+
+  return This->pItems + index * This->slotSize;
+}
+
+/* --------------------------------------------------------------------------
+   CSLIST_PRIVATE_VectorClear
+   For internal use by a vector CSLIST; releases the items.
+-------------------------------------------------------------------------- */
+
+void
+  CSLIST_PRIVATE_VectorClear
+    (CSLIST* This)
+{
+  long i;
+
+  if (This->itemSize == 0)
+  {
+    for (i=0; i<This->numItems; i++)
+    {
+      CSARENA_PRIVATE_Free(This->pArena,
+                           ((CSLISTITEM*)(This->pItems))[i].data);
+    }
+  }
+
+  This->numItems = 0;
+}
+
+/* --------------------------------------------------------------------------
+   CSLIST_PRIVATE_VectorInsert
+   For internal use by a vector CSLIST; inserts an item before the
+   specified index or at the end of the list (CSLIST_BOTTOM).
+-------------------------------------------------------------------------- */
+
+CSRESULT
+  CSLIST_PRIVATE_VectorInsert
+    (CSLIST* This,
+     void*   value,
+     long    valueSize,
+     long    index)
+{
+  char* pSlot;
+
+  CSLISTITEM* pItem;
+
+  // Items stored in the array all have the same size
+
+  if (This->itemSize > 0 && valueSize != This->itemSize)
+  {
+    return CS_FAILURE;
+  }
+
+  if (This->numItems == This->capacity)
+  {
+    This->pItems = (char*)CSARENA_PRIVATE_Realloc(This->pArena,
+                                  This->pItems,
+                                  This->capacity * This->slotSize,
+                                  This->capacity * 2 * This->slotSize);
+    This->capacity *= 2;
+  }
+
+  if (index == CSLIST_BOTTOM)
+  {
+    index = This->numItems;
+  }
+
+  pSlot = This->pItems + index * This->slotSize;
+
+  if (index < This->numItems)
+  {
+    memmove(pSlot + This->slotSize, pSlot,
+            (This->numItems - index) * This->slotSize);
+  }
+
+  if (This->itemSize > 0)
+  {
+    memcpy(pSlot, value, valueSize);
+  }
+  else
+  {
+    pItem = (CSLISTITEM*)pSlot;
+    pItem->dataSize = valueSize;
+
+    if (valueSize > 0)
+    {
+      pItem->data = (void*)CSARENA_PRIVATE_Malloc(This->pArena, valueSize);
+      memcpy(pItem->data, value, valueSize);
+    }
+    else
+    {
+      pItem->data = 0;
+    }
+  }
+
+  This->numItems++;
+
+  return CS_SUCCESS;
+}
+
+/* --------------------------------------------------------------------------
+   CSLIST_PRIVATE_VectorRemove
+   For internal use by a vector CSLIST; removes an item.
+-------------------------------------------------------------------------- */
+
+CSRESULT
+  CSLIST_PRIVATE_VectorRemove
+    (CSLIST* This,
+     long    index)
+{
+  char* pSlot;
+
+  if (This->numItems == 0)
+  {
+    return CS_FAILURE;
+  }
+
+  pSlot = CSLIST_PRIVATE_VectorSlot(This, index);
+
+  if (This->itemSize == 0)
+  {
+    CSARENA_PRIVATE_Free(This->pArena, ((CSLISTITEM*)pSlot)->data);
+  }
+
+  This->numItems--;
+
+  memmove(pSlot, pSlot + This->slotSize,
+          This->pItems + This->numItems * This->slotSize - pSlot);
+
+  return CS_SUCCESS;
+}
+
+/* --------------------------------------------------------------------------
+   CSMAP_ArenaConstructor
+   Creates an instance of type CSMAP whose memory, including the instance
+   itself, is allocated from an arena. Removed keys and replaced values
+   are only reclaimed when the arena is reset and the destructor does not
+   need to be called. If pArena is 0, this is the same as
+   CSMAP_Constructor.
+-------------------------------------------------------------------------- */
+
+CSMAP*
+  CSMAP_ArenaConstructor
+     (CSARENA* pArena) {
+
+   CSMAP* pInstance;
+
+   pInstance = (CSMAP*)CSARENA_PRIVATE_Malloc(pArena, sizeof(CSMAP));
+
+   pInstance->tree = 0;
+   pInstance->hash = 0;
+   pInstance->pArena = pArena;
+
+   if (pArena == 0) {
+      pInstance->keys = CSLIST_Constructor();
+   }
+   else {
+      pInstance->keys = CSLIST_ArenaConstructor(pArena, sizeof(pAVLTREE));
+   }
+
+   return pInstance;
+}
+
 CSMAP*
   CSMAP_Constructor
      (void) {
 
+   return CSMAP_ArenaConstructor(0);
+}
+
+/* --------------------------------------------------------------------------
+   CSMAP_ArenaHashConstructor
+   Creates a hash map (see CSMAP_HashConstructor) on an arena (see
+   CSMAP_ArenaConstructor).
+-------------------------------------------------------------------------- */
+
+CSMAP*
+  CSMAP_ArenaHashConstructor
+     (CSARENA* pArena) {
+
    CSMAP* pInstance;
 
-   pInstance = (CSMAP*)malloc(sizeof(CSMAP));
+   pInstance = CSMAP_ArenaConstructor(pArena);
 
-   pInstance->tree = 0;
+   pInstance->hash = 
+      (CSMAPHASH*)CSARENA_PRIVATE_Malloc(pArena, sizeof(CSMAPHASH));
+
+   pInstance->hash->pArena = pArena;
+   pInstance->hash->numSlots = CSMAP_HASH_MINSLOTS;
+   pInstance->hash->slots = (uint32_t*)CSARENA_PRIVATE_Malloc(pArena,
+                                  CSMAP_HASH_MINSLOTS * sizeof(uint32_t));
+
+   memset(pInstance->hash->slots, 0, CSMAP_HASH_MINSLOTS * sizeof(uint32_t));
 
-   pInstance->keys = CSLIST_Constructor();
+   pInstance->hash->entries = (CSMAPENTRY*)CSARENA_PRIVATE_Malloc(pArena,
+                        (CSMAP_HASH_MINSLOTS / 2) * sizeof(CSMAPENTRY));
+
+   pInstance->hash->numEntries = 0;
+   pInstance->hash->numRemoved = 0;
 
    return pInstance;
 }
 
+/* --------------------------------------------------------------------------
+   CSMAP_HashConstructor
+   Creates an instance of type CSMAP implemented as a hash table with
+   open addressing; use it when keys need not be iterated in order.
+   Keys are iterated in insertion order (the iteration mode is ignored)
+   and key pointers returned by CSMAP_IterNext are only valid until the
+   map is modified.
+-------------------------------------------------------------------------- */
+
+CSMAP*
+  CSMAP_HashConstructor
+     (void) {
+
+   return CSMAP_ArenaHashConstructor(0);
+}
+
 CSRESULT
   CSMAP_Clear
      (CSMAP* This)
 {
   CSLIST_Clear(This->keys);
-  CSMAP_PRIVATE_Clear(This->tree);
+
+  if (This->hash != 0) {
+    CSMAP_PRIVATE_HashClear(This->hash);
+    return CS_SUCCESS;
+  }
+
+  CSMAP_PRIVATE_Clear(This->pArena, This->tree);
 
   This->tree = 0;
 
@@ -770,11 +1593,27 @@ CSRESULT
     return CS_FAILURE;
   }
 
+  // Nothing to release for a map constructed on an arena
+
+  if ((*This)->pArena != 0)
+  {
+    *This = 0;
+    return CS_SUCCESS;
+  }
+
   if ((*This)->tree != 0)
   {
     CSMAP_Clear(*This);
   }
 
+  if ((*This)->hash != 0)
+  {
+    CSMAP_PRIVATE_HashClear((*This)->hash);
+    free((*This)->hash->entries);
+    free((*This)->hash->slots);
+    free((*This)->hash);
+  }
+
   CSLIST_Destructor(&(((*This)->keys)));
   free(*This);
 
@@ -790,7 +1629,11 @@ CSRESULT
        void*  value,
        long   valueSize) {
 
-   This->tree = CSMAP_PRIVATE_Insert(This->tree,
+   if (This->hash != 0) {
+      return CSMAP_PRIVATE_HashInsert(This->hash, key, value, valueSize, 0);
+   }
+
+   This->tree = CSMAP_PRIVATE_Insert(This->pArena, This->tree,
                              0, key,  value, valueSize);
    return CS_SUCCESS;
 }
@@ -802,7 +1645,11 @@ CSRESULT
        void*  value,
        long   valueSize) {
 
-   This->tree = CSMAP_PRIVATE_InsertKeyRef(This->tree,
+   if (This->hash != 0) {
+      return CSMAP_PRIVATE_HashInsert(This->hash, key, value, valueSize, 1);
+   }
+
+   This->tree = CSMAP_PRIVATE_InsertKeyRef(This->pArena, This->tree,
                                0, key,  value, valueSize);
    return CS_SUCCESS;
 }
@@ -812,7 +1659,12 @@ CSRESULT
      (CSMAP* This,
        char*  key) {
 
-   This->tree = CSMAP_PRIVATE_Remove(This->tree, key);
+   if (This->hash != 0) {
+      CSMAP_PRIVATE_HashRemove(This->hash, key);
+      return CS_SUCCESS;
+   }
+
+   This->tree = CSMAP_PRIVATE_Remove(This->pArena, This->tree, key);
    return CS_SUCCESS;
 }
 
@@ -823,6 +1675,10 @@ CSRESULT
        void** value,
        long*  valueSize) {
 
+  if (This->hash != 0) {
+    return CSMAP_PRIVATE_HashLookup(This->hash, key, value, valueSize);
+  }
+
   return CSMAP_PRIVATE_Lookup(This->tree,
                                key, value, valueSize);
 }
@@ -832,11 +1688,16 @@ CSRESULT
      (CSMAP* This,
       long mode)
 {
+   This->NextKey = 0;
+
+   if (This->hash != 0) {
+      return CS_SUCCESS;
+   }
+
    CSLIST_Clear(This->keys);
 
    CSMAP_PRIVATE_Traverse(This->tree, This->keys, mode);
 
-   This->NextKey = 0;
    return CS_SUCCESS;
 }
 
@@ -849,6 +1710,28 @@ CSRESULT
 {
    long count;
    pAVLTREE pNode;
+   CSMAPENTRY* pEntry;
+
+   if (This->hash != 0)
+   {
+      while (This->NextKey < This->hash->numEntries)
+      {
+         pEntry = &(This->hash->entries[This->NextKey++]);
+
+         if (pEntry->keySize >= 0)
+         {
+            *key = CSMAP_ENTRYKEY(pEntry);
+            *value = (void*)(pEntry->value);
+            *valueSize = pEntry->valueSize;
+            return CS_SUCCESS;
+         }
+      }
+
+      *key = 0;
+      *value = 0;
+      return CS_FAILURE;
+   }
+
    count = CSLIST_Count((void*)This->keys);
 
    if (This->NextKey < count)
@@ -883,21 +1766,340 @@ CSLIST*
    return This->keys;
 }
 
+/* --------------------------------------------------------------------------
+   CSMAP_PRIVATE_Hash
+   FNV-1a hash of a key.
+-------------------------------------------------------------------------- */
+
+uint32_t
+  CSMAP_PRIVATE_Hash
+     (char* key) {
+
+   uint32_t hash;
+
+   hash = 2166136261U;
+
+   while (*key != 0)
+   {
+      hash ^= (unsigned char)(*key);
+      hash *= 16777619U;
+      key++;
+   }
+
+   return hash;
+}
+
+/* --------------------------------------------------------------------------
+   CSMAP_PRIVATE_HashFind
+   Returns the slot of a key in a hash map or, if the map does not have
+   the key, the slot where the key would be inserted.
+-------------------------------------------------------------------------- */
+
+long
+  CSMAP_PRIVATE_HashFind
+     (CSMAPHASH* This,
+      char*      key,
+      uint32_t   hash) {
+
+   long i;
+   long mask;
+   long available;
+
+   CSMAPENTRY* pEntry;
+
+   mask = This->numSlots - 1;
+   available = -1;
+
+   for (i = hash & mask; This->slots[i] != 0; i = (i + 1) & mask)
+   {
+      if (This->slots[i] == CSMAP_HASH_REMOVED)
+      {
+         if (available < 0) {
+            available = i;
+         }
+
+         continue;
+      }
+
+      pEntry = &(This->entries[This->slots[i] - 1]);
+
+      if (pEntry->hash == hash && !strcmp(CSMAP_ENTRYKEY(pEntry), key))
+      {
+         return i;
+      }
+   }
+
+   return available < 0 ? i : available;
+}
+
+/* --------------------------------------------------------------------------
+   CSMAP_PRIVATE_HashResize
+   Compacts the entries of a hash map (removed entries are dropped) and
+   rebuilds its slots. The map grows if more than half of its entries
+   are still in use.
+-------------------------------------------------------------------------- */
+
+void
+  CSMAP_PRIVATE_HashResize
+     (CSMAPHASH* This) {
+
+   long i;
+   long j;
+   long mask;
+
+   for (i=0, j=0; i<This->numEntries; i++)
+   {
+      if (This->entries[i].keySize >= 0)
+      {
+         if (i != j) {
+            This->entries[j] = This->entries[i];
+         }
+
+         j++;
+      }
+   }
+
+   This->numEntries = j;
+   This->numRemoved = 0;
+
+   if (This->numEntries > This->numSlots / 4)
+   {
+      This->slots = (uint32_t*)CSARENA_PRIVATE_Realloc(This->pArena,
+                               This->slots,
+                               This->numSlots * sizeof(uint32_t),
+                               This->numSlots * 2 * sizeof(uint32_t));
+
+      This->entries = (CSMAPENTRY*)CSARENA_PRIVATE_Realloc(This->pArena,
+                               This->entries,
+                               (This->numSlots / 2) * sizeof(CSMAPENTRY),
+                               This->numSlots * sizeof(CSMAPENTRY));
+
+      This->numSlots *= 2;
+   }
+
+   memset(This->slots, 0, This->numSlots * sizeof(uint32_t));
+
+   mask = This->numSlots - 1;
+
+   for (i=0; i<This->numEntries; i++)
+   {
+      for (j = This->entries[i].hash & mask; This->slots[j] != 0;
+           j = (j + 1) & mask);
+
+      This->slots[j] = i + 1;
+   }
+}
+
+/* --------------------------------------------------------------------------
+   CSMAP_PRIVATE_HashInsert
+   Inserts a key in a hash map or updates its value. The key is copied
+   (in the entry itself if it is small enough) unless keyRef is set.
+-------------------------------------------------------------------------- */
+
+CSRESULT
+  CSMAP_PRIVATE_HashInsert
+     (CSMAPHASH* This,
+      char*      key,
+      void*      value,
+      long       valueSize,
+      int        keyRef) {
+
+   long i;
+   long keySize;
+
+   uint32_t hash;
+
+   CSMAPENTRY* pEntry;
+
+   if (key == 0)
+   {
+      return CS_FAILURE;
+   }
+
+   // Entries and slots are full at half the number of slots
+
+   if (This->numEntries == This->numSlots / 2)
+   {
+      CSMAP_PRIVATE_HashResize(This);
+   }
+
+   hash = CSMAP_PRIVATE_Hash(key);
+   i = CSMAP_PRIVATE_HashFind(This, key, hash);
+
+   if (This->slots[i] != 0 && This->slots[i] != CSMAP_HASH_REMOVED)
+   {
+      // The map already has this key ... we will update its value
+
+      pEntry = &(This->entries[This->slots[i] - 1]);
+      CSARENA_PRIVATE_Free(This->pArena, pEntry->value);
+   }
+   else
+   {
+      pEntry = &(This->entries[This->numEntries]);
+      This->slots[i] = ++(This->numEntries);
+
+      pEntry->hash = hash;
+
+      if (keyRef)
+      {
+         // Keys referenced outside the map have a size of zero
+
+         pEntry->key = key;
+         pEntry->keySize = 0;
+      }
+      else
+      {
+         keySize = strlen(key) + 1;
+
+         if (keySize <= CSMAP_HASH_INLINEKEY)
+         {
+            pEntry->key = 0;
+            memcpy(pEntry->inlineKey, key, keySize);
+         }
+         else
+         {
+            pEntry->key = (char*)CSARENA_PRIVATE_Malloc(This->pArena, keySize);
+            memcpy(pEntry->key, key, keySize);
+         }
+
+         pEntry->keySize = keySize;
+      }
+   }
+
+   pEntry->valueSize = valueSize;
+
+   if (valueSize > 0)
+   {
+      pEntry->value = (char*)CSARENA_PRIVATE_Malloc(This->pArena, valueSize);
+      memcpy(pEntry->value, value, valueSize);
+   }
+   else
+   {
+      pEntry->value = 0;  /* NULL value for this entry */
+   }
+
+   return CS_SUCCESS;
+}
+
+/* --------------------------------------------------------------------------
+   CSMAP_PRIVATE_HashRemove
+   The entry is only marked as removed; it is dropped when the map is
+   resized so that iteration order is preserved.
+-------------------------------------------------------------------------- */
+
+void
+  CSMAP_PRIVATE_HashRemove
+     (CSMAPHASH* This,
+      char*      key) {
+
+   long i;
+
+   CSMAPENTRY* pEntry;
+
+   i = CSMAP_PRIVATE_HashFind(This, key, CSMAP_PRIVATE_Hash(key));
+
+   if (This->slots[i] == 0 || This->slots[i] == CSMAP_HASH_REMOVED)
+   {
+      return;
+   }
+
+   pEntry = &(This->entries[This->slots[i] - 1]);
+
+   CSARENA_PRIVATE_Free(This->pArena, pEntry->value);
+
+   if (pEntry->keySize > 0) {
+      CSARENA_PRIVATE_Free(This->pArena, pEntry->key);
+   }
+
+   pEntry->key = 0;
+   pEntry->value = 0;
+   pEntry->keySize = -1;
+
+   This->slots[i] = CSMAP_HASH_REMOVED;
+   This->numRemoved++;
+}
+
+/* --------------------------------------------------------------------------
+   CSMAP_PRIVATE_HashLookup
+-------------------------------------------------------------------------- */
+
+CSRESULT
+  CSMAP_PRIVATE_HashLookup
+     (CSMAPHASH* This,
+      char*      key,
+      void**     value,
+      long*      valueSize) {
+
+   long i;
+
+   CSMAPENTRY* pEntry;
+
+   i = CSMAP_PRIVATE_HashFind(This, key, CSMAP_PRIVATE_Hash(key));
+
+   if (This->slots[i] == 0 || This->slots[i] == CSMAP_HASH_REMOVED)
+   {
+      *valueSize = 0;
+      *value = 0;
+      return CS_FAILURE;
+   }
+
+   pEntry = &(This->entries[This->slots[i] - 1]);
+
+   *valueSize = pEntry->valueSize;
+   *value = (void*)pEntry->value;
+
+   return CS_SUCCESS;
+}
+
+/* --------------------------------------------------------------------------
+   CSMAP_PRIVATE_HashClear
+-------------------------------------------------------------------------- */
+
+void
+  CSMAP_PRIVATE_HashClear
+     (CSMAPHASH* This) {
+
+   long i;
+
+   for (i=0; i<This->numEntries; i++)
+   {
+      if (This->entries[i].keySize >= 0)
+      {
+         CSARENA_PRIVATE_Free(This->pArena, This->entries[i].value);
+
+         if (This->entries[i].keySize > 0) {
+            CSARENA_PRIVATE_Free(This->pArena, This->entries[i].key);
+         }
+      }
+   }
+
+   This->numEntries = 0;
+   This->numRemoved = 0;
+
+   memset(This->slots, 0, This->numSlots * sizeof(uint32_t));
+}
+
 void
   CSMAP_PRIVATE_Clear
-     (pAVLTREE Tree) {
+     (CSARENA* pArena,
+      pAVLTREE Tree) {
 
    if (Tree == 0)
       return;
 
+   // There is nothing to release individually on an arena
+
+   if (pArena != 0)
+      return;
+
    if (Tree->left != 0)
    {
-      CSMAP_PRIVATE_Clear(Tree->left);
+      CSMAP_PRIVATE_Clear(pArena, Tree->left);
    }
 
    if (Tree->right != 0)
    {
-      CSMAP_PRIVATE_Clear(Tree->right);
+      CSMAP_PRIVATE_Clear(pArena, Tree->right);
    }
 
    if (Tree->valueSize > 0)
@@ -959,7 +2161,8 @@ CSRESULT
 
 pAVLTREE
   CSMAP_PRIVATE_Insert
-     (pAVLTREE This,
+     (CSARENA* pArena,
+       pAVLTREE This,
        pAVLTREE parent,
        char*    key,
        void*    value,
@@ -981,14 +2184,15 @@ pAVLTREE
        This is the insertion point
       --------------------------------------------------------------- */
 
-      root = (pAVLTREE)malloc(sizeof(CSMAPNODE));
+      root = (pAVLTREE)CSARENA_PRIVATE_Malloc(pArena, sizeof(CSMAPNODE));
 
       /* ---------------------------------------------------------------
        * Set the node's key and value
       --------------------------------------------------------------- */
 
       iKeySize = strlen(key) + 1;
-      root->key = (char*)malloc(sizeof(char) * iKeySize);
+      root->key = (char*)CSARENA_PRIVATE_Malloc(pArena, 
+                                                sizeof(char) * iKeySize);
       strcpy(root->key, key);
 
       root->keySize = iKeySize;
@@ -996,7 +2200,7 @@ pAVLTREE
 
       if (root->valueSize > 0)
       {
-         root->value = (char*)malloc(root->valueSize);
+         root->value = (char*)CSARENA_PRIVATE_Malloc(pArena, root->valueSize);
          memcpy(root->value, value, root->valueSize);
       }
       else
@@ -1023,13 +2227,14 @@ pAVLTREE
           * The tree already has this key ... we will update it's value
          --------------------------------------------------------------- */
 
-         free(This->value);
+         CSARENA_PRIVATE_Free(pArena, This->value);
 
          This->valueSize = valueSize;
 
          if (This->valueSize > 0)
          {
-            This->value = (char*)malloc(This->valueSize);
+            This->value = (char*)CSARENA_PRIVATE_Malloc(pArena,
+                                                        This->valueSize);
             memcpy(This->value, value, This->valueSize);
          }
          else
@@ -1048,7 +2253,7 @@ pAVLTREE
              *  right tree from this node
             ------------------------------------------------------------ */
 
-            This->right  = CSMAP_PRIVATE_Insert(This->right,
+            This->right  = CSMAP_PRIVATE_Insert(pArena, This->right,
                                            This, key, value, valueSize);
          }
          else {  // specified key is lower than current node key
@@ -1058,7 +2263,7 @@ pAVLTREE
              * the left tree from this node.
             ------------------------------------------------------------ */
 
-            This->left  = CSMAP_PRIVATE_Insert(This->left,
+            This->left  = CSMAP_PRIVATE_Insert(pArena, This->left,
                                          This, key, value, valueSize);
          }
 
@@ -1076,7 +2281,8 @@ pAVLTREE
 
 pAVLTREE
   CSMAP_PRIVATE_InsertKeyRef
-     (pAVLTREE This,
+     (CSARENA* pArena,
+       pAVLTREE This,
        pAVLTREE parent,
        char*    key,
        void*    value,
@@ -1097,7 +2303,7 @@ pAVLTREE
        This is the insertion point
       --------------------------------------------------------------- */
 
-      root = (pAVLTREE)malloc(sizeof(CSMAPNODE));
+      root = (pAVLTREE)CSARENA_PRIVATE_Malloc(pArena, sizeof(CSMAPNODE));
 
       /* ---------------------------------------------------------------
        * Set the node's key and value
@@ -1110,7 +2316,7 @@ pAVLTREE
 
       if (root->valueSize > 0)
       {
-         root->value = (char*)malloc(root->valueSize);
+         root->value = (char*)CSARENA_PRIVATE_Malloc(pArena, root->valueSize);
          memcpy(root->value, value, root->valueSize);
       }
       else
@@ -1137,13 +2343,14 @@ pAVLTREE
           * The tree already has this key ... we will update it's value
          --------------------------------------------------------------- */
 
-         free(This->value);
+         CSARENA_PRIVATE_Free(pArena, This->value);
 
          This->valueSize = valueSize;
 
          if (This->valueSize > 0)
          {
-            This->value = (char*)malloc(This->valueSize);
+            This->value = (char*)CSARENA_PRIVATE_Malloc(pArena,
+                                                        This->valueSize);
             memcpy(This->value, value, This->valueSize);
          }
          else
@@ -1162,7 +2369,7 @@ pAVLTREE
              * the right tree from this node
             ------------------------------------------------------------- */
 
-            This->right  = CSMAP_PRIVATE_InsertKeyRef(This->right,
+            This->right  = CSMAP_PRIVATE_InsertKeyRef(pArena, This->right,
                                                 This, key, value, valueSize);
          }
          else {  // specified key is lower than current node key
@@ -1172,7 +2379,7 @@ pAVLTREE
              * in the left tree from this node.
             ------------------------------------------------------------- */
 
-            This->left  = CSMAP_PRIVATE_InsertKeyRef(This->left,
+            This->left  = CSMAP_PRIVATE_InsertKeyRef(pArena, This->left,
                                          This, key, value, valueSize);
          }
 
@@ -1190,7 +2397,8 @@ pAVLTREE
 
 pAVLTREE
   CSMAP_PRIVATE_Remove
-     (pAVLTREE This,
+     (CSARENA* pArena,
+       pAVLTREE This,
        char*    key) {
 
    long compare;
@@ -1227,11 +2435,11 @@ pAVLTREE
 
             if (This->valueSize > 0)
             {
-               free(This->value);
+               CSARENA_PRIVATE_Free(pArena, This->value);
             }
 
-            free(This->key);
-            free(This);
+            CSARENA_PRIVATE_Free(pArena, This->key);
+            CSARENA_PRIVATE_Free(pArena, This);
             return 0;
          }
          else
@@ -1264,10 +2472,10 @@ pAVLTREE
 
                if (This->valueSize > 0)
                {
-                  free(This->value);
+                  CSARENA_PRIVATE_Free(pArena, This->value);
                }
 
-               free(This->key);
+               CSARENA_PRIVATE_Free(pArena, This->key);
 
                This->key       = pSuccessor->key;
                This->value     = pSuccessor->value;
@@ -1314,7 +2522,7 @@ pAVLTREE
 
                // We are now done with the successor node itself, we delete it
 
-               free(pSuccessor);
+               CSARENA_PRIVATE_Free(pArena, pSuccessor);
 
                // The root node may now have a new height ... recompute
 
@@ -1343,11 +2551,11 @@ pAVLTREE
 
                if (This->valueSize > 0)
                {
-                  free(This->value);
+                  CSARENA_PRIVATE_Free(pArena, This->value);
                }
 
-               free(This->key);
-               free(This);
+               CSARENA_PRIVATE_Free(pArena, This->key);
+               CSARENA_PRIVATE_Free(pArena, This);
 
                // return new root to parent; no need to re-balance
 
@@ -1359,11 +2567,11 @@ pAVLTREE
       {
          if (compare < 0)  // specified key is greater than current node key
          {
-            This->right = CSMAP_PRIVATE_Remove(This->right, key);
+            This->right = CSMAP_PRIVATE_Remove(pArena, This->right, key);
          }
          else
          {
-            This->left = CSMAP_PRIVATE_Remove(This->left, key);
+            This->left = CSMAP_PRIVATE_Remove(pArena, This->left, key);
          }
 
          /* Compute new root's height */
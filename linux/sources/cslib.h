@@ -76,10 +76,32 @@ typedef long CSRESULT;
 #define RM_PATTERN_CONTAINS            (0x00000002)
 
 
+typedef void* CSARENA;
 typedef void* CSLIST;
 typedef void* CSMAP;
 typedef void* CSSTRCV;
 
+/* --------------------------------------------------------------------------
+  Arena (region allocator)
+-------------------------------------------------------------------------- */
+
+CSARENA
+  CSARENA_Constructor
+    (long blockSize);
+
+CSRESULT
+  CSARENA_Destructor
+    (CSARENA*);
+
+void*
+  CSARENA_Alloc
+    (CSARENA This,
+     long    size);
+
+void
+  CSARENA_Reset
+    (CSARENA This);
+
 /* --------------------------------------------------------------------------
   Linked List
 -------------------------------------------------------------------------- */
@@ -88,6 +110,15 @@ CSLIST
   CSLIST_Constructor
     (void);
 
+CSLIST
+  CSLIST_VectorConstructor
+    (long itemSize);
+
+CSLIST
+  CSLIST_ArenaConstructor
+    (CSARENA pArena,
+     long    itemSize);
+
 CSRESULT
   CSLIST_Destructor
     (CSLIST*);
@@ -144,6 +175,18 @@ CSMAP
   CSMAP_Constructor
     (void);
 
+CSMAP
+  CSMAP_HashConstructor
+    (void);
+
+CSMAP
+  CSMAP_ArenaConstructor
+    (CSARENA pArena);
+
+CSMAP
+  CSMAP_ArenaHashConstructor
+    (CSARENA pArena);
+
 CSRESULT
   CSMAP_Destructor
     (CSMAP*);
@@ -100,6 +100,7 @@
 #define CSWSCK_OPERATION(x)          ((x) & CSWSCK_MASK_OPERATION)
 
 #define CSWSCK_MAX_FRAGMENTSIZE      LONG_MAX
+#define CSWSCK_MAX_FRAMES            (CFS_MAX_IOVEC / 2)
 
 typedef struct tagCSWSCK {
 
@@ -257,6 +258,52 @@ char*
   return token;
 }
 
+//////////////////////////////////////////////////////////////////////////////
+//
+// CSWSCK_PRV_FrameHeader
+//
+// Formats the header of a frame carrying iDataSize bytes; returns the 
+// size of the header.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+long
+  CSWSCK_PRV_FrameHeader
+    (char*    ws_header,
+     char     operation,
+     uint64_t iDataSize,
+     char     fin) {
+
+  uint16_t iSize16;
+  uint64_t iSize64;
+
+  if (fin & CSWSCK_FIN_ON) {
+    ws_header[0] = 0x80 | operation;
+  }
+  else {
+    ws_header[0] = 0x00 | operation;
+  }
+
+  if (iDataSize < 126) {
+    ws_header[1] = 0x00 | iDataSize;
+    return 2;
+  }
+
+  if (iDataSize < 65536) {
+    ws_header[1] = 0x00 | 126;
+    iSize16 = htons(iDataSize);
+    memcpy(&ws_header[2], &iSize16, sizeof(uint16_t));
+    return 4;
+  }
+
+  ws_header[1] = 0x00 | 127;
+
+  // For Portability; AS400 is already in NBO
+  iSize64 = htonll(iDataSize);
+  memcpy(&ws_header[2], &iSize64, sizeof(uint64_t));
+  return 10;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // CSWSCK_Send
@@ -273,57 +320,27 @@ CSRESULT
      uint64_t iDataSize,
      char     fin) {
 
-  uint16_t iSize16;
-  uint64_t iSize64;
-
   char ws_header[14];
 
   long SegmentSize;
 
-  CSRESULT hResult;
+  struct iovec frame[2];
 
-  memset(ws_header, 0, 14);
+  CSRESULT hResult;
 
   if (data != 0 && iDataSize > 0)
   {
-    if (fin & CSWSCK_FIN_ON) {
-      ws_header[0] = 0x80 | operation;
-    }
-    else {
-      ws_header[0] = 0x00 | operation;
-    }
-
-    if (iDataSize < 126) {
-      ws_header[1] = 0x00 | iDataSize;
-      SegmentSize = 2;
-    }
-    else if (iDataSize < 65536) {
-      ws_header[1] = 0x00 | 126;
-      iSize16 = htons(iDataSize);
-      memcpy(&ws_header[2], &iSize16, sizeof(uint16_t));
-      SegmentSize = 4;
-    }
-    else {
-      ws_header[1] = 0x00 | 127;
+    // Send frame header and data together
 
-      // For Portability; AS400 is already in NBO
-      iSize64 = htonll(iDataSize);
-      memcpy(&ws_header[2], &iSize64, sizeof(uint64_t));
-      SegmentSize = 10;
-    }
-
-    // Send frame header.
-    hResult = This->Session->lpVtbl->CFS_SendRecord(This->Session,
-                                ws_header,
-                                &SegmentSize, 1);
+    frame[0].iov_base = ws_header;
+    frame[0].iov_len = CSWSCK_PRV_FrameHeader(ws_header, operation, 
+                                              iDataSize, fin);
+    frame[1].iov_base = data;
+    frame[1].iov_len = (size_t)iDataSize;
 
-    if (CS_SUCCEED(hResult)) {
-
-      SegmentSize = (long)iDataSize;
-      hResult = This->Session->lpVtbl->CFS_SendRecord(This->Session,
-                                 data,
-                                 &SegmentSize, 1);
-    }
+    hResult = This->Session->lpVtbl->CFS_SendV(This->Session,
+                                               frame, 2,
+                                               &SegmentSize, 1);
   }
   else {
 
@@ -370,6 +387,90 @@ CSRESULT
   return hResult;
 }
 
+//////////////////////////////////////////////////////////////////////////////
+//
+// CSWSCK_SendFrames
+//
+// Sends up to CSWSCK_MAX_FRAMES complete (FIN) frames in a single write;
+// operations[i] is the operation of frames[i]. As with CSWSCK_Send, data
+// frames without data are not sent.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+CSRESULT
+  CSWSCK_SendFrames
+    (CSWSCK*       This,
+     char*         operations,
+     struct iovec* frames,
+     int           count) {
+
+  int i;
+  int numVectors;
+
+  char ws_headers[CSWSCK_MAX_FRAMES][14];
+
+  long size;
+
+  struct iovec vectors[CSWSCK_MAX_FRAMES * 2];
+
+  CSRESULT hResult;
+
+  if (count < 0 || count > CSWSCK_MAX_FRAMES) {
+    return CS_FAILURE | CSWSCK_OPER_CFSAPI | CSWSCK_E_NOTSUPPORTED;
+  }
+
+  numVectors = 0;
+
+  for (i = 0; i < count; i++) {
+
+    if (frames[i].iov_base == NULL || frames[i].iov_len == 0) {
+
+      switch(operations[i]) {
+
+        case CSWSCK_OP_PING:
+        case CSWSCK_OP_PONG:
+        case CSWSCK_OP_CLOSE:
+
+          vectors[numVectors].iov_base = ws_headers[i];
+          vectors[numVectors].iov_len = 
+                CSWSCK_PRV_FrameHeader(ws_headers[i], operations[i], 
+                                       0, CSWSCK_FIN_ON);
+          numVectors++;
+          break;
+      }
+
+      continue;
+    }
+
+    vectors[numVectors].iov_base = ws_headers[i];
+    vectors[numVectors].iov_len = 
+          CSWSCK_PRV_FrameHeader(ws_headers[i], operations[i], 
+                                 (uint64_t)frames[i].iov_len, 
+                                 CSWSCK_FIN_ON);
+    numVectors++;
+
+    vectors[numVectors] = frames[i];
+    numVectors++;
+  }
+
+  if (numVectors == 0) {
+    return CS_SUCCESS;
+  }
+
+  hResult = This->Session->lpVtbl->CFS_SendV(This->Session,
+                                             vectors, numVectors,
+                                             &size, 1);
+
+  if (CS_SUCCEED(hResult)) {
+     hResult = CS_SUCCESS;
+  }
+  else {
+     hResult = CS_FAILURE | CSWSCK_OPER_CFSAPI | CS_DIAG(hResult);
+  }
+
+  return hResult;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // CSWSCK_Receive
@@ -1267,6 +1368,8 @@ CSRESULT
   long iHeaderSize;
   long size;
 
+  struct iovec frame[2];
+
   CSRESULT hResult;
 
   // PING operation code and header size
@@ -1291,21 +1394,16 @@ CSRESULT
       // Just take first 125 bytes; we need to down cast to long integer
       szFrameHdr[1] = 0x00 | iDataSize;
 
-      // Send header
-      hResult = This->Session->lpVtbl->CFS_SendRecord(This->Session,
-                               szFrameHdr,
-                               &iHeaderSize, 1);
+      // Send header and data
 
-      // Send data
+      frame[0].iov_base = szFrameHdr;
+      frame[0].iov_len = (size_t)iHeaderSize;
+      frame[1].iov_base = szData;
+      frame[1].iov_len = (size_t)iDataSize;
 
-      if (CS_SUCCEED(hResult)) {
-
-        // we need to dowen cast to long integer.
-        size = (long)iDataSize;
-        hResult = This->Session->lpVtbl->CFS_SendRecord(This->Session,
-                                 szData,
-                                 &size, 1);
-      }
+      hResult = This->Session->lpVtbl->CFS_SendV(This->Session,
+                                                 frame, 2,
+                                                 &size, 1);
     }
   }
   else {
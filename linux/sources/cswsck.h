@@ -51,6 +51,8 @@
 #define CSWSCK_FIN_OFF               (0x00)
 #define CSWSCK_FIN_ON                (0x01)
 
+#define CSWSCK_MAX_FRAMES            (CFS_MAX_IOVEC / 2)
+
 #define CSWSCK_E_NODATA              (0x00000001)
 #define CSWSCK_E_PARTIALDATA         (0x00000002)
 #define CSWSCK_E_ALLDATA             (0x00000003)
@@ -141,4 +143,11 @@ CSRESULT
      uint64_t iDataSize,
      char     fin);
 
+CSRESULT
+  CSWSCK_SendFrames
+    (CSWSCK*       This,
+     char*         operations,
+     struct iovec* frames,
+     int           count);
+
 #endif
\ No newline at end of file
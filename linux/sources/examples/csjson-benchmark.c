@@ -0,0 +1,312 @@
+/* ==========================================================================
+
+  Clarasoft Foundation Server - Linux
+
+  CSJSON parser benchmark.
+  Version 1.0.0
+
+  Parses generated JSON payloads of the given sizes (in MB) or the
+  contents of the given files and reports the parse throughput.
+
+    ./csjson-benchmark               (1, 10 and 50 MB payloads)
+    ./csjson-benchmark 5 20          (5 and 20 MB payloads)
+    ./csjson-benchmark payload.json  (a file)
+
+  With -c, the same payloads are also parsed by the CSJSON_Parse of
+  another build of csjson.c, loaded from a shared object, and both
+  results are reported. To compare with the parser that came before 
+  the single-pass parser (the commit that added this program):
+
+    git show $(git log -1 --format=%h \
+                 --grep='single-pass parser')^:linux/sources/csjson.c \
+      > csjson-old.c
+    gcc -g -fPIC -shared csjson-old.c -o libcsjson-old.so -lcslib
+    ./csjson-benchmark -c ./libcsjson-old.so 1 10 50
+
+  Build with:
+
+    gcc -g csjson-benchmark.c -o csjson-benchmark -lcslib -ldl
+
+  Distributed under the MIT license
+
+  Copyright (c) 2013 Clarasoft I.T. Solutions Inc.
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify,
+  merge, publish, distribute, sub-license, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+  THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+========================================================================== */
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <clarasoft/cslib.h>
+#include <clarasoft/csjson.h>
+
+#define BENCHMARK_RUNS 3
+
+// A CSJSON parser: the one we are linked with or one loaded with -c
+
+typedef struct tagPARSER {
+
+  char* szName;
+
+  CSJSON (*Constructor)(void);
+  CSRESULT (*Destructor)(CSJSON*);
+  CSRESULT (*Parse)(CSJSON, char*, int);
+
+  CSJSON pJson;
+
+} PARSER;
+
+CSRESULT LoadParser(PARSER* pParser, char* szLibrary);
+double Measure(PARSER* pParser, char* szPayload);
+char* GeneratePayload(long size);
+char* ReadPayload(char* szFileName);
+double Elapsed(struct timespec* pStart);
+
+int main(int argc, char** argv) {
+
+  PARSER parsers[2];
+
+  char* szDefaultSizes[] = { "1", "10", "50" };
+  char** pArgs;
+  char* szPayload;
+  char* pEnd;
+
+  double seconds[2];
+  double megabytes;
+
+  long size;
+  int count;
+  int numParsers;
+  int i;
+  int j;
+
+  parsers[0].szName = "";
+  parsers[0].Constructor = CSJSON_Constructor;
+  parsers[0].Destructor = CSJSON_Destructor;
+  parsers[0].Parse = CSJSON_Parse;
+  numParsers = 1;
+
+  pArgs = argv + 1;
+  count = argc - 1;
+
+  if (count >= 2 && !strcmp(pArgs[0], "-c")) {
+
+    if (CS_FAIL(LoadParser(&parsers[1], pArgs[1]))) {
+      printf("%s: cannot load CSJSON parser\n", pArgs[1]);
+      return 1;
+    }
+
+    numParsers = 2;
+    pArgs += 2;
+    count -= 2;
+  }
+
+  if (count == 0) {
+    pArgs = szDefaultSizes;
+    count = 3;
+  }
+
+  for (j=0; j<numParsers; j++) {
+    parsers[j].pJson = parsers[j].Constructor();
+  }
+
+  for (i=0; i<count; i++) {
+
+    size = strtol(pArgs[i], &pEnd, 10);
+
+    if (*pEnd == 0 && size > 0) {
+      szPayload = GeneratePayload(size * 1024 * 1024);
+    }
+    else {
+      szPayload = ReadPayload(pArgs[i]);
+    }
+
+    if (szPayload == NULL) {
+      printf("%s: cannot read payload\n", pArgs[i]);
+      continue;
+    }
+
+    megabytes = (double)strlen(szPayload) / (1024 * 1024);
+
+    for (j=0; j<numParsers; j++) {
+
+      if ((seconds[j] = Measure(&parsers[j], szPayload)) < 0) {
+        printf("%s: parse failed%s\n", pArgs[i], parsers[j].szName);
+        continue;
+      }
+
+      printf("%s: %.1f MB parsed in %.3f s (%.1f MB/s)%s",
+             pArgs[i], megabytes, seconds[j], megabytes / seconds[j],
+             parsers[j].szName);
+
+      if (j > 0 && seconds[0] > 0) {
+        printf(", %.2fx the time", seconds[j] / seconds[0]);
+      }
+
+      printf("\n");
+    }
+
+    free(szPayload);
+  }
+
+  for (j=0; j<numParsers; j++) {
+    parsers[j].Destructor(&(parsers[j].pJson));
+  }
+
+  return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Loads the CSJSON parser of a shared object. The object is bound to its 
+// own CSJSON functions (RTLD_DEEPBIND) rather than to those of the cslib
+// we are linked with; it uses the other cslib functions of that library.
+///////////////////////////////////////////////////////////////////////////////
+
+CSRESULT LoadParser(PARSER* pParser, char* szLibrary) {
+
+  void* pLibrary;
+
+  if ((pLibrary = dlopen(szLibrary, 
+                         RTLD_NOW | RTLD_LOCAL | RTLD_DEEPBIND)) == NULL) {
+    return CS_FAILURE;
+  }
+
+  pParser->Constructor = dlsym(pLibrary, "CSJSON_Constructor");
+  pParser->Destructor = dlsym(pLibrary, "CSJSON_Destructor");
+  pParser->Parse = dlsym(pLibrary, "CSJSON_Parse");
+
+  if (pParser->Constructor == NULL || 
+      pParser->Destructor == NULL ||
+      pParser->Parse == NULL) {
+    dlclose(pLibrary);
+    return CS_FAILURE;
+  }
+
+  pParser->szName = (char*)malloc(strlen(szLibrary) + 7);
+  sprintf(pParser->szName, " with %s", szLibrary);
+
+  return CS_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the best time of the runs, or -1 if the payload is not parsed.
+///////////////////////////////////////////////////////////////////////////////
+
+double Measure(PARSER* pParser, char* szPayload) {
+
+  struct timespec start;
+
+  double best;
+  double seconds;
+
+  int run;
+
+  best = 0;
+
+  for (run=0; run<BENCHMARK_RUNS; run++) {
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (CS_FAIL(pParser->Parse(pParser->pJson, szPayload, 0))) {
+      return -1;
+    }
+
+    seconds = Elapsed(&start);
+
+    if (run == 0 || seconds < best) {
+      best = seconds;
+    }
+  }
+
+  return best;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Generates an array of records resembling service payloads: short keys,
+// strings (a few of them escaped), numbers, booleans and nested objects.
+///////////////////////////////////////////////////////////////////////////////
+
+char* GeneratePayload(long size) {
+
+  char* szPayload;
+
+  long pos;
+  long i;
+
+  szPayload = (char*)malloc(size + 512);
+
+  pos = sprintf(szPayload, "[");
+
+  for (i=0; pos < size; i++) {
+    pos += sprintf(szPayload + pos,
+                   "%s{\"id\":%ld,\"name\":\"customer-%ld\","
+                   "\"balance\":%ld.%02ld,\"active\":%s,"
+                   "\"note\":\"line\\none \\\"quoted\\\" \\u00e9t\\u00e9\","
+                   "\"address\":{\"street\":\"%ld Main Street\","
+                   "\"city\":\"Montreal\",\"zip\":\"H2X 1Y4\"},"
+                   "\"tags\":[\"a\",\"b\",%ld,null]}",
+                   i == 0 ? "" : ",",
+                   i, i, i * 7 % 100000, i % 100,
+                   i % 2 ? "true" : "false", i % 9999, i);
+  }
+
+  sprintf(szPayload + pos, "]");
+
+  return szPayload;
+}
+
+char* ReadPayload(char* szFileName) {
+
+  FILE* pFile;
+
+  char* szPayload;
+
+  long size;
+
+  pFile = fopen(szFileName, "rb");
+
+  if (pFile == NULL) {
+    return NULL;
+  }
+
+  fseek(pFile, 0, SEEK_END);
+  size = ftell(pFile);
+  fseek(pFile, 0, SEEK_SET);
+
+  szPayload = (char*)malloc(size + 1);
+  size = fread(szPayload, 1, size, pFile);
+  szPayload[size] = 0;
+
+  fclose(pFile);
+
+  return szPayload;
+}
+
+double Elapsed(struct timespec* pStart) {
+
+  struct timespec end;
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  return (end.tv_sec - pStart->tv_sec) +
+         (end.tv_nsec - pStart->tv_nsec) / 1e9;
+}
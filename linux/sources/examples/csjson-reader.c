@@ -0,0 +1,146 @@
+/* ==========================================================================
+
+  Clarasoft Foundation Server - Linux
+
+  CSJSONREADER example.
+  Version 1.0.0
+
+  Reads a JSON document from a file (or from standard input) in 64K
+  chunks and counts the records of its top-level array without ever
+  holding the whole document in memory.
+
+    ./csjson-reader payload.json
+    cat payload.json | ./csjson-reader
+
+  Build with:
+
+    gcc -g csjson-reader.c -o csjson-reader -lcslib
+
+  Distributed under the MIT license
+
+  Copyright (c) 2013 Clarasoft I.T. Solutions Inc.
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify,
+  merge, publish, distribute, sub-license, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+  THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+========================================================================== */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <clarasoft/cslib.h>
+#include <clarasoft/csjson.h>
+
+#define READER_CHUNK_SIZE 65536
+
+int main(int argc, char** argv) {
+
+  CSRESULT Rc;
+
+  CSJSONREADER pReader;
+  CSJSON_EVENT event;
+
+  FILE* pFile;
+
+  char* pChunk;
+
+  long size;
+  long records;
+  long values;
+
+  if (argc > 1) {
+    pFile = fopen(argv[1], "rb");
+    if (pFile == NULL) {
+      printf("%s: cannot open file\n", argv[1]);
+      return 1;
+    }
+  }
+  else {
+    pFile = stdin;
+  }
+
+  pChunk = (char*)malloc(READER_CHUNK_SIZE * sizeof(char));
+  pReader = CSJSONREADER_Constructor();
+
+  records = 0;
+  values = 0;
+
+  for (;;) {
+
+    Rc = CSJSONREADER_Next(pReader, &event);
+
+    if (CS_SUCCEED(Rc)) {
+
+      switch(event.type) {
+
+        case JSON_EVENT_OBJECT:
+        case JSON_EVENT_ARRAY:
+
+          // A record is any value of the top-level array
+
+          if (event.depth == 1) {
+            records++;
+          }
+          break;
+
+        case JSON_EVENT_OBJECT_END:
+        case JSON_EVENT_ARRAY_END:
+
+          break;
+
+        default:
+
+          if (event.depth == 1) {
+            records++;
+          }
+          values++;
+          break;
+      }
+    }
+    else {
+
+      if (CS_DIAG(Rc) != JSON_DIAG_MOREDATA) {
+        break;
+      }
+
+      size = fread(pChunk, 1, READER_CHUNK_SIZE, pFile);
+
+      if (size <= 0) {
+        break;
+      }
+
+      CSJSONREADER_Feed(pReader, pChunk, size);
+    }
+  }
+
+  if (CS_DIAG(Rc) == JSON_DIAG_ENDOFDATA) {
+    printf("%ld records, %ld values\n", records, values);
+  }
+  else {
+    printf("invalid or incomplete document\n");
+  }
+
+  CSJSONREADER_Destructor(&pReader);
+  free(pChunk);
+
+  if (pFile != stdin) {
+    fclose(pFile);
+  }
+
+  return CS_DIAG(Rc) == JSON_DIAG_ENDOFDATA ? 0 : 1;
+}
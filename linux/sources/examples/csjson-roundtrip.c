@@ -0,0 +1,245 @@
+/* ==========================================================================
+
+  Clarasoft Foundation Server - Linux
+
+  CSJSON round trip benchmark.
+  Version 1.0.0
+
+  Counts the heap allocations made for each message of a CSAP style
+  exchange: a control frame is written with a CSJSONWRITER, parsed
+  into a CSJSON instance and its values looked up; a reply is then
+  built with CSJSON_Init, CSJSON_MkDir and CSJSON_Insert* and
+  serialized. The exchange is run with a heap instance
+  (CSJSON_Constructor) and with a pooled instance
+  (CSJSON_PoolConstructor), which should make no allocation at all
+  once it has seen the first message.
+
+    ./csjson-roundtrip            (100000 messages)
+    ./csjson-roundtrip 1000000    (1000000 messages)
+
+  Build with:
+
+    gcc -g csjson-roundtrip.c -o csjson-roundtrip -lcslib
+
+  Distributed under the MIT license
+
+  Copyright (c) 2013 Clarasoft I.T. Solutions Inc.
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify,
+  merge, publish, distribute, sub-license, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+  THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+========================================================================== */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <clarasoft/cslib.h>
+#include <clarasoft/csjson.h>
+
+// The allocation functions of the C library are wrapped to count
+// the allocations made by the library (glibc).
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* pData, size_t size);
+
+long g_Allocations = 0;
+
+void* malloc(size_t size) {
+  g_Allocations++;
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+  g_Allocations++;
+  return __libc_calloc(count, size);
+}
+
+void* realloc(void* pData, size_t size) {
+  g_Allocations++;
+  return __libc_realloc(pData, size);
+}
+
+CSRESULT RoundTrip(CSJSONWRITER pWriter,
+                   CSJSON pJsonIn,
+                   CSJSON pJsonOut,
+                   CSJSONPATH pCtlPath,
+                   long message);
+
+void Run(char* szName,
+         CSJSON pJsonIn,
+         CSJSON pJsonOut,
+         long count);
+
+double Elapsed(struct timespec* pStart);
+
+int main(int argc, char** argv) {
+
+  CSJSON pJsonIn;
+  CSJSON pJsonOut;
+
+  long count;
+
+  count = 100000;
+
+  if (argc > 1) {
+    count = strtol(argv[1], 0, 10);
+    if (count <= 0) {
+      printf("usage: csjson-roundtrip [messages]\n");
+      return 1;
+    }
+  }
+
+  pJsonIn = CSJSON_Constructor();
+  pJsonOut = CSJSON_Constructor();
+
+  Run("heap instances  ", pJsonIn, pJsonOut, count);
+
+  CSJSON_Destructor(&pJsonIn);
+  CSJSON_Destructor(&pJsonOut);
+
+  pJsonIn = CSJSON_PoolConstructor();
+  pJsonOut = CSJSON_PoolConstructor();
+
+  Run("pooled instances", pJsonIn, pJsonOut, count);
+
+  CSJSON_Destructor(&pJsonIn);
+  CSJSON_Destructor(&pJsonOut);
+
+  return 0;
+}
+
+void Run(char* szName,
+         CSJSON pJsonIn,
+         CSJSON pJsonOut,
+         long count) {
+
+  CSJSONWRITER pWriter;
+  CSJSONPATH pCtlPath;
+
+  struct timespec start;
+
+  long allocations;
+  long i;
+
+  pWriter = CSJSONWRITER_Constructor();
+  pCtlPath = CSJSON_CompilePath("/ctl");
+
+  // The first message sizes the buffers
+
+  if (CS_FAIL(RoundTrip(pWriter, pJsonIn, pJsonOut, pCtlPath, 0))) {
+    printf("%s: round trip failed\n", szName);
+    return;
+  }
+
+  allocations = g_Allocations;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for (i=1; i<=count; i++) {
+    if (CS_FAIL(RoundTrip(pWriter, pJsonIn, pJsonOut, pCtlPath, i))) {
+      printf("%s: round trip failed\n", szName);
+      break;
+    }
+  }
+
+  printf("%s: %.2f allocations per message, %.0f ns per message\n",
+         szName,
+         (double)(g_Allocations - allocations) / count,
+         Elapsed(&start) * 1e9 / count);
+
+  CSJSON_FreePath(&pCtlPath);
+  CSJSONWRITER_Destructor(&pWriter);
+}
+
+CSRESULT RoundTrip(CSJSONWRITER pWriter,
+                   CSJSON pJsonIn,
+                   CSJSON pJsonOut,
+                   CSJSONPATH pCtlPath,
+                   long message) {
+
+  CSJSON_LSENTRY lse;
+
+  char* szFrame;
+  char* szReply;
+
+  int64_t usrCtlSize;
+  int64_t dataSize;
+
+  // Control frame, as sent by CSAP_Send
+
+  CSJSONWRITER_Reset(pWriter);
+  CSJSONWRITER_BeginObject(pWriter, 0);
+  CSJSONWRITER_BeginObject(pWriter, "ctl");
+  CSJSONWRITER_Int64(pWriter, "dataSize", message % 65536);
+  CSJSONWRITER_String(pWriter, "fmt", "text");
+  CSJSONWRITER_Int64(pWriter, "usrCtlSize", 0);
+  CSJSONWRITER_EndObject(pWriter);
+  CSJSONWRITER_EndObject(pWriter);
+  CSJSONWRITER_Serialize(pWriter, &szFrame);
+
+  // Control frame, as received by CSAP_Receive
+
+  if (CS_FAIL(CSJSON_Parse(pJsonIn, szFrame, 0))) {
+    return CS_FAILURE;
+  }
+
+  if (CS_FAIL(CSJSON_LookupPathInt64(pJsonIn, pCtlPath, "usrCtlSize", &usrCtlSize))) {
+    return CS_FAILURE;
+  }
+
+  if (CS_FAIL(CSJSON_LookupPathInt64(pJsonIn, pCtlPath, "dataSize", &dataSize))) {
+    return CS_FAILURE;
+  }
+
+  if (CS_FAIL(CSJSON_LookupPathKey(pJsonIn, pCtlPath, "fmt", &lse))) {
+    return CS_FAILURE;
+  }
+
+  if (usrCtlSize != 0 || dataSize != message % 65536) {
+    return CS_FAILURE;
+  }
+
+  // Reply, as built by a CSAP application
+
+  CSJSON_Init(pJsonOut, JSON_TYPE_OBJECT);
+  CSJSON_MkDir(pJsonOut, "/", "ctl", JSON_TYPE_OBJECT);
+  CSJSON_InsertString(pJsonOut, "/ctl", "HRESULT", "0");
+  CSJSON_InsertString(pJsonOut, "/ctl", "FACILITY", "000");
+  CSJSON_InsertString(pJsonOut, "/ctl", "REASON", "0000");
+  CSJSON_InsertString(pJsonOut, "/ctl", "op", "EXEC");
+  CSJSON_MkDir(pJsonOut, "/", "data", JSON_TYPE_ARRAY);
+  CSJSON_InsertInt64(pJsonOut, "/data", 0, message);
+  CSJSON_InsertBool(pJsonOut, "/data", 0, 1);
+
+  if (CSJSON_Serialize(pJsonOut, "/", &szReply, 0) <= 0) {
+    return CS_FAILURE;
+  }
+
+  return CS_SUCCESS;
+}
+
+double Elapsed(struct timespec* pStart) {
+
+  struct timespec end;
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  return (end.tv_sec - pStart->tv_sec) +
+         (end.tv_nsec - pStart->tv_nsec) / 1e9;
+}
@@ -89,6 +89,12 @@ int main(int argc, char **argv)
   sigaction(SIGTERM, &sa, NULL);
   sigaction(SIGCHLD, &sa, NULL);
 
+  // The main daemon sends SIGHUP to have us reload the configurations
+
+  sa.sa_handler = signalCatcher;
+  sa.sa_flags = SA_RESTART;
+  sigaction(SIGHUP, &sa, NULL);
+
   pRepo = NULL;
   pEnv = NULL;
 
@@ -175,6 +181,40 @@ int main(int argc, char **argv)
 
   stream_fd = atoi(argv[1]);
 
+  /////////////////////////////////////////////////////////////////////
+  // In zygote mode ('Z'), this process is a template from which the
+  // main daemon obtains new handlers (see CFS_RunZygote); we go on
+  // only in a new handler.
+  /////////////////////////////////////////////////////////////////////
+
+  /////////////////////////////////////////////////////////////////////
+  // Acceptor mode ('A', LISTEN_MODE *REUSEPORT) is not implemented by
+  // this handler; the main daemon refuses to start it in that mode.
+  /////////////////////////////////////////////////////////////////////
+
+  if (argv[2][0] == 'A') {
+    syslog(LOG_ERR, "acceptor mode not supported - Handler exiting");
+    closelog();
+    CFS_CloseEnv(&pEnv);
+    close(stream_fd);
+    exit(8);
+  }
+
+  if (argv[2][0] == 'Z') {
+
+    syslog(LOG_INFO, "Running in zygote mode");
+
+    if ((stream_fd = CFS_RunZygote(stream_fd)) < 0) {
+      dlclose(pInprocServer);
+      CFS_CloseEnv(&pEnv);
+      syslog(LOG_INFO, "Zygote exiting");
+      closelog();
+      exit(0);
+    }
+
+    pid = getpid();
+  }
+
   pSession = CSWSCK_Constructor();
 
   send(stream_fd, &buffer, 1, 0);
@@ -203,6 +243,12 @@ int main(int argc, char **argv)
 
       send(stream_fd, &buffer, 1, 0);
     }
+    else {
+
+      if (CS_DIAG(hResult) == CFS_DIAG_CONNCLOSE) {
+        break; // the main daemon no longer uses this handler
+      }
+    }
   }
   
   CFS_CloseEnv(&pEnv);
@@ -224,6 +270,11 @@ void signalCatcher(int signal)
 {
   switch (signal)
   {
+    case SIGHUP:
+
+      CFSRPS_Reload();
+      break;
+
     case SIGTERM:
 
       if (pSession != NULL) {